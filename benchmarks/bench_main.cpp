@@ -0,0 +1,335 @@
+#include "workload.h"
+#include "interpreter.h"
+#include "lexer.h"
+#include "parser.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::vector<size_t> sizes = {1024, 64 * 1024, 1024 * 1024};  // Lexer and parser inputs
+    std::vector<size_t> program_sizes = {1024, 16 * 1024};       // Full lex, parse and execute
+    int iterations = 200;                                       // Loop count of the execution kernels
+    int recursion_depth = 10;
+    int min_runs = 3;
+    double min_seconds = 0.2;
+    uint32_t seed = 1;
+    std::string filter;
+    std::string output = "-";
+    size_t generate = 0;
+};
+
+struct Result {
+    std::string name;
+    std::string kind;  // "micro" or "macro"
+    size_t runs = 0;
+    double seconds = 0;  // Median over all runs
+    std::vector<std::pair<std::string, double>> metrics;
+    std::string error;
+};
+
+// The lexer, parser and interpreter trace to std::cout and std::cerr; the
+// benchmarks throw that output away instead of timing the terminal
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override {
+        return c;
+    }
+    std::streamsize xsputn(const char*, std::streamsize count) override {
+        return count;
+    }
+};
+
+class SilencedOutput {
+public:
+    SilencedOutput() : out(std::cout.rdbuf(&buffer)), err(std::cerr.rdbuf(&buffer)) {}
+    ~SilencedOutput() {
+        std::cout.rdbuf(out);
+        std::cerr.rdbuf(err);
+    }
+
+private:
+    NullBuffer buffer;
+    std::streambuf* out;
+    std::streambuf* err;
+};
+
+double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+size_t count_nodes(const ASTNode& node) {
+    size_t count = 1;
+    for_each_child(node, [&count](const ASTNode& child) { count += count_nodes(child); });
+    return count;
+}
+
+std::unique_ptr<ASTNode> parse_source(const std::string& source) {
+    Lexer lexer(source);
+    auto tokens = lexer.tokenize();
+    Parser parser(tokens);
+    return parser.parse();
+}
+
+// Repeats `run`, which returns the seconds spent in its timed region, until
+// both the minimum run count and the minimum total time are reached
+void measure(const Options& options, Result& result, const std::function<double()>& run) {
+    std::vector<double> samples;
+    double total = 0;
+    while (static_cast<int>(samples.size()) < options.min_runs || total < options.min_seconds) {
+        double seconds = run();
+        samples.push_back(seconds);
+        total += seconds;
+    }
+    std::sort(samples.begin(), samples.end());
+    result.runs = samples.size();
+    result.seconds = samples[samples.size() / 2];
+}
+
+double per_second(double amount, double seconds) {
+    return seconds > 0 ? amount / seconds : 0;
+}
+
+Result bench_lex(const Options& options, size_t size) {
+    Result result{"lex/" + format_size(size), "micro", 0, 0, {}, ""};
+    std::string source = generate_program(size, options.seed).source;
+    size_t tokens = 0;
+    measure(options, result, [&] {
+        auto start = Clock::now();
+        Lexer lexer(source);
+        tokens = lexer.tokenize().size();
+        return seconds_since(start);
+    });
+    result.metrics = {{"bytes", static_cast<double>(source.size())},
+                      {"tokens", static_cast<double>(tokens)},
+                      {"mb_per_sec", per_second(source.size() / 1e6, result.seconds)},
+                      {"tokens_per_sec", per_second(tokens, result.seconds)}};
+    return result;
+}
+
+Result bench_parse(const Options& options, size_t size) {
+    Result result{"parse/" + format_size(size), "micro", 0, 0, {}, ""};
+    std::string source = generate_program(size, options.seed).source;
+    Lexer lexer(source);
+    auto tokens = lexer.tokenize();
+    size_t nodes = 0;
+    measure(options, result, [&] {
+        auto start = Clock::now();
+        Parser parser(tokens);
+        auto ast = parser.parse();
+        double seconds = seconds_since(start);
+        nodes = count_nodes(*ast);
+        return seconds;
+    });
+    result.metrics = {{"tokens", static_cast<double>(tokens.size())},
+                      {"nodes", static_cast<double>(nodes)},
+                      {"nodes_per_sec", per_second(nodes, result.seconds)}};
+    return result;
+}
+
+Result bench_execute(const Options& options, const Workload& workload) {
+    Result result{"exec/" + workload.name, "micro", 0, 0, {}, ""};
+    auto ast = parse_source(workload.source);
+    measure(options, result, [&] {
+        Interpreter interpreter;
+        interpreter.interpret(ast->clone());
+        auto start = Clock::now();
+        interpreter.execute();
+        return seconds_since(start);
+    });
+    result.metrics = {{"operations", static_cast<double>(workload.operations)},
+                      {"ops_per_sec", per_second(workload.operations, result.seconds)}};
+    return result;
+}
+
+Result bench_pipeline(const Options& options, size_t size) {
+    Result result{"pipeline/" + format_size(size), "macro", 0, 0, {}, ""};
+    Workload workload = generate_program(size, options.seed);
+    measure(options, result, [&] {
+        auto start = Clock::now();
+        Interpreter interpreter;
+        interpreter.interpret(parse_source(workload.source));
+        interpreter.execute();
+        return seconds_since(start);
+    });
+    result.metrics = {{"bytes", static_cast<double>(workload.source.size())},
+                      {"operations", static_cast<double>(workload.operations)},
+                      {"mb_per_sec", per_second(workload.source.size() / 1e6, result.seconds)},
+                      {"ops_per_sec", per_second(workload.operations, result.seconds)}};
+    return result;
+}
+
+std::string json_string(const std::string& value) {
+    std::ostringstream out;
+    out << '"';
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+    return out.str();
+}
+
+void write_json(std::ostream& out, const std::vector<Result>& results) {
+    out << std::setprecision(9);
+    out << "{\n  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& result = results[i];
+        out << (i == 0 ? "\n" : ",\n");
+        out << "    {\"name\": " << json_string(result.name) << ", \"kind\": " << json_string(result.kind);
+        if (!result.error.empty()) {
+            out << ", \"error\": " << json_string(result.error) << "}";
+            continue;
+        }
+        out << ", \"runs\": " << result.runs << ", \"seconds\": " << result.seconds;
+        for (const auto& metric : result.metrics) {
+            out << ", " << json_string(metric.first) << ": " << metric.second;
+        }
+        out << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+std::vector<size_t> parse_sizes(const std::string& list) {
+    std::vector<size_t> sizes;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        sizes.push_back(parse_size(item));
+    }
+    return sizes;
+}
+
+Options parse_options(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        size_t equals = argument.find('=');
+        std::string name = argument.substr(0, equals);
+        std::string value = equals == std::string::npos ? "" : argument.substr(equals + 1);
+        if (name == "--sizes") {
+            options.sizes = parse_sizes(value);
+        } else if (name == "--program-sizes") {
+            options.program_sizes = parse_sizes(value);
+        } else if (name == "--iterations") {
+            options.iterations = std::stoi(value);
+        } else if (name == "--recursion-depth") {
+            options.recursion_depth = std::stoi(value);
+        } else if (name == "--min-runs") {
+            options.min_runs = std::stoi(value);
+        } else if (name == "--min-time") {
+            options.min_seconds = std::stod(value);
+        } else if (name == "--seed") {
+            options.seed = static_cast<uint32_t>(std::stoul(value));
+        } else if (name == "--filter") {
+            options.filter = value;
+        } else if (name == "--output") {
+            options.output = value;
+        } else if (name == "--generate") {
+            options.generate = parse_size(value);
+        } else {
+            throw std::invalid_argument("Unknown option: " + argument);
+        }
+    }
+    return options;
+}
+
+void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --sizes=1K,64K,1M        lexer and parser input sizes (up to 100M and beyond)\n"
+              << "  --program-sizes=1K,16K   generated programs run through lex, parse and execute\n"
+              << "  --iterations=N           loop count of the execution kernels\n"
+              << "  --recursion-depth=N      argument of the recursive Fibonacci kernel\n"
+              << "  --min-runs=N --min-time=S  repeat each benchmark at least N times and S seconds\n"
+              << "  --filter=TEXT            only run benchmarks whose name contains TEXT\n"
+              << "  --output=FILE            write JSON results to FILE instead of stdout\n"
+              << "  --generate=SIZE          write a generated program of SIZE bytes to the output and exit\n"
+              << "  --seed=N                 seed of the workload generator\n";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    try {
+        options = parse_options(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    std::ofstream file;
+    if (options.output != "-") {
+        file.open(options.output);
+        if (!file.is_open()) {
+            std::cerr << "Error: Could not open file: " << options.output << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = options.output == "-" ? std::cout : file;
+
+    if (options.generate > 0) {
+        out << generate_program(options.generate, options.seed).source;
+        return 0;
+    }
+
+    std::vector<std::pair<std::string, std::function<Result()>>> benchmarks;
+    for (size_t size : options.sizes) {
+        benchmarks.push_back({"lex/" + format_size(size), [&options, size] { return bench_lex(options, size); }});
+    }
+    for (size_t size : options.sizes) {
+        benchmarks.push_back({"parse/" + format_size(size), [&options, size] { return bench_parse(options, size); }});
+    }
+    for (const Workload& workload : {arithmetic_loop(options.iterations), recursion(options.recursion_depth),
+                                     array_indexing(options.iterations), string_concat(options.iterations),
+                                     function_calls(options.iterations)}) {
+        benchmarks.push_back({"exec/" + workload.name, [&options, workload] { return bench_execute(options, workload); }});
+    }
+    for (size_t size : options.program_sizes) {
+        benchmarks.push_back({"pipeline/" + format_size(size), [&options, size] { return bench_pipeline(options, size); }});
+    }
+
+    std::vector<Result> results;
+    bool failed = false;
+    for (const auto& benchmark : benchmarks) {
+        if (benchmark.first.find(options.filter) == std::string::npos) {
+            continue;
+        }
+        Result result;
+        try {
+            SilencedOutput silenced;
+            result = benchmark.second();
+        } catch (const std::exception& e) {
+            std::string kind = benchmark.first.rfind("pipeline/", 0) == 0 ? "macro" : "micro";
+            result = {benchmark.first, kind, 0, 0, {}, e.what()};
+            failed = true;
+        }
+        if (result.error.empty()) {
+            std::cerr << std::left << std::setw(24) << result.name << std::right << std::fixed << std::setprecision(6)
+                << result.seconds << " s (" << result.runs << " runs)" << std::endl;
+        } else {
+            std::cerr << std::left << std::setw(24) << result.name << "error: " << result.error << std::endl;
+        }
+        results.push_back(std::move(result));
+    }
+
+    write_json(out, results);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,160 @@
+#include "workload.h"
+#include <cctype>
+#include <random>
+#include <stdexcept>
+
+namespace {
+
+// Statements one program unit executes: the declaration, two in the called
+// body, six other top-level statements and the bodies of its two loops
+const uint64_t UNIT_OPERATIONS = 15;
+
+void append_unit(std::string& out, size_t unit, std::mt19937& random) {
+    std::uniform_int_distribution<int> small(1, 99);
+    std::string id = std::to_string(unit);
+    int a = small(random);
+    int b = small(random);
+    int c = small(random);
+
+    out += "// unit " + id + "\n";
+    out += "fun f" + id + "(a, b) {\n";
+    out += "    t = a * " + std::to_string(a) + " + b / " + std::to_string(b) + ";\n";
+    out += "    return t - " + std::to_string(c) + ";\n";
+    out += "}\n";
+    out += "v" + id + " = f" + id + "(" + std::to_string(c) + ", " + std::to_string(a) + ");\n";
+    out += "s" + id + " = \"npc_\" + \"" + id + "\";\n";
+    out += "for k = 1 to 3 {\n";
+    out += "    v" + id + " = v" + id + " + k * " + std::to_string(b) + ";\n";
+    out += "}\n";
+    out += "w" + id + " = [" + std::to_string(a) + ", " + std::to_string(b) + ", " + std::to_string(c) + "];\n";
+    out += "foreach e in w" + id + " {\n";
+    out += "    v" + id + " = v" + id + " + e;\n";
+    out += "}\n";
+    out += "print v" + id + ";\n";
+}
+
+}
+
+Workload generate_program(size_t target_bytes, uint32_t seed) {
+    Workload workload;
+    workload.name = "program_" + format_size(target_bytes);
+    workload.source.reserve(target_bytes + 512);
+    std::mt19937 random(seed);
+    size_t unit = 0;
+    do {
+        append_unit(workload.source, unit++, random);
+    } while (workload.source.size() < target_bytes);
+    workload.operations = unit * UNIT_OPERATIONS;
+    return workload;
+}
+
+Workload arithmetic_loop(int iterations) {
+    Workload workload;
+    workload.name = "arithmetic_loop";
+    workload.source =
+        "x = 0;\n"
+        "for i = 1 to " + std::to_string(iterations) + " {\n"
+        "    x = x + i * 2 - 1;\n"
+        "}\n";
+    workload.operations = static_cast<uint64_t>(iterations);
+    return workload;
+}
+
+Workload recursion(int depth) {
+    // Naive Fibonacci; the while loop stands in for an if statement
+    Workload workload;
+    workload.name = "recursion";
+    workload.source =
+        "fun fib(n) {\n"
+        "    while n > 1 {\n"
+        "        return fib(n - 1) + fib(n - 2);\n"
+        "    }\n"
+        "    return n;\n"
+        "}\n"
+        "r = fib(" + std::to_string(depth) + ");\n";
+    uint64_t previous = 1;  // Calls made by fib(0) and fib(1)
+    uint64_t calls = 1;
+    for (int n = 2; n <= depth; ++n) {
+        uint64_t next = calls + previous + 1;
+        previous = calls;
+        calls = next;
+    }
+    workload.operations = calls;
+    return workload;
+}
+
+Workload array_indexing(int iterations) {
+    Workload workload;
+    workload.name = "array_indexing";
+    workload.source =
+        "a = [3, 1, 4, 1, 5, 9, 2, 6];\n"
+        "s = 0;\n"
+        "for r = 1 to " + std::to_string(iterations / 8) + " {\n"
+        "    for i = 0 to 7 {\n"
+        "        s = s + a[i];\n"
+        "    }\n"
+        "}\n";
+    workload.operations = static_cast<uint64_t>(iterations / 8) * 8;
+    return workload;
+}
+
+Workload string_concat(int iterations) {
+    Workload workload;
+    workload.name = "string_concat";
+    workload.source =
+        "s = \"\";\n"
+        "for i = 1 to " + std::to_string(iterations) + " {\n"
+        "    s = s + \"ab\";\n"
+        "}\n";
+    workload.operations = static_cast<uint64_t>(iterations);
+    return workload;
+}
+
+Workload function_calls(int iterations) {
+    Workload workload;
+    workload.name = "function_calls";
+    workload.source =
+        "fun add(a, b) {\n"
+        "    return a + b;\n"
+        "}\n"
+        "x = 0;\n"
+        "for i = 1 to " + std::to_string(iterations) + " {\n"
+        "    x = add(x, i);\n"
+        "}\n";
+    workload.operations = static_cast<uint64_t>(iterations);
+    return workload;
+}
+
+size_t parse_size(const std::string& text) {
+    size_t digits = 0;
+    while (digits < text.size() && std::isdigit(static_cast<unsigned char>(text[digits]))) {
+        ++digits;
+    }
+    if (digits == 0) {
+        throw std::invalid_argument("Invalid size: " + text);
+    }
+    size_t value = std::stoull(text.substr(0, digits));
+    std::string unit = text.substr(digits);
+    for (auto& c : unit) {
+        c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    }
+    if (unit.empty() || unit == "B") {
+        return value;
+    } else if (unit == "K" || unit == "KB") {
+        return value * 1024;
+    } else if (unit == "M" || unit == "MB") {
+        return value * 1024 * 1024;
+    } else if (unit == "G" || unit == "GB") {
+        return value * 1024 * 1024 * 1024;
+    }
+    throw std::invalid_argument("Invalid size: " + text);
+}
+
+std::string format_size(size_t bytes) {
+    if (bytes >= 1024 * 1024 && bytes % (1024 * 1024) == 0) {
+        return std::to_string(bytes / (1024 * 1024)) + "MB";
+    } else if (bytes >= 1024 && bytes % 1024 == 0) {
+        return std::to_string(bytes / 1024) + "KB";
+    }
+    return std::to_string(bytes) + "B";
+}
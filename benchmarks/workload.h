@@ -0,0 +1,34 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A generated Abyssian script. `operations` counts the units of work it
+// performs (statements, loop iterations or calls), which turns a run time into
+// an ops/s figure.
+struct Workload {
+    std::string name;
+    std::string source;
+    uint64_t operations = 0;
+};
+
+// A valid program of at least `target_bytes` bytes built from repeated units of
+// function declarations, assignments, loops, arrays, strings and comments.
+// Each unit runs a bounded amount of work, so the script is executable at any
+// size. The same seed always produces the same script.
+Workload generate_program(size_t target_bytes, uint32_t seed = 1);
+
+// Kernels for the execution microbenchmarks, each looping `iterations` times
+Workload arithmetic_loop(int iterations);
+Workload recursion(int depth);
+Workload array_indexing(int iterations);
+Workload string_concat(int iterations);
+Workload function_calls(int iterations);
+
+// Parses sizes such as "512", "64K", "1M" or "100MB"
+size_t parse_size(const std::string& text);
+std::string format_size(size_t bytes);
+
+#endif // WORKLOAD_H
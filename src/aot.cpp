@@ -0,0 +1,1270 @@
+#include "aot.h"
+#include "interpreter.h"
+#include "operations.h"
+#include "stats.h"
+#include "utils.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+
+#ifndef ABYSSIAN_AOT_INCLUDE_DIR
+#define ABYSSIAN_AOT_INCLUDE_DIR "src"
+#endif
+
+struct NativeBinding {
+    std::shared_ptr<const NativeModule> module;
+    const aot::Module* functions = nullptr;
+    std::vector<Symbol> symbols;                                 // Module::symbols, interned
+    std::vector<std::shared_ptr<const ASTNode>> declarations;  // Module::declarations, as declared
+    std::unordered_map<const FunctionDeclarationNode*, aot::Entry> entries;
+};
+
+namespace {
+
+// Function declarations, event listeners and parallel loops in the order the
+// module numbers them: depth first through blocks, loop and function bodies.
+// Listener and parallel loop bodies stay in the interpreter, so nothing below
+// them is numbered.
+void collect_declarations(const ASTNode& node, std::vector<const ASTNode*>& declarations) {
+    if (auto block = dynamic_cast<const BlockNode*>(&node)) {
+        for (const auto& statement : block->statements) {
+            collect_declarations(*statement, declarations);
+        }
+    } else if (auto function = dynamic_cast<const FunctionDeclarationNode*>(&node)) {
+        declarations.push_back(function);
+        collect_declarations(*function->body, declarations);
+    } else if (dynamic_cast<const EventListenerNode*>(&node)) {
+        declarations.push_back(&node);
+    } else if (auto for_loop = dynamic_cast<const ForLoopNode*>(&node)) {
+        collect_declarations(*for_loop->body, declarations);
+    } else if (auto while_loop = dynamic_cast<const WhileLoopNode*>(&node)) {
+        collect_declarations(*while_loop->body, declarations);
+    } else if (auto foreach_loop = dynamic_cast<const ForeachLoopNode*>(&node)) {
+        if (foreach_loop->parallel) {
+            declarations.push_back(&node);
+        } else {
+            collect_declarations(*foreach_loop->body, declarations);
+        }
+    }
+}
+
+// Variables a parallel loop's body may assign, which get slots in the frame
+// running the loop so they can take the values it leaves
+void collect_assigned(const ASTNode& node, std::vector<Symbol>& names) {
+    if (auto block = dynamic_cast<const BlockNode*>(&node)) {
+        for (const auto& statement : block->statements) {
+            collect_assigned(*statement, names);
+        }
+    } else if (auto assignment = dynamic_cast<const AssignmentNode*>(&node)) {
+        names.push_back(assignment->identifier);
+    } else if (auto array_assignment = dynamic_cast<const ArrayAssignmentNode*>(&node)) {
+        names.push_back(array_assignment->arrayName);
+    } else if (auto for_loop = dynamic_cast<const ForLoopNode*>(&node)) {
+        names.push_back(for_loop->identifier);
+        collect_assigned(*for_loop->body, names);
+    } else if (auto while_loop = dynamic_cast<const WhileLoopNode*>(&node)) {
+        collect_assigned(*while_loop->body, names);
+    } else if (auto foreach_loop = dynamic_cast<const ForeachLoopNode*>(&node)) {
+        names.push_back(foreach_loop->identifier);
+        collect_assigned(*foreach_loop->body, names);
+    }
+}
+
+std::string quote_cpp(const std::string& text) {
+    std::ostringstream out;
+    out << '"';
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (c >= 0x20 && c < 0x7f && c != '?') {
+            out << c;
+        } else {
+            // Three octal digits, so a following digit is not read as part of the escape
+            out << '\\' << std::oct << std::setw(3) << std::setfill('0') << static_cast<int>(c) << std::dec;
+        }
+    }
+    out << '"';
+    return out.str();
+}
+
+std::string quote_shell(const std::string& text) {
+    std::string quoted = "'";
+    for (char c : text) {
+        quoted += c == '\'' ? std::string("'\\''") : std::string(1, c);
+    }
+    return quoted + "'";
+}
+
+const char* const OP_NAMES[] = {"Add", "Subtract", "Multiply", "Divide", "And", "Or", "Less", "Greater", "LessEqual", "GreaterEqual", "Unknown"};
+
+// An operand the generated code can refer to: a slot, a temporary, or a constant
+struct Emitted {
+    std::string name;  // An aot::Operand lvalue
+    bool owned;        // A temporary that may be moved from
+};
+
+// Writes the C++ for a program. Each function, and the program itself,
+// becomes one C++ function whose statements follow the AST's; every value
+// goes through a named aot::Operand, which keeps the output simple for the
+// C++ compiler to optimize.
+class Transpiler {
+public:
+    std::string run(const BlockNode& program, uint64_t source_hash);
+
+private:
+    struct Function {
+        std::unordered_map<Symbol, uint32_t> slots;
+        std::vector<uint32_t> names;
+        std::ostringstream body;
+        int indent = 1;
+        std::string entry;            // The C++ name, for a function's calls to itself in tail position
+        std::vector<uint32_t> hidden;  // Parameters hidden by a later one of the same name
+        size_t parameters = 0;
+        bool restarts = false;        // Such a call jumps back to the start
+    };
+
+    uint32_t symbol(Symbol name);
+    uint32_t slot(Symbol name);
+    std::string fresh(const char* prefix) { return prefix + std::to_string(counter++); }
+    void line(const std::string& text);
+
+    void function(const std::string& name, const std::vector<Symbol>& parameters, const BlockNode& body, bool program);
+    void block(const BlockNode& block);
+    bool statement(const ASTNode& node);
+    void assignment(const AssignmentNode& assignment);
+    void give(const Emitted& value, const std::string& to);
+    Emitted expression(const ASTNode& node);
+    Emitted call(const FunctionCallNode& call, bool tail);
+    std::string condition(const ASTNode& node);
+
+    std::ostringstream definitions;
+    std::vector<Symbol> symbols;
+    std::unordered_map<Symbol, uint32_t> symbol_index;
+    std::unordered_map<const ASTNode*, uint32_t> declaration_index;
+    Function* current = nullptr;
+    int counter = 0;
+    int for_loops = 0;  // Around the statement: a call it returns is not in tail position
+};
+
+uint32_t Transpiler::symbol(Symbol name) {
+    auto it = symbol_index.find(name);
+    if (it != symbol_index.end()) {
+        return it->second;
+    }
+    symbol_index.emplace(name, symbols.size());
+    symbols.push_back(name);
+    return symbols.size() - 1;
+}
+
+uint32_t Transpiler::slot(Symbol name) {
+    auto it = current->slots.find(name);
+    if (it != current->slots.end()) {
+        return it->second;
+    }
+    current->slots.emplace(name, current->names.size());
+    current->names.push_back(symbol(name));
+    return current->names.size() - 1;
+}
+
+void Transpiler::line(const std::string& text) {
+    current->body << std::string(current->indent * 4, ' ') << text << '\n';
+}
+
+std::string Transpiler::run(const BlockNode& program, uint64_t source_hash) {
+    std::vector<const ASTNode*> declarations;
+    collect_declarations(program, declarations);
+    for (size_t i = 0; i < declarations.size(); ++i) {
+        declaration_index[declarations[i]] = i;
+    }
+
+    function("program", {}, program, true);
+    for (size_t i = 0; i < declarations.size(); ++i) {
+        if (auto declaration = dynamic_cast<const FunctionDeclarationNode*>(declarations[i])) {
+            function("f" + std::to_string(i), declaration->parameters, *declaration->body, false);
+        }
+    }
+
+    std::ostringstream out;
+    out << "// Generated by Abyssian --aot; see aot.h\n";
+    out << "#define ABYSSIAN_AOT_MODULE\n#include \"aot_abi.h\"\n\n";
+    out << "namespace {\n\n";
+    for (size_t i = 0; i < declarations.size(); ++i) {
+        if (dynamic_cast<const FunctionDeclarationNode*>(declarations[i])) {
+            out << "int f" << i << "(void* ctx, aot::Operand* arguments, aot::Frame* caller, aot::Operand* result);\n";
+        }
+    }
+    out << '\n' << definitions.str();
+
+    // Before the symbol table, since a declaration no statement reaches adds its name here
+    std::ostringstream table;
+    table << "const aot::Declaration declarations[] = {";
+    for (size_t i = 0; i < declarations.size(); ++i) {
+        if (auto function = dynamic_cast<const FunctionDeclarationNode*>(declarations[i])) {
+            table << "\n    {aot::Function, " << symbol(function->identifier) << ", " << function->parameters.size() << ", f" << i << "},";
+        } else if (auto loop = dynamic_cast<const ForeachLoopNode*>(declarations[i])) {
+            table << "\n    {aot::ParallelLoop, " << symbol(loop->identifier) << ", 0, nullptr},";
+        } else {
+            auto listener = static_cast<const EventListenerNode*>(declarations[i]);
+            table << "\n    {aot::EventListener, " << symbol(listener->event_name) << ", 0, nullptr},";
+        }
+    }
+    table << "\n    {aot::Function, aot::NO_NAME, 0, nullptr}\n};\n\n";
+
+    out << "const char* const symbols[] = {";
+    for (Symbol name : symbols) {
+        out << "\n    " << quote_cpp(name.str()) << ",";
+    }
+    out << "\n    nullptr\n};\n\n";
+    out << table.str();
+
+    out << "void bind_runtime(const aot::Runtime* runtime) {\n    aot::runtime = runtime;\n}\n\n";
+    out << "const aot::Module module = {aot::ABI_VERSION, " << source_hash << "ull, symbols, " << symbols.size()
+        << ", declarations, " << declarations.size() << ", program, bind_runtime};\n\n";
+    out << "}\n\n";
+    out << "extern \"C\" __attribute__((visibility(\"default\"))) const aot::Module* abyssian_module() {\n    return &module;\n}\n";
+    return out.str();
+}
+
+void Transpiler::function(const std::string& name, const std::vector<Symbol>& parameters, const BlockNode& body, bool program) {
+    Function code;
+    current = &code;
+    code.entry = program ? std::string() : name;
+    code.parameters = parameters.size();
+    // Parameter i is slot i, where the caller put argument i; of parameters
+    // sharing a name, the last one is bound, as in the interpreter
+    std::vector<uint32_t>& hidden = code.hidden;
+    for (Symbol parameter : parameters) {
+        auto it = code.slots.find(parameter);
+        if (it != code.slots.end()) {
+            hidden.push_back(it->second);
+            code.names[it->second] = aot::NO_NAME;
+        }
+        code.slots[parameter] = code.names.size();
+        code.names.push_back(symbol(parameter));
+    }
+    block(body);
+    line("return 0;");
+    current = nullptr;
+
+    size_t count = code.names.size();
+    definitions << "int " << name << "(void* ctx, aot::Operand* arguments, aot::Frame* caller, aot::Operand* result) {\n";
+    definitions << "    static const uint32_t names[] = {";
+    for (uint32_t index : code.names) {
+        definitions << (index == aot::NO_NAME ? std::string("aot::NO_NAME") : std::to_string(index)) << ", ";
+    }
+    definitions << "aot::NO_NAME};\n";
+    definitions << "    aot::Operand slots[" << count + 1 << "] = {};\n";
+    definitions << "    aot::Frame frame{names, slots, " << count << ", " << (program ? 1 : 0) << ", " << (program ? "nullptr" : "caller") << "};\n";
+    definitions << "    aot::Scope scope(ctx, frame);\n";
+    if (program) {
+        definitions << "    (void)arguments;\n    (void)caller;\n";
+    }
+    for (size_t i = 0; i < parameters.size(); ++i) {
+        definitions << "    aot::bind(frame, " << i << ", arguments[" << i << "]);\n";
+    }
+    for (uint32_t slot : hidden) {
+        definitions << "    aot::hide(frame, " << slot << ");\n";
+    }
+    if (code.restarts) {
+        definitions << "start:\n";
+    }
+    definitions << code.body.str() << "}\n\n";
+}
+
+void Transpiler::block(const BlockNode& block) {
+    for (const auto& node : block.statements) {
+        if (statement(*node)) {
+            return;  // Nothing after a return runs
+        }
+        line("aot::runtime->safe_point(ctx, &frame);");
+    }
+}
+
+// Returns true if the statement always returns
+bool Transpiler::statement(const ASTNode& node) {
+    if (auto nested = dynamic_cast<const BlockNode*>(&node)) {
+        line("{");
+        ++current->indent;
+        block(*nested);
+        --current->indent;
+        line("}");
+        return false;
+    }
+
+    line("{");
+    ++current->indent;
+    bool returns = false;
+    if (auto assignment = dynamic_cast<const AssignmentNode*>(&node)) {
+        this->assignment(*assignment);
+    } else if (auto print = dynamic_cast<const PrintNode*>(&node)) {
+        Emitted value = expression(*print->expression);
+        line("aot::runtime->print(ctx, &" + value.name + ");");
+    } else if (auto input = dynamic_cast<const InputNode*>(&node)) {
+        line("aot::runtime->input(ctx, &frame, " + std::to_string(slot(input->identifier)) + ");");
+    } else if (dynamic_cast<const FunctionDeclarationNode*>(&node)) {
+        line("aot::runtime->declare(ctx, " + std::to_string(declaration_index.at(&node)) + ");");
+    } else if (dynamic_cast<const EventListenerNode*>(&node)) {
+        line("aot::runtime->listen(ctx, " + std::to_string(declaration_index.at(&node)) + ");");
+    } else if (auto return_node = dynamic_cast<const ReturnNode*>(&node)) {
+        auto returned = dynamic_cast<const FunctionCallNode*>(return_node->expression.get());
+        give(returned && for_loops == 0 ? call(*returned, true) : expression(*return_node->expression), "*result");
+        line("return 1;");
+        returns = true;
+    } else if (auto for_loop = dynamic_cast<const ForLoopNode*>(&node)) {
+        // As in the interpreter, errors from the bounds and the body alike end the loop with a diagnostic
+        std::string first = fresh("first");
+        std::string last = fresh("last");
+        std::string i = fresh("i");
+        line("try {");
+        ++current->indent;
+        Emitted lower = expression(*for_loop->lower_bound);
+        Emitted upper = expression(*for_loop->upper_bound);
+        line("int " + first + ", " + last + ";");
+        line("aot::runtime->bounds(&" + lower.name + ", &" + upper.name + ", &" + first + ", &" + last + ");");
+        line("for (int " + i + " = " + first + "; " + i + " <= " + last + "; ++" + i + ") {");
+        ++current->indent;
+        line("aot::set_counter(frame.slots[" + std::to_string(slot(for_loop->identifier)) + "], " + i + ");");
+        ++for_loops;
+        block(*for_loop->body);
+        --for_loops;
+        --current->indent;
+        line("}");
+        --current->indent;
+        line("} catch (const std::invalid_argument& e) {");
+        line("    aot::runtime->for_error(0, e.what());");
+        line("} catch (const std::out_of_range& e) {");
+        line("    aot::runtime->for_error(1, e.what());");
+        line("}");
+    } else if (auto while_loop = dynamic_cast<const WhileLoopNode*>(&node)) {
+        line("while (true) {");
+        ++current->indent;
+        line("{");
+        ++current->indent;
+        line("if (!(" + condition(*while_loop->condition) + ")) {");
+        line("    break;");
+        line("}");
+        --current->indent;
+        line("}");
+        block(*while_loop->body);
+        --current->indent;
+        line("}");
+    } else if (auto foreach_loop = dynamic_cast<const ForeachLoopNode*>(&node)) {
+        Emitted collection = expression(*foreach_loop->collection);
+        if (foreach_loop->parallel) {
+            // The interpreter runs it, and stores what it leaves in the variables into the slots
+            std::vector<Symbol> assigned;
+            collect_assigned(*foreach_loop->body, assigned);
+            slot(foreach_loop->identifier);
+            for (Symbol name : assigned) {
+                slot(name);
+            }
+            line("if (aot::runtime->parallel_foreach(ctx, &frame, " + std::to_string(declaration_index.at(&node)) + ", &" + collection.name + ", result)) {");
+            line("    return 1;");
+            line("}");
+        } else {
+            std::string iteration = fresh("iteration");
+            line("aot::Iteration " + iteration + "(ctx, " + std::to_string(symbol(foreach_loop->identifier)) + ", " + collection.name + ");");
+            line("while (" + iteration + ".next(frame.slots[" + std::to_string(slot(foreach_loop->identifier)) + "])) {");
+            ++current->indent;
+            block(*foreach_loop->body);
+            --current->indent;
+            line("}");
+        }
+    } else if (auto npc_action = dynamic_cast<const NPCActionNode*>(&node)) {
+        line("aot::runtime->npc_action(ctx, " + std::to_string(symbol(npc_action->npc_name)) + ", " + std::to_string(symbol(npc_action->action)) + ");");
+    } else if (auto array_assignment = dynamic_cast<const ArrayAssignmentNode*>(&node)) {
+        uint32_t target = slot(array_assignment->arrayName);
+        Emitted index = expression(*array_assignment->index);
+        line("aot::runtime->check_index(&" + index.name + ");");
+        Emitted value = expression(*array_assignment->expression);
+        line("aot::runtime->assign_element(ctx, &frame, " + std::to_string(target) + ", &" + index.name + ", &" + value.name + ");");
+    } else if (auto object_declaration = dynamic_cast<const ObjectDeclarationNode*>(&node)) {
+        uint32_t target = slot(object_declaration->identifier);
+        line("aot::runtime->object(ctx, &frame.slots[" + std::to_string(target) + "]);");
+        line("frame.slots[" + std::to_string(target) + "].state = aot::Dirty;");
+    } else if (auto field_assignment = dynamic_cast<const FieldAssignmentNode*>(&node)) {
+        std::string field = std::to_string(symbol(field_assignment->field));
+        Emitted object = expression(*field_assignment->object);
+        line("aot::runtime->check_object(ctx, &" + object.name + ", " + field + ");");
+        Emitted value = expression(*field_assignment->expression);
+        line("aot::runtime->set_field(ctx, &" + object.name + ", " + field + ", &" + value.name + ");");
+    } else {
+        // An expression used as a statement becomes the result
+        give(expression(node), "*result");
+        line("return 1;");
+        returns = true;
+    }
+    --current->indent;
+    line("}");
+    return returns;
+}
+
+void Transpiler::assignment(const AssignmentNode& assignment) {
+    uint32_t target = slot(assignment.identifier);
+    std::string target_slot = "frame.slots[" + std::to_string(target) + "]";
+
+    // `s = s + a + b` appends to the slot in place, as the interpreter
+    // appends to the variable (see Interpreter::append_in_place)
+    std::vector<const ASTNode*> operands;
+    const ASTNode* node = assignment.expression.get();
+    while (auto binary = dynamic_cast<const BinaryExpressionNode*>(node)) {
+        if (binary->op != "+") {
+            operands.clear();
+            break;
+        }
+        operands.push_back(binary->right.get());
+        node = binary->left.get();
+    }
+    auto self = dynamic_cast<const IdentifierNode*>(node);
+    if (!operands.empty() && self && self->identifier == assignment.identifier) {
+        line("if (aot::slot(ctx, frame, " + std::to_string(target) + ").state != aot::Missing) {");
+        ++current->indent;
+        std::vector<Emitted> pieces;
+        for (auto operand = operands.rbegin(); operand != operands.rend(); ++operand) {
+            pieces.push_back(expression(**operand));
+        }
+        for (const auto& piece : pieces) {
+            line("aot::append(" + target_slot + ", " + piece.name + ");");
+        }
+        line(target_slot + ".state = aot::Dirty;");
+        --current->indent;
+        line("} else {");
+        ++current->indent;
+        give(expression(*assignment.expression), target_slot);
+        line(target_slot + ".state = aot::Dirty;");
+        --current->indent;
+        line("}");
+        return;
+    }
+    give(expression(*assignment.expression), target_slot);
+    line(target_slot + ".state = aot::Dirty;");
+}
+
+// Stores a value into an operand, moving it if it is a temporary
+void Transpiler::give(const Emitted& value, const std::string& to) {
+    line(std::string(value.owned ? "aot::move(" : "aot::copy(") + to + ", " + value.name + ");");
+}
+
+Emitted Transpiler::expression(const ASTNode& node) {
+    if (auto identifier = dynamic_cast<const IdentifierNode*>(&node)) {
+        // Nothing an expression evaluates can assign to this frame's slots
+        std::string name = fresh("v");
+        line("aot::Operand& " + name + " = aot::slot(ctx, frame, " + std::to_string(slot(identifier->identifier)) + ");");
+        return {name, false};
+    } else if (auto number = dynamic_cast<const NumberNode*>(&node)) {
+        std::ostringstream literal;
+        literal << std::setprecision(17) << number->value;
+        std::string name = fresh("t");
+        if (std::trunc(number->value) == number->value && std::fabs(number->value) < 9007199254740992.0) {
+            line("aot::Operand " + name + " = aot::integral(" + literal.str() + ".0);");
+            return {name, true};
+        }
+        line("aot::Temp " + name + ";");
+        line("aot::runtime->number(" + literal.str() + ", &" + name + ".o);");
+        return {name + ".o", true};
+    } else if (auto str = dynamic_cast<const StringNode*>(&node)) {
+        std::string name = fresh("t");
+        line("aot::Temp " + name + ";");
+        line("aot::runtime->text(" + quote_cpp(str->value) + ", " + std::to_string(str->value.size()) + ", &" + name + ".o);");
+        return {name + ".o", true};
+    } else if (auto binary = dynamic_cast<const BinaryExpressionNode*>(&node)) {
+        Emitted left = expression(*binary->left);
+        Emitted right = expression(*binary->right);
+        std::string name = fresh("t");
+        line("aot::Temp " + name + ";");
+        line("aot::binary(ctx, aot::" + std::string(OP_NAMES[static_cast<int>(binary_op(binary->op))]) + ", " + quote_cpp(binary->op) + ", " +
+             left.name + ", " + right.name + ", " + name + ".o);");
+        return {name + ".o", true};
+    } else if (auto function_call = dynamic_cast<const FunctionCallNode*>(&node)) {
+        return call(*function_call, false);
+    } else if (auto array_literal = dynamic_cast<const ArrayLiteralNode*>(&node)) {
+        std::string count = std::to_string(array_literal->elements.size());
+        std::string elements = fresh("e");
+        line("aot::Values<" + count + "> " + elements + ";");
+        for (size_t i = 0; i < array_literal->elements.size(); ++i) {
+            give(expression(*array_literal->elements[i]), elements + ".o[" + std::to_string(i) + "]");
+        }
+        std::string name = fresh("t");
+        line("aot::Temp " + name + ";");
+        line("aot::runtime->array(" + elements + ".o, " + count + ", &" + name + ".o);");
+        return {name + ".o", true};
+    } else if (auto array_index = dynamic_cast<const ArrayIndexNode*>(&node)) {
+        Emitted index = expression(*array_index->index);
+        std::string name = fresh("t");
+        line("aot::Temp " + name + ";");
+        line("aot::runtime->element(ctx, &frame, " + std::to_string(slot(array_index->arrayName)) + ", &" + index.name + ", &" + name + ".o);");
+        return {name + ".o", true};
+    } else if (auto field_access = dynamic_cast<const FieldAccessNode*>(&node)) {
+        Emitted object = expression(*field_access->object);
+        std::string name = fresh("t");
+        line("aot::Temp " + name + ";");
+        line("aot::runtime->field(ctx, &" + object.name + ", " + std::to_string(symbol(field_access->field)) + ", &" + name + ".o);");
+        return {name + ".o", true};
+    }
+    throw std::runtime_error("Unknown expression node");
+}
+
+// A function's call to itself in tail position rebinds the parameters and
+// jumps back to the start of the body, if the runtime agrees that a new
+// frame would run the same code; jumping leaves the scopes the body is in
+Emitted Transpiler::call(const FunctionCallNode& call, bool tail) {
+    // Check the call before evaluating arguments, which may have side effects
+    std::string function = std::to_string(symbol(call.identifier));
+    std::string count = std::to_string(call.arguments.size());
+    line("aot::runtime->check_call(ctx, " + function + ", " + count + ");");
+    std::string arguments = fresh("a");
+    line("aot::Values<" + count + "> " + arguments + ";");
+    for (size_t i = 0; i < call.arguments.size(); ++i) {
+        give(expression(*call.arguments[i]), arguments + ".o[" + std::to_string(i) + "]");
+    }
+    if (tail && !current->entry.empty() && call.arguments.size() == current->parameters) {
+        line("if (int tail = aot::runtime->tail_call(ctx, " + function + ", " + current->entry + ", " + arguments + ".o, " + count + ", result)) {");
+        ++current->indent;
+        line("if (tail == 2) {");
+        line("    return 1;");
+        line("}");
+        for (size_t i = 0; i < call.arguments.size(); ++i) {
+            line("aot::bind(frame, " + std::to_string(i) + ", " + arguments + ".o[" + std::to_string(i) + "]);");
+        }
+        for (uint32_t slot : current->hidden) {
+            line("aot::hide(frame, " + std::to_string(slot) + ");");
+        }
+        line("goto start;");
+        --current->indent;
+        line("}");
+        current->restarts = true;
+    }
+    std::string name = fresh("t");
+    line("aot::Temp " + name + ";");
+    line("aot::runtime->call(ctx, &frame, " + function + ", " + arguments + ".o, " + count + ", &" + name + ".o);");
+    return {name + ".o", true};
+}
+
+// Comparisons on numbers answer the condition directly
+std::string Transpiler::condition(const ASTNode& node) {
+    auto binary = dynamic_cast<const BinaryExpressionNode*>(&node);
+    BinaryOp op = binary ? binary_op(binary->op) : BinaryOp::Unknown;
+    if (op == BinaryOp::Less || op == BinaryOp::Greater || op == BinaryOp::LessEqual || op == BinaryOp::GreaterEqual) {
+        Emitted left = expression(*binary->left);
+        Emitted right = expression(*binary->right);
+        return "aot::compare(ctx, aot::" + std::string(OP_NAMES[static_cast<int>(op)]) + ", " + quote_cpp(binary->op) + ", " + left.name + ", " + right.name + ")";
+    }
+    return expression(node).name + ".truth";
+}
+
+// Value data behind an aot::Box
+struct HostBox : aot::Box {
+    Value value;
+};
+
+HostBox* host_box(aot::Box* box) {
+    return static_cast<HostBox*>(box);
+}
+
+void release(aot::Box* box) {
+    delete host_box(box);
+}
+
+void drop(aot::Operand& operand) {
+    if (operand.box && --operand.box->refs == 0) {
+        release(operand.box);
+    }
+    operand.box = nullptr;
+}
+
+Value to_value(const aot::Operand& operand) {
+    if (operand.box) {
+        return host_box(operand.box)->value;
+    }
+    switch (operand.format) {
+        case aot::Double:
+            return Value(std::to_string(operand.number));
+        case aot::Integer:
+            return Value(std::to_string(static_cast<int>(operand.number)));
+        default:
+            return Value();
+    }
+}
+
+// Whether the value is a number, or the text "true", is worked out once here
+void classify(aot::Operand& operand) {
+    const Value& value = host_box(operand.box)->value;
+    operand.format = aot::Boxed;
+    operand.numeric = 0;
+    operand.truth = 0;
+    operand.number = 0;
+    if (value.is_text()) {
+        if (is_number_text(value.str())) {
+            operand.numeric = 1;
+            operand.number = std::stod(value.str());
+        } else {
+            operand.truth = value.str() == "true";
+        }
+    }
+}
+
+// Keeps the operand's slot state
+void assign(aot::Operand& out, Value value) {
+    auto box = new HostBox;
+    box->refs = 1;
+    box->value = std::move(value);
+    drop(out);
+    out.box = box;
+    classify(out);
+}
+
+// Copies a box shared with other operands, so it can be changed
+Value& unshare(aot::Operand& operand) {
+    if (!operand.box) {
+        assign(operand, to_value(operand));
+    } else if (operand.box->refs > 1) {
+        auto box = new HostBox;
+        box->refs = 1;
+        box->value = host_box(operand.box)->value;
+        --operand.box->refs;
+        operand.box = box;
+    }
+    return host_box(operand.box)->value;
+}
+
+// The interpreter state behind `foreach` in native code
+struct Iteration {
+    Value collection;
+    size_t next = 0;  // Element, or position in the text
+};
+
+}
+
+// The interpreter's side of aot::Runtime
+class NativeRuntime {
+public:
+    static const aot::Runtime table;
+
+private:
+    static Interpreter& interpreter(void* context) { return *static_cast<Interpreter*>(context); }
+    static Symbol name(Interpreter& interpreter, uint32_t index) { return interpreter.native->symbols[index]; }
+    static Symbol slot_name(Interpreter& interpreter, const aot::Frame* frame, uint32_t slot) { return name(interpreter, frame->names[slot]); }
+
+    static void flush(Interpreter& interpreter, aot::Frame* frame) {
+        for (uint32_t i = 0; i < frame->count; ++i) {
+            aot::Operand& slot = frame->slots[i];
+            if (slot.state == aot::Dirty && frame->names[i] != aot::NO_NAME) {
+                interpreter.variables[slot_name(interpreter, frame, i)] = to_value(slot);
+                slot.state = aot::Clean;
+            }
+        }
+        stats::note_variable_count(interpreter.variables.size());
+    }
+
+    // Innermost last, so its values shadow the callers'
+    static void write_frames(Interpreter& interpreter, aot::Frame* frame) {
+        if (!frame) {
+            return;
+        }
+        write_frames(interpreter, frame->caller);
+        for (uint32_t i = 0; i < frame->count; ++i) {
+            if (frame->slots[i].state == aot::Dirty && frame->names[i] != aot::NO_NAME) {
+                interpreter.variables[slot_name(interpreter, frame, i)] = to_value(frame->slots[i]);
+            }
+        }
+    }
+
+    static void text(const char* text, size_t size, aot::Operand* out) {
+        assign(*out, Value(std::string(text, size)));
+    }
+
+    static void number(double number, aot::Operand* out) {
+        assign(*out, Value(std::to_string(number)));
+    }
+
+    static void boolean(int value, aot::Operand* out) {
+        assign(*out, Value(value ? "true" : "false"));
+    }
+
+    static void binary(void*, int op, const char* op_text, const aot::Operand* left, const aot::Operand* right, aot::Operand* out) {
+        assign(*out, apply_binary(static_cast<BinaryOp>(op), op_text, to_value(*left), to_value(*right)));
+    }
+
+    static void append(aot::Operand* value, const aot::Operand* piece) {
+        unshare(*value).append(to_value(*piece).text());  // Appends in place unless the text is shared
+        classify(*value);
+    }
+
+    // Binds a slot the first time it is used: to the value the caller's scope
+    // has, which cannot change while the frame runs
+    static void load(void* context, aot::Frame* frame, uint32_t slot) {
+        Interpreter& in = interpreter(context);
+        aot::Operand& operand = frame->slots[slot];
+        uint32_t name_index = frame->names[slot];
+        for (aot::Frame* caller = frame->caller; caller; caller = caller->caller) {
+            for (uint32_t i = 0; i < caller->count; ++i) {
+                const aot::Operand& value = caller->slots[i];
+                if (caller->names[i] == name_index && (value.state == aot::Clean || value.state == aot::Dirty)) {
+                    if (value.box) {
+                        ++value.box->refs;
+                    }
+                    drop(operand);
+                    operand = value;
+                    operand.state = aot::Clean;
+                    return;
+                }
+            }
+        }
+        auto it = in.variables.find(name(in, name_index));
+        if (it == in.variables.end()) {
+            operand.state = aot::Missing;
+            return;
+        }
+        assign(operand, it->second);
+        operand.state = aot::Clean;
+    }
+
+    static void leave(void* context, aot::Frame* frame) {
+        if (frame->program) {
+            flush(interpreter(context), frame);
+        }
+    }
+
+    // As Interpreter::gc_safe_point; the collector finds a program's values in the variables map
+    static void safe_point(void* context, aot::Frame* frame) {
+        Interpreter& in = interpreter(context);
+        if (in.call_depth == 0 && in.heap.wants_collection()) {
+            if (frame->program) {
+                flush(in, frame);
+            }
+            in.collect_garbage(in.gc_budget);
+        }
+    }
+
+    static void print(void* context, const aot::Operand* value) {
+        *interpreter(context).output_stream << display_text(to_value(*value).text()) << std::endl;
+    }
+
+    static void input(void* context, aot::Frame* frame, uint32_t slot) {
+        Interpreter& in = interpreter(context);
+        // Exhausted input reads as an empty line, as it does at the end of std::cin
+        std::string value;
+        if (in.input_provider) {
+            value = in.input_provider->next(slot_name(in, frame, slot)).value_or("");
+        } else {
+            std::getline(std::cin, value);
+        }
+        assign(frame->slots[slot], Value(std::move(value)));
+        frame->slots[slot].state = aot::Dirty;
+    }
+
+    static void check_call(void* context, uint32_t name_index, size_t count) {
+        Interpreter& in = interpreter(context);
+        Symbol function = name(in, name_index);
+        auto it = in.functions.find(function);
+        if (it == in.functions.end()) {
+            throw std::runtime_error("Function not found: " + function);
+        }
+        if (it->second->parameters.size() != count) {
+            throw std::runtime_error("Argument count mismatch in function call: " + function);
+        }
+    }
+
+    static void call(void* context, aot::Frame* caller, uint32_t name_index, aot::Operand* arguments, size_t count, aot::Operand* result) {
+        Interpreter& in = interpreter(context);
+        Symbol function_name = name(in, name_index);
+        // Evaluating the arguments may have declared another function of the same name
+        auto it = in.functions.find(function_name);
+        if (it == in.functions.end()) {
+            throw std::runtime_error("Function not found: " + function_name);
+        }
+        auto function = it->second;
+        if (function->parameters.size() != count) {
+            throw std::runtime_error("Argument count mismatch in function call: " + function_name);
+        }
+        std::vector<Value> values;
+        auto read_arguments = [&] {
+            values.reserve(count);
+            for (size_t i = values.size(); i < count; ++i) {
+                values.push_back(to_value(arguments[i]));
+            }
+        };
+        // As Interpreter::call_memoized
+        std::shared_ptr<FunctionProfile> profile;
+        std::optional<std::string> key;
+        if (function->memoized && in.memo_policy.enabled) {
+            read_arguments();
+            profile = in.profile_for(function);
+            key = MemoTable::key(values);
+            if (key) {
+                if (const Value* kept = profile->memo.find(*key)) {
+                    assign(*result, *kept);
+                    return;
+                }
+            }
+        }
+        if (aot::Entry entry = in.native_entry(*function)) {
+            stats::add(stats::FunctionCalls);
+            Interpreter::CallScope depth(in, function_name);
+            ProfiledFunction scope(in.profiler, function_name);
+            Interpreter::TailResults results(in);
+            entry(context, arguments, caller, result);
+            results.keep(to_value(*result));
+            if (key) {
+                profile->memo.insert(std::move(*key), to_value(*result), in.memo_policy.capacity);
+            }
+            return;
+        }
+
+        // The interpreter looks names up in the variables map, which gets the
+        // frames' assignments for the duration of the call
+        read_arguments();
+        Value value;
+        {
+            struct Restore {
+                Interpreter& in;
+                std::unordered_map<Symbol, Value> variables;
+                ~Restore() { in.variables = std::move(variables); }
+            } restore{in, in.variables};
+            write_frames(in, caller);
+            value = in.invoke_function(function_name, values);
+        }
+        if (key) {
+            profile->memo.insert(std::move(*key), value, in.memo_policy.capacity);
+        }
+        assign(*result, std::move(value));
+    }
+
+    static int tail_call(void* context, uint32_t name_index, aot::Entry entry, const aot::Operand* arguments, size_t count, aot::Operand* result) {
+        Interpreter& in = interpreter(context);
+        if (!in.call_policy.tail_calls) {
+            return 0;
+        }
+        auto it = in.functions.find(name(in, name_index));
+        if (it == in.functions.end() || in.native_entry(*it->second) != entry) {
+            return 0;
+        }
+        auto function = it->second;
+        if (function->memoized && in.memo_policy.enabled) {
+            std::vector<Value> values;
+            values.reserve(count);
+            for (size_t i = 0; i < count; ++i) {
+                values.push_back(to_value(arguments[i]));
+            }
+            if (const Value* kept = in.memo_tail_call(function, values)) {
+                assign(*result, *kept);
+                return 2;
+            }
+        }
+        stats::add(stats::FunctionCalls);
+        stats::add(stats::TailCalls);
+        return 1;
+    }
+
+    static void declare(void* context, uint32_t declaration) {
+        Interpreter& in = interpreter(context);
+        // The same declaration every time the statement runs, so the function keeps its native code
+        auto function = std::static_pointer_cast<const FunctionDeclarationNode>(in.native->declarations[declaration]);
+        auto& entry = in.functions[function->identifier];
+        if (entry != function) {
+            if (entry) {
+                in.profiles.erase(entry.get());
+            }
+            entry = function;
+        }
+    }
+
+    static void listen(void* context, uint32_t declaration) {
+        Interpreter& in = interpreter(context);
+        const ASTNode& listener = *in.native->declarations[declaration];
+        in.events[static_cast<const EventListenerNode&>(listener).event_name].push_back(
+            std::unique_ptr<EventListenerNode>(static_cast<EventListenerNode*>(listener.clone().release())));
+    }
+
+    static void npc_action(void* context, uint32_t npc, uint32_t action) {
+        Interpreter& in = interpreter(context);
+        if (in.event_bus) {
+            while (!in.event_bus->send(RecordKind::NPCAction, name(in, npc), name(in, action))) {
+                std::this_thread::yield();
+            }
+            return;
+        }
+        *in.output_stream << "Executing NPC action for: " << name(in, npc) << std::endl;
+    }
+
+    static void bounds(const aot::Operand* lower, const aot::Operand* upper, int* first, int* last) {
+        std::string lower_bound = to_value(*lower).text();
+        std::string upper_bound = to_value(*upper).text();
+        if (!is_number_text(lower_bound) || !is_number_text(upper_bound)) {
+            throw std::invalid_argument("Bounds are not valid numbers");
+        }
+        *first = std::stoi(lower_bound);
+        *last = std::stoi(upper_bound);
+    }
+
+    static void for_error(int out_of_range, const char* what) {
+        if (out_of_range) {
+            diagnostic_stream() << "Out of range error in for loop bounds: " << what << std::endl;
+        } else {
+            diagnostic_stream() << "Invalid argument in for loop bounds: " << what << std::endl;
+        }
+    }
+
+    // Holding the collection keeps the elements fixed even if the body assigns into the array
+    static void* foreach_begin(void* context, uint32_t name_index, const aot::Operand* collection) {
+        Interpreter& in = interpreter(context);
+        auto iteration = std::make_unique<Iteration>();
+        iteration->collection = to_value(*collection);
+        if (iteration->collection.is_object()) {
+            throw std::runtime_error("Cannot iterate over an object: " + name(in, name_index));
+        }
+        in.pinned_values.push_back(&iteration->collection);
+        return iteration.release();
+    }
+
+    static int foreach_next(void* handle, aot::Operand* out) {
+        auto iteration = static_cast<Iteration*>(handle);
+        const Value& collection = iteration->collection;
+        if (collection.is_array()) {
+            if (iteration->next >= collection.elements().size()) {
+                return 0;
+            }
+            assign(*out, collection.elements()[iteration->next++]);
+            return 1;
+        }
+        // Text is split on commas, as std::getline splits it in the interpreter
+        const std::string& text = collection.str();
+        if (iteration->next >= text.size()) {
+            return 0;
+        }
+        size_t comma = text.find(',', iteration->next);
+        size_t end = comma == std::string::npos ? text.size() : comma;
+        assign(*out, Value(text.substr(iteration->next, end - iteration->next)));
+        iteration->next = end + 1;
+        return 1;
+    }
+
+    static void foreach_end(void* context, void* handle) {
+        interpreter(context).pinned_values.pop_back();
+        delete static_cast<Iteration*>(handle);
+    }
+
+    static void array(aot::Operand* elements, size_t count, aot::Operand* out) {
+        std::vector<Value> values;
+        values.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            Value value = to_value(elements[i]);
+            values.push_back(value.is_text() ? Value(display_text(value.str())) : std::move(value));
+        }
+        assign(*out, Value::array(std::move(values)));
+    }
+
+    static void check_index(const aot::Operand* index) {
+        std::string index_str = to_value(*index).text();
+        if (!is_number_text(index_str)) {
+            throw std::runtime_error("Array index is not a valid number: " + index_str);
+        }
+        std::stoi(index_str);
+    }
+
+    static void element(void* context, aot::Frame* frame, uint32_t slot, const aot::Operand* index, aot::Operand* out) {
+        std::string index_str = to_value(*index).text();
+        if (!is_number_text(index_str)) {
+            throw std::runtime_error("Array index is not a valid number: " + index_str);
+        }
+        if (frame->slots[slot].state == aot::Unset) {
+            load(context, frame, slot);
+        }
+        const aot::Operand& array = frame->slots[slot];
+        if (array.box && host_box(array.box)->value.is_array()) {
+            assign(*out, element_at(host_box(array.box)->value, index_str));
+        } else {
+            assign(*out, element_at(to_value(array), index_str));
+        }
+    }
+
+    static void assign_element(void* context, aot::Frame* frame, uint32_t slot, const aot::Operand* index, const aot::Operand* value) {
+        Interpreter& in = interpreter(context);
+        std::string index_str = to_value(*index).text();
+        int position = std::stoi(index_str);
+        if (frame->slots[slot].state == aot::Unset) {
+            load(context, frame, slot);
+        }
+        aot::Operand& array = frame->slots[slot];
+        if (!array.box || !host_box(array.box)->value.is_array()) {
+            throw std::runtime_error("Not an array: " + slot_name(in, frame, slot));
+        }
+        // Copies the elements first if another operand or a caller still shares them
+        auto& elements = unshare(array).mutable_elements();
+        if (position < 0 || static_cast<size_t>(position) >= elements.size()) {
+            throw std::runtime_error("Array index out of bounds: " + index_str);
+        }
+        Value element = to_value(*value);
+        elements[position] = element.is_text() ? Value(display_text(element.str())) : std::move(element);
+        array.state = aot::Dirty;
+    }
+
+    static void object(void* context, aot::Operand* out) {
+        assign(*out, Value::object(interpreter(context).heap.allocate()));
+    }
+
+    static void field(void* context, const aot::Operand* object, uint32_t field_index, aot::Operand* out) {
+        Interpreter& in = interpreter(context);
+        Value holder = to_value(*object);
+        if (!holder.is_object()) {
+            throw std::runtime_error("Not an object, reading field: " + name(in, field_index));
+        }
+        // Fields never assigned read as empty, as unset variables do
+        const Value* value = holder.as_object()->find(name(in, field_index));
+        assign(*out, value ? *value : Value());
+    }
+
+    static void check_object(void* context, const aot::Operand* object, uint32_t field_index) {
+        if (!object->box || !host_box(object->box)->value.is_object()) {
+            throw std::runtime_error("Not an object, assigning field: " + name(interpreter(context), field_index));
+        }
+    }
+
+    static void set_field(void* context, const aot::Operand* object, uint32_t field_index, const aot::Operand* value) {
+        Interpreter& in = interpreter(context);
+        in.heap.store(host_box(object->box)->value.as_object(), name(in, field_index), to_value(*value));
+    }
+
+    static int parallel_foreach(void* context, aot::Frame* frame, uint32_t declaration, const aot::Operand* collection, aot::Operand* result) {
+        Interpreter& in = interpreter(context);
+        const auto& loop = static_cast<const ForeachLoopNode&>(*in.native->declarations[declaration]);
+        Value items = to_value(*collection);
+        in.pinned_values.push_back(&items);
+        // The interpreter runs the loop on the variables map, with the frames'
+        // assignments; afterwards the frame's slots take what the loop left
+        // there, and a function's frame puts the map back, as a call does
+        struct Restore {
+            Interpreter& in;
+            std::optional<std::unordered_map<Symbol, Value>> variables;
+            ~Restore() {
+                if (variables) {
+                    in.variables = std::move(*variables);
+                }
+                in.pinned_values.pop_back();
+            }
+        } restore{in, frame->program ? std::nullopt : std::optional<std::unordered_map<Symbol, Value>>(in.variables)};
+        write_frames(in, frame);
+        auto store_slots = [&] {
+            for (uint32_t i = 0; i < frame->count; ++i) {
+                if (frame->names[i] == aot::NO_NAME) {
+                    continue;
+                }
+                auto variable = in.variables.find(slot_name(in, frame, i));
+                if (variable != in.variables.end()) {
+                    assign(frame->slots[i], variable->second);
+                    frame->slots[i].state = aot::Dirty;
+                }
+            }
+        };
+        std::optional<Value> returned;
+        try {
+            returned = in.run_parallel_foreach(loop, items);
+        } catch (...) {
+            store_slots();
+            throw;
+        }
+        store_slots();
+        if (!returned) {
+            return 0;
+        }
+        assign(*result, std::move(*returned));
+        return 1;
+    }
+};
+
+const aot::Runtime NativeRuntime::table = {
+    release,
+    NativeRuntime::text,
+    NativeRuntime::number,
+    NativeRuntime::boolean,
+    NativeRuntime::binary,
+    NativeRuntime::append,
+    NativeRuntime::load,
+    NativeRuntime::leave,
+    NativeRuntime::safe_point,
+    NativeRuntime::print,
+    NativeRuntime::input,
+    NativeRuntime::check_call,
+    NativeRuntime::call,
+    NativeRuntime::declare,
+    NativeRuntime::listen,
+    NativeRuntime::npc_action,
+    NativeRuntime::bounds,
+    NativeRuntime::for_error,
+    NativeRuntime::foreach_begin,
+    NativeRuntime::foreach_next,
+    NativeRuntime::foreach_end,
+    NativeRuntime::array,
+    NativeRuntime::check_index,
+    NativeRuntime::element,
+    NativeRuntime::assign_element,
+    NativeRuntime::object,
+    NativeRuntime::field,
+    NativeRuntime::check_object,
+    NativeRuntime::set_field,
+    NativeRuntime::parallel_foreach,
+    NativeRuntime::tail_call,
+};
+
+std::shared_ptr<const NativeModule> NativeModule::load(const std::string& path, std::string& error) {
+#ifdef _WIN32
+    (void)path;
+    error = "Native modules are not supported on this platform";
+    return nullptr;
+#else
+    // A bare file name would be searched for on the library path
+    std::string file = path.find('/') == std::string::npos ? "./" + path : path;
+    void* handle = dlopen(file.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        error = dlerror();
+        return nullptr;
+    }
+    auto function = reinterpret_cast<aot::ModuleFunction>(dlsym(handle, ABYSSIAN_AOT_MODULE_FUNCTION));
+    const aot::Module* module = function ? function() : nullptr;
+    if (!module || module->abi_version != aot::ABI_VERSION) {
+        error = "Not a module for this version of Abyssian: " + path;
+        dlclose(handle);
+        return nullptr;
+    }
+    module->bind(&NativeRuntime::table);
+    return std::shared_ptr<const NativeModule>(new NativeModule(handle, module));
+#endif
+}
+
+NativeModule::~NativeModule() {
+#ifndef _WIN32
+    dlclose(handle);
+#endif
+}
+
+std::string transpile(const BlockNode& program, uint64_t source_hash) {
+    return Transpiler().run(program, source_hash);
+}
+
+bool compile_native(const std::string& source, const std::string& library, std::string& error) {
+    std::string source_file = library + ".cpp";
+    std::string log_file = library + ".log";
+    std::string output_file = library + ".tmp";
+    {
+        std::ofstream out(source_file);
+        if (!out.is_open()) {
+            error = "Could not open file: " + source_file;
+            return false;
+        }
+        out << source;
+    }
+
+    const char* compiler = std::getenv("CXX");
+    std::string command = std::string(compiler && *compiler ? compiler : "c++") +
+                          " -std=c++17 -O2 -fPIC -shared -fvisibility=hidden -I" + quote_shell(ABYSSIAN_AOT_INCLUDE_DIR) +
+                          " -o " + quote_shell(output_file) + " " + quote_shell(source_file) + " 2> " + quote_shell(log_file);
+    int status = std::system(command.c_str());
+    std::remove(source_file.c_str());
+    if (status != 0) {
+        std::ifstream log(log_file);
+        std::stringstream messages;
+        messages << log.rdbuf();
+        error = "C++ compiler failed: " + command + "\n" + messages.str();
+        std::remove(log_file.c_str());
+        std::remove(output_file.c_str());
+        return false;
+    }
+    std::remove(log_file.c_str());
+    // Replaced rather than overwritten, so a process that has the old library open keeps it
+    if (std::rename(output_file.c_str(), library.c_str()) != 0) {
+        error = "Could not write file: " + library;
+        std::remove(output_file.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool Interpreter::bind_native(std::shared_ptr<const NativeModule> module) {
+    if (!ast) {
+        return false;
+    }
+    const aot::Module& functions = *module->module;
+    // The declarations are copied with their marks, which execute() makes too late for them
+    mark_pure_functions(*ast);
+    std::vector<const ASTNode*> declarations;
+    collect_declarations(*ast, declarations);
+    if (declarations.size() != functions.declaration_count) {
+        return false;
+    }
+
+    auto binding = std::make_shared<NativeBinding>();
+    binding->module = module;
+    binding->functions = &functions;
+    for (uint32_t i = 0; i < functions.symbol_count; ++i) {
+        binding->symbols.emplace_back(functions.symbols[i]);
+    }
+    for (size_t i = 0; i < declarations.size(); ++i) {
+        const aot::Declaration& compiled = functions.declarations[i];
+        auto function = dynamic_cast<const FunctionDeclarationNode*>(declarations[i]);
+        auto listener = dynamic_cast<const EventListenerNode*>(declarations[i]);
+        auto loop = dynamic_cast<const ForeachLoopNode*>(declarations[i]);
+        bool matches = compiled.name < functions.symbol_count &&
+                       (function ? compiled.kind == aot::Function && function->identifier == functions.symbols[compiled.name] &&
+                                       function->parameters.size() == compiled.arity
+                        : loop   ? compiled.kind == aot::ParallelLoop && loop->identifier == functions.symbols[compiled.name]
+                                 : compiled.kind == aot::EventListener && listener->event_name == functions.symbols[compiled.name]);
+        if (!matches) {
+            return false;
+        }
+        std::shared_ptr<const ASTNode> declaration = declarations[i]->clone();
+        if (function) {
+            binding->entries[static_cast<const FunctionDeclarationNode*>(declaration.get())] = compiled.entry;
+        }
+        binding->declarations.push_back(std::move(declaration));
+    }
+    native = std::move(binding);
+    return true;
+}
+
+aot::Entry Interpreter::native_entry(const FunctionDeclarationNode& function) const {
+    if (!native) {
+        return nullptr;
+    }
+    auto it = native->entries.find(&function);
+    return it == native->entries.end() ? nullptr : it->second;
+}
+
+Value Interpreter::run_native(aot::Entry entry, const std::vector<Value>& arguments) {
+    struct Operands {
+        std::vector<aot::Operand> arguments;
+        aot::Operand result{};
+        ~Operands() {
+            for (auto& argument : arguments) {
+                drop(argument);
+            }
+            drop(result);
+        }
+    } operands{std::vector<aot::Operand>(arguments.size(), aot::Operand{})};
+    for (size_t i = 0; i < arguments.size(); ++i) {
+        assign(operands.arguments[i], arguments[i]);
+    }
+    TailResults results(*this);
+    entry(this, operands.arguments.data(), nullptr, &operands.result);
+    Value result = to_value(operands.result);
+    results.keep(result);
+    return result;
+}
+
+std::optional<Value> Interpreter::run_native_program() {
+    struct Result {
+        aot::Operand operand{};
+        ~Result() { drop(operand); }
+    } result;
+    if (native->functions->program(this, nullptr, nullptr, &result.operand)) {
+        return to_value(result.operand);
+    }
+    return std::nullopt;
+}
@@ -0,0 +1,53 @@
+#ifndef AOT_H
+#define AOT_H
+
+#include "ast.h"
+#include "aot_abi.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Ahead-of-time compilation of a script to a shared object:
+//
+//   transpile() writes C++ for the program and every function it declares,
+//   compile_native() builds it with the system C++ compiler, and
+//   NativeModule::load() opens it, after which Interpreter::bind_native()
+//   runs the program and its functions from it.
+//
+// The generated code keeps the interpreter's semantics, dynamic scoping and
+// error messages included, working on numbers directly and calling back into
+// the interpreter for text, arrays, objects, output and calls to functions it
+// did not compile (see aot_abi.h). Event listener bodies run in the
+// interpreter. Node and lookup counts are not collected for native code.
+class NativeModule {
+public:
+    // nullptr, with the reason in `error`, if the library cannot be opened or
+    // was built against another version of aot_abi.h
+    static std::shared_ptr<const NativeModule> load(const std::string& path, std::string& error);
+    ~NativeModule();
+
+    NativeModule(const NativeModule&) = delete;
+    NativeModule& operator=(const NativeModule&) = delete;
+
+    // hash_source of the script the library was compiled from
+    uint64_t source_hash() const { return module->source_hash; }
+
+private:
+    NativeModule(void* handle, const aot::Module* module) : handle(handle), module(module) {}
+
+    friend class NativeRuntime;
+    friend class Interpreter;
+
+    void* handle;
+    const aot::Module* module;
+};
+
+struct NativeBinding;  // A module bound to one program, defined in aot.cpp
+
+std::string transpile(const BlockNode& program, uint64_t source_hash);
+
+// Compiles `source` into the shared object `library` with $CXX (default c++);
+// false, with the compiler's messages in `error`, if that fails
+bool compile_native(const std::string& source, const std::string& library, std::string& error);
+
+#endif // AOT_H
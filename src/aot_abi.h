@@ -0,0 +1,360 @@
+#ifndef AOT_ABI_H
+#define AOT_ABI_H
+
+// The interface between the interpreter and a script compiled ahead of time
+// into a shared object (see aot.h). The generated C++ includes only this
+// header: it works on numbers itself and calls back into the interpreter
+// through aot::Runtime for everything else, so the shared object does not
+// depend on the layout of the interpreter's classes.
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+namespace aot {
+
+const uint32_t ABI_VERSION = 3;
+const uint32_t NO_NAME = 0xffffffff;  // A parameter hidden by a later one of the same name
+
+// Interpreter-owned value data. Generated code only counts the references;
+// the interpreter frees the box when the count drops to zero.
+struct Box {
+    size_t refs;
+};
+
+enum Format : uint8_t {
+    Boxed,    // `box` holds the value; no box is the empty text
+    Double,   // No box: the text is std::to_string(number)
+    Integer   // No box: the text is std::to_string(int(number)), as for loop counters
+};
+
+enum SlotState : uint8_t {
+    Unset,    // Not read or assigned yet: callers' frames or the variables map have the value
+    Missing,  // Read, but no variable of that name existed
+    Clean,    // Holds the value the callers' frames or the map had
+    Dirty     // Assigned by this frame
+};
+
+// A value, or a frame slot. All zeros is the empty text.
+struct Operand {
+    double number;    // What the text parses to, when `numeric`
+    Box* box;
+    uint8_t format;
+    uint8_t numeric;
+    uint8_t truth;    // The value is the text "true"
+    uint8_t state;    // Slots only
+};
+
+// One activation of generated code
+struct Frame {
+    const uint32_t* names;  // Each slot's name, an index into Module::symbols
+    Operand* slots;
+    uint32_t count;
+    uint8_t program;        // Top level: the slots stand for the interpreter's variables
+    Frame* caller;          // Next generated frame to search for names this one has not bound
+};
+
+// A function, or the program. `arguments` are moved into the new frame; returns 1 once `result` is set.
+typedef int (*Entry)(void* context, Operand* arguments, Frame* caller, Operand* result);
+
+// Provided by the interpreter. `context` is the interpreter; functions that
+// write an `out` operand release what it held first. Errors are thrown as
+// exceptions, exactly as the interpreter throws them.
+struct Runtime {
+    void (*release)(Box* box);
+    void (*text)(const char* text, size_t size, Operand* out);
+    void (*number)(double number, Operand* out);  // A result that is not an exact integer
+    void (*boolean)(int value, Operand* out);
+    void (*binary)(void* context, int op, const char* op_text, const Operand* left, const Operand* right, Operand* out);
+    void (*append)(Operand* value, const Operand* piece);
+    void (*load)(void* context, Frame* frame, uint32_t slot);
+    void (*leave)(void* context, Frame* frame);
+    void (*safe_point)(void* context, Frame* frame);
+    void (*print)(void* context, const Operand* value);
+    void (*input)(void* context, Frame* frame, uint32_t slot);
+    void (*check_call)(void* context, uint32_t name, size_t count);
+    void (*call)(void* context, Frame* caller, uint32_t name, Operand* arguments, size_t count, Operand* result);
+    void (*declare)(void* context, uint32_t declaration);
+    void (*listen)(void* context, uint32_t declaration);
+    void (*npc_action)(void* context, uint32_t npc, uint32_t action);
+    void (*bounds)(const Operand* lower, const Operand* upper, int* first, int* last);
+    void (*for_error)(int out_of_range, const char* what);
+    void* (*foreach_begin)(void* context, uint32_t name, const Operand* collection);
+    int (*foreach_next)(void* iteration, Operand* out);
+    void (*foreach_end)(void* context, void* iteration);
+    void (*array)(Operand* elements, size_t count, Operand* out);
+    void (*check_index)(const Operand* index);
+    void (*element)(void* context, Frame* frame, uint32_t slot, const Operand* index, Operand* out);
+    void (*assign_element)(void* context, Frame* frame, uint32_t slot, const Operand* index, const Operand* value);
+    void (*object)(void* context, Operand* out);
+    void (*field)(void* context, const Operand* object, uint32_t field, Operand* out);
+    void (*check_object)(void* context, const Operand* object, uint32_t field);
+    void (*set_field)(void* context, const Operand* object, uint32_t field, const Operand* value);
+    // Runs a `parallel foreach` in the interpreter; returns 1 if its body returned, with `result` set
+    int (*parallel_foreach)(void* context, Frame* frame, uint32_t declaration, const Operand* collection, Operand* result);
+    // For a call to `name` that `entry` returns: 0 to make the call as usual,
+    // 1, counting the call, to rebind the parameters of the running frame to
+    // the `count` arguments and start it again, because `name` still runs
+    // `entry`, or 2 with `result` set to the value memoized for the arguments
+    int (*tail_call)(void* context, uint32_t name, Entry entry, const Operand* arguments, size_t count, Operand* result);
+};
+
+enum DeclarationKind : uint32_t { Function, EventListener, ParallelLoop };
+
+// Function declarations, event listeners and parallel loops in the order
+// aot::declarations lists them; listeners are registered, and their bodies
+// and the parallel loops' run in the interpreter. A loop is named by its variable.
+struct Declaration {
+    uint32_t kind;
+    uint32_t name;
+    uint32_t arity;
+    Entry entry;  // Functions only
+};
+
+struct Module {
+    uint32_t abi_version;
+    uint64_t source_hash;  // hash_source of the script it was compiled from
+    const char* const* symbols;
+    uint32_t symbol_count;
+    const Declaration* declarations;
+    uint32_t declaration_count;
+    Entry program;
+    void (*bind)(const Runtime* runtime);
+};
+
+// Exported by every shared object, unmangled
+typedef const Module* (*ModuleFunction)();
+#define ABYSSIAN_AOT_MODULE_FUNCTION "abyssian_module"
+
+}
+
+#ifdef ABYSSIAN_AOT_MODULE
+
+// Helpers for the generated code, compiled into the shared object only
+namespace aot {
+namespace {
+
+const Runtime* runtime = nullptr;
+
+const double EXACT_INTEGER_LIMIT = 9007199254740992.0;  // 2^53
+
+enum Op { Add, Subtract, Multiply, Divide, And, Or, Less, Greater, LessEqual, GreaterEqual, Unknown };
+
+inline void drop(Operand& operand) {
+    if (operand.box && --operand.box->refs == 0) {
+        runtime->release(operand.box);
+    }
+    operand.box = nullptr;
+}
+
+// Overwrites `to`, keeping its slot state
+inline void copy(Operand& to, const Operand& from) {
+    if (from.box) {
+        ++from.box->refs;
+    }
+    drop(to);
+    uint8_t state = to.state;
+    to = from;
+    to.state = state;
+}
+
+inline void move(Operand& to, Operand& from) {
+    if (&to == &from) {
+        return;
+    }
+    drop(to);
+    uint8_t state = to.state;
+    to = from;
+    to.state = state;
+    from.box = nullptr;
+}
+
+// Whole numbers keep their text implicit, as the tier does
+inline void set_number(Operand& out, double number) {
+    if (std::trunc(number) == number && std::fabs(number) < EXACT_INTEGER_LIMIT) {
+        drop(out);
+        out.number = number;
+        out.format = Double;
+        out.numeric = 1;
+        out.truth = 0;
+    } else {
+        runtime->number(number, &out);
+    }
+}
+
+inline Operand integral(double number) {
+    Operand operand{};
+    operand.number = number;
+    operand.format = Double;
+    operand.numeric = 1;
+    return operand;
+}
+
+// A temporary
+struct Temp {
+    Operand o{};
+    Temp() = default;
+    ~Temp() { drop(o); }
+    Temp(const Temp&) = delete;
+    Temp& operator=(const Temp&) = delete;
+};
+
+// Arguments of a call, or elements of an array literal
+template <size_t N>
+struct Values {
+    Operand o[N ? N : 1]{};
+    Values() = default;
+    ~Values() {
+        for (Operand& operand : o) {
+            drop(operand);
+        }
+    }
+    Values(const Values&) = delete;
+    Values& operator=(const Values&) = delete;
+};
+
+// Releases a frame's slots, storing a program's variables first, however the body exits
+struct Scope {
+    void* context;
+    Frame& frame;
+    Scope(void* context, Frame& frame) : context(context), frame(frame) {}
+    ~Scope() {
+        runtime->leave(context, &frame);
+        for (uint32_t i = 0; i < frame.count; ++i) {
+            drop(frame.slots[i]);
+        }
+    }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+};
+
+inline void bind(Frame& frame, uint32_t slot, Operand& argument) {
+    move(frame.slots[slot], argument);
+    frame.slots[slot].state = Dirty;
+}
+
+inline void hide(Frame& frame, uint32_t slot) {
+    drop(frame.slots[slot]);
+    frame.slots[slot].state = Missing;
+}
+
+inline Operand& slot(void* context, Frame& frame, uint32_t slot) {
+    if (frame.slots[slot].state == Unset) {
+        runtime->load(context, &frame, slot);
+    }
+    return frame.slots[slot];
+}
+
+inline void store_copy(Frame& frame, uint32_t slot, const Operand& value) {
+    copy(frame.slots[slot], value);
+    frame.slots[slot].state = Dirty;
+}
+
+inline void store_move(Frame& frame, uint32_t slot, Operand& value) {
+    move(frame.slots[slot], value);
+    frame.slots[slot].state = Dirty;
+}
+
+inline void set_counter(Operand& slot, int value) {
+    drop(slot);
+    slot.number = value;
+    slot.format = Integer;
+    slot.numeric = 1;
+    slot.truth = 0;
+    slot.state = Dirty;
+}
+
+inline void binary(void* context, int op, const char* op_text, const Operand& left, const Operand& right, Operand& out) {
+    if (left.numeric && right.numeric) {
+        double l = left.number;
+        double r = right.number;
+        switch (op) {
+            case Add:
+                set_number(out, l + r);
+                return;
+            case Subtract:
+                set_number(out, l - r);
+                return;
+            case Multiply:
+                set_number(out, l * r);
+                return;
+            case Divide:
+                if (r == 0) {
+                    throw std::runtime_error("Division by zero");
+                }
+                set_number(out, l / r);
+                return;
+            case Less:
+                runtime->boolean(l < r, &out);
+                return;
+            case Greater:
+                runtime->boolean(l > r, &out);
+                return;
+            case LessEqual:
+                runtime->boolean(l <= r, &out);
+                return;
+            case GreaterEqual:
+                runtime->boolean(l >= r, &out);
+                return;
+            default:
+                break;
+        }
+    }
+    runtime->binary(context, op, op_text, &left, &right, &out);
+}
+
+// A comparison used as a condition
+inline bool compare(void* context, int op, const char* op_text, const Operand& left, const Operand& right) {
+    if (left.numeric && right.numeric) {
+        switch (op) {
+            case Less:
+                return left.number < right.number;
+            case Greater:
+                return left.number > right.number;
+            case LessEqual:
+                return left.number <= right.number;
+            default:
+                return left.number >= right.number;
+        }
+    }
+    Temp result;
+    runtime->binary(context, op, op_text, &left, &right, &result.o);
+    return result.o.truth;
+}
+
+inline void append(Operand& value, const Operand& piece) {
+    if (value.numeric && piece.numeric) {
+        set_number(value, value.number + piece.number);
+    } else {
+        runtime->append(&value, &piece);
+    }
+}
+
+class Iteration {
+public:
+    Iteration(void* context, uint32_t name, const Operand& collection)
+        : context(context), iteration(runtime->foreach_begin(context, name, &collection)) {}
+    ~Iteration() { runtime->foreach_end(context, iteration); }
+    Iteration(const Iteration&) = delete;
+    Iteration& operator=(const Iteration&) = delete;
+
+    bool next(Operand& slot) {
+        if (!runtime->foreach_next(iteration, &slot)) {
+            return false;
+        }
+        slot.state = Dirty;
+        return true;
+    }
+
+private:
+    void* context;
+    void* iteration;
+};
+
+}
+}
+
+#endif // ABYSSIAN_AOT_MODULE
+
+#endif // AOT_ABI_H
@@ -0,0 +1,61 @@
+#include "ast.h"
+#include <stdexcept>
+
+void for_each_child(const ASTNode& node, const std::function<void(const ASTNode&)>& visit) {
+    if (auto block = dynamic_cast<const BlockNode*>(&node)) {
+        for (const auto& statement : block->statements) {
+            visit(*statement);
+        }
+    } else if (auto assignment = dynamic_cast<const AssignmentNode*>(&node)) {
+        visit(*assignment->expression);
+    } else if (auto print = dynamic_cast<const PrintNode*>(&node)) {
+        visit(*print->expression);
+    } else if (auto function = dynamic_cast<const FunctionDeclarationNode*>(&node)) {
+        visit(*function->body);
+    } else if (auto return_node = dynamic_cast<const ReturnNode*>(&node)) {
+        visit(*return_node->expression);
+    } else if (auto binary_expression = dynamic_cast<const BinaryExpressionNode*>(&node)) {
+        visit(*binary_expression->left);
+        visit(*binary_expression->right);
+    } else if (auto function_call = dynamic_cast<const FunctionCallNode*>(&node)) {
+        for (const auto& argument : function_call->arguments) {
+            visit(*argument);
+        }
+    } else if (auto foreach_loop = dynamic_cast<const ForeachLoopNode*>(&node)) {
+        visit(*foreach_loop->collection);
+        visit(*foreach_loop->body);
+    } else if (auto event_listener = dynamic_cast<const EventListenerNode*>(&node)) {
+        visit(*event_listener->body);
+    } else if (auto for_loop = dynamic_cast<const ForLoopNode*>(&node)) {
+        visit(*for_loop->lower_bound);
+        visit(*for_loop->upper_bound);
+        visit(*for_loop->body);
+    } else if (auto while_loop = dynamic_cast<const WhileLoopNode*>(&node)) {
+        visit(*while_loop->condition);
+        visit(*while_loop->body);
+    } else if (auto array_literal = dynamic_cast<const ArrayLiteralNode*>(&node)) {
+        for (const auto& element : array_literal->elements) {
+            visit(*element);
+        }
+    } else if (auto array_index = dynamic_cast<const ArrayIndexNode*>(&node)) {
+        visit(*array_index->index);
+    } else if (auto array_assignment = dynamic_cast<const ArrayAssignmentNode*>(&node)) {
+        visit(*array_assignment->index);
+        visit(*array_assignment->expression);
+    } else if (auto field_access = dynamic_cast<const FieldAccessNode*>(&node)) {
+        visit(*field_access->object);
+    } else if (auto field_assignment = dynamic_cast<const FieldAssignmentNode*>(&node)) {
+        visit(*field_assignment->object);
+        visit(*field_assignment->expression);
+    } else if (!dynamic_cast<const IdentifierNode*>(&node) && !dynamic_cast<const NumberNode*>(&node) &&
+               !dynamic_cast<const StringNode*>(&node) && !dynamic_cast<const NPCActionNode*>(&node) &&
+               !dynamic_cast<const InputNode*>(&node) && !dynamic_cast<const ObjectDeclarationNode*>(&node)) {
+        throw std::runtime_error("Unknown AST node");
+    }
+}
+
+void for_each_child(ASTNode& node, const std::function<void(ASTNode&)>& visit) {
+    for_each_child(static_cast<const ASTNode&>(node), [&visit](const ASTNode& child) {
+        visit(const_cast<ASTNode&>(child));
+    });
+}
@@ -1,14 +1,33 @@
 #ifndef AST_H
 #define AST_H
 
+#include "symbol.h"
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <vector>
 #include <string>
 
 class ASTNode {
 public:
+    int line = 0; // Source line of the token that starts the node
+    // Set by cache_expressions (see optimizer.h). A loop or block that opens a
+    // cache has its id in `cache` and its number of values in `slot`; an
+    // expression whose value is kept there has the owner's id and its index.
+    uint32_t cache = 0;
+    uint32_t slot = 0;
+
     virtual ~ASTNode() = default;
     virtual std::unique_ptr<ASTNode> clone() const = 0;
+
+protected:
+    template <typename T>
+    std::unique_ptr<ASTNode> located(std::unique_ptr<T> node) const {
+        node->line = line;
+        node->cache = cache;
+        node->slot = slot;
+        return node;
+    }
 };
 
 class BlockNode : public ASTNode {
@@ -20,20 +39,20 @@ public:
         for (const auto& stmt : statements) {
             block->statements.push_back(stmt->clone());
         }
-        return block;
+        return located(std::move(block));
     }
 };
 
 class AssignmentNode : public ASTNode {
 public:
-    std::string identifier;
+    Symbol identifier;
     std::unique_ptr<ASTNode> expression;
 
-    AssignmentNode(const std::string& id, std::unique_ptr<ASTNode> expr)
+    AssignmentNode(Symbol id, std::unique_ptr<ASTNode> expr)
         : identifier(id), expression(std::move(expr)) {}
 
     std::unique_ptr<ASTNode> clone() const override {
-        return std::make_unique<AssignmentNode>(identifier, expression->clone());
+        return located(std::make_unique<AssignmentNode>(identifier, expression->clone()));
     }
 };
 
@@ -45,21 +64,30 @@ public:
         : expression(std::move(expr)) {}
 
     std::unique_ptr<ASTNode> clone() const override {
-        return std::make_unique<PrintNode>(expression->clone());
+        return located(std::make_unique<PrintNode>(expression->clone()));
     }
 };
 
 class FunctionDeclarationNode : public ASTNode {
 public:
-    std::string identifier;
-    std::vector<std::string> parameters;
+    Symbol identifier;
+    std::vector<Symbol> parameters;
     std::unique_ptr<BlockNode> body;
+    uint64_t inline_id = 0;  // Set by inline_functions (see optimizer.h) when the body is copied into callers
+    bool declared_pure = false;  // Written `pure fun`: the author promises the result depends only on the arguments
+    bool pure = false;           // Set by mark_pure_functions (see optimizer.h)
+    bool memoized = false;       // Set by it too: calls keep their results by argument values (see memo.h)
 
-    FunctionDeclarationNode(const std::string& id, std::vector<std::string> params, std::unique_ptr<BlockNode> b)
+    FunctionDeclarationNode(Symbol id, std::vector<Symbol> params, std::unique_ptr<BlockNode> b)
         : identifier(id), parameters(std::move(params)), body(std::move(b)) {}
 
     std::unique_ptr<ASTNode> clone() const override {
-        return std::make_unique<FunctionDeclarationNode>(identifier, parameters, std::unique_ptr<BlockNode>(static_cast<BlockNode*>(body->clone().release())));
+        auto function = std::make_unique<FunctionDeclarationNode>(identifier, parameters, std::unique_ptr<BlockNode>(static_cast<BlockNode*>(body->clone().release())));
+        function->inline_id = inline_id;
+        function->declared_pure = declared_pure;
+        function->pure = pure;
+        function->memoized = memoized;
+        return located(std::move(function));
     }
 };
 
@@ -71,33 +99,44 @@ public:
         : expression(std::move(expr)) {}
 
     std::unique_ptr<ASTNode> clone() const override {
-        return std::make_unique<ReturnNode>(expression->clone());
+        return located(std::make_unique<ReturnNode>(expression->clone()));
     }
 };
 
+// What infer_types (see types.h) proved about a binary expression's operands
+enum class BinarySpecialization : uint8_t {
+    Generic,           // Checked when evaluated
+    NumberArithmetic,  // + - * / on two numbers
+    NumberCompare,     // < > <= >= on two numbers
+    Concat             // + where one side is never a number
+};
+
 class BinaryExpressionNode : public ASTNode {
 public:
     std::unique_ptr<ASTNode> left;
     std::string op;
     std::unique_ptr<ASTNode> right;
+    BinarySpecialization specialization = BinarySpecialization::Generic;
 
     BinaryExpressionNode(std::unique_ptr<ASTNode> lhs, const std::string& operator_, std::unique_ptr<ASTNode> rhs)
         : left(std::move(lhs)), op(operator_), right(std::move(rhs)) {}
 
     std::unique_ptr<ASTNode> clone() const override {
-        return std::make_unique<BinaryExpressionNode>(left->clone(), op, right->clone());
+        auto binary = std::make_unique<BinaryExpressionNode>(left->clone(), op, right->clone());
+        binary->specialization = specialization;
+        return located(std::move(binary));
     }
 };
 
 class IdentifierNode : public ASTNode {
 public:
-    std::string identifier;
+    Symbol identifier;
 
-    IdentifierNode(const std::string& id)
+    IdentifierNode(Symbol id)
         : identifier(id) {}
 
     std::unique_ptr<ASTNode> clone() const override {
-        return std::make_unique<IdentifierNode>(identifier);
+        return located(std::make_unique<IdentifierNode>(identifier));
     }
 };
 
@@ -109,28 +148,38 @@ public:
         : value(val) {}
 
     std::unique_ptr<ASTNode> clone() const override {
-        return std::make_unique<NumberNode>(value);
+        return located(std::make_unique<NumberNode>(value));
     }
 };
 
 class StringNode : public ASTNode {
 public:
-    std::string value;
+    std::string value;  // Not interned: literals are data, and their text would stay in the table for good
 
-    StringNode(const std::string& val)
-        : value(val) {}
+    StringNode(std::string val)
+        : value(std::move(val)) {}
 
     std::unique_ptr<ASTNode> clone() const override {
-        return std::make_unique<StringNode>(value);
+        return located(std::make_unique<StringNode>(value));
     }
 };
 
+// A copy of a function's body that inline_functions (see optimizer.h) gave
+// the calls to it
+struct InlinedBody {
+    uint64_t callee;                // FunctionDeclarationNode::inline_id of the copied declaration
+    std::vector<Symbol> parameters;
+    std::unique_ptr<BlockNode> body;
+    std::vector<Symbol> locals;     // Parameters and every variable the body reads or writes
+};
+
 class FunctionCallNode : public ASTNode {
 public:
-    std::string identifier;
+    Symbol identifier;
     std::vector<std::unique_ptr<ASTNode>> arguments;
+    std::shared_ptr<const InlinedBody> inlined;  // Run in place of the call while the callee is unchanged
 
-    FunctionCallNode(const std::string& id)
+    FunctionCallNode(Symbol id)
         : identifier(id) {}
 
     std::unique_ptr<ASTNode> clone() const override {
@@ -138,62 +187,69 @@ public:
         for (const auto& arg : arguments) {
             call->arguments.push_back(arg->clone());
         }
-        return call;
+        call->inlined = inlined;
+        return located(std::move(call));
     }
 };
 
 class ForeachLoopNode : public ASTNode {
 public:
-    std::string identifier;
+    Symbol identifier;
     std::unique_ptr<ASTNode> collection;
     std::unique_ptr<BlockNode> body;
+    bool parallel = false;  // Written `parallel foreach`: iterations run on several threads (see parallel.h)
 
-    ForeachLoopNode(const std::string& id, std::unique_ptr<ASTNode> coll, std::unique_ptr<BlockNode> b)
+    ForeachLoopNode(Symbol id, std::unique_ptr<ASTNode> coll, std::unique_ptr<BlockNode> b)
         : identifier(id), collection(std::move(coll)), body(std::move(b)) {}
 
     std::unique_ptr<ASTNode> clone() const override {
-        return std::make_unique<ForeachLoopNode>(identifier, collection->clone(), std::unique_ptr<BlockNode>(static_cast<BlockNode*>(body->clone().release())));
+        auto loop = std::make_unique<ForeachLoopNode>(identifier, collection->clone(), std::unique_ptr<BlockNode>(static_cast<BlockNode*>(body->clone().release())));
+        loop->parallel = parallel;
+        return located(std::move(loop));
     }
 };
 
 class EventListenerNode : public ASTNode {
 public:
-    std::string event_name;
+    Symbol event_name;
     std::unique_ptr<BlockNode> body;
+    bool declared = false;  // At the top level of the script, so a hot reload replaces it
 
-    EventListenerNode(const std::string& event, std::unique_ptr<BlockNode> b)
+    EventListenerNode(Symbol event, std::unique_ptr<BlockNode> b)
         : event_name(event), body(std::move(b)) {}
 
     std::unique_ptr<ASTNode> clone() const override {
-        return std::make_unique<EventListenerNode>(event_name, std::unique_ptr<BlockNode>(static_cast<BlockNode*>(body->clone().release())));
+        auto listener = std::make_unique<EventListenerNode>(event_name, std::unique_ptr<BlockNode>(static_cast<BlockNode*>(body->clone().release())));
+        listener->declared = declared;
+        return located(std::move(listener));
     }
 };
 
 class NPCActionNode : public ASTNode {
 public:
-    std::string npc_name;
-    std::string action;
+    Symbol npc_name;
+    Symbol action;
 
-    NPCActionNode(const std::string& npc, const std::string& act)
+    NPCActionNode(Symbol npc, Symbol act)
         : npc_name(npc), action(act) {}
 
     std::unique_ptr<ASTNode> clone() const override {
-        return std::make_unique<NPCActionNode>(npc_name, action);
+        return located(std::make_unique<NPCActionNode>(npc_name, action));
     }
 };
 
 class ForLoopNode : public ASTNode {
 public:
-    std::string identifier;
+    Symbol identifier;
     std::unique_ptr<ASTNode> lower_bound;
     std::unique_ptr<ASTNode> upper_bound;
     std::unique_ptr<BlockNode> body;
 
-    ForLoopNode(const std::string& id, std::unique_ptr<ASTNode> lower, std::unique_ptr<ASTNode> upper, std::unique_ptr<BlockNode> b)
+    ForLoopNode(Symbol id, std::unique_ptr<ASTNode> lower, std::unique_ptr<ASTNode> upper, std::unique_ptr<BlockNode> b)
         : identifier(id), lower_bound(std::move(lower)), upper_bound(std::move(upper)), body(std::move(b)) {}
 
     std::unique_ptr<ASTNode> clone() const override {
-        return std::make_unique<ForLoopNode>(identifier, lower_bound->clone(), upper_bound->clone(), std::unique_ptr<BlockNode>(static_cast<BlockNode*>(body->clone().release())));
+        return located(std::make_unique<ForLoopNode>(identifier, lower_bound->clone(), upper_bound->clone(), std::unique_ptr<BlockNode>(static_cast<BlockNode*>(body->clone().release()))));
     }
 };
 
@@ -206,19 +262,19 @@ public:
         : condition(std::move(cond)), body(std::move(b)) {}
 
     std::unique_ptr<ASTNode> clone() const override {
-        return std::make_unique<WhileLoopNode>(condition->clone(), std::unique_ptr<BlockNode>(static_cast<BlockNode*>(body->clone().release())));
+        return located(std::make_unique<WhileLoopNode>(condition->clone(), std::unique_ptr<BlockNode>(static_cast<BlockNode*>(body->clone().release()))));
     }
 };
 
 class InputNode : public ASTNode {
 public:
-    std::string identifier;
+    Symbol identifier;
 
-    InputNode(const std::string& id)
+    InputNode(Symbol id)
         : identifier(id) {}
 
     std::unique_ptr<ASTNode> clone() const override {
-        return std::make_unique<InputNode>(identifier);
+        return located(std::make_unique<InputNode>(identifier));
     }
 };
 
@@ -233,21 +289,79 @@ public:
         for (const auto& element : elements) {
             arrayLiteral->elements.push_back(element->clone());
         }
-        return arrayLiteral;
+        return located(std::move(arrayLiteral));
     }
 };
 
 class ArrayIndexNode : public ASTNode {
 public:
-    std::string arrayName;
+    Symbol arrayName;
     std::unique_ptr<ASTNode> index;
 
-    ArrayIndexNode(const std::string& arrayName, std::unique_ptr<ASTNode> index)
+    ArrayIndexNode(Symbol arrayName, std::unique_ptr<ASTNode> index)
         : arrayName(arrayName), index(std::move(index)) {}
 
     std::unique_ptr<ASTNode> clone() const override {
-        return std::make_unique<ArrayIndexNode>(arrayName, index->clone());
+        return located(std::make_unique<ArrayIndexNode>(arrayName, index->clone()));
+    }
+};
+
+class ArrayAssignmentNode : public ASTNode {
+public:
+    Symbol arrayName;
+    std::unique_ptr<ASTNode> index;
+    std::unique_ptr<ASTNode> expression;
+
+    ArrayAssignmentNode(Symbol arrayName, std::unique_ptr<ASTNode> index, std::unique_ptr<ASTNode> expr)
+        : arrayName(arrayName), index(std::move(index)), expression(std::move(expr)) {}
+
+    std::unique_ptr<ASTNode> clone() const override {
+        return located(std::make_unique<ArrayAssignmentNode>(arrayName, index->clone(), expression->clone()));
+    }
+};
+
+// `object name`: binds a new, empty object to the variable
+class ObjectDeclarationNode : public ASTNode {
+public:
+    Symbol identifier;
+
+    ObjectDeclarationNode(Symbol id)
+        : identifier(id) {}
+
+    std::unique_ptr<ASTNode> clone() const override {
+        return located(std::make_unique<ObjectDeclarationNode>(identifier));
     }
 };
 
+class FieldAccessNode : public ASTNode {
+public:
+    std::unique_ptr<ASTNode> object;
+    Symbol field;
+
+    FieldAccessNode(std::unique_ptr<ASTNode> object, Symbol field)
+        : object(std::move(object)), field(field) {}
+
+    std::unique_ptr<ASTNode> clone() const override {
+        return located(std::make_unique<FieldAccessNode>(object->clone(), field));
+    }
+};
+
+class FieldAssignmentNode : public ASTNode {
+public:
+    std::unique_ptr<ASTNode> object;
+    Symbol field;
+    std::unique_ptr<ASTNode> expression;
+
+    FieldAssignmentNode(std::unique_ptr<ASTNode> object, Symbol field, std::unique_ptr<ASTNode> expr)
+        : object(std::move(object)), field(field), expression(std::move(expr)) {}
+
+    std::unique_ptr<ASTNode> clone() const override {
+        return located(std::make_unique<FieldAssignmentNode>(object->clone(), field, expression->clone()));
+    }
+};
+
+// Calls `visit` on each direct child of `node`, in evaluation order
+void for_each_child(const ASTNode& node, const std::function<void(const ASTNode&)>& visit);
+void for_each_child(ASTNode& node, const std::function<void(ASTNode&)>& visit);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,234 @@
+#include "batch.h"
+#include "input.h"
+#include "interpreter.h"
+#include "lexer.h"
+#include "parser.h"
+#include "thread_pool.h"
+#include "utils.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double ms_since(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+struct ParsedSource {
+    const std::string* text;
+    std::unique_ptr<ASTNode> ast;
+    std::string error;
+    double parse_ms = 0;
+};
+
+// Discards the lexer and parser trace and diagnostics of the current thread
+class QuietFrontend {
+public:
+    QuietFrontend() {
+        set_trace_stream(&nowhere);
+        set_diagnostic_stream(&nowhere);
+    }
+    ~QuietFrontend() {
+        set_trace_stream(nullptr);
+        set_diagnostic_stream(nullptr);
+    }
+
+private:
+    std::ostream nowhere{nullptr};
+};
+
+}
+
+std::vector<std::string> collect_batch_files(const std::string& path) {
+    std::vector<std::string> files;
+    if (fs::is_directory(path)) {
+        for (const auto& entry : fs::recursive_directory_iterator(path)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".aby") {
+                files.push_back(entry.path().string());
+            }
+        }
+        std::sort(files.begin(), files.end());
+        return files;
+    }
+
+    std::ifstream manifest(path);
+    if (!manifest.is_open()) {
+        throw std::runtime_error("Could not open file: " + path);
+    }
+    fs::path base = fs::path(path).parent_path();
+    std::string line;
+    while (std::getline(manifest, line)) {
+        line.erase(0, line.find_first_not_of(" \t\r"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        fs::path file(line);
+        files.push_back(file.is_absolute() ? file.string() : (base / file).string());
+    }
+    return files;
+}
+
+BatchReport run_batch(const std::vector<std::string>& files, size_t jobs) {
+    BatchReport report;
+    auto total_start = Clock::now();
+    ThreadPool pool(jobs);
+    report.threads = pool.size();
+    report.files.resize(files.size());
+
+    // Read
+    auto phase_start = Clock::now();
+    std::vector<std::string> texts(files.size());
+    {
+        std::vector<std::future<void>> reads;
+        for (size_t i = 0; i < files.size(); ++i) {
+            report.files[i].path = files[i];
+            reads.push_back(pool.submit([&texts, &report, &files, i] {
+                try {
+                    texts[i] = read_file(files[i]);
+                } catch (const std::exception& e) {
+                    report.files[i].error = e.what();
+                }
+            }));
+        }
+        for (auto& read : reads) {
+            read.get();
+        }
+    }
+    report.read_ms = ms_since(phase_start);
+
+    // Deduplicate by hash, comparing the text on a hash match
+    std::vector<ParsedSource> sources;
+    std::vector<size_t> source_of(files.size(), 0);
+    std::unordered_map<uint64_t, std::vector<size_t>> by_hash;
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (!report.files[i].error.empty()) {
+            continue;
+        }
+        uint64_t hash = hash_source(texts[i]);
+        report.files[i].hash = hash;
+        auto& candidates = by_hash[hash];
+        auto match = std::find_if(candidates.begin(), candidates.end(),
+                                  [&](size_t source) { return *sources[source].text == texts[i]; });
+        if (match != candidates.end()) {
+            source_of[i] = *match;
+            report.files[i].reused_parse = true;
+        } else {
+            source_of[i] = sources.size();
+            candidates.push_back(sources.size());
+            sources.push_back({&texts[i], nullptr, "", 0});
+        }
+    }
+    report.unique_sources = sources.size();
+
+    // Lex and parse each distinct source once
+    phase_start = Clock::now();
+    {
+        std::vector<std::future<void>> parses;
+        for (auto& source : sources) {
+            parses.push_back(pool.submit([&source] {
+                QuietFrontend quiet;
+                auto start = Clock::now();
+                try {
+                    Lexer lexer(*source.text);
+                    auto tokens = lexer.tokenize();
+                    Parser parser(tokens);
+                    source.ast = parser.parse();
+                } catch (const std::exception& e) {
+                    source.error = e.what();
+                }
+                source.parse_ms = ms_since(start);
+            }));
+        }
+        for (auto& parse : parses) {
+            parse.get();
+        }
+    }
+    report.parse_ms = ms_since(phase_start);
+
+    // Execute every file in its own interpreter
+    phase_start = Clock::now();
+    {
+        std::vector<std::future<void>> runs;
+        for (size_t i = 0; i < files.size(); ++i) {
+            BatchFileResult& result = report.files[i];
+            if (!result.error.empty()) {
+                continue;
+            }
+            const ParsedSource& source = sources[source_of[i]];
+            if (!result.reused_parse) {
+                result.parse_ms = source.parse_ms;
+            }
+            if (!source.error.empty()) {
+                result.error = source.error;
+                continue;
+            }
+            runs.push_back(pool.submit([&result, &source] {
+                QuietFrontend quiet;
+                std::ostringstream output;
+                // Jobs share the process's std::cin; `input` reads an empty line instead
+                QueueInput no_input(std::vector<std::string>{});
+                auto start = Clock::now();
+                try {
+                    Interpreter interpreter;
+                    interpreter.set_output(output);
+                    interpreter.set_input(&no_input);
+                    interpreter.interpret(source.ast->clone());
+                    interpreter.execute();
+                    result.passed = true;
+                } catch (const std::exception& e) {
+                    result.error = e.what();
+                }
+                result.execute_ms = ms_since(start);
+                result.output = output.str();
+            }));
+        }
+        for (auto& run : runs) {
+            run.get();
+        }
+    }
+    report.execute_ms = ms_since(phase_start);
+
+    report.failed = static_cast<size_t>(std::count_if(report.files.begin(), report.files.end(),
+                                                      [](const BatchFileResult& result) { return !result.passed; }));
+    report.total_ms = ms_since(total_start);
+    return report;
+}
+
+void write_batch_report(std::ostream& out, const BatchReport& report, bool show_output) {
+    std::ios_base::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(3);
+    for (const auto& file : report.files) {
+        if (file.passed) {
+            out << "ok    " << file.path << "  parse ";
+            if (file.reused_parse) {
+                out << "(cached)";
+            } else {
+                out << file.parse_ms << " ms";
+            }
+            out << "  execute " << file.execute_ms << " ms\n";
+        } else {
+            out << "FAIL  " << file.path << "  " << file.error << "\n";
+        }
+        if (show_output && !file.output.empty()) {
+            out << file.output;
+        }
+    }
+    out << report.files.size() << " files, " << report.unique_sources << " unique sources, "
+        << report.files.size() - report.failed << " passed, " << report.failed << " failed\n";
+    out << "read " << report.read_ms << " ms, lex+parse " << report.parse_ms << " ms, execute "
+        << report.execute_ms << " ms, total " << report.total_ms << " ms (" << report.threads << " threads)\n";
+    out.flags(flags);
+}
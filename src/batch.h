@@ -0,0 +1,45 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct BatchFileResult {
+    std::string path;
+    uint64_t hash = 0;
+    bool reused_parse = false;  // Same text as an earlier file, so its tree was reused
+    bool passed = false;
+    std::string error;
+    std::string output;
+    double parse_ms = 0;  // Lexing and parsing; zero when reused
+    double execute_ms = 0;
+};
+
+struct BatchReport {
+    std::vector<BatchFileResult> files;
+    size_t unique_sources = 0;
+    size_t failed = 0;
+    size_t threads = 0;
+    double read_ms = 0;
+    double parse_ms = 0;    // Wall time of the parallel lex and parse phase
+    double execute_ms = 0;  // Wall time of the parallel execution phase
+    double total_ms = 0;
+};
+
+// Scripts named by `path`: every .aby file below a directory, or the lines of
+// a manifest file (relative paths resolve against the manifest's directory,
+// blank lines and lines starting with '#' are skipped)
+std::vector<std::string> collect_batch_files(const std::string& path);
+
+// Reads the files and lexes and parses each distinct source once, in parallel
+// on `jobs` threads (0 for one per core). Every file then executes in its own
+// interpreter, also in parallel, with its output captured in its result.
+BatchReport run_batch(const std::vector<std::string>& files, size_t jobs = 0);
+
+// One line per file followed by totals; with `show_output` each file's
+// program output follows its line
+void write_batch_report(std::ostream& out, const BatchReport& report, bool show_output);
+
+#endif // BATCH_H
@@ -0,0 +1,228 @@
+#include "event_bus.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr uint32_t BUS_MAGIC = 0x53554241;  // "ABUS"
+constexpr uint32_t BUS_VERSION = 1;
+
+struct BusHeader {
+    std::atomic<uint32_t> magic{0};  // Stored last by the creator
+    uint32_t version = BUS_VERSION;
+    uint64_t capacity = 0;
+    RingIndices to_script;
+    RingIndices to_host;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared-memory rings need lock-free 64-bit atomics");
+
+size_t region_size_for(uint64_t capacity) {
+    return sizeof(BusHeader) + 2 * capacity * sizeof(BusRecord);
+}
+
+BusRecord* records_to_script(void* region) {
+    return reinterpret_cast<BusRecord*>(static_cast<char*>(region) + sizeof(BusHeader));
+}
+
+BusRecord* records_to_host(void* region, uint64_t capacity) {
+    return records_to_script(region) + capacity;
+}
+
+void copy_text(char* field, size_t size, const std::string& text) {
+    std::memset(field, 0, size);
+    std::memcpy(field, text.data(), std::min(text.size(), size));
+}
+
+std::string field_text(const char* field, size_t size) {
+    return std::string(field, strnlen(field, size));
+}
+
+std::string shm_name(const std::string& name) {
+    return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+
+}
+
+BusRecord BusRecord::make(RecordKind kind, const std::string& name, const std::string& payload) {
+    BusRecord record;
+    record.kind = kind;
+    record.sequence = 0;
+    copy_text(record.name, sizeof(record.name), name);
+    copy_text(record.payload, sizeof(record.payload), payload);
+    return record;
+}
+
+std::string BusRecord::name_text() const {
+    return field_text(name, sizeof(name));
+}
+
+std::string BusRecord::payload_text() const {
+    return field_text(payload, sizeof(payload));
+}
+
+SpscRing::SpscRing(RingIndices* indices, BusRecord* records, uint64_t capacity)
+    : indices(indices), records(records), mask(capacity - 1) {
+    cached_head = indices->head.load(std::memory_order_acquire);
+    cached_tail = indices->tail.load(std::memory_order_acquire);
+}
+
+bool SpscRing::try_push(const BusRecord& record) {
+    uint64_t tail = indices->tail.load(std::memory_order_relaxed);
+    if (tail - cached_head > mask) {
+        // Only look at the consumer's index when the ring seems full
+        cached_head = indices->head.load(std::memory_order_acquire);
+        if (tail - cached_head > mask) {
+            return false;
+        }
+    }
+    records[tail & mask] = record;
+    indices->tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+bool SpscRing::try_pop(BusRecord& record) {
+    uint64_t head = indices->head.load(std::memory_order_relaxed);
+    if (head == cached_tail) {
+        cached_tail = indices->tail.load(std::memory_order_acquire);
+        if (head == cached_tail) {
+            return false;
+        }
+    }
+    record = records[head & mask];
+    indices->head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+size_t SpscRing::size() const {
+    return static_cast<size_t>(indices->tail.load(std::memory_order_acquire) - indices->head.load(std::memory_order_acquire));
+}
+
+EventBus::EventBus(const std::string& name, Side side, void* region, size_t size)
+    : name(name), bus_side(side), region(region), region_size(size) {
+    auto* header = static_cast<BusHeader*>(region);
+    SpscRing to_script(&header->to_script, records_to_script(region), header->capacity);
+    SpscRing to_host(&header->to_host, records_to_host(region, header->capacity), header->capacity);
+    incoming = side == Side::Host ? to_host : to_script;
+    outgoing = side == Side::Host ? to_script : to_host;
+}
+
+bool EventBus::send(RecordKind kind, const std::string& name, const std::string& payload) {
+    return send(BusRecord::make(kind, name, payload));
+}
+
+bool EventBus::send(BusRecord record) {
+    record.sequence = next_sequence;
+    if (!outgoing.try_push(record)) {
+        return false;
+    }
+    ++next_sequence;
+    return true;
+}
+
+bool EventBus::receive(BusRecord& record) {
+    return incoming.try_pop(record);
+}
+
+EventBus::Side EventBus::side() const {
+    return bus_side;
+}
+
+uint64_t EventBus::capacity() const {
+    return static_cast<const BusHeader*>(region)->capacity;
+}
+
+#ifndef _WIN32
+
+std::unique_ptr<EventBus> EventBus::create(const std::string& name, size_t capacity) {
+    uint64_t rounded = 1;
+    while (rounded < capacity) {
+        rounded <<= 1;
+    }
+    size_t size = region_size_for(rounded);
+
+    // A bus of the same name belongs to another host, or one that crashed; it is never taken over
+    std::string path = shm_name(name);
+    int fd = shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0 && errno == EEXIST) {
+        throw std::runtime_error("Event bus already exists: " + name + " (remove /dev/shm" + path + " if no host is using it)");
+    }
+    if (fd < 0) {
+        throw std::runtime_error("Could not create event bus: " + name);
+    }
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        close(fd);
+        shm_unlink(path.c_str());
+        throw std::runtime_error("Could not size event bus: " + name);
+    }
+    void* region = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (region == MAP_FAILED) {
+        shm_unlink(path.c_str());
+        throw std::runtime_error("Could not map event bus: " + name);
+    }
+
+    auto* header = new (region) BusHeader();
+    header->capacity = rounded;
+    header->magic.store(BUS_MAGIC, std::memory_order_release);
+    return std::unique_ptr<EventBus>(new EventBus(path, Side::Host, region, size));
+}
+
+std::unique_ptr<EventBus> EventBus::open(const std::string& name) {
+    std::string path = shm_name(name);
+    int fd = shm_open(path.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open event bus: " + name);
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(BusHeader)) {
+        close(fd);
+        throw std::runtime_error("Event bus is not initialized: " + name);
+    }
+    size_t size = static_cast<size_t>(info.st_size);
+    void* region = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (region == MAP_FAILED) {
+        throw std::runtime_error("Could not map event bus: " + name);
+    }
+
+    auto* header = static_cast<BusHeader*>(region);
+    if (header->magic.load(std::memory_order_acquire) != BUS_MAGIC || header->version != BUS_VERSION ||
+        header->capacity == 0 || (header->capacity & (header->capacity - 1)) != 0 ||
+        region_size_for(header->capacity) > size) {
+        munmap(region, size);
+        throw std::runtime_error("Not an event bus: " + name);
+    }
+    return std::unique_ptr<EventBus>(new EventBus(path, Side::Script, region, size));
+}
+
+EventBus::~EventBus() {
+    munmap(region, region_size);
+    if (bus_side == Side::Host) {
+        shm_unlink(name.c_str());
+    }
+}
+
+#else
+
+std::unique_ptr<EventBus> EventBus::create(const std::string& name, size_t) {
+    throw std::runtime_error("The event bus needs POSIX shared memory: " + name);
+}
+
+std::unique_ptr<EventBus> EventBus::open(const std::string& name) {
+    throw std::runtime_error("The event bus needs POSIX shared memory: " + name);
+}
+
+EventBus::~EventBus() {}
+
+#endif
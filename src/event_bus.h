@@ -0,0 +1,97 @@
+#ifndef EVENT_BUS_H
+#define EVENT_BUS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+enum class RecordKind : uint32_t {
+    WorldEvent = 1,  // Host to script: run the listeners of `name` with `payload` as event_data
+    NPCAction = 2,   // Script to host: `npc` NPC performs `action` (an NPCActionNode)
+    Close = 3,       // Host to script: stop polling
+};
+
+// Fixed-size record exchanged in both directions. Text fields are NUL padded
+// and truncated to fit.
+struct BusRecord {
+    RecordKind kind;
+    uint32_t sequence;      // Assigned by the sender, counting from 0
+    char name[56];          // Event name or NPC name
+    char payload[192];      // Event data or NPC action
+
+    static BusRecord make(RecordKind kind, const std::string& name, const std::string& payload);
+    std::string name_text() const;
+    std::string payload_text() const;
+};
+static_assert(sizeof(BusRecord) == 256, "BusRecord is part of the shared-memory format");
+
+// Indices of one ring; head and tail sit on separate cache lines so the two
+// sides do not invalidate each other's line on every record
+struct RingIndices {
+    alignas(64) std::atomic<uint64_t> head{0};  // Next record to read, written by the consumer
+    alignas(64) std::atomic<uint64_t> tail{0};  // Next free slot, written by the producer
+};
+
+// Single-producer single-consumer queue over memory it does not own. Exactly
+// one thread may push and one may pop; neither blocks nor makes system calls.
+class SpscRing {
+public:
+    SpscRing() = default;
+    SpscRing(RingIndices* indices, BusRecord* records, uint64_t capacity);
+
+    bool try_push(const BusRecord& record);
+    bool try_pop(BusRecord& record);
+    size_t size() const;
+
+private:
+    RingIndices* indices = nullptr;
+    BusRecord* records = nullptr;
+    uint64_t mask = 0;
+    uint64_t cached_head = 0;  // Producer's last view of head
+    uint64_t cached_tail = 0;  // Consumer's last view of tail
+};
+
+// A POSIX shared-memory region holding one ring in each direction between a
+// game host process and a script runtime:
+//
+//   header (magic, version, capacity, ring indices), host-to-script records,
+//   script-to-host records
+//
+// The host creates the region and removes it when destroyed; the runtime opens
+// it by name. Creating a bus whose name is taken fails rather than replacing it. Each side is the only producer of its outgoing ring and the only
+// consumer of its incoming one.
+class EventBus {
+public:
+    enum class Side { Host, Script };
+
+    // `capacity` is rounded up to a power of two
+    static std::unique_ptr<EventBus> create(const std::string& name, size_t capacity = 4096);
+    static std::unique_ptr<EventBus> open(const std::string& name);
+    ~EventBus();
+    EventBus(const EventBus&) = delete;
+    EventBus& operator=(const EventBus&) = delete;
+
+    // Non-blocking; send returns false when the outgoing ring is full and
+    // receive returns false when the incoming ring is empty
+    bool send(RecordKind kind, const std::string& name, const std::string& payload);
+    bool send(BusRecord record);
+    bool receive(BusRecord& record);
+
+    Side side() const;
+    uint64_t capacity() const;
+
+private:
+    EventBus(const std::string& name, Side side, void* region, size_t size);
+
+    std::string name;
+    Side bus_side;
+    void* region;
+    size_t region_size;
+    SpscRing incoming;
+    SpscRing outgoing;
+    uint32_t next_sequence = 0;
+};
+
+#endif // EVENT_BUS_H
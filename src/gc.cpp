@@ -0,0 +1,286 @@
+#include "gc.h"
+#include "stats.h"
+#include <algorithm>
+#include <new>
+#include <stdexcept>
+
+namespace {
+
+const size_t BLOCK_ALIGNMENT = alignof(std::max_align_t);
+
+// Checking the clock costs more than scanning an object, so steps look at it
+// only after this many objects
+const size_t WORK_BETWEEN_CLOCK_CHECKS = 64;
+
+size_t fields_in_class(uint32_t size_class) {
+    return size_t(4) << size_class;
+}
+
+}
+
+bool holds_objects(const Value& value) {
+    if (value.is_object()) {
+        return true;
+    }
+    if (value.is_array()) {
+        for (const Value& element : value.elements()) {
+            if (holds_objects(element)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+Pool::Pool(size_t block_size)
+    : block_size((std::max(block_size, sizeof(FreeBlock)) + BLOCK_ALIGNMENT - 1) / BLOCK_ALIGNMENT * BLOCK_ALIGNMENT),
+      chunk_size(std::max(CHUNK_SIZE, this->block_size)),
+      chunk_used(chunk_size) {}
+
+void* Pool::allocate() {
+    if (free_list) {
+        FreeBlock* block = free_list;
+        free_list = block->next;
+        return block;
+    }
+    if (chunk_used + block_size > chunk_size) {
+        chunks.push_back(std::make_unique<char[]>(chunk_size));
+        chunk_used = 0;
+    }
+    void* block = chunks.back().get() + chunk_used;
+    chunk_used += block_size;
+    return block;
+}
+
+void Pool::release(void* block) {
+    free_list = new (block) FreeBlock{free_list};
+}
+
+size_t Pool::reserved_bytes() const {
+    return chunks.size() * chunk_size;
+}
+
+const Value* ScriptObject::find(Symbol name) const {
+    for (const ObjectField& field : *this) {
+        if (field.name == name) {
+            return &field.value;
+        }
+    }
+    return nullptr;
+}
+
+Heap::Heap() : object_pool(sizeof(ScriptObject)) {}
+
+Heap::~Heap() {
+    while (objects) {
+        ScriptObject* next = objects->next;
+        free_object(objects);
+        objects = next;
+    }
+}
+
+ScriptObject* Heap::allocate() {
+    auto* object = new (object_pool.allocate()) ScriptObject();
+    // Objects allocated during a cycle survive it: they are marked already and
+    // sit before the sweep position
+    object->mark_epoch = epoch;
+    object->next = objects;
+    objects = object;
+    ++allocated_since_cycle;
+    ++counters.objects_allocated;
+    stats::add(stats::HeapAllocations);
+    stats::add(stats::HeapBytes, sizeof(ScriptObject));
+    ++counters.live_objects;
+    return object;
+}
+
+void Heap::store(ScriptObject* object, Symbol name, Value value) {
+    if (current_phase == Phase::Mark && object->mark_epoch == epoch) {
+        mark(value);
+    }
+    for (uint32_t i = 0; i < object->count; ++i) {
+        if (object->fields[i].name == name) {
+            object->fields[i].value = std::move(value);
+            return;
+        }
+    }
+    if (!object->fields || object->count == fields_in_class(object->size_class)) {
+        uint32_t size_class = object->fields ? object->size_class + 1 : 0;
+        ObjectField* fields = allocate_fields(size_class);
+        for (uint32_t i = 0; i < object->count; ++i) {
+            new (&fields[i]) ObjectField{object->fields[i].name, std::move(object->fields[i].value)};
+            object->fields[i].~ObjectField();
+        }
+        if (object->fields) {
+            release_fields(object->fields, object->size_class);
+        }
+        object->fields = fields;
+        object->size_class = size_class;
+    }
+    new (&object->fields[object->count]) ObjectField{name, std::move(value)};
+    ++object->count;
+}
+
+void Heap::mark(const Value& value) {
+    if (value.is_object()) {
+        ScriptObject* object = value.as_object();
+        if (object->mark_epoch != epoch) {
+            object->mark_epoch = epoch;
+            gray.push_back(object);
+        }
+    } else if (value.is_array()) {
+        for (const Value& element : value.elements()) {
+            mark(element);
+        }
+    }
+}
+
+bool Heap::wants_collection() const {
+    return current_phase != Phase::Idle || allocated_since_cycle >= trigger;
+}
+
+bool Heap::step(const RootScanner& roots, std::chrono::nanoseconds budget) {
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = budget >= std::chrono::steady_clock::time_point::max() - start ? std::chrono::steady_clock::time_point::max() : start + budget;
+    if (current_phase == Phase::Idle) {
+        begin_cycle(roots);
+    }
+    if (current_phase == Phase::Mark && mark_some(deadline)) {
+        // Variables changed since the cycle began; whatever they reach now
+        // must survive, so marking finishes without a deadline
+        roots(*this);
+        mark_some(std::chrono::steady_clock::time_point::max());
+        current_phase = Phase::Sweep;
+        sweep_link = &objects;
+    }
+    if (current_phase == Phase::Sweep && sweep_some(deadline)) {
+        current_phase = Phase::Idle;
+        allocated_since_cycle = 0;
+        trigger = std::max<size_t>(MIN_TRIGGER, counters.live_objects);
+        ++counters.collections;
+        stats::add(stats::GcCollections);
+    }
+
+    uint64_t pause = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    ++counters.steps;
+    counters.last_pause_ns = pause;
+    counters.max_pause_ns = std::max(counters.max_pause_ns, pause);
+    counters.total_pause_ns += pause;
+    stats::note_gc_pause(pause);
+    return current_phase == Phase::Idle;
+}
+
+void Heap::collect(const RootScanner& roots) {
+    if (current_phase != Phase::Idle) {
+        step(roots, std::chrono::nanoseconds::max());
+    }
+    step(roots, std::chrono::nanoseconds::max());
+}
+
+void Heap::begin_cycle(const RootScanner& roots) {
+    ++epoch;
+    current_phase = Phase::Mark;
+    gray.clear();
+    roots(*this);
+}
+
+bool Heap::mark_some(std::chrono::steady_clock::time_point deadline) {
+    size_t work = 0;
+    while (!gray.empty()) {
+        ScriptObject* object = gray.back();
+        gray.pop_back();
+        scan(*object);
+        if (++work % WORK_BETWEEN_CLOCK_CHECKS == 0 && std::chrono::steady_clock::now() >= deadline) {
+            return gray.empty();
+        }
+    }
+    return true;
+}
+
+void Heap::scan(const ScriptObject& object) {
+    for (const ObjectField& field : object) {
+        mark(field.value);
+    }
+}
+
+bool Heap::sweep_some(std::chrono::steady_clock::time_point deadline) {
+    size_t work = 0;
+    while (*sweep_link) {
+        ScriptObject* object = *sweep_link;
+        if (object->mark_epoch == epoch) {
+            sweep_link = &object->next;
+        } else {
+            *sweep_link = object->next;
+            free_object(object);
+            ++counters.objects_freed;
+            stats::add(stats::GcObjectsFreed);
+        }
+        if (++work % WORK_BETWEEN_CLOCK_CHECKS == 0 && std::chrono::steady_clock::now() >= deadline) {
+            return *sweep_link == nullptr;
+        }
+    }
+    return true;
+}
+
+void Heap::free_object(ScriptObject* object) {
+    for (uint32_t i = 0; i < object->count; ++i) {
+        object->fields[i].~ObjectField();
+    }
+    if (object->fields) {
+        release_fields(object->fields, object->size_class);
+    }
+    object->~ScriptObject();
+    object_pool.release(object);
+    --counters.live_objects;
+}
+
+ObjectField* Heap::allocate_fields(uint32_t size_class) {
+    while (field_pools.size() <= size_class) {
+        field_pools.push_back(std::make_unique<Pool>(fields_in_class(static_cast<uint32_t>(field_pools.size())) * sizeof(ObjectField)));
+    }
+    stats::add(stats::HeapAllocations);
+    stats::add(stats::HeapBytes, fields_in_class(size_class) * sizeof(ObjectField));
+    return static_cast<ObjectField*>(field_pools[size_class]->allocate());
+}
+
+void Heap::release_fields(ObjectField* fields, uint32_t size_class) {
+    field_pools[size_class]->release(fields);
+}
+
+Value Heap::import(const Value& value, std::unordered_map<const ScriptObject*, ScriptObject*>& copies) {
+    if (value.is_object()) {
+        const ScriptObject* original = value.as_object();
+        auto it = copies.find(original);
+        if (it != copies.end()) {
+            return Value::object(it->second);
+        }
+        ScriptObject* copy = allocate();
+        copies[original] = copy;
+        for (const ObjectField& field : *original) {
+            store(copy, field.name, import(field.value, copies));
+        }
+        return Value::object(copy);
+    }
+    if (!holds_objects(value)) {
+        return value;  // Shared with the original
+    }
+    std::vector<Value> elements;
+    elements.reserve(value.elements().size());
+    for (const Value& element : value.elements()) {
+        elements.push_back(import(element, copies));
+    }
+    return Value::array(std::move(elements));
+}
+
+Heap::Phase Heap::phase() const {
+    return current_phase;
+}
+
+GcStats Heap::stats() const {
+    GcStats result = counters;
+    result.pool_bytes = object_pool.reserved_bytes();
+    for (const auto& pool : field_pools) {
+        result.pool_bytes += pool->reserved_bytes();
+    }
+    return result;
+}
@@ -0,0 +1,163 @@
+#ifndef GC_H
+#define GC_H
+
+#include "symbol.h"
+#include "value.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Fixed-size blocks carved out of large chunks. Released blocks go on a free
+// list and are handed out again before another chunk is taken; chunks are
+// returned only when the pool is destroyed.
+class Pool {
+public:
+    explicit Pool(size_t block_size);
+    Pool(const Pool&) = delete;
+    Pool& operator=(const Pool&) = delete;
+
+    void* allocate();
+    void release(void* block);
+    size_t reserved_bytes() const;
+
+private:
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    size_t block_size;
+    size_t chunk_size;
+    std::vector<std::unique_ptr<char[]>> chunks;
+    size_t chunk_used;  // Bytes handed out from the newest chunk
+    FreeBlock* free_list = nullptr;
+};
+
+struct ObjectField {
+    Symbol name;
+    Value value;
+};
+
+// A script object: named fields, shared by reference between every variable,
+// array and object that holds it. Objects belong to the Heap that allocated
+// them and are freed only by its collector; fields are written through
+// Heap::store so the collector sees every change.
+class ScriptObject {
+public:
+    // nullptr when the object has no such field
+    const Value* find(Symbol name) const;
+
+    const ObjectField* begin() const { return fields; }
+    const ObjectField* end() const { return fields + count; }
+    size_t size() const { return count; }
+
+private:
+    friend class Heap;
+
+    ScriptObject* next = nullptr;  // Every object of the heap, newest first
+    uint32_t mark_epoch = 0;
+    uint32_t count = 0;
+    uint32_t size_class = 0;       // The field table holds 4 << size_class fields
+    ObjectField* fields = nullptr;
+};
+
+struct GcStats {
+    uint64_t collections = 0;        // Completed cycles
+    uint64_t steps = 0;              // Increments of collector work, each one pause
+    uint64_t objects_allocated = 0;
+    uint64_t objects_freed = 0;
+    uint64_t live_objects = 0;       // Allocated and not freed yet, garbage included
+    uint64_t pool_bytes = 0;         // Reserved by the object and field-table pools
+    uint64_t last_pause_ns = 0;
+    uint64_t max_pause_ns = 0;
+    uint64_t total_pause_ns = 0;
+};
+
+// Managed heap for script objects with an incremental mark-sweep collector.
+//
+// A cycle marks everything reachable from the roots, then sweeps the list of
+// objects and frees the rest, so objects that only reference each other (a
+// guard in its allies' `allies` arrays) are reclaimed. Both phases run in
+// steps bounded by a time budget, interleaved with the script:
+//
+//   - Marking is tri-color. Objects allocated while a cycle runs start out
+//     marked, and storing a value into a marked object marks the value too, so
+//     a scanned object never points at an unmarked one. Variables are not
+//     watched: before sweeping, the roots are scanned once more and marking
+//     finishes in the same step.
+//   - Each cycle uses a new mark epoch, so no pass is needed to clear marks.
+//
+// Arrays are reference counted values (see value.h) and cannot contain
+// themselves; the collector traces through them to the objects they hold, and
+// they are released together with the last object or variable holding them.
+class Heap {
+public:
+    enum class Phase { Idle, Mark, Sweep };
+
+    // Calls Heap::mark on every root; invoked when a cycle starts and again
+    // before it sweeps
+    using RootScanner = std::function<void(Heap&)>;
+
+    Heap();
+    ~Heap();
+    Heap(const Heap&) = delete;
+    Heap& operator=(const Heap&) = delete;
+
+    ScriptObject* allocate();
+    void store(ScriptObject* object, Symbol name, Value value);
+
+    // Marks the objects `value` holds, directly or through arrays
+    void mark(const Value& value);
+
+    // Whether a cycle is running or enough has been allocated to start one
+    bool wants_collection() const;
+    // Does collector work for about `budget`, starting a cycle if none is
+    // running; returns true once the cycle has finished
+    bool step(const RootScanner& roots, std::chrono::nanoseconds budget);
+    // Finishes the running cycle, if any, and runs a complete one
+    void collect(const RootScanner& roots);
+
+    // Copies `value` from another heap into this one: the objects it holds
+    // are copied, and values without objects are shared. `copies` maps the
+    // objects copied so far, so shared and cyclic references stay shared.
+    Value import(const Value& value, std::unordered_map<const ScriptObject*, ScriptObject*>& copies);
+
+    Phase phase() const;
+    GcStats stats() const;
+
+private:
+    // Cycles start once this many objects were allocated since the last one,
+    // or as many as survived it if that is more
+    static constexpr size_t MIN_TRIGGER = 1024;
+
+    void begin_cycle(const RootScanner& roots);
+    bool mark_some(std::chrono::steady_clock::time_point deadline);
+    bool sweep_some(std::chrono::steady_clock::time_point deadline);
+    void scan(const ScriptObject& object);
+    void free_object(ScriptObject* object);
+    ObjectField* allocate_fields(uint32_t size_class);
+    void release_fields(ObjectField* fields, uint32_t size_class);
+
+    Pool object_pool;
+    std::vector<std::unique_ptr<Pool>> field_pools;  // One per size class
+
+    ScriptObject* objects = nullptr;
+    ScriptObject** sweep_link = nullptr;  // Link to the next object to sweep
+    std::vector<ScriptObject*> gray;  // Marked but not scanned yet
+    Phase current_phase = Phase::Idle;
+    uint32_t epoch = 0;
+    size_t allocated_since_cycle = 0;
+    size_t trigger = MIN_TRIGGER;
+
+    GcStats counters;
+};
+
+// Whether `value` is an object or an array holding one, at any depth
+bool holds_objects(const Value& value);
+
+#endif // GC_H
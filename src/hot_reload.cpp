@@ -0,0 +1,89 @@
+#include "interpreter.h"
+#include "incremental.h"
+#include "types.h"
+#include <algorithm>
+
+void Interpreter::interpret_source(const std::string& source) {
+    auto parsed = std::make_unique<IncrementalFrontend>(source);
+    interpret(parsed->parse());
+    frontend = std::move(parsed);
+}
+
+ReloadSummary Interpreter::reload(const std::string& source) {
+    ReloadSummary summary;
+
+    // Parse before touching live state so a syntax error leaves the old code running.
+    // The incremental front end only re-lexes and re-parses the changed region.
+    if (!frontend) {
+        frontend = std::make_unique<IncrementalFrontend>(source);
+    } else {
+        frontend->update(source);
+    }
+
+    std::vector<const ASTNode*> declarations;
+    for (const auto& statement : frontend->statements()) {
+        const ASTNode* node = statement.node.get();
+        if (!dynamic_cast<const FunctionDeclarationNode*>(node) && !dynamic_cast<const EventListenerNode*>(node)) {
+            continue;
+        }
+        if (statement.reparsed) {
+            ++summary.reparsed;
+        } else {
+            ++summary.reused;
+        }
+        declarations.push_back(node);
+    }
+
+    std::unordered_set<Symbol> new_function_names;
+    for (const auto* declaration : declarations) {
+        if (auto function = dynamic_cast<const FunctionDeclarationNode*>(declaration)) {
+            new_function_names.insert(function->identifier);
+        }
+    }
+    for (const auto& name : declared_functions) {
+        if (new_function_names.find(name) == new_function_names.end() && functions.erase(name) > 0) {
+            ++summary.removed;
+        }
+    }
+
+    // Marked together, so a pure function calling a replaced one is checked against the new version
+    BlockNode reloaded;
+    for (const auto* declaration : declarations) {
+        reloaded.statements.push_back(declaration->clone());
+        infer_types(*reloaded.statements.back());
+    }
+    mark_pure_functions(reloaded);
+
+    // Listeners a function or block added while running are not in the source, and stay
+    for (auto it = events.begin(); it != events.end();) {
+        auto& listeners = it->second;
+        listeners.erase(std::remove_if(listeners.begin(), listeners.end(), [](const auto& listener) { return listener->declared; }), listeners.end());
+        it = listeners.empty() ? events.erase(it) : std::next(it);
+    }
+    profiles.clear();  // Every function is replaced, and starts over in the interpreter, with no results kept
+    for (auto& copy : reloaded.statements) {
+        if (auto function = dynamic_cast<FunctionDeclarationNode*>(copy.get())) {
+            copy.release();
+            functions[function->identifier] = std::unique_ptr<FunctionDeclarationNode>(function);
+        } else if (auto listener = dynamic_cast<EventListenerNode*>(copy.get())) {
+            copy.release();
+            listener->declared = true;
+            events[listener->event_name].push_back(std::unique_ptr<EventListenerNode>(listener));
+        }
+    }
+
+    // A program that has not run yet would otherwise re-declare the old versions
+    if (ast) {
+        auto& statements = ast->statements;
+        for (auto it = statements.begin(); it != statements.end();) {
+            if (dynamic_cast<FunctionDeclarationNode*>(it->get()) || dynamic_cast<EventListenerNode*>(it->get())) {
+                it = statements.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    declared_functions = std::move(new_function_names);
+    return summary;
+}
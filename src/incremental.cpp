@@ -0,0 +1,249 @@
+#include "incremental.h"
+#include "parser.h"
+#include "stats.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+void shift_lines(ASTNode& node, int delta) {
+    if (node.line > 0) {  // Blocks carry no location of their own
+        node.line += delta;
+    }
+    for_each_child(node, [delta](ASTNode& child) { shift_lines(child, delta); });
+}
+
+}
+
+IncrementalFrontend::IncrementalFrontend(const std::string& source) : text(source) {
+    Lexer lexer(text);
+    token_cache = lexer.tokenize();
+    stats.tokens_relexed = token_cache.size();
+    reparse_from(0, 0, 0);
+}
+
+const std::string& IncrementalFrontend::source() const {
+    return text;
+}
+
+const std::vector<Token>& IncrementalFrontend::tokens() const {
+    return token_cache;
+}
+
+const std::vector<TopLevelStatement>& IncrementalFrontend::statements() const {
+    return statement_cache;
+}
+
+const IncrementalStats& IncrementalFrontend::last_stats() const {
+    return stats;
+}
+
+std::unique_ptr<BlockNode> IncrementalFrontend::parse() const {
+    auto block = std::make_unique<BlockNode>();
+    for (const auto& statement : statement_cache) {
+        block->statements.push_back(statement.node->clone());
+    }
+    return block;
+}
+
+size_t IncrementalFrontend::line_offset(int line) const {
+    size_t offset = 0;
+    for (int current = 1; current < line; ++current) {
+        offset = text.find('\n', offset);
+        if (offset == std::string::npos) {
+            return text.size();
+        }
+        ++offset;
+    }
+    return offset;
+}
+
+void IncrementalFrontend::edit(int first_line, int last_line, const std::string& replacement) {
+    if (first_line < 1 || last_line < first_line - 1) {
+        throw std::invalid_argument("Invalid line range " + std::to_string(first_line) + "-" + std::to_string(last_line));
+    }
+    size_t begin = line_offset(first_line);
+    size_t end = line_offset(last_line + 1);
+    replace(begin, end - begin, replacement);
+}
+
+void IncrementalFrontend::update(const std::string& new_source) {
+    // An empty edit would still re-lex the last token, and re-parse the statement it ends
+    if (new_source == text) {
+        stats = IncrementalStats();
+        stats.tokens_reused = token_cache.size();
+        stats.statements_reused = statement_cache.size();
+        for (auto& statement : statement_cache) {
+            statement.reparsed = false;
+        }
+        return;
+    }
+    size_t limit = std::min(text.size(), new_source.size());
+    size_t prefix = 0;
+    while (prefix < limit && text[prefix] == new_source[prefix]) {
+        ++prefix;
+    }
+    size_t suffix = 0;
+    while (suffix < limit - prefix && text[text.size() - 1 - suffix] == new_source[new_source.size() - 1 - suffix]) {
+        ++suffix;
+    }
+    replace(prefix, text.size() - prefix - suffix, new_source.substr(prefix, new_source.size() - prefix - suffix));
+}
+
+void IncrementalFrontend::replace(size_t offset, size_t length, const std::string& replacement) {
+    if (offset > text.size() || length > text.size() - offset) {
+        throw std::out_of_range("Edit range is outside the source");
+    }
+    stats = IncrementalStats();
+    size_t edit_end = offset + length;
+    long long delta = static_cast<long long>(replacement.size()) - static_cast<long long>(length);
+    int line_delta = static_cast<int>(std::count(replacement.begin(), replacement.end(), '\n') -
+                                      std::count(text.begin() + offset, text.begin() + edit_end, '\n'));
+
+    std::string new_text = text.substr(0, offset) + replacement + text.substr(edit_end);
+
+    // Restart at the last token that begins before the edit: maximal munch means
+    // the edit can extend it, but nothing earlier can change.
+    auto first_affected = std::lower_bound(token_cache.begin(), token_cache.end(), offset,
+                                           [](const Token& token, size_t value) { return token.offset < value; });
+    size_t relex_start = 0;
+    size_t start_offset = 0;
+    int start_line = 1;
+    if (first_affected != token_cache.begin()) {
+        relex_start = static_cast<size_t>(first_affected - token_cache.begin()) - 1;
+        start_offset = token_cache[relex_start].offset;
+        start_line = token_cache[relex_start].line;
+    }
+
+    // Lexing is stateless between tokens, so once a new token starts where a
+    // shifted old token started, the rest of the old stream is still valid.
+    std::vector<Token> relexed;
+    size_t resync = token_cache.size();
+    {
+        stats::Timer timer(stats::LexNanoseconds);
+        Lexer lexer(new_text);
+        lexer.seek(start_offset, start_line);
+        while (true) {
+            Token token = lexer.next();
+            if (token.offset >= offset + replacement.size()) {
+                size_t old_offset = static_cast<size_t>(static_cast<long long>(token.offset) - delta);
+                auto match = std::lower_bound(token_cache.begin() + relex_start, token_cache.end(), old_offset,
+                                              [](const Token& old, size_t value) { return old.offset < value; });
+                if (match != token_cache.end() && match->offset == old_offset && match->type == token.type && match->value == token.value) {
+                    resync = static_cast<size_t>(match - token_cache.begin());
+                    break;
+                }
+            }
+            relexed.push_back(token);
+            if (token.type == TokenType::EndOfFile) {
+                break;
+            }
+        }
+    }
+
+    std::vector<Token> new_tokens;
+    new_tokens.reserve(relex_start + relexed.size() + (token_cache.size() - resync));
+    new_tokens.insert(new_tokens.end(), token_cache.begin(), token_cache.begin() + relex_start);
+    new_tokens.insert(new_tokens.end(), relexed.begin(), relexed.end());
+    for (size_t i = resync; i < token_cache.size(); ++i) {
+        Token token = token_cache[i];
+        token.offset = static_cast<size_t>(static_cast<long long>(token.offset) + delta);
+        token.line += line_delta;
+        new_tokens.push_back(std::move(token));
+    }
+    long long index_shift = static_cast<long long>(relex_start + relexed.size()) - static_cast<long long>(resync);
+
+    stats.tokens_relexed = relexed.size();
+    stats.tokens_reused = new_tokens.size() - relexed.size();
+
+    // A statement is dirty when any token it looked at, including the lookahead
+    // token that ended it, was re-lexed.
+    size_t first_dirty = 0;
+    while (first_dirty < statement_cache.size() && statement_cache[first_dirty].end < relex_start) {
+        statement_cache[first_dirty].reparsed = false;
+        ++first_dirty;
+    }
+    size_t first_clean = first_dirty;
+    while (first_clean < statement_cache.size() && statement_cache[first_clean].first < resync) {
+        ++first_clean;
+    }
+    for (size_t i = first_clean; i < statement_cache.size(); ++i) {
+        auto& statement = statement_cache[i];
+        statement.first = static_cast<size_t>(static_cast<long long>(statement.first) + index_shift);
+        statement.end = static_cast<size_t>(static_cast<long long>(statement.end) + index_shift);
+        statement.reparsed = false;
+        if (line_delta != 0) {
+            shift_lines(*statement.node, line_delta);
+        }
+    }
+
+    // Statements are contiguous, so the end of the last untouched statement is a boundary before the edit
+    size_t start_token = first_dirty > 0 ? statement_cache[first_dirty - 1].end : 0;
+    text = std::move(new_text);
+    token_cache = std::move(new_tokens);
+    try {
+        reparse_from(first_dirty, start_token, first_clean);
+    } catch (...) {
+        // Without a consistent statement list the next edit re-parses everything
+        statement_cache.clear();
+        throw;
+    }
+}
+
+void IncrementalFrontend::reparse_from(size_t statement_index, size_t first_token, size_t clean_index) {
+    stats::Timer timer(stats::ParseNanoseconds);
+    // Statements from clean_index on have unchanged tokens; reparsing stops as
+    // soon as it reaches the start of one of them. A parse that runs past the
+    // candidate boundary falls back to parsing through to the end of the file.
+    std::vector<TopLevelStatement> clean_tail;
+    for (size_t i = clean_index; i < statement_cache.size(); ++i) {
+        clean_tail.push_back(std::move(statement_cache[i]));
+    }
+    statement_cache.resize(statement_index);
+
+    size_t slice_end = clean_tail.empty() ? token_cache.size() : std::min(clean_tail.front().first + 1, token_cache.size());
+    while (true) {
+        std::vector<TopLevelStatement> reparsed;
+        size_t resumed_at = clean_tail.size();
+        bool complete = false;
+        try {
+            Parser parser(token_cache, first_token, slice_end);
+            while (!parser.atEnd()) {
+                size_t first = first_token + parser.position();
+                auto node = parser.parseTopLevelStatement();
+                size_t end = first_token + parser.position();
+                if (end >= slice_end && slice_end < token_cache.size()) {
+                    break;  // Ran into the artificial end of the slice
+                }
+                reparsed.push_back({first, end, std::move(node), true});
+                auto boundary = std::find_if(clean_tail.begin(), clean_tail.end(),
+                                             [end](const TopLevelStatement& statement) { return statement.first == end; });
+                if (boundary != clean_tail.end()) {
+                    resumed_at = static_cast<size_t>(boundary - clean_tail.begin());
+                    complete = true;
+                    break;
+                }
+            }
+            if (parser.atEnd() && slice_end >= token_cache.size()) {
+                complete = true;
+            }
+        } catch (const std::exception&) {
+            if (slice_end >= token_cache.size()) {
+                throw;
+            }
+        }
+
+        if (complete) {
+            stats.statements_reparsed = reparsed.size();
+            stats.statements_reused = statement_cache.size() + (clean_tail.size() - resumed_at);
+            for (auto& statement : reparsed) {
+                statement_cache.push_back(std::move(statement));
+            }
+            for (size_t i = resumed_at; i < clean_tail.size(); ++i) {
+                statement_cache.push_back(std::move(clean_tail[i]));
+            }
+            return;
+        }
+        slice_end = token_cache.size();
+    }
+}
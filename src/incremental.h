@@ -0,0 +1,60 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include "ast.h"
+#include "lexer.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+// A top-level statement and the range of tokens it was parsed from. The parser
+// inspects the token at `end` to decide the statement is finished, so the
+// statement only stays valid while tokens [first, end] are unchanged.
+struct TopLevelStatement {
+    size_t first;
+    size_t end;
+    std::unique_ptr<ASTNode> node;
+    bool reparsed;
+};
+
+struct IncrementalStats {
+    size_t tokens_relexed = 0;
+    size_t tokens_reused = 0;
+    size_t statements_reparsed = 0;
+    size_t statements_reused = 0;
+};
+
+// Keeps the tokens and top-level statements of one script and, after an edit,
+// re-lexes from the edit point only until the token stream resynchronizes and
+// re-parses only the statements whose tokens changed.
+class IncrementalFrontend {
+public:
+    explicit IncrementalFrontend(const std::string& source);
+
+    // Replaces lines [first_line, last_line] (1-based, inclusive, including the
+    // final newline) with `text`
+    void edit(int first_line, int last_line, const std::string& text);
+    // Replaces `length` bytes at `offset` with `text`
+    void replace(size_t offset, size_t length, const std::string& text);
+    // Replaces the whole source, treating the differing middle section as one edit
+    void update(const std::string& new_source);
+
+    const std::string& source() const;
+    const std::vector<Token>& tokens() const;
+    const std::vector<TopLevelStatement>& statements() const;
+    const IncrementalStats& last_stats() const;
+
+    // A fresh program tree assembled from the cached statements
+    std::unique_ptr<BlockNode> parse() const;
+
+private:
+    std::string text;
+    std::vector<Token> token_cache;
+    std::vector<TopLevelStatement> statement_cache;
+    IncrementalStats stats;
+
+    void reparse_from(size_t statement_index, size_t first_token, size_t clean_token);
+    size_t line_offset(int line) const;
+};
+
+#endif // INCREMENTAL_H
@@ -0,0 +1,69 @@
+#include "input.h"
+#include <fstream>
+#include <stdexcept>
+
+StreamInput::StreamInput(std::istream& in) : in(in) {}
+
+std::optional<std::string> StreamInput::next(const std::string&) {
+    std::string line;
+    if (!std::getline(in, line)) {
+        return std::nullopt;
+    }
+    return line;
+}
+
+FileInput::FileInput(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open file: " + path);
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        lines.push_back(line);
+    }
+}
+
+std::optional<std::string> FileInput::next(const std::string&) {
+    if (position == lines.size()) {
+        return std::nullopt;
+    }
+    return lines[position++];
+}
+
+QueueInput::QueueInput(std::vector<std::string> values) : values(values.begin(), values.end()), closed(true) {}
+
+void QueueInput::push(std::string value) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        values.push_back(std::move(value));
+    }
+    available.notify_one();
+}
+
+void QueueInput::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+    }
+    available.notify_all();
+}
+
+std::optional<std::string> QueueInput::next(const std::string&) {
+    std::unique_lock<std::mutex> lock(mutex);
+    available.wait(lock, [this] { return closed || !values.empty(); });
+    if (values.empty()) {
+        return std::nullopt;
+    }
+    std::string value = std::move(values.front());
+    values.pop_front();
+    return value;
+}
+
+CallbackInput::CallbackInput(Callback callback) : callback(std::move(callback)) {}
+
+std::optional<std::string> CallbackInput::next(const std::string& name) {
+    return callback(name);
+}
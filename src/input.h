@@ -0,0 +1,75 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <istream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Source of values for `input` statements. An interpreter without one reads
+// lines from std::cin.
+class InputProvider {
+public:
+    virtual ~InputProvider() = default;
+
+    // Value for the variable `name`, or nothing once the input is exhausted
+    virtual std::optional<std::string> next(const std::string& name) = 0;
+};
+
+// One line per value from a stream
+class StreamInput : public InputProvider {
+public:
+    explicit StreamInput(std::istream& in);
+    std::optional<std::string> next(const std::string& name) override;
+
+private:
+    std::istream& in;
+};
+
+// Canned responses, one per line of a file, read up front
+class FileInput : public InputProvider {
+public:
+    explicit FileInput(const std::string& path);
+    std::optional<std::string> next(const std::string& name) override;
+
+private:
+    std::vector<std::string> lines;
+    size_t position = 0;
+};
+
+// Values pushed by the host, possibly from another thread. next() waits for a
+// value until the queue is closed; a queue built from a list of values starts
+// closed, so it simply runs dry.
+class QueueInput : public InputProvider {
+public:
+    QueueInput() = default;
+    explicit QueueInput(std::vector<std::string> values);
+
+    void push(std::string value);
+    void close();
+    std::optional<std::string> next(const std::string& name) override;
+
+private:
+    std::mutex mutex;
+    std::condition_variable available;
+    std::deque<std::string> values;
+    bool closed = false;
+};
+
+// Asks the host for each value
+class CallbackInput : public InputProvider {
+public:
+    using Callback = std::function<std::optional<std::string>(const std::string& name)>;
+
+    explicit CallbackInput(Callback callback);
+    std::optional<std::string> next(const std::string& name) override;
+
+private:
+    Callback callback;
+};
+
+#endif // INPUT_H
@@ -1,141 +1,533 @@
 #include "interpreter.h"
+#include "operations.h"
 #include "parser.h"
+#include "stats.h"
+#include "types.h"
+#include "utils.h"
+#include <algorithm>
 #include <stdexcept>
 #include <iostream>
 #include <sstream>
-#include <regex>
-#include <iomanip>
+#include <thread>
+
+namespace {
+
+bool is_number(const Value& value) {
+    return value.is_text() && is_number_text(value.str());
+}
+
+// What a call leaves on the thread's stack for its own frames: the deepest
+// expression and statement nesting one call level takes, and unwinding an error
+const size_t STACK_RESERVE = 256 * 1024;
+
+// Pops an interpreted call's frame however the call ends
+class PushedFrame {
+public:
+    explicit PushedFrame(std::vector<CallFrame>& frames) : frames(frames) {}
+    ~PushedFrame() { frames.pop_back(); }
+    PushedFrame(const PushedFrame&) = delete;
+    PushedFrame& operator=(const PushedFrame&) = delete;
+
+private:
+    std::vector<CallFrame>& frames;
+};
+
+// Sets the depth at which a return is in tail position for as long as a body or loop runs
+class TailPosition {
+public:
+    TailPosition(size_t& tail_depth, size_t depth) : tail_depth(tail_depth), previous(tail_depth) { tail_depth = depth; }
+    ~TailPosition() { tail_depth = previous; }
+    TailPosition(const TailPosition&) = delete;
+    TailPosition& operator=(const TailPosition&) = delete;
+
+private:
+    size_t& tail_depth;
+    size_t previous;
+};
+
+// Attributes loop iterations to the interpreted function running them
+class ActiveProfile {
+public:
+    ActiveProfile(FunctionProfile*& current, FunctionProfile* profile) : current(current), previous(current) { current = profile; }
+    ~ActiveProfile() { current = previous; }
+    ActiveProfile(const ActiveProfile&) = delete;
+    ActiveProfile& operator=(const ActiveProfile&) = delete;
+
+private:
+    FunctionProfile*& current;
+    FunctionProfile* previous;
+};
+
+// Makes a value the C++ code holds outside any variable a collector root
+class PinnedValue {
+public:
+    PinnedValue(std::vector<const Value*>& pins, const Value& value) : pins(pins) { pins.push_back(&value); }
+    ~PinnedValue() { pins.pop_back(); }
+    PinnedValue(const PinnedValue&) = delete;
+    PinnedValue& operator=(const PinnedValue&) = delete;
+
+private:
+    std::vector<const Value*>& pins;
+};
+
+// Opens the cache of a loop or block cache_expressions gave one, for as long as it runs
+class CacheScope {
+public:
+    CacheScope(std::vector<ExpressionCache>& caches, const ASTNode& owner) : caches(owner.cache ? &caches : nullptr) {
+        if (this->caches) {
+            caches.push_back({owner.cache, std::vector<std::optional<Value>>(owner.slot)});
+        }
+    }
+    ~CacheScope() {
+        if (caches) {
+            caches->pop_back();
+        }
+    }
+    CacheScope(const CacheScope&) = delete;
+    CacheScope& operator=(const CacheScope&) = delete;
+
+private:
+    std::vector<ExpressionCache>* caches;
+};
+
+}
+
+Interpreter::CallScope::CallScope(Interpreter& interpreter, Symbol name) : depth(interpreter.call_depth) {
+    if (depth >= interpreter.call_policy.max_depth || native_stack_left() < STACK_RESERVE) {
+        throw std::runtime_error("Maximum call depth exceeded in function call: " + name);
+    }
+    ++depth;
+}
 
 void Interpreter::interpret(std::unique_ptr<ASTNode> ast) {
+    native.reset();
     this->ast = std::unique_ptr<BlockNode>(dynamic_cast<BlockNode*>(ast.release()));
+    declared_functions.clear();
+    frontend.reset();
+    if (this->ast) {
+        infer_types(*this->ast);
+        for (const auto& statement : this->ast->statements) {
+            if (auto function = dynamic_cast<FunctionDeclarationNode*>(statement.get())) {
+                declared_functions.insert(function->identifier);
+            } else if (auto listener = dynamic_cast<EventListenerNode*>(statement.get())) {
+                listener->declared = true;
+            }
+        }
+    }
 }
 
 std::optional<std::string> Interpreter::execute() {
-    std::optional<std::string> return_value;
+    std::optional<Value> return_value;
     if (ast) {
-        interpret_block(std::move(ast), return_value);
+        stats::Timer timer(stats::ExecuteNanoseconds);
+        ProfiledFunction scope(profiler, "main");
+        FunctionProfile profile;
+        std::shared_ptr<const CompiledFunction> program;
+        if (!native) {
+            mark_pure_functions(*ast);
+        }
+        // Before inlining, so the copies of bodies keep their marks
+        cached = native || !expression_caching ? ExpressionSummary() : cache_expressions(*ast);
+        stats::add(stats::ExpressionsCached, cached.loop_invariant + cached.repeated);
+        inlined = native ? InlineSummary() : inline_functions(*ast, inline_policy);
+        stats::add(stats::CallsInlined, inlined.calls_inlined);
+        stats::add(stats::FunctionsRemoved, inlined.functions_removed);
+        if (!native && execution_mode == ExecutionMode::Compiled && tier_policy.enabled) {
+            program = CompiledFunction::compile_program(*ast, profile);
+        }
+        if (native) {
+            ast.reset();
+            return_value = run_native_program();
+        } else if (program) {
+            ast.reset();
+            return_value = program->run_program(*this, profile);
+        } else {
+            interpret_block(std::move(ast), return_value);
+        }
     } else {
         throw std::runtime_error("No code to execute.");
     }
-    return return_value;
+    if (return_value.has_value()) {
+        return return_value->text();
+    }
+    return std::nullopt;
+}
+
+std::string Interpreter::call_function(const std::string& name, const std::vector<std::string>& arguments) {
+    // A name that was never interned cannot belong to a declared function
+    auto symbol = Symbol::find(name);
+    if (!symbol) {
+        throw std::runtime_error("Function not found: " + name);
+    }
+    std::vector<Value> values(arguments.begin(), arguments.end());
+    auto function = functions.find(*symbol);
+    if (memo_policy.enabled && function != functions.end() && function->second->memoized) {
+        return call_memoized(*symbol, nullptr, values).text();
+    }
+    return invoke_function(*symbol, values).text();
+}
+
+std::unique_ptr<Interpreter> Interpreter::fork() const {
+    std::unordered_map<const ScriptObject*, ScriptObject*> copies;
+    return fork(copies);
+}
+
+std::unique_ptr<Interpreter> Interpreter::fork(std::unordered_map<const ScriptObject*, ScriptObject*>& copies) const {
+    auto copy = std::make_unique<Interpreter>();
+    // Objects belong to one heap, so the fork gets copies; everything else is shared
+    for (const auto& [name, value] : variables) {
+        copy->variables[name] = copy->heap.import(value, copies);
+    }
+    copy->functions = functions;
+    for (const auto& [name, listeners] : events) {
+        auto& copied = copy->events[name];
+        for (const auto& listener : listeners) {
+            copied.push_back(std::unique_ptr<EventListenerNode>(static_cast<EventListenerNode*>(listener->clone().release())));
+        }
+    }
+    copy->declared_functions = declared_functions;
+    // Compiled code is immutable and shared; counters and type feedback are per interpreter
+    for (const auto& [function, profile] : profiles) {
+        copy->profiles[function] = std::make_shared<FunctionProfile>(*profile);
+    }
+    copy->tier_policy = tier_policy;
+    copy->execution_mode = execution_mode;
+    copy->memo_policy = memo_policy;
+    copy->parallel_policy = parallel_policy;
+    copy->call_policy = call_policy;
+    copy->parallel_pool = parallel_pool;
+    copy->native = native;
+    return copy;
+}
+
+void Interpreter::set_output(std::ostream& out) {
+    output_stream = &out;
+}
+
+void Interpreter::set_input(InputProvider* input) {
+    input_provider = input;
+}
+
+void Interpreter::set_event_bus(EventBus* bus) {
+    event_bus = bus;
+}
+
+size_t Interpreter::dispatch_event(const std::string& name, const std::string& data) {
+    auto symbol = Symbol::find(name);
+    auto it = symbol ? events.find(*symbol) : events.end();
+    if (it == events.end()) {
+        return 0;
+    }
+    // Clone first: a listener may register more listeners for the same event
+    std::vector<std::unique_ptr<ASTNode>> bodies;
+    for (const auto& listener : it->second) {
+        bodies.push_back(listener->body->clone());
+    }
+    static const Symbol event_data("event_data");
+    variables[event_data] = Value(data);
+    stats::note_variable_count(variables.size());
+    for (auto& body : bodies) {
+        std::optional<Value> return_value;
+        interpret_node(std::move(body), return_value);
+    }
+    return bodies.size();
+}
+
+void Interpreter::set_profiler(Profiler* profiler) {
+    this->profiler = profiler;
+}
+
+void Interpreter::set_gc_budget(std::chrono::nanoseconds budget) {
+    gc_budget = budget;
+}
+
+bool Interpreter::collect_garbage(std::chrono::nanoseconds budget) {
+    return heap.step([this](Heap& heap) { mark_roots(heap); }, budget);
+}
+
+void Interpreter::collect_garbage() {
+    heap.collect([this](Heap& heap) { mark_roots(heap); });
+}
+
+GcStats Interpreter::gc_stats() const {
+    return heap.stats();
+}
+
+void Interpreter::set_tier_policy(const TierPolicy& policy) {
+    tier_policy = policy;
+    profiles.clear();
+}
+
+void Interpreter::set_execution_mode(ExecutionMode mode) {
+    execution_mode = mode;
+}
+
+void Interpreter::set_inline_policy(const InlinePolicy& policy) {
+    inline_policy = policy;
+}
+
+const InlineSummary& Interpreter::inline_summary() const {
+    return inlined;
+}
+
+void Interpreter::set_expression_caching(bool enabled) {
+    expression_caching = enabled;
+}
+
+const ExpressionSummary& Interpreter::expression_summary() const {
+    return cached;
+}
+
+void Interpreter::set_memo_policy(const MemoPolicy& policy) {
+    memo_policy = policy;
+    for (auto& [function, profile] : profiles) {
+        profile->memo = MemoTable();
+    }
+}
+
+std::vector<MemoStats> Interpreter::memo_stats() const {
+    std::vector<MemoStats> stats;
+    for (const auto& [function, profile] : profiles) {
+        if (function->memoized && memo_policy.enabled) {
+            stats.push_back(profile->memo.stats(function->identifier));
+        }
+    }
+    std::sort(stats.begin(), stats.end(), [](const MemoStats& a, const MemoStats& b) {
+        return a.function.str() < b.function.str();
+    });
+    return stats;
 }
 
-void Interpreter::interpret_node(std::unique_ptr<ASTNode> node, std::optional<std::string>& return_value) {
-    if (auto block = dynamic_cast<BlockNode*>(node.get())) {
+void Interpreter::set_parallel_policy(const ParallelPolicy& policy) {
+    parallel_policy = policy;
+}
+
+void Interpreter::set_call_policy(const CallPolicy& policy) {
+    call_policy = policy;
+}
+
+void Interpreter::gc_safe_point() {
+    // A parallel loop's worker creates no objects, and must keep the copies
+    // it made of the loop's, which its copies map refers to
+    if (call_depth == 0 && !parallel_worker && heap.wants_collection()) {
+        collect_garbage(gc_budget);
+    }
+}
+
+void Interpreter::mark_roots(Heap& heap) const {
+    for (const auto& [name, value] : variables) {
+        heap.mark(value);
+    }
+    for (const Value* value : pinned_values) {
+        heap.mark(*value);
+    }
+    for (const auto& cache : expression_caches) {
+        for (const auto& value : cache.values) {
+            if (value) {
+                heap.mark(*value);
+            }
+        }
+    }
+}
+
+void Interpreter::interpret_node(std::unique_ptr<ASTNode> node, std::optional<Value>& return_value) {
+    if (dynamic_cast<BlockNode*>(node.get())) {
+        stats::count_node(NodeKind::Block);
         interpret_block(std::unique_ptr<BlockNode>(static_cast<BlockNode*>(node.release())), return_value);
-    } else if (auto assignment = dynamic_cast<AssignmentNode*>(node.get())) {
+    } else if (dynamic_cast<AssignmentNode*>(node.get())) {
+        stats::count_node(NodeKind::Assignment);
         interpret_assignment(std::unique_ptr<AssignmentNode>(static_cast<AssignmentNode*>(node.release())));
-    } else if (auto print = dynamic_cast<PrintNode*>(node.get())) {
+    } else if (dynamic_cast<PrintNode*>(node.get())) {
+        stats::count_node(NodeKind::Print);
         interpret_print(std::unique_ptr<PrintNode>(static_cast<PrintNode*>(node.release())));
-    } else if (auto input = dynamic_cast<InputNode*>(node.get())) {
+    } else if (dynamic_cast<InputNode*>(node.get())) {
+        stats::count_node(NodeKind::Input);
         interpret_input(std::unique_ptr<InputNode>(static_cast<InputNode*>(node.release())));
-    } else if (auto function = dynamic_cast<FunctionDeclarationNode*>(node.get())) {
+    } else if (dynamic_cast<FunctionDeclarationNode*>(node.get())) {
+        stats::count_node(NodeKind::FunctionDeclaration);
         interpret_function_declaration(std::unique_ptr<FunctionDeclarationNode>(static_cast<FunctionDeclarationNode*>(node.release())));
-    } else if (auto for_loop = dynamic_cast<ForLoopNode*>(node.get())) {
+    } else if (dynamic_cast<ForLoopNode*>(node.get())) {
+        stats::count_node(NodeKind::ForLoop);
         interpret_for_loop(std::unique_ptr<ForLoopNode>(static_cast<ForLoopNode*>(node.release())), return_value);
-    } else if (auto while_loop = dynamic_cast<WhileLoopNode*>(node.get())) {
+    } else if (dynamic_cast<WhileLoopNode*>(node.get())) {
+        stats::count_node(NodeKind::WhileLoop);
         interpret_while_loop(std::unique_ptr<WhileLoopNode>(static_cast<WhileLoopNode*>(node.release())), return_value);
-    } else if (auto foreach_loop = dynamic_cast<ForeachLoopNode*>(node.get())) {
+    } else if (dynamic_cast<ForeachLoopNode*>(node.get())) {
+        stats::count_node(NodeKind::ForeachLoop);
         interpret_foreach_loop(std::unique_ptr<ForeachLoopNode>(static_cast<ForeachLoopNode*>(node.release())), return_value);
-    } else if (auto event_listener = dynamic_cast<EventListenerNode*>(node.get())) {
+    } else if (dynamic_cast<EventListenerNode*>(node.get())) {
+        stats::count_node(NodeKind::EventListener);
         interpret_event_listener(std::unique_ptr<EventListenerNode>(static_cast<EventListenerNode*>(node.release())));
-    } else if (auto npc_action = dynamic_cast<NPCActionNode*>(node.get())) {
+    } else if (dynamic_cast<NPCActionNode*>(node.get())) {
+        stats::count_node(NodeKind::NPCAction);
         interpret_npc_action(std::unique_ptr<NPCActionNode>(static_cast<NPCActionNode*>(node.release())));
-    } else if (auto return_node = dynamic_cast<ReturnNode*>(node.get())) {
+    } else if (dynamic_cast<ReturnNode*>(node.get())) {
+        stats::count_node(NodeKind::Return);
         interpret_return(std::unique_ptr<ReturnNode>(static_cast<ReturnNode*>(node.release())), return_value);
-    } else if (auto binary_expression = dynamic_cast<BinaryExpressionNode*>(node.get())) {
+    } else if (dynamic_cast<BinaryExpressionNode*>(node.get())) {
+        stats::count_node(NodeKind::BinaryExpression);
         return_value = interpret_binary_expression(std::unique_ptr<BinaryExpressionNode>(static_cast<BinaryExpressionNode*>(node.release())));
     } else if (auto identifier_node = dynamic_cast<IdentifierNode*>(node.get())) {
+        stats::count_node(NodeKind::Identifier);
+        stats::add(stats::VariableLookups);
         return_value = variables[identifier_node->identifier];
     } else if (auto number_node = dynamic_cast<NumberNode*>(node.get())) {
-        return_value = std::to_string(number_node->value);
+        stats::count_node(NodeKind::Number);
+        return_value = Value(std::to_string(number_node->value));
     } else if (auto string_node = dynamic_cast<StringNode*>(node.get())) {
-        return_value = string_node->value;
-    } else if (auto function_call = dynamic_cast<FunctionCallNode*>(node.get())) {
+        stats::count_node(NodeKind::String);
+        return_value = Value(string_node->value);
+    } else if (dynamic_cast<FunctionCallNode*>(node.get())) {
+        stats::count_node(NodeKind::FunctionCall);
         return_value = interpret_function_call(std::unique_ptr<FunctionCallNode>(static_cast<FunctionCallNode*>(node.release())));
-    } else if (auto array_literal = dynamic_cast<ArrayLiteralNode*>(node.get())) {
+    } else if (dynamic_cast<ArrayLiteralNode*>(node.get())) {
+        stats::count_node(NodeKind::ArrayLiteral);
         return_value = interpret_array_literal(std::unique_ptr<ArrayLiteralNode>(static_cast<ArrayLiteralNode*>(node.release())));
-    } else if (auto array_index = dynamic_cast<ArrayIndexNode*>(node.get())) {
+    } else if (dynamic_cast<ArrayIndexNode*>(node.get())) {
+        stats::count_node(NodeKind::ArrayIndex);
         return_value = interpret_array_index(std::unique_ptr<ArrayIndexNode>(static_cast<ArrayIndexNode*>(node.release())));
+    } else if (dynamic_cast<ArrayAssignmentNode*>(node.get())) {
+        stats::count_node(NodeKind::ArrayAssignment);
+        interpret_array_assignment(std::unique_ptr<ArrayAssignmentNode>(static_cast<ArrayAssignmentNode*>(node.release())));
+    } else if (dynamic_cast<ObjectDeclarationNode*>(node.get())) {
+        stats::count_node(NodeKind::ObjectDeclaration);
+        interpret_object_declaration(std::unique_ptr<ObjectDeclarationNode>(static_cast<ObjectDeclarationNode*>(node.release())));
+    } else if (dynamic_cast<FieldAccessNode*>(node.get())) {
+        stats::count_node(NodeKind::FieldAccess);
+        return_value = interpret_field_access(std::unique_ptr<FieldAccessNode>(static_cast<FieldAccessNode*>(node.release())));
+    } else if (dynamic_cast<FieldAssignmentNode*>(node.get())) {
+        stats::count_node(NodeKind::FieldAssignment);
+        interpret_field_assignment(std::unique_ptr<FieldAssignmentNode>(static_cast<FieldAssignmentNode*>(node.release())));
     } else {
         throw std::runtime_error("Unknown AST node");
     }
 }
 
-void Interpreter::interpret_block(std::unique_ptr<BlockNode> block, std::optional<std::string>& return_value) {
+void Interpreter::interpret_block(std::unique_ptr<BlockNode> block, std::optional<Value>& return_value) {
+    CacheScope cache(expression_caches, *block);
     for (const auto& statement : block->statements) {
+        ProfiledStatement scope(profiler, statement->line);
         interpret_node(statement->clone(), return_value);
         if (return_value.has_value()) {
             break;
         }
+        gc_safe_point();
     }
 }
 
 void Interpreter::interpret_assignment(std::unique_ptr<AssignmentNode> assignment) {
+    if (parallel_worker && record_reduction(*assignment)) {
+        return;
+    }
+    if (append_in_place(*assignment)) {
+        return;
+    }
     auto value = evaluate_expression(assignment->expression->clone());
-    variables[assignment->identifier] = value;
+    variables[assignment->identifier] = std::move(value);
+    stats::note_variable_count(variables.size());
 }
 
-void Interpreter::interpret_print(std::unique_ptr<PrintNode> print) {
-    auto value = evaluate_expression(print->expression->clone());
+// `s = s + a + b`: rather than copying s out, building a new string and
+// copying it back, append the pieces to s where it is stored, so assembling a
+// line piece by piece is linear instead of quadratic. The pieces are evaluated
+// first, exactly as before; calls cannot change the caller's variables. Only
+// this form is: `s = a + s`, and building s through a call or a parameter,
+// still copy it every time (see tests/test_cases/test_string_limits.aby).
+bool Interpreter::append_in_place(const AssignmentNode& assignment) {
+    std::vector<const ASTNode*> operands;
+    const ASTNode* node = assignment.expression.get();
+    while (auto binary = dynamic_cast<const BinaryExpressionNode*>(node)) {
+        if (binary->op != "+") {
+            return false;
+        }
+        operands.push_back(binary->right.get());
+        node = binary->left.get();
+    }
+    auto target = dynamic_cast<const IdentifierNode*>(node);
+    if (!target || target->identifier != assignment.identifier || operands.empty() ||
+        variables.find(assignment.identifier) == variables.end()) {
+        return false;
+    }
 
-    // Format the output to include decimals only if necessary
-    std::stringstream ss(value);
-    double number;
-    ss >> number;
-
-    if (!ss.fail() && ss.eof()) {
-        // Value is a number
-        std::stringstream formatted_value;
-        formatted_value << std::fixed << std::setprecision(6) << number;
-        std::string output = formatted_value.str();
-        // Remove trailing zeros and the decimal point if not needed
-        output.erase(output.find_last_not_of('0') + 1, std::string::npos);
-        if (output.back() == '.') {
-            output.pop_back();
-        }
-        std::cout << output << std::endl;  // Removed std::endl
-    } else {
-        // Value is not a number
-        std::cout << value << std::endl;  // Removed std::endl
+    stats::count_node(NodeKind::Identifier);
+    stats::add(stats::VariableLookups);
+    std::vector<Value> pieces;
+    for (auto operand = operands.rbegin(); operand != operands.rend(); ++operand) {
+        pieces.push_back(evaluate_expression((*operand)->clone()));
+    }
+    Value& value = variables[assignment.identifier];
+    for (const auto& piece : pieces) {
+        stats::count_node(NodeKind::BinaryExpression);
+        if (is_number(value) && is_number(piece)) {
+            value = Value(std::to_string(std::stod(value.str()) + std::stod(piece.str())));
+        } else {
+            value.append(piece.text());  // Copies first only if the text is shared
+        }
     }
+    return true;
+}
+
+void Interpreter::interpret_print(std::unique_ptr<PrintNode> print) {
+    auto value = evaluate_expression(print->expression->clone());
+    *output_stream << display_text(value.text()) << std::endl;
 }
 
 void Interpreter::interpret_input(std::unique_ptr<InputNode> input) {
+    // Exhausted input reads as an empty line, as it does at the end of std::cin
     std::string value;
-    std::getline(std::cin, value);
-    variables[input->identifier] = value;
+    if (input_provider) {
+        value = input_provider->next(input->identifier).value_or("");
+    } else {
+        std::getline(std::cin, value);
+    }
+    variables[input->identifier] = Value(std::move(value));
+    stats::note_variable_count(variables.size());
 }
 
 void Interpreter::interpret_function_declaration(std::unique_ptr<FunctionDeclarationNode> function) {
+    auto it = functions.find(function->identifier);
+    if (it != functions.end()) {
+        profiles.erase(it->second.get());
+    }
     functions[function->identifier] = std::move(function);
 }
 
-void Interpreter::interpret_for_loop(std::unique_ptr<ForLoopNode> for_loop, std::optional<std::string>& return_value) {
+void Interpreter::interpret_for_loop(std::unique_ptr<ForLoopNode> for_loop, std::optional<Value>& return_value) {
     try {
-        std::string lower_bound_str = evaluate_expression(for_loop->lower_bound->clone());
-        std::string upper_bound_str = evaluate_expression(for_loop->upper_bound->clone());
-        if (!is_number(lower_bound_str) || !is_number(upper_bound_str)) {
+        std::string lower_bound_str = evaluate_expression(for_loop->lower_bound->clone()).text();
+        std::string upper_bound_str = evaluate_expression(for_loop->upper_bound->clone()).text();
+        if (!is_number_text(lower_bound_str) || !is_number_text(upper_bound_str)) {
             throw std::invalid_argument("Bounds are not valid numbers");
         }
         int lower_bound = std::stoi(lower_bound_str);
         int upper_bound = std::stoi(upper_bound_str);
+        CacheScope cache(expression_caches, *for_loop);
+        // Errors in a call the body returns still end up in the handlers below
+        TailPosition tail(tail_depth, SIZE_MAX);
         for (int i = lower_bound; i <= upper_bound; ++i) {
-            variables[for_loop->identifier] = std::to_string(i);
+            if (current_profile) {
+                ++current_profile->back_edges;
+            }
+            variables[for_loop->identifier] = Value(std::to_string(i));
+            stats::note_variable_count(variables.size());
             interpret_node(for_loop->body->clone(), return_value);
             if (return_value.has_value()) {
                 break;
             }
         }
     } catch (const std::invalid_argument& e) {
-        std::cerr << "Invalid argument in for loop bounds: " << e.what() << std::endl;
+        diagnostic_stream() << "Invalid argument in for loop bounds: " << e.what() << std::endl;
     } catch (const std::out_of_range& e) {
-        std::cerr << "Out of range error in for loop bounds: " << e.what() << std::endl;
+        diagnostic_stream() << "Out of range error in for loop bounds: " << e.what() << std::endl;
     }
 }
 
-void Interpreter::interpret_while_loop(std::unique_ptr<WhileLoopNode> while_loop, std::optional<std::string>& return_value) {
+void Interpreter::interpret_while_loop(std::unique_ptr<WhileLoopNode> while_loop, std::optional<Value>& return_value) {
+    CacheScope cache(expression_caches, *while_loop);
     while (evaluate_condition(while_loop->condition->clone())) {
+        if (current_profile) {
+            ++current_profile->back_edges;
+        }
         interpret_node(while_loop->body->clone(), return_value);
         if (return_value.has_value()) {
             break;
@@ -144,16 +536,46 @@ void Interpreter::interpret_while_loop(std::unique_ptr<WhileLoopNode> while_loop
 }
 
 bool Interpreter::evaluate_condition(std::unique_ptr<ASTNode> condition) {
-    std::string result = evaluate_expression(std::move(condition));
-    return result == "true";
+    return evaluate_expression(std::move(condition)) == "true";
 }
 
-void Interpreter::interpret_foreach_loop(std::unique_ptr<ForeachLoopNode> foreach_loop, std::optional<std::string>& return_value) {
+void Interpreter::interpret_foreach_loop(std::unique_ptr<ForeachLoopNode> foreach_loop, std::optional<Value>& return_value) {
+    // Holding the collection keeps the elements fixed even if the body assigns into the array
     auto collection = evaluate_expression(foreach_loop->collection->clone());
-    std::istringstream ss(collection);
+    PinnedValue pin(pinned_values, collection);
+    CacheScope cache(expression_caches, *foreach_loop);
+    if (foreach_loop->parallel) {
+        if (auto result = run_parallel_foreach(*foreach_loop, collection)) {
+            return_value = std::move(result);
+        }
+        return;
+    }
+    if (collection.is_array()) {
+        for (const auto& item : collection.elements()) {
+            if (current_profile) {
+                ++current_profile->back_edges;
+            }
+            variables[foreach_loop->identifier] = item;
+            stats::note_variable_count(variables.size());
+            interpret_node(foreach_loop->body->clone(), return_value);
+            if (return_value.has_value()) {
+                break;
+            }
+        }
+        return;
+    }
+    if (collection.is_object()) {
+        throw std::runtime_error("Cannot iterate over an object: " + foreach_loop->identifier);
+    }
+    // Text is split on commas, as arrays used to be
+    std::istringstream ss(collection.str());
     std::string item;
     while (std::getline(ss, item, ',')) {
-        variables[foreach_loop->identifier] = item;
+        if (current_profile) {
+            ++current_profile->back_edges;
+        }
+        variables[foreach_loop->identifier] = Value(item);
+        stats::note_variable_count(variables.size());
         interpret_node(foreach_loop->body->clone(), return_value);
         if (return_value.has_value()) {
             break;
@@ -166,155 +588,449 @@ void Interpreter::interpret_event_listener(std::unique_ptr<EventListenerNode> ev
 }
 
 void Interpreter::interpret_npc_action(std::unique_ptr<NPCActionNode> npc_action) {
+    if (event_bus) {
+        // The host drains its ring every frame, so a full ring only needs a moment
+        while (!event_bus->send(RecordKind::NPCAction, npc_action->npc_name, npc_action->action)) {
+            std::this_thread::yield();
+        }
+        return;
+    }
     // Execute the NPC action (implementation depends on the game engine)
-    std::cout << "Executing NPC action for: " << npc_action->npc_name << std::endl;
+    *output_stream << "Executing NPC action for: " << npc_action->npc_name << std::endl;
 }
 
-void Interpreter::interpret_return(std::unique_ptr<ReturnNode> return_node, std::optional<std::string>& return_value) {
+void Interpreter::interpret_return(std::unique_ptr<ReturnNode> return_node, std::optional<Value>& return_value) {
+    // Inlined calls have no frame to reuse. A call whose value is not kept yet
+    // is made; keeping it is no use, as its loop or block ends with the return.
+    auto call = dynamic_cast<const FunctionCallNode*>(return_node->expression.get());
+    auto kept = [&] {
+        auto cache = std::find_if(expression_caches.rbegin(), expression_caches.rend(), [&](const ExpressionCache& cache) {
+            return cache.id == call->cache;
+        });
+        return cache != expression_caches.rend() && cache->values[call->slot].has_value();
+    };
+    if (call && !call->inlined && !(call->cache && kept()) && tail_depth == call_depth && call_policy.tail_calls) {
+        stats::count_node(NodeKind::FunctionCall);
+        return_value = return_call(*call);
+        return;
+    }
     return_value = evaluate_expression(return_node->expression->clone());
 }
 
-std::string Interpreter::interpret_binary_expression(std::unique_ptr<BinaryExpressionNode> binary_expression) {
-    auto left = evaluate_expression(binary_expression->left->clone());
-    auto right = evaluate_expression(binary_expression->right->clone());
-
-    if (is_number(left) && is_number(right)) {
-        double left_num = std::stod(left);
-        double right_num = std::stod(right);
-        if (binary_expression->op == "+") {
-            return std::to_string(left_num + right_num);
-        } else if (binary_expression->op == "-") {
-            return std::to_string(left_num - right_num);
-        } else if (binary_expression->op == "*") {
-            return std::to_string(left_num * right_num);
-        } else if (binary_expression->op == "/") {
-            if (right_num == 0) {
-                throw std::runtime_error("Division by zero");
+// Checked and evaluated as interpret_function_call does; the body then ends
+// with an empty result, which call_body replaces with the call's
+Value Interpreter::return_call(const FunctionCallNode& call) {
+    auto it = functions.find(call.identifier);
+    if (it == functions.end()) {
+        throw std::runtime_error("Function not found: " + call.identifier);
+    }
+    if (it->second->parameters.size() != call.arguments.size()) {
+        throw std::runtime_error("Argument count mismatch in function call: " + call.identifier);
+    }
+    if (!it->second->pure) {
+        ++impure_calls;
+    }
+    std::vector<Value> arguments;
+    arguments.reserve(call.arguments.size());
+    for (const auto& argument : call.arguments) {
+        arguments.push_back(evaluate_expression(argument->clone()));
+    }
+    if (memo_policy.enabled) {
+        auto callee = functions.find(call.identifier);  // The arguments may have redefined it
+        if (callee != functions.end() && callee->second->memoized) {
+            if (const Value* result = memo_tail_call(callee->second, arguments)) {
+                return *result;
             }
-            return std::to_string(left_num / right_num);
-        } else if (binary_expression->op == "and") {
-            return (left == "true" && right == "true") ? "true" : "false";
-        } else if (binary_expression->op == "or") {
-            return (left == "true" || right == "true") ? "true" : "false";
-        } else if (binary_expression->op == "<") {
-            return (left_num < right_num) ? "true" : "false";
-        } else if (binary_expression->op == ">") {
-            return (left_num > right_num) ? "true" : "false";
-        } else if (binary_expression->op == "<=") {
-            return (left_num <= right_num) ? "true" : "false";
-        } else if (binary_expression->op == ">=") {
-            return (left_num >= right_num) ? "true" : "false";
-        } else {
-            throw std::runtime_error("Unknown binary operator: " + binary_expression->op);
         }
-    } else if (binary_expression->op == "+") {
-        // Concatenate strings
-        return left + right;
-    } else {
-        throw std::runtime_error("Invalid operands for binary operator: " + binary_expression->op);
     }
+    call_frames.back().tail_call = TailCall{call.identifier, std::move(arguments)};
+    return Value();
 }
 
-std::string Interpreter::evaluate_expression(std::unique_ptr<ASTNode> node) {
+Value Interpreter::interpret_binary_expression(std::unique_ptr<BinaryExpressionNode> binary_expression) {
+    auto left = evaluate_expression(binary_expression->left->clone());
+    auto right = evaluate_expression(binary_expression->right->clone());
+    switch (binary_expression->specialization) {
+        case BinarySpecialization::NumberArithmetic:
+        case BinarySpecialization::NumberCompare:
+            return apply_number_binary(binary_op(binary_expression->op), binary_expression->op, left, right);
+        case BinarySpecialization::Concat:
+            return Value(left.text() + right.text());
+        default:
+            return apply_binary(binary_op(binary_expression->op), binary_expression->op, left, right);
+    }
+}
+
+Value Interpreter::evaluate_expression(std::unique_ptr<ASTNode> node) {
+    if (node->cache) {
+        return evaluate_cached(std::move(node));
+    }
     if (auto identifier = dynamic_cast<IdentifierNode*>(node.get())) {
+        stats::count_node(NodeKind::Identifier);
+        stats::add(stats::VariableLookups);
         return variables[identifier->identifier];
     } else if (auto number = dynamic_cast<NumberNode*>(node.get())) {
-        return std::to_string(number->value);
+        stats::count_node(NodeKind::Number);
+        return Value(std::to_string(number->value));
     } else if (auto str = dynamic_cast<StringNode*>(node.get())) {
-        return str->value;
-    } else if (auto binary_expression = dynamic_cast<BinaryExpressionNode*>(node.get())) {
+        stats::count_node(NodeKind::String);
+        return Value(str->value);
+    } else if (dynamic_cast<BinaryExpressionNode*>(node.get())) {
+        stats::count_node(NodeKind::BinaryExpression);
         return interpret_binary_expression(std::unique_ptr<BinaryExpressionNode>(static_cast<BinaryExpressionNode*>(node.release())));
-    } else if (auto function_call = dynamic_cast<FunctionCallNode*>(node.get())) {
+    } else if (dynamic_cast<FunctionCallNode*>(node.get())) {
+        stats::count_node(NodeKind::FunctionCall);
         return interpret_function_call(std::unique_ptr<FunctionCallNode>(static_cast<FunctionCallNode*>(node.release())));
-    } else if (auto array_literal = dynamic_cast<ArrayLiteralNode*>(node.get())) {
+    } else if (dynamic_cast<ArrayLiteralNode*>(node.get())) {
+        stats::count_node(NodeKind::ArrayLiteral);
         return interpret_array_literal(std::unique_ptr<ArrayLiteralNode>(static_cast<ArrayLiteralNode*>(node.release())));
-    } else if (auto array_index = dynamic_cast<ArrayIndexNode*>(node.get())) {
+    } else if (dynamic_cast<ArrayIndexNode*>(node.get())) {
+        stats::count_node(NodeKind::ArrayIndex);
         return interpret_array_index(std::unique_ptr<ArrayIndexNode>(static_cast<ArrayIndexNode*>(node.release())));
+    } else if (dynamic_cast<FieldAccessNode*>(node.get())) {
+        stats::count_node(NodeKind::FieldAccess);
+        return interpret_field_access(std::unique_ptr<FieldAccessNode>(static_cast<FieldAccessNode*>(node.release())));
     }
     throw std::runtime_error("Unknown expression node");
 }
 
-std::string Interpreter::interpret_function_call(std::unique_ptr<FunctionCallNode> function_call) {
+Value Interpreter::evaluate_cached(std::unique_ptr<ASTNode> node) {
+    // The innermost, since a recursive call opens the same loop's cache again
+    auto cache = std::find_if(expression_caches.rbegin(), expression_caches.rend(), [&](const ExpressionCache& cache) {
+        return cache.id == node->cache;
+    });
+    size_t slot = node->slot;
+    node->cache = 0;
+    if (cache == expression_caches.rend()) {
+        return evaluate_expression(std::move(node));  // Not run by its loop or block, e.g. in a listener
+    }
+    size_t index = expression_caches.rend() - cache - 1;  // Computing it may open more caches
+    if (const auto& value = expression_caches[index].values[slot]) {
+        stats::add(stats::CachedValuesReused);
+        return *value;
+    }
+    // A call to a function that is no longer the pure one may not give the same value again
+    size_t calls = impure_calls;
+    Value value = evaluate_expression(std::move(node));
+    if (impure_calls == calls) {
+        expression_caches[index].values[slot] = value;
+    }
+    return value;
+}
+
+Value Interpreter::interpret_function_call(std::unique_ptr<FunctionCallNode> function_call) {
+    // Check the call before evaluating arguments, which may have side effects
     auto it = functions.find(function_call->identifier);
     if (it == functions.end()) {
         throw std::runtime_error("Function not found: " + function_call->identifier);
     }
-    auto& function = it->second;
-    if (function->parameters.size() != function_call->arguments.size()) {
+    if (it->second->parameters.size() != function_call->arguments.size()) {
         throw std::runtime_error("Argument count mismatch in function call: " + function_call->identifier);
     }
-    std::unordered_map<std::string, std::string> old_variables = variables;
-    for (size_t i = 0; i < function->parameters.size(); ++i) {
-        variables[function->parameters[i]] = evaluate_expression(function_call->arguments[i]->clone());
+    if (!it->second->pure) {
+        ++impure_calls;
+    }
+    // All arguments are evaluated in the caller's scope before any parameter is bound
+    std::vector<Value> arguments;
+    arguments.reserve(function_call->arguments.size());
+    for (const auto& argument : function_call->arguments) {
+        arguments.push_back(evaluate_expression(argument->clone()));
+    }
+    if (memo_policy.enabled) {
+        auto callee = functions.find(function_call->identifier);  // The arguments may have redefined it
+        if (callee != functions.end() && callee->second->memoized) {
+            return call_memoized(function_call->identifier, function_call->inlined.get(), arguments);
+        }
+    }
+    if (function_call->inlined) {
+        return invoke_inlined(function_call->identifier, *function_call->inlined, arguments);
+    }
+    return invoke_function(function_call->identifier, arguments);
+}
+
+Value Interpreter::call_memoized(Symbol name, const InlinedBody* inlined, std::vector<Value>& arguments) {
+    // Held, so a call that redefines the function keeps its result in the old table
+    std::shared_ptr<FunctionProfile> profile = profile_for(functions.at(name));
+    std::optional<std::string> key = MemoTable::key(arguments);
+    if (key) {
+        if (const Value* result = profile->memo.find(*key)) {
+            return *result;
+        }
+    }
+    Value result = inlined ? invoke_inlined(name, *inlined, arguments) : invoke_function(name, arguments);
+    if (key) {
+        profile->memo.insert(std::move(*key), result, memo_policy.capacity);
+    }
+    return result;
+}
+
+const Value* Interpreter::memo_tail_call(const std::shared_ptr<const FunctionDeclarationNode>& function, const std::vector<Value>& arguments) {
+    std::shared_ptr<FunctionProfile> profile = profile_for(function);
+    std::optional<std::string> key = MemoTable::key(arguments);
+    if (!key) {
+        return nullptr;
+    }
+    if (const Value* result = profile->memo.find(*key)) {
+        return result;
+    }
+    tail_memos.push_back(TailMemo{std::move(profile), std::move(*key)});
+    return nullptr;
+}
+
+// Innermost call first, the order in which they would have returned
+void Interpreter::TailResults::keep(const Value& result) {
+    for (size_t i = interpreter.tail_memos.size(); i > mark; --i) {
+        TailMemo& memo = interpreter.tail_memos[i - 1];
+        memo.profile->memo.insert(std::move(memo.key), result, interpreter.memo_policy.capacity);
+    }
+    interpreter.tail_memos.resize(mark);
+}
+
+// Runs the copied body in place of the call, saving and restoring only the
+// variables it uses rather than the whole map. As with a call, they are left
+// as they are if the body ends in an error.
+Value Interpreter::invoke_inlined(Symbol name, const InlinedBody& inlined, std::vector<Value>& arguments) {
+    auto it = functions.find(name);
+    if (it == functions.end() || it->second->inline_id != inlined.callee) {
+        return invoke_function(name, arguments);  // Redefined since it was inlined
+    }
+    // Once the function is hot its compiled code beats interpreting the copy
+    if (tier_policy.enabled && optimized_code(*profile_for(it->second))) {
+        return invoke_function(name, arguments);
+    }
+    // Saved values are not roots, so the collector must not run before they are back
+    CallScope call(*this, name);
+    std::vector<std::optional<Value>> saved;
+    saved.reserve(inlined.locals.size());
+    for (Symbol local : inlined.locals) {
+        auto variable = variables.find(local);
+        saved.push_back(variable == variables.end() ? std::nullopt : std::optional<Value>(variable->second));
+    }
+    for (size_t i = 0; i < inlined.parameters.size(); ++i) {
+        variables[inlined.parameters[i]] = std::move(arguments[i]);
+    }
+    stats::note_variable_count(variables.size());
+    std::optional<Value> return_value;
+    {
+        ProfiledFunction scope(profiler, name);
+        interpret_block(std::unique_ptr<BlockNode>(static_cast<BlockNode*>(inlined.body->clone().release())), return_value);
+    }
+    for (size_t i = 0; i < saved.size(); ++i) {
+        if (saved[i]) {
+            variables[inlined.locals[i]] = std::move(*saved[i]);
+        } else {
+            variables.erase(inlined.locals[i]);
+        }
     }
-    std::optional<std::string> return_value;
-    interpret_block(std::unique_ptr<BlockNode>(static_cast<BlockNode*>(function->body->clone().release())), return_value);
-    variables = old_variables;
     if (return_value.has_value()) {
-        return return_value.value();
+        return std::move(*return_value);
     }
-    return "";
+    return Value();
 }
 
-bool Interpreter::is_number(const std::string& s) {
-    std::regex number_regex("^-?\\d+(\\.\\d+)?$");
-    return std::regex_match(s, number_regex);
+Value Interpreter::invoke_function(Symbol name, const std::vector<Value>& arguments) {
+    auto it = functions.find(name);
+    if (it == functions.end()) {
+        throw std::runtime_error("Function not found: " + name);
+    }
+    auto function = it->second;  // Keeps the body alive if the call redefines the function
+    if (function->parameters.size() != arguments.size()) {
+        throw std::runtime_error("Argument count mismatch in function call: " + name);
+    }
+    stats::add(stats::FunctionCalls);
+    CallScope call(*this, name);
+    std::shared_ptr<FunctionProfile> profile = profile_for(function);
+    if (auto compiled = optimized_code(*profile)) {
+        // `compiled` keeps the code alive even if the call deoptimizes it
+        ProfiledFunction scope(profiler, name);
+        Value result = compiled->run(*this, arguments, *profile);
+        if (profile->invalidated) {
+            deoptimize(*profile);
+        }
+        return result;
+    }
+    return call_body(*function, *profile, name, arguments);
 }
 
-std::string Interpreter::interpret_array_literal(std::unique_ptr<ArrayLiteralNode> array_literal) {
-    std::string result;
-    for (const auto& element : array_literal->elements) {
-        if (!result.empty()) {
-            result += ",";
-        }
-        std::string value = evaluate_expression(element->clone());
-
-        // Format the value to include decimals only if necessary
-        std::stringstream ss(value);
-        double number;
-        ss >> number;
-
-        if (!ss.fail() && ss.eof()) {
-            // Value is a number
-            std::stringstream formatted_value;
-            formatted_value << std::fixed << std::setprecision(6) << number;
-            std::string output = formatted_value.str();
-            // Remove trailing zeros and the decimal point if not needed
-            output.erase(output.find_last_not_of('0') + 1, std::string::npos);
-            if (output.back() == '.') {
-                output.pop_back();
+Value Interpreter::call_body(const FunctionDeclarationNode& function, FunctionProfile& profile, Symbol name, const std::vector<Value>& arguments) {
+    if (aot::Entry entry = native_entry(function)) {
+        ProfiledFunction scope(profiler, name);
+        return run_native(entry, arguments);
+    }
+    // Values are shared, not copied, so saving the caller's variables is cheap
+    call_frames.push_back(CallFrame{name, variables, std::nullopt});
+    PushedFrame frame(call_frames);
+    TailPosition tail(tail_depth, call_depth);
+    TailResults results(*this);
+    const FunctionDeclarationNode* body = &function;
+    FunctionProfile* body_profile = &profile;
+    const std::vector<Value>* bound = &arguments;
+    std::shared_ptr<const FunctionDeclarationNode> callee;  // Of a tail call; kept alive if the call redefines it
+    std::shared_ptr<FunctionProfile> callee_profile;
+    std::vector<Value> callee_arguments;
+    std::optional<Value> return_value;
+    while (true) {
+        {
+            ActiveProfile active(current_profile, body_profile);
+            for (size_t i = 0; i < body->parameters.size(); ++i) {
+                variables[body->parameters[i]] = (*bound)[i];
+            }
+            stats::note_variable_count(variables.size());
+            ProfiledFunction scope(profiler, name);
+            interpret_block(std::unique_ptr<BlockNode>(static_cast<BlockNode*>(body->body->clone().release())), return_value);
+        }
+        if (!call_frames.back().tail_call) {
+            break;
+        }
+        // As invoke_function, but the callee sees the variables the body left,
+        // as it would if called from it, and the frame puts back the caller's
+        TailCall next = std::move(*call_frames.back().tail_call);
+        call_frames.back().tail_call.reset();
+        return_value.reset();
+        auto it = functions.find(next.function);
+        if (it == functions.end()) {
+            throw std::runtime_error("Function not found: " + next.function);
+        }
+        callee = it->second;
+        if (callee->parameters.size() != next.arguments.size()) {
+            throw std::runtime_error("Argument count mismatch in function call: " + next.function);
+        }
+        stats::add(stats::FunctionCalls);
+        stats::add(stats::TailCalls);
+        name = next.function;
+        call_frames.back().function = name;
+        callee_profile = profile_for(callee);
+        if (aot::Entry entry = native_entry(*callee)) {
+            ProfiledFunction scope(profiler, name);
+            return_value = run_native(entry, next.arguments);
+            break;
+        }
+        if (auto compiled = optimized_code(*callee_profile)) {
+            ProfiledFunction scope(profiler, name);
+            return_value = compiled->run(*this, next.arguments, *callee_profile);
+            if (callee_profile->invalidated) {
+                deoptimize(*callee_profile);
             }
-            result += output;
+            break;
+        }
+        body = callee.get();
+        body_profile = callee_profile.get();
+        callee_arguments = std::move(next.arguments);
+        bound = &callee_arguments;
+    }
+    variables = std::move(call_frames.back().caller_variables);
+    Value result = return_value.has_value() ? std::move(*return_value) : Value();
+    results.keep(result);
+    return result;
+}
+
+std::shared_ptr<FunctionProfile> Interpreter::profile_for(const std::shared_ptr<const FunctionDeclarationNode>& function) {
+    auto& profile = profiles[function.get()];
+    if (!profile) {
+        profile = std::make_shared<FunctionProfile>();
+        profile->function = function;
+    }
+    return profile;
+}
+
+std::shared_ptr<const CompiledFunction> Interpreter::optimized_code(FunctionProfile& profile) {
+    if (native_entry(*profile.function)) {
+        return nullptr;  // Already native
+    }
+    if (profile.invalidated) {
+        deoptimize(profile);  // A call that failed a speculation ended in an error
+    }
+    ++profile.calls;
+    bool hot = execution_mode == ExecutionMode::Compiled ||
+               profile.calls > tier_policy.call_threshold || profile.back_edges > tier_policy.back_edge_threshold;
+    if (!profile.compiled && !profile.interpreted_only && tier_policy.enabled && hot) {
+        profile.compiled = CompiledFunction::compile(*profile.function, profile);
+        if (profile.compiled) {
+            stats::add(stats::FunctionsOptimized);
         } else {
-            // Value is not a number
-            result += value;
+            profile.interpreted_only = true;
         }
     }
-    return result;  // Return the formatted array without extra brackets
+    return profile.compiled;
+}
+
+// Back to the interpreter, which gathers counts again before recompiling with
+// the feedback of the failed speculation
+void Interpreter::deoptimize(FunctionProfile& profile) {
+    profile.invalidated = false;
+    if (!profile.compiled) {
+        return;  // Another activation of the function already did
+    }
+    profile.compiled.reset();
+    profile.calls = 0;
+    profile.back_edges = 0;
+    stats::add(stats::Deoptimizations);
+    // Compiled mode recompiles at the next call, with the feedback, however often that takes
+    if (++profile.deoptimizations >= tier_policy.max_deoptimizations && execution_mode == ExecutionMode::Tiered) {
+        profile.interpreted_only = true;
+    }
+}
+
+Value Interpreter::interpret_array_literal(std::unique_ptr<ArrayLiteralNode> array_literal) {
+    std::vector<Value> elements;
+    elements.reserve(array_literal->elements.size());
+    for (const auto& element : array_literal->elements) {
+        Value value = evaluate_expression(element->clone());
+        elements.push_back(value.is_text() ? Value(display_text(value.str())) : std::move(value));
+    }
+    return Value::array(std::move(elements));
 }
 
-std::string Interpreter::interpret_array_index(std::unique_ptr<ArrayIndexNode> array_index) {
-    std::string array_name = array_index->arrayName;
-    std::string index_str = evaluate_expression(array_index->index->clone());
-    if (!is_number(index_str)) {
+Value Interpreter::interpret_array_index(std::unique_ptr<ArrayIndexNode> array_index) {
+    std::string index_str = evaluate_expression(array_index->index->clone()).text();
+    if (!is_number_text(index_str)) {
+        throw std::runtime_error("Array index is not a valid number: " + index_str);
+    }
+    stats::add(stats::VariableLookups);
+    return element_at(variables[array_index->arrayName], index_str);
+}
+
+void Interpreter::interpret_array_assignment(std::unique_ptr<ArrayAssignmentNode> array_assignment) {
+    std::string index_str = evaluate_expression(array_assignment->index->clone()).text();
+    if (!is_number_text(index_str)) {
         throw std::runtime_error("Array index is not a valid number: " + index_str);
     }
     int index = std::stoi(index_str);
+    Value value = evaluate_expression(array_assignment->expression->clone());
+
+    stats::add(stats::VariableLookups);
+    auto it = variables.find(array_assignment->arrayName);
+    if (it == variables.end() || !it->second.is_array()) {
+        throw std::runtime_error("Not an array: " + array_assignment->arrayName);
+    }
+    // Copies the elements first if another variable or a caller still shares them
+    auto& elements = it->second.mutable_elements();
+    if (index < 0 || static_cast<size_t>(index) >= elements.size()) {
+        throw std::runtime_error("Array index out of bounds: " + index_str);
+    }
+    elements[index] = value.is_text() ? Value(display_text(value.str())) : std::move(value);
+}
+
+void Interpreter::interpret_object_declaration(std::unique_ptr<ObjectDeclarationNode> object_declaration) {
+    variables[object_declaration->identifier] = Value::object(heap.allocate());
+    stats::note_variable_count(variables.size());
+}
 
-    std::string array_value = variables[array_name];
-    if (array_value.front() != '[' || array_value.back() != ']') {
-        throw std::runtime_error("Variable is not an array: " + array_name);
+Value Interpreter::interpret_field_access(std::unique_ptr<FieldAccessNode> field_access) {
+    Value object = evaluate_expression(field_access->object->clone());
+    if (!object.is_object()) {
+        throw std::runtime_error("Not an object, reading field: " + field_access->field);
     }
-    array_value = array_value.substr(1, array_value.size() - 2);  // Remove brackets
+    // Fields never assigned read as empty, as unset variables do
+    const Value* value = object.as_object()->find(field_access->field);
+    return value ? *value : Value();
+}
 
-    std::istringstream ss(array_value);
-    std::string element;
-    int current_index = 0;
-    while (std::getline(ss, element, ',')) {
-        if (current_index == index) {
-            return element;
-        }
-        ++current_index;
+void Interpreter::interpret_field_assignment(std::unique_ptr<FieldAssignmentNode> field_assignment) {
+    Value object = evaluate_expression(field_assignment->object->clone());
+    if (!object.is_object()) {
+        throw std::runtime_error("Not an object, assigning field: " + field_assignment->field);
     }
-    throw std::runtime_error("Array index out of bounds: " + index_str);
-}
\ No newline at end of file
+    Value value = evaluate_expression(field_assignment->expression->clone());
+    heap.store(object.as_object(), field_assignment->field, std::move(value));
+}
@@ -1,48 +1,313 @@
 #ifndef INTERPRETER_H
 #define INTERPRETER_H
 
+#include "aot.h"
 #include "ast.h"
+#include "event_bus.h"
+#include "gc.h"
+#include "incremental.h"
+#include "input.h"
+#include "memo.h"
+#include "optimizer.h"
+#include "parallel.h"
+#include "profiler.h"
+#include "tier.h"
+#include "value.h"
+#include <chrono>
+#include <cstdint>
 #include <memory>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <string>
 #include <optional>
+#include <ostream>
+#include <iostream>
+
+class ThreadPool;
+struct ParallelWorker;
+
+struct ReloadSummary {
+    size_t reused = 0;    // Declarations whose source text was unchanged
+    size_t reparsed = 0;  // Declarations that had to be parsed again
+    size_t removed = 0;   // Functions that no longer exist in the new source
+};
+
+// Values a running loop or block keeps for the expressions
+// cache_expressions marked (see optimizer.h)
+struct ExpressionCache {
+    uint32_t id;                             // ASTNode::cache of the loop or block
+    std::vector<std::optional<Value>> values;  // By ASTNode::slot, empty until first computed
+};
+
+// How deeply script calls may nest
+struct CallPolicy {
+    // Calls running at once, inlined ones included; one more fails with an
+    // error, as does a call the thread's stack has no room left for. Calls
+    // nest on the native stack, and the default is what an unoptimized build
+    // has room for on an 8 MB stack; optimized builds allow a few thousand.
+    size_t max_depth = 1000;
+    // `return f(...)` in a function makes the call in the returning
+    // function's frame, so recursion in tail position does not nest
+    bool tail_calls = true;
+};
+
+// A call to f that a body returns, made once the body has unwound
+struct TailCall {
+    Symbol function;
+    std::vector<Value> arguments;
+};
+
+// A memoized call made in tail position returns the result of the frame it
+// was made in, kept under the call's key once the frame returns
+struct TailMemo {
+    std::shared_ptr<FunctionProfile> profile;
+    std::string key;
+};
+
+// An interpreted call running: what it keeps on the interpreter's frame
+// stack rather than on the C++ stack
+struct CallFrame {
+    Symbol function;  // The function whose body runs, which a tail call replaces
+    std::unordered_map<Symbol, Value> caller_variables;  // Put back when the call returns
+    std::optional<TailCall> tail_call;  // Set when the body returns a call to make in this frame
+};
 
 class Interpreter {
 public:
     void interpret(std::unique_ptr<ASTNode> ast);
+    // Parses `source` and loads it as interpret() does, keeping its tokens and
+    // statements so that reload() only parses again what changed
+    void interpret_source(const std::string& source);
     std::optional<std::string> execute();
 
+    // Calls a declared function with the given argument values
+    std::string call_function(const std::string& name, const std::vector<std::string>& arguments);
+    // A new interpreter with the same variables, functions and event listeners,
+    // but no pending program. Function bodies are shared rather than copied.
+    std::unique_ptr<Interpreter> fork() const;
+
+    // Destination of print statements and NPC actions; defaults to std::cout
+    void set_output(std::ostream& out);
+
+    // Source of `input` values; nullptr (the default) reads lines from std::cin
+    void set_input(InputProvider* input);
+
+    // Publishes NPC actions to `bus` instead of the output stream; nullptr detaches
+    void set_event_bus(EventBus* bus);
+    // Runs the listeners registered for `name` with event_data set to `data`;
+    // returns how many ran
+    size_t dispatch_event(const std::string& name, const std::string& data);
+
+    // Reports function and statement timings to `profiler` while executing; nullptr disables profiling
+    void set_profiler(Profiler* profiler);
+
+    // Binary snapshot of variables, functions, event listeners and the pending program (see snapshot.h)
+    void snapshot(std::ostream& out) const;
+    void restore(const char* data, size_t size);
+    void restore_file(const std::string& path);
+
+    // Script objects are collected incrementally while the script runs, a
+    // step of at most `budget` between top-level statements (see gc.h); a
+    // host can also collect between calls, e.g. once per frame
+    void set_gc_budget(std::chrono::nanoseconds budget);
+    // Does up to `budget` of collection work; returns true once no collection is in progress
+    bool collect_garbage(std::chrono::nanoseconds budget);
+    // Runs a complete collection
+    void collect_garbage();
+    GcStats gc_stats() const;
+
+    // Functions called often, or looping long, are compiled into a faster tier
+    // (see tier.h); setting a policy discards the code compiled so far
+    void set_tier_policy(const TierPolicy& policy);
+    // Compiled mode compiles the program and each function before it first
+    // runs, instead of interpreting until they are hot
+    void set_execution_mode(ExecutionMode mode);
+
+    // When the program is executed, calls to small functions are given a copy
+    // of the body to run in place of the call (see optimizer.h)
+    void set_inline_policy(const InlinePolicy& policy);
+    // What inlining did to the last program executed
+    const InlineSummary& inline_summary() const;
+
+    // When the program is executed, loops keep the values of expressions
+    // that do not change in them, and blocks those they compute again (see
+    // optimizer.h); on by default
+    void set_expression_caching(bool enabled);
+    // What the last program executed keeps
+    const ExpressionSummary& expression_summary() const;
+
+    // Calls to memoized functions keep their results by argument values,
+    // until the function is redefined or reloaded (see memo.h); setting a
+    // policy drops the results kept so far
+    void set_memo_policy(const MemoPolicy& policy);
+    // Per memoized function called since it was last defined
+    std::vector<MemoStats> memo_stats() const;
+
+    // How many threads run the iterations of a `parallel foreach` (see parallel.h)
+    void set_parallel_policy(const ParallelPolicy& policy);
+
+    // How deeply calls may nest, and whether calls in tail position reuse
+    // the caller's frame (see CallPolicy)
+    void set_call_policy(const CallPolicy& policy);
+
+    // Runs the pending program, and the functions it declares, from `module`,
+    // which must have been transpiled from that program (see aot.h); false if
+    // it was not, leaving the program to the interpreter
+    bool bind_native(std::shared_ptr<const NativeModule> module);
+
+    // Swaps in changed top-level functions and event listeners, keeping variable values (see hot_reload.cpp)
+    ReloadSummary reload(const std::string& source);
+
 private:
-    void interpret_node(std::unique_ptr<ASTNode> node, std::optional<std::string>& return_value);
-    void interpret_block(std::unique_ptr<BlockNode> block, std::optional<std::string>& return_value);
+    friend class TierCompiler;
+    friend class NativeRuntime;
+    friend class ParallelRun;
+
+    // Counts a call for as long as it runs, exceptions included. A call past
+    // call_policy.max_depth, or near the end of the thread's stack, fails
+    // with an error instead of overflowing it.
+    class CallScope {
+    public:
+        CallScope(Interpreter& interpreter, Symbol name);
+        ~CallScope() { --depth; }
+        CallScope(const CallScope&) = delete;
+        CallScope& operator=(const CallScope&) = delete;
+
+    private:
+        size_t& depth;
+    };
+
+    // Marks where the memoized calls made in tail position by one frame start
+    // in tail_memos, and drops them when the frame ends; keep() gives them its result
+    class TailResults {
+    public:
+        explicit TailResults(Interpreter& interpreter) : interpreter(interpreter), mark(interpreter.tail_memos.size()) {}
+        ~TailResults() { interpreter.tail_memos.resize(mark); }
+        TailResults(const TailResults&) = delete;
+        TailResults& operator=(const TailResults&) = delete;
+        void keep(const Value& result);
+
+    private:
+        Interpreter& interpreter;
+        size_t mark;
+    };
+
+    // fork, also returning which of the fork's objects copies which of ours
+    std::unique_ptr<Interpreter> fork(std::unordered_map<const ScriptObject*, ScriptObject*>& copies) const;
+
+    void interpret_node(std::unique_ptr<ASTNode> node, std::optional<Value>& return_value);
+    void interpret_block(std::unique_ptr<BlockNode> block, std::optional<Value>& return_value);
     void interpret_assignment(std::unique_ptr<AssignmentNode> assignment);
+    bool append_in_place(const AssignmentNode& assignment);
     void interpret_print(std::unique_ptr<PrintNode> print);
     void interpret_input(std::unique_ptr<InputNode> input);
     void interpret_function_declaration(std::unique_ptr<FunctionDeclarationNode> function);
-    void interpret_for_loop(std::unique_ptr<ForLoopNode> for_loop, std::optional<std::string>& return_value);
-    void interpret_while_loop(std::unique_ptr<WhileLoopNode> while_loop, std::optional<std::string>& return_value);
+    void interpret_for_loop(std::unique_ptr<ForLoopNode> for_loop, std::optional<Value>& return_value);
+    void interpret_while_loop(std::unique_ptr<WhileLoopNode> while_loop, std::optional<Value>& return_value);
 
     bool evaluate_condition(std::unique_ptr<ASTNode> condition);
 
-    void interpret_foreach_loop(std::unique_ptr<ForeachLoopNode> foreach_loop, std::optional<std::string>& return_value);
+    void interpret_foreach_loop(std::unique_ptr<ForeachLoopNode> foreach_loop, std::optional<Value>& return_value);
+    // Runs the iterations of a `parallel foreach` on several threads, or
+    // sequentially where they cannot be (see parallel.cpp); returns what the body returned
+    std::optional<Value> run_parallel_foreach(const ForeachLoopNode& loop, const Value& collection);
+    void run_foreach_items(const ForeachLoopNode& loop, const std::vector<Value>& items, size_t begin, std::optional<Value>& return_value);
+    bool record_reduction(const AssignmentNode& assignment);
     void interpret_event_listener(std::unique_ptr<EventListenerNode> event_listener);
     void interpret_npc_action(std::unique_ptr<NPCActionNode> npc_action);
-    void interpret_return(std::unique_ptr<ReturnNode> return_node, std::optional<std::string>& return_value);
-    std::string interpret_binary_expression(std::unique_ptr<BinaryExpressionNode> binary_expression);
-    std::string interpret_function_call(std::unique_ptr<FunctionCallNode> function_call);
+    void interpret_return(std::unique_ptr<ReturnNode> return_node, std::optional<Value>& return_value);
+    // Leaves a call the body returns for call_body to make in the body's
+    // frame, unless it has to be made here; returns what the body returns
+    Value return_call(const FunctionCallNode& call);
+    Value interpret_binary_expression(std::unique_ptr<BinaryExpressionNode> binary_expression);
+    Value interpret_function_call(std::unique_ptr<FunctionCallNode> function_call);
+    // Runs a call's inlined copy of the function body, or makes the call if
+    // the function has changed or been compiled since
+    Value invoke_inlined(Symbol name, const InlinedBody& inlined, std::vector<Value>& arguments);
+    // Answers the call from the function's kept results, or makes it and keeps the result
+    Value call_memoized(Symbol name, const InlinedBody* inlined, std::vector<Value>& arguments);
+    // For a memoized call to be made in tail position: the result kept for
+    // the arguments, or nullptr after noting the key in tail_memos
+    const Value* memo_tail_call(const std::shared_ptr<const FunctionDeclarationNode>& function, const std::vector<Value>& arguments);
+    // Binds already evaluated arguments to the parameters and runs the body
+    Value invoke_function(Symbol name, const std::vector<Value>& arguments);
+    // Runs the body of a call that has been counted and checked, natively if
+    // the function was compiled ahead of time, else in the interpreter on a
+    // new frame, along with the tail calls it returns
+    Value call_body(const FunctionDeclarationNode& function, FunctionProfile& profile, Symbol name, const std::vector<Value>& arguments);
+    // The function's native code, if it was compiled ahead of time
+    aot::Entry native_entry(const FunctionDeclarationNode& function) const;
+    Value run_native(aot::Entry entry, const std::vector<Value>& arguments);
+    std::optional<Value> run_native_program();
+    std::shared_ptr<FunctionProfile> profile_for(const std::shared_ptr<const FunctionDeclarationNode>& function);
+    // The function's optimized code, compiling it first if it has become hot
+    std::shared_ptr<const CompiledFunction> optimized_code(FunctionProfile& profile);
+    void deoptimize(FunctionProfile& profile);
 
-    std::string evaluate_expression(std::unique_ptr<ASTNode> node);
-    bool is_number(const std::string& s);
+    Value evaluate_expression(std::unique_ptr<ASTNode> node);
+    // The value the loop or block running keeps for the expression, computing it the first time
+    Value evaluate_cached(std::unique_ptr<ASTNode> node);
 
     // New function declarations for array handling
-    std::string interpret_array_literal(std::unique_ptr<ArrayLiteralNode> array_literal);
-    std::string interpret_array_index(std::unique_ptr<ArrayIndexNode> array_index);
+    Value interpret_array_literal(std::unique_ptr<ArrayLiteralNode> array_literal);
+    Value interpret_array_index(std::unique_ptr<ArrayIndexNode> array_index);
+    void interpret_array_assignment(std::unique_ptr<ArrayAssignmentNode> array_assignment);
+
+    void interpret_object_declaration(std::unique_ptr<ObjectDeclarationNode> object_declaration);
+    Value interpret_field_access(std::unique_ptr<FieldAccessNode> field_access);
+    void interpret_field_assignment(std::unique_ptr<FieldAssignmentNode> field_assignment);
 
-    std::unordered_map<std::string, std::string> variables;
-    std::unordered_map<std::string, std::unique_ptr<FunctionDeclarationNode>> functions;
-    std::unordered_map<std::string, std::vector<std::unique_ptr<EventListenerNode>>> events;
+    // Collection only runs where every live value is held by a variable or
+    // pinned: between statements outside any function call
+    void gc_safe_point();
+    void mark_roots(Heap& heap) const;
+
+    // Declared before the variables that reference its objects
+    Heap heap;
+    std::vector<const Value*> pinned_values;  // Temporaries the collector must treat as roots
+    size_t call_depth = 0;
+    CallPolicy call_policy;
+    std::vector<CallFrame> call_frames;  // Of the interpreted calls running, innermost last
+    // call_depth of the body whose `return f(...)` is in tail position: not
+    // in an inlined body, a compiled callee's or a for loop's
+    size_t tail_depth = SIZE_MAX;
+    std::vector<TailMemo> tail_memos;  // Of the frames running, innermost last
+    std::chrono::nanoseconds gc_budget = std::chrono::microseconds(250);
+
+    // Keyed by interned names, so lookups hash and compare a pointer
+    std::unordered_map<Symbol, Value> variables;
+    std::unordered_map<Symbol, std::shared_ptr<const FunctionDeclarationNode>> functions;  // Bodies are never modified, so forks share them
+    std::unordered_map<Symbol, std::vector<std::unique_ptr<EventListenerNode>>> events;
     std::unique_ptr<BlockNode> ast;
+
+    // Hot reload bookkeeping: the incrementally parsed current source, and the
+    // names of functions declared at its top level (listeners are marked `declared`)
+    std::unique_ptr<IncrementalFrontend> frontend;
+    std::unordered_set<Symbol> declared_functions;
+
+    // Keyed by declaration, so a redefined function starts over in the interpreter
+    std::unordered_map<const FunctionDeclarationNode*, std::shared_ptr<FunctionProfile>> profiles;
+    FunctionProfile* current_profile = nullptr;  // Of the interpreted function running, for counting loop iterations
+    TierPolicy tier_policy;
+    ExecutionMode execution_mode = ExecutionMode::Tiered;
+    InlinePolicy inline_policy;
+    InlineSummary inlined;
+    bool expression_caching = true;
+    ExpressionSummary cached;
+    std::vector<ExpressionCache> expression_caches;  // Of the loops and blocks running, innermost last
+    size_t impure_calls = 0;  // Calls to functions not known to be pure, so their results cannot be kept
+    MemoPolicy memo_policy;
+    ParallelPolicy parallel_policy;
+    std::shared_ptr<ThreadPool> parallel_pool;  // Created when a loop first needs it; forks share it
+    ParallelWorker* parallel_worker = nullptr;  // Set while this is a fork running a parallel loop's iterations
+    std::shared_ptr<TierStack> tier_stack;  // Frames of the compiled code running, created when first needed
+    std::shared_ptr<const NativeBinding> native;  // Set by bind_native until another program is loaded
+
+    Profiler* profiler = nullptr;
+    EventBus* event_bus = nullptr;
+    InputProvider* input_provider = nullptr;
+    std::ostream* output_stream = &std::cout;
 };
 
 #endif // INTERPRETER_H
\ No newline at end of file
@@ -1,11 +1,234 @@
 #include "lexer.h"
-#include <cctype>
+#include "stats.h"
+#include "utils.h"
+#include <algorithm>
+#include <cstring>
 #include <iostream>
-#include <unordered_set>
+#include <iterator>
 
-Lexer::Lexer(const std::string& source) : source(source), currentPosition(0), currentLine(1) {
+namespace {
+
+// How traces describe a token, as in "Identified keyword: fun"
+enum class Trace : uint8_t { Keyword, Symbol, Operator, ArrayIndex, Semicolon };
+
+struct TokenSpec {
+    const char* text;
+    TokenType type;
+    Trace trace;
+};
+
+// Every keyword and punctuation token. The character classes, the
+// punctuation DFA and the keyword hash table below are computed from it
+// at compile time.
+constexpr TokenSpec TOKEN_SPEC[] = {
+    {"print", TokenType::Print, Trace::Keyword},
+    {"fun", TokenType::Fun, Trace::Keyword},
+    {"return", TokenType::Return, Trace::Keyword},
+    {"for", TokenType::For, Trace::Keyword},
+    {"while", TokenType::While, Trace::Keyword},
+    {"foreach", TokenType::Foreach, Trace::Keyword},
+    {"event", TokenType::Event, Trace::Keyword},
+    {"npc", TokenType::Npc, Trace::Keyword},
+    {"input", TokenType::Input, Trace::Keyword},
+    {"do", TokenType::Do, Trace::Keyword},
+    {"end", TokenType::End, Trace::Keyword},
+    {"if", TokenType::If, Trace::Keyword},
+    {"elif", TokenType::Elif, Trace::Keyword},
+    {"else", TokenType::Else, Trace::Keyword},
+    {"to", TokenType::To, Trace::Keyword},
+    {"true", TokenType::True, Trace::Keyword},
+    {"false", TokenType::False, Trace::Keyword},
+    {"and", TokenType::And, Trace::Keyword},
+    {"or", TokenType::Or, Trace::Keyword},
+    {"not", TokenType::Not, Trace::Keyword},
+    {"in", TokenType::In, Trace::Keyword},
+    {"(", TokenType::LeftParen, Trace::Symbol},
+    {")", TokenType::RightParen, Trace::Symbol},
+    {"{", TokenType::LeftBrace, Trace::Symbol},
+    {"}", TokenType::RightBrace, Trace::Symbol},
+    {"[", TokenType::LeftBracket, Trace::ArrayIndex},
+    {"]", TokenType::RightBracket, Trace::ArrayIndex},
+    {",", TokenType::Comma, Trace::Symbol},
+    {".", TokenType::Dot, Trace::Symbol},
+    {"+", TokenType::Plus, Trace::Symbol},
+    {"-", TokenType::Minus, Trace::Symbol},
+    {"*", TokenType::Star, Trace::Symbol},
+    {"/", TokenType::Slash, Trace::Symbol},
+    {"=", TokenType::Assign, Trace::Operator},
+    {"==", TokenType::Equal, Trace::Operator},
+    {"!=", TokenType::NotEqual, Trace::Operator},
+    {"<", TokenType::Less, Trace::Operator},
+    {">", TokenType::Greater, Trace::Operator},
+    {"<=", TokenType::LessEqual, Trace::Operator},
+    {">=", TokenType::GreaterEqual, Trace::Operator},
+    {";", TokenType::Semicolon, Trace::Semicolon},
+};
+constexpr size_t TOKEN_COUNT = std::size(TOKEN_SPEC);
+
+constexpr size_t text_length(const char* text) {
+    size_t length = 0;
+    while (text[length]) {
+        ++length;
+    }
+    return length;
+}
+
+// As std::isspace, std::isalpha and std::isdigit in the "C" locale; a
+// byte that starts punctuation may still be an Other token on its own, as `!` is
+enum class CharClass : uint8_t { Other, End, Space, Letter, Digit, Quote, Punctuation };
+
+struct CharClasses {
+    CharClass of[256] = {};
+
+    CharClass operator[](char c) const { return of[static_cast<unsigned char>(c)]; }
+};
+
+constexpr CharClasses make_char_classes() {
+    CharClasses classes{};
+    for (int c = 0; c < 256; ++c) {
+        if (c == ' ' || (c >= '\t' && c <= '\r')) {
+            classes.of[c] = CharClass::Space;
+        } else if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_') {
+            classes.of[c] = CharClass::Letter;
+        } else if (c >= '0' && c <= '9') {
+            classes.of[c] = CharClass::Digit;
+        }
+    }
+    classes.of[0] = CharClass::End;
+    classes.of[static_cast<unsigned char>('"')] = CharClass::Quote;
+    for (const TokenSpec& spec : TOKEN_SPEC) {
+        if (!is_keyword(spec.type)) {
+            classes.of[static_cast<unsigned char>(spec.text[0])] = CharClass::Punctuation;
+        }
+    }
+    return classes;
+}
+
+constexpr CharClasses CHAR_CLASSES = make_char_classes();
+
+// One state per prefix of a punctuation token, the empty one included
+constexpr size_t punctuation_states() {
+    size_t states = 1;
+    for (const TokenSpec& spec : TOKEN_SPEC) {
+        if (!is_keyword(spec.type)) {
+            states += text_length(spec.text);
+        }
+    }
+    return states;
+}
+
+// Recognizes punctuation a byte at a time. State 0 is the start; a state
+// accepts the token spelled by the bytes leading to it, if there is one.
+template <size_t States>
+struct Dfa {
+    static_assert(States < 256, "states are numbered in a byte");
+    uint8_t next[States][256] = {};  // 0 where there is no transition
+    int8_t accepts[States] = {};     // Index into TOKEN_SPEC, or -1
+};
+
+template <size_t States>
+constexpr Dfa<States> make_punctuation_dfa() {
+    Dfa<States> dfa{};
+    for (size_t state = 0; state < States; ++state) {
+        dfa.accepts[state] = -1;
+    }
+    size_t states = 1;
+    for (size_t i = 0; i < TOKEN_COUNT; ++i) {
+        if (is_keyword(TOKEN_SPEC[i].type)) {
+            continue;
+        }
+        size_t state = 0;
+        for (const char* c = TOKEN_SPEC[i].text; *c; ++c) {
+            uint8_t& next = dfa.next[state][static_cast<unsigned char>(*c)];
+            if (!next) {
+                next = static_cast<uint8_t>(states++);
+            }
+            state = next;
+        }
+        dfa.accepts[state] = static_cast<int8_t>(i);
+    }
+    return dfa;
+}
+
+constexpr Dfa<punctuation_states()> PUNCTUATION = make_punctuation_dfa<punctuation_states()>();
+
+// FNV-1a from a seed, one byte at a time, so the lexer hashes an
+// identifier while it reads it
+constexpr uint32_t hash_start(uint32_t seed) {
+    return 2166136261u ^ seed;
+}
+
+constexpr uint32_t hash_step(uint32_t hash, char c) {
+    return (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+}
+
+// A perfect hash of the keywords: the first seed under which no two of
+// them share a bucket, found by the compiler
+template <size_t Buckets>
+struct KeywordTable {
+    static_assert((Buckets & (Buckets - 1)) == 0, "a power of two, so a bucket is a mask away");
+    uint32_t seed = 0;
+    int8_t buckets[Buckets] = {};  // Index into TOKEN_SPEC, or -1
+    size_t longest = 0;
+
+    constexpr size_t bucket(uint32_t hash) const { return hash & (Buckets - 1); }
+};
+
+template <size_t Buckets>
+constexpr KeywordTable<Buckets> make_keyword_table() {
+    for (uint32_t seed = 0;; ++seed) {
+        KeywordTable<Buckets> table{};
+        table.seed = seed;
+        for (size_t bucket = 0; bucket < Buckets; ++bucket) {
+            table.buckets[bucket] = -1;
+        }
+        bool collided = false;
+        for (size_t i = 0; i < TOKEN_COUNT && !collided; ++i) {
+            if (!is_keyword(TOKEN_SPEC[i].type)) {
+                continue;
+            }
+            uint32_t hash = hash_start(seed);
+            for (const char* c = TOKEN_SPEC[i].text; *c; ++c) {
+                hash = hash_step(hash, *c);
+            }
+            int8_t& bucket = table.buckets[table.bucket(hash)];
+            collided = bucket >= 0;
+            bucket = static_cast<int8_t>(i);
+            table.longest = std::max(table.longest, text_length(TOKEN_SPEC[i].text));
+        }
+        if (!collided) {
+            return table;
+        }
+    }
+}
+
+constexpr KeywordTable<64> KEYWORDS = make_keyword_table<64>();
+
+void trace_token(const TokenSpec& spec) {
+    switch (spec.trace) {
+        case Trace::Keyword:
+            trace_stream() << "Identified keyword: " << spec.text << std::endl;
+            break;
+        case Trace::Symbol:
+            trace_stream() << "Identified symbol: " << spec.text << std::endl;
+            break;
+        case Trace::Operator:
+            trace_stream() << "Identified operator: " << spec.text << std::endl;
+            break;
+        case Trace::ArrayIndex:
+            trace_stream() << "Identified array index symbol: " << spec.text << std::endl;
+            break;
+        case Trace::Semicolon:
+            trace_stream() << "Identified semicolon" << std::endl;
+            break;
+    }
+}
+
+}
+
+Lexer::Lexer(const std::string& source, int first_line) : source(source), currentPosition(0), currentLine(first_line) {
     currentChar = source[currentPosition];
-    std::cout << "Initializing lexer with source: " << source << std::endl;
+    trace_stream() << "Initializing lexer with source: " << source << std::endl;
 }
 
 void Lexer::advance() {
@@ -21,7 +244,7 @@ void Lexer::advance() {
 }
 
 void Lexer::skipWhitespace() {
-    while (std::isspace(currentChar)) {
+    while (CHAR_CLASSES[currentChar] == CharClass::Space) {
         advance();
     }
 }
@@ -36,127 +259,113 @@ void Lexer::skipComment() {
 }
 
 Token Lexer::identifier() {
-    std::string result;
+    size_t start = currentPosition;
     int line = currentLine;
-    while (std::isalnum(currentChar) || currentChar == '_') {
-        result += currentChar;
+    uint32_t hash = hash_start(KEYWORDS.seed);
+    while (CHAR_CLASSES[currentChar] == CharClass::Letter || CHAR_CLASSES[currentChar] == CharClass::Digit) {
+        hash = hash_step(hash, currentChar);
         advance();
     }
-    static const std::unordered_set<std::string> keywords = {
-        "print", "fun", "return", "for", "while", "foreach",
-        "event", "npc", "input", "do", "end", "if", "elif", "else", "to",
-        "true", "false", "and", "or", "not", "in"
-    };
-    if (keywords.find(result) != keywords.end()) {
-        std::cout << "Identified keyword: " << result << std::endl;
-        return {TokenType::Keyword, result, line};
+    size_t length = currentPosition - start;
+    std::string result = source.substr(start, length);
+    int8_t keyword = length <= KEYWORDS.longest ? KEYWORDS.buckets[KEYWORDS.bucket(hash)] : -1;
+    if (keyword >= 0 && std::strcmp(TOKEN_SPEC[keyword].text, result.c_str()) == 0) {
+        trace_token(TOKEN_SPEC[keyword]);
+        return {TOKEN_SPEC[keyword].type, result, line};
     }
-    std::cout << "Identified identifier: " << result << std::endl;
-    return {TokenType::Identifier, result, line};
+    trace_stream() << "Identified identifier: " << result << std::endl;
+    return {TokenType::Identifier, result, line, 0, Symbol(result)};
 }
 
 Token Lexer::number() {
-    std::string result;
+    size_t start = currentPosition;
     int line = currentLine;
-    while (std::isdigit(currentChar)) {
-        result += currentChar;
+    while (CHAR_CLASSES[currentChar] == CharClass::Digit) {
         advance();
     }
-    std::cout << "Identified number: " << result << std::endl;
+    std::string result = source.substr(start, currentPosition - start);
+    trace_stream() << "Identified number: " << result << std::endl;
     return {TokenType::Number, result, line};
 }
 
+// Strings have no escapes, so the text between the quotes is copied in one piece
 Token Lexer::string() {
-    std::string result;
     int line = currentLine;
-    advance(); // Skip the opening quote
-    while (currentChar != '"' && currentChar != '\0') {
-        result += currentChar;
-        advance();
+    size_t start = currentPosition + 1; // After the opening quote
+    size_t end = start;
+    while (end < source.size() && source[end] != '"' && source[end] != '\0') {
+        ++end;
     }
+    std::string result = source.substr(start, end - start);
+    currentLine += static_cast<int>(std::count(result.begin(), result.end(), '\n'));
+    currentPosition = end;
+    currentChar = end < source.size() ? source[end] : '\0';
     advance(); // Skip the closing quote
-    std::cout << "Identified string: " << result << std::endl;
-    return {TokenType::String, result, line};
+    trace_stream() << "Identified string: " << result << std::endl;
+    return {TokenType::String, result, line, 0};
 }
 
-Token Lexer::symbol_or_operator() {
-    std::string result(1, currentChar);
+// The longest punctuation token at the current character, or the character
+// alone as an Other token if none starts there
+Token Lexer::punctuation() {
+    size_t start = currentPosition;
     int line = currentLine;
-    advance();
-
-    if (result == "=") {
-        if (currentChar == '=') {
-            result += currentChar;
-            advance();
-            std::cout << "Identified operator: ==" << std::endl;
-            return {TokenType::Operator, result, line};
+    int accepted = -1;
+    size_t end = start + 1;
+    uint8_t state = 0;
+    for (size_t i = start; i < source.size(); ++i) {
+        state = PUNCTUATION.next[state][static_cast<unsigned char>(source[i])];
+        if (!state) {
+            break;
         }
-        std::cout << "Identified operator: =" << std::endl;
-        return {TokenType::Operator, result, line};
-    }
-
-    if (result == "<" || result == ">") {
-        if (currentChar == '=') {
-            result += currentChar;
-            advance();
+        if (PUNCTUATION.accepts[state] >= 0) {
+            accepted = PUNCTUATION.accepts[state];
+            end = i + 1;
         }
-        std::cout << "Identified operator: " << result << std::endl;
-        return {TokenType::Operator, result, line};
     }
-
-    if (result == "!") {
-        if (currentChar == '=') {
-            result += currentChar;
-            advance();
-            std::cout << "Identified operator: !=" << std::endl;
-            return {TokenType::Operator, result, line};
-        }
-    }
-
-    if (result == "[" || result == "]") {
-        std::cout << "Identified array index symbol: " << result << std::endl;
-        return {TokenType::Symbol, result, line};
+    seek(end, line);  // Punctuation spans no newlines
+    std::string result = source.substr(start, end - start);
+    if (accepted < 0) {
+        trace_stream() << "Identified symbol: " << result << std::endl;
+        return {TokenType::Other, result, line};
     }
-
-    std::cout << "Identified symbol: " << result << std::endl;
-    return {TokenType::Symbol, result, line};
+    trace_token(TOKEN_SPEC[accepted]);
+    return {TOKEN_SPEC[accepted].type, result, line};
 }
 
 Token Lexer::nextToken() {
-    while (currentChar != '\0') {
-        if (std::isspace(currentChar)) {
-            skipWhitespace();
-            continue;
-        }
-
-        if (currentChar == '/' && peek() == '/') {
-            skipComment();
-            continue;
-        }
-
-        if (std::isalpha(currentChar) || currentChar == '_') {
-            return identifier();
-        }
-
-        if (std::isdigit(currentChar)) {
-            return number();
-        }
-
-        if (currentChar == '"') {
-            return string();
-        }
-
-        if (currentChar == ';') {
-            int line = currentLine;
-            advance();
-            std::cout << "Identified semicolon" << std::endl;
-            return {TokenType::Semicolon, ";", line};
+    while (true) {
+        size_t start = currentPosition;
+        Token token;
+        switch (CHAR_CLASSES[currentChar]) {
+            case CharClass::End:
+                return {TokenType::EndOfFile, "", currentLine, source.size()};
+            case CharClass::Space:
+                skipWhitespace();
+                continue;
+            case CharClass::Letter:
+                token = identifier();
+                break;
+            case CharClass::Digit:
+                token = number();
+                break;
+            case CharClass::Quote:
+                token = string();
+                break;
+            case CharClass::Punctuation:
+                if (currentChar == '/' && peek() == '/') {
+                    skipComment();
+                    continue;
+                }
+                token = punctuation();
+                break;
+            case CharClass::Other:
+                token = punctuation();
+                break;
         }
-
-        return symbol_or_operator();
+        token.offset = start;
+        return token;
     }
-
-    return {TokenType::EndOfFile, "", currentLine};
 }
 
 char Lexer::peek() const {
@@ -166,7 +375,18 @@ char Lexer::peek() const {
     return '\0';
 }
 
+void Lexer::seek(size_t offset, int line) {
+    currentPosition = offset;
+    currentLine = line;
+    currentChar = offset < source.size() ? source[offset] : '\0';
+}
+
+Token Lexer::next() {
+    return nextToken();
+}
+
 std::vector<Token> Lexer::tokenize() {
+    stats::Timer timer(stats::LexNanoseconds);
     std::vector<Token> tokens;
     Token token = nextToken();
     while (token.type != TokenType::EndOfFile) {
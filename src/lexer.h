@@ -1,32 +1,86 @@
 #ifndef LEXER_H
 #define LEXER_H
 
+#include "symbol.h"
+#include <cstdint>
 #include <string>
 #include <vector>
 
-enum class TokenType {
+// What a token is. Keywords and punctuation each have their own kind, so
+// the parser switches on it rather than comparing text; their spelling is
+// declared once, in the lexer's TOKEN_SPEC.
+enum class TokenType : uint8_t {
     Identifier,
     Number,
     String,
-    Keyword,
-    Symbol,
-    Operator,
+    // Keywords, from Print to In
+    Print,
+    Fun,
+    Return,
+    For,
+    While,
+    Foreach,
+    Event,
+    Npc,
+    Input,
+    Do,
+    End,
+    If,
+    Elif,
+    Else,
+    To,
+    True,
+    False,
+    And,
+    Or,
+    Not,
+    In,
+    // Punctuation
+    LeftParen,
+    RightParen,
+    LeftBrace,
+    RightBrace,
+    LeftBracket,
+    RightBracket,
+    Comma,
+    Dot,
+    Plus,
+    Minus,
+    Star,
+    Slash,
+    Assign,
+    Equal,
+    NotEqual,
+    Less,
+    Greater,
+    LessEqual,
+    GreaterEqual,
     Semicolon,
-    ArrayIndex,
+    Other,  // Any other character, which no statement or expression starts with
     EndOfFile
 };
 
+constexpr bool is_keyword(TokenType type) {
+    return type >= TokenType::Print && type <= TokenType::In;
+}
+
 struct Token {
     TokenType type;
     std::string value;
     int line; // Line number for error reporting
+    size_t offset = 0; // Byte offset of the token's first character in the source
+    Symbol symbol = Symbol(); // Interned value of identifiers; empty for every other kind
 };
 
 class Lexer {
 public:
-    Lexer(const std::string& source);
+    Lexer(const std::string& source, int first_line = 1);
     std::vector<Token> tokenize();
 
+    // Resumes lexing at a token boundary, for incremental re-lexing
+    void seek(size_t offset, int line);
+    Token next();
+
 private:
     std::string source;
     size_t currentPosition;
@@ -39,7 +93,7 @@ private:
     Token identifier();
     Token number();
     Token string();
-    Token symbol_or_operator();
+    Token punctuation();
     Token nextToken();
     char peek() const;
 };
@@ -1,36 +1,298 @@
+#include "aot.h"
+#include "batch.h"
+#include "event_bus.h"
 #include "lexer.h"
 #include "parser.h"
+#include "server.h"
 #include "interpreter.h"
+#include "stats.h"
+#include "utils.h"
+#include <cstdint>
 #include <iostream>
 #include <fstream>
+#include <optional>
 #include <sstream>
+#include <stdexcept>
+#include <thread>
 
-std::string read_file(const std::string& filename) {
-    std::ifstream file(filename);
-    if (!file.is_open()) {
-        throw std::runtime_error("Could not open file: " + filename);
+namespace {
+
+// More threads than any machine this runs on has cores
+constexpr size_t MAX_JOBS = 1024;
+
+// The value of an "--option=<n>" argument if it is a whole number from 1 to `max`
+std::optional<size_t> parse_count(const std::string& argument, size_t max) {
+    std::string text = argument.substr(argument.find('=') + 1);
+    size_t used = 0;
+    unsigned long long count = 0;
+    try {
+        count = std::stoull(text, &used);
+    } catch (const std::logic_error&) {
+        return std::nullopt;
     }
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    return buffer.str();
+    if (used != text.size() || text[0] == '-' || count == 0 || count > max) {
+        return std::nullopt;
+    }
+    return static_cast<size_t>(count);
+}
+
+// Runs world events from the host until it sends Close. Polling only yields
+// the thread while the ring is empty, so delivery needs no system calls.
+void serve_events(Interpreter& interpreter, EventBus& bus) {
+    BusRecord record;
+    while (true) {
+        if (!bus.receive(record)) {
+            std::this_thread::yield();
+            continue;
+        }
+        if (record.kind == RecordKind::Close) {
+            return;
+        }
+        if (record.kind == RecordKind::WorldEvent) {
+            interpreter.dispatch_event(record.name_text(), record.payload_text());
+        }
+    }
+}
+
 }
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <source_file>" << std::endl;
+    std::string source_file;
+    std::string profile_output;
+    std::string stats_output;
+    std::string batch_path;
+    std::string socket_path;
+    std::string bus_name;
+    std::string input_file;
+    size_t jobs = 0;
+    size_t max_call_depth = CallPolicy().max_depth;
+    bool profile = false;
+    bool stats = false;
+    bool show_output = false;
+    bool tiering = true;
+    bool compiled = false;
+    bool native = false;
+    bool inlining = true;
+    bool inline_report = false;
+    bool expression_caching = true;
+    bool cache_report = false;
+    bool memoization = true;
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        if (argument == "--profile") {
+            profile = true;
+            profile_output = "abyssian.folded";
+        } else if (argument.rfind("--profile=", 0) == 0) {
+            profile = true;
+            profile_output = argument.substr(10);
+        } else if (argument == "--stats") {
+            stats = true;
+        } else if (argument.rfind("--stats=", 0) == 0) {
+            stats = true;
+            stats_output = argument.substr(8);
+        } else if (argument.rfind("--batch=", 0) == 0) {
+            batch_path = argument.substr(8);
+        } else if (argument.rfind("--serve=", 0) == 0) {
+            socket_path = argument.substr(8);
+        } else if (argument.rfind("--event-bus=", 0) == 0) {
+            bus_name = argument.substr(12);
+        } else if (argument.rfind("--input=", 0) == 0) {
+            input_file = argument.substr(8);
+        } else if (argument.rfind("--jobs=", 0) == 0) {
+            auto count = parse_count(argument, MAX_JOBS);
+            if (!count) {
+                std::cerr << "Error: Invalid value for --jobs: " << argument.substr(7) << std::endl;
+                return 1;
+            }
+            jobs = *count;
+        } else if (argument.rfind("--max-call-depth=", 0) == 0) {
+            auto count = parse_count(argument, SIZE_MAX);
+            if (!count) {
+                std::cerr << "Error: Invalid value for --max-call-depth: " << argument.substr(17) << std::endl;
+                return 1;
+            }
+            max_call_depth = *count;
+        } else if (argument == "--show-output") {
+            show_output = true;
+        } else if (argument == "--no-tier") {
+            tiering = false;
+        } else if (argument == "--compiled") {
+            compiled = true;
+        } else if (argument == "--aot") {
+            native = true;
+        } else if (argument == "--no-inline") {
+            inlining = false;
+        } else if (argument == "--inline-report") {
+            inline_report = true;
+        } else if (argument == "--no-expression-cache") {
+            expression_caching = false;
+        } else if (argument == "--cache-report") {
+            cache_report = true;
+        } else if (argument == "--no-memo") {
+            memoization = false;
+        } else if (source_file.empty()) {
+            source_file = argument;
+        } else {
+            source_file.clear();
+            break;
+        }
+    }
+    if (!socket_path.empty() && source_file.empty() && batch_path.empty()) {
+        // Long-lived server with a warm program cache; see server.h
+        try {
+            ServerOptions options;
+            options.socket_path = socket_path;
+            options.workers = jobs;
+            ScriptServer server(options);
+            server.serve();
+            return 0;
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+    if (!batch_path.empty() && source_file.empty()) {
+        // Validates many scripts in one process; see batch.h
+        try {
+            BatchReport report = run_batch(collect_batch_files(batch_path), jobs);
+            write_batch_report(std::cout, report, show_output);
+            if (stats) {
+                if (stats_output.empty()) {
+                    write_stats_json(std::cerr, collect_stats());
+                } else {
+                    std::ofstream out(stats_output);
+                    write_stats_json(out, collect_stats());
+                }
+            }
+            return report.failed == 0 ? 0 : 1;
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+    if (source_file.empty() || !batch_path.empty() || !socket_path.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--profile[=<stacks_file>]] [--stats[=<json_file>]] [--event-bus=<name>] [--input=<file>] [--no-tier|--compiled|--aot] [--no-inline] [--inline-report] [--no-expression-cache] [--no-memo] [--cache-report] [--jobs=<n>] [--max-call-depth=<n>] <source_file>" << std::endl;
+        std::cerr << "       " << argv[0] << " --batch=<directory|manifest> [--jobs=<n>] [--show-output] [--stats[=<json_file>]]" << std::endl;
+        std::cerr << "       " << argv[0] << " --serve=<socket_path> [--jobs=<n>]" << std::endl;
         return 1;
     }
 
     try {
-        std::string source_code = read_file(argv[1]);
+        std::string source_code = read_file(source_file);
         Lexer lexer(source_code);
         auto tokens = lexer.tokenize();
 
         Parser parser(tokens);
         auto ast = parser.parse();
 
+        // Compiled to a shared object next to the script, reused while the script is unchanged
+        std::shared_ptr<const NativeModule> module;
+        std::string native_error;
+        if (native) {
+            uint64_t source_hash = hash_source(source_code);
+            std::string library = source_file + ".so";
+            if (std::ifstream(library).good()) {
+                module = NativeModule::load(library, native_error);
+                if (module && module->source_hash() != source_hash) {
+                    module.reset();
+                }
+            }
+            auto block = dynamic_cast<const BlockNode*>(ast.get());
+            if (!module && block && compile_native(transpile(*block, source_hash), library, native_error)) {
+                module = NativeModule::load(library, native_error);
+            }
+        }
+
         Interpreter interpreter;
         interpreter.interpret(std::move(ast));
+        if (native && !(module && interpreter.bind_native(module))) {
+            std::cerr << "Not compiled ahead of time, running in the interpreter: "
+                      << (native_error.empty() ? "the library does not match the program" : native_error) << std::endl;
+        }
+
+        // Everything in the tree-walking interpreter, e.g. to compare against the optimized tier
+        if (!tiering) {
+            TierPolicy policy;
+            policy.enabled = false;
+            interpreter.set_tier_policy(policy);
+        }
+        // Or nothing in it: the program and functions are compiled before they run
+        if (compiled) {
+            interpreter.set_execution_mode(ExecutionMode::Compiled);
+        }
+        // Only the script calls its functions here, so the ones it never calls can go
+        InlinePolicy inline_policy;
+        inline_policy.enabled = inlining;
+        inline_policy.remove_unused_functions = true;
+        interpreter.set_inline_policy(inline_policy);
+        interpreter.set_expression_caching(expression_caching);
+        MemoPolicy memo_policy;
+        memo_policy.enabled = memoization;
+        interpreter.set_memo_policy(memo_policy);
+        // Threads for `parallel foreach`, one per hardware thread by default
+        ParallelPolicy parallel_policy;
+        parallel_policy.workers = jobs;
+        interpreter.set_parallel_policy(parallel_policy);
+        // Deeper recursion fails with an error rather than overflowing the stack
+        CallPolicy call_policy;
+        call_policy.max_depth = max_call_depth;
+        interpreter.set_call_policy(call_policy);
+
+        // Canned responses for `input` statements instead of the terminal
+        std::unique_ptr<InputProvider> input;
+        if (!input_file.empty()) {
+            input = std::make_unique<FileInput>(input_file);
+            interpreter.set_input(input.get());
+        }
+
+        // Attached to a game host: NPC actions go out on the bus and world events come in
+        std::unique_ptr<EventBus> bus;
+        if (!bus_name.empty()) {
+            bus = EventBus::open(bus_name);
+            interpreter.set_event_bus(bus.get());
+        }
+
+        // The requested reports are written once the program has run, also when it failed
+        Profiler profiler;
+        if (profile) {
+            interpreter.set_profiler(&profiler);
+        }
+        auto report = [&] {
+            if (inline_report) {
+                write_inline_report(std::cerr, interpreter.inline_summary());
+            }
+            if (cache_report) {
+                write_expression_report(std::cerr, interpreter.expression_summary());
+                write_memo_report(std::cerr, interpreter.memo_stats());
+            }
+            if (profile) {
+                std::ofstream stacks(profile_output);
+                if (!stacks.is_open()) {
+                    throw std::runtime_error("Could not open file: " + profile_output);
+                }
+                profiler.write_collapsed(stacks);
+                profiler.write_report(std::cerr);
+            }
+            if (stats && stats_output.empty()) {
+                write_stats_json(std::cerr, collect_stats());
+            } else if (stats) {
+                std::ofstream out(stats_output);
+                if (!out.is_open()) {
+                    throw std::runtime_error("Could not open file: " + stats_output);
+                }
+                write_stats_json(out, collect_stats());
+            }
+        };
+        try {
+            interpreter.execute();
+            if (bus) {
+                serve_events(interpreter, *bus);
+            }
+        } catch (...) {
+            report();
+            throw;
+        }
+        report();
 
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
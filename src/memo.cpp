@@ -0,0 +1,99 @@
+#include "memo.h"
+#include "stats.h"
+#include <iomanip>
+
+namespace {
+
+bool holds_object(const Value& value) {
+    if (value.is_object()) {
+        return true;
+    }
+    if (value.is_array()) {
+        for (const auto& element : value.elements()) {
+            if (holds_object(element)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Text is length-prefixed, so no two lists of values share a key
+bool append_key(const Value& value, std::string& key) {
+    if (value.is_object()) {
+        return false;
+    }
+    if (value.is_array()) {
+        const auto& elements = value.elements();
+        key += 'a' + std::to_string(elements.size()) + ':';
+        for (const auto& element : elements) {
+            if (!append_key(element, key)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    const std::string& text = value.str();
+    key += 't' + std::to_string(text.size()) + ':';
+    key += text;
+    return true;
+}
+
+}
+
+std::optional<std::string> MemoTable::key(const std::vector<Value>& arguments) {
+    std::string key;
+    for (const auto& argument : arguments) {
+        if (!append_key(argument, key)) {
+            return std::nullopt;
+        }
+    }
+    return key;
+}
+
+const Value* MemoTable::find(const std::string& key) {
+    auto it = results.find(key);
+    if (it == results.end()) {
+        ++misses;
+        stats::add(stats::MemoMisses);
+        return nullptr;
+    }
+    ++hits;
+    stats::add(stats::MemoHits);
+    recent.splice(recent.begin(), recent, it->second.second);
+    return &it->second.first;
+}
+
+void MemoTable::insert(std::string key, const Value& result, size_t capacity) {
+    if (capacity == 0 || holds_object(result) || results.count(key)) {
+        return;
+    }
+    recent.push_front(key);
+    results.emplace(std::move(key), std::make_pair(result, recent.begin()));
+    if (results.size() > capacity) {
+        results.erase(recent.back());
+        recent.pop_back();
+        ++evictions;
+    }
+}
+
+MemoStats MemoTable::stats(Symbol function) const {
+    MemoStats stats;
+    stats.function = function;
+    stats.entries = results.size();
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.evictions = evictions;
+    return stats;
+}
+
+void write_memo_report(std::ostream& out, const std::vector<MemoStats>& functions) {
+    out << "Memoized " << functions.size() << " functions" << std::endl;
+    for (const auto& function : functions) {
+        out << "  " << std::left << std::setw(20) << function.function.str()
+            << " hits " << std::setw(7) << function.hits
+            << " misses " << std::setw(7) << function.misses
+            << " kept " << std::setw(5) << function.entries
+            << " evicted " << function.evictions << std::endl;
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include "symbol.h"
+#include "value.h"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Which calls keep their results (see FunctionDeclarationNode::memoized)
+struct MemoPolicy {
+    bool enabled = true;
+    size_t capacity = 256;  // Results kept per function
+};
+
+struct MemoStats {
+    Symbol function;
+    size_t entries = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+};
+
+// Results of one function's calls keyed on the argument values, dropping the
+// least recently used beyond a capacity. Calls with an object among their
+// arguments or in their result are not kept: objects compare by identity, and
+// the collector may free one and give its address to another.
+class MemoTable {
+public:
+    // The arguments' text, kinds included, or nothing if they hold an object
+    static std::optional<std::string> key(const std::vector<Value>& arguments);
+
+    // The result kept for `key`, now the most recently used; nullptr if there is none
+    const Value* find(const std::string& key);
+    void insert(std::string key, const Value& result, size_t capacity);
+
+    MemoStats stats(Symbol function) const;
+
+private:
+    std::unordered_map<std::string, std::pair<Value, std::list<std::string>::iterator>> results;
+    std::list<std::string> recent;  // Most recently used first
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+};
+
+// One line per function, with its hits, misses and results kept
+void write_memo_report(std::ostream& out, const std::vector<MemoStats>& functions);
+
+#endif // MEMO_H
@@ -0,0 +1,174 @@
+#include "operations.h"
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+bool is_number_text(const std::string& s) {
+    size_t i = 0;
+    if (i < s.size() && s[i] == '-') {
+        ++i;
+    }
+    size_t digits = i;
+    while (i < s.size() && s[i] >= '0' && s[i] <= '9') {
+        ++i;
+    }
+    if (i == digits) {
+        return false;
+    }
+    if (i < s.size() && s[i] == '.') {
+        size_t fraction = ++i;
+        while (i < s.size() && s[i] >= '0' && s[i] <= '9') {
+            ++i;
+        }
+        if (i == fraction) {
+            return false;
+        }
+    }
+    return i == s.size();
+}
+
+std::string display_text(const std::string& value) {
+    std::stringstream ss(value);
+    double number;
+    ss >> number;
+    if (ss.fail() || !ss.eof()) {
+        return value;
+    }
+    std::stringstream formatted_value;
+    formatted_value << std::fixed << std::setprecision(6) << number;
+    std::string output = formatted_value.str();
+    // Remove trailing zeros and the decimal point if not needed
+    output.erase(output.find_last_not_of('0') + 1, std::string::npos);
+    if (output.back() == '.') {
+        output.pop_back();
+    }
+    return output;
+}
+
+BinaryOp binary_op(const std::string& op) {
+    if (op == "+") {
+        return BinaryOp::Add;
+    } else if (op == "-") {
+        return BinaryOp::Subtract;
+    } else if (op == "*") {
+        return BinaryOp::Multiply;
+    } else if (op == "/") {
+        return BinaryOp::Divide;
+    } else if (op == "and") {
+        return BinaryOp::And;
+    } else if (op == "or") {
+        return BinaryOp::Or;
+    } else if (op == "<") {
+        return BinaryOp::Less;
+    } else if (op == ">") {
+        return BinaryOp::Greater;
+    } else if (op == "<=") {
+        return BinaryOp::LessEqual;
+    } else if (op == ">=") {
+        return BinaryOp::GreaterEqual;
+    }
+    return BinaryOp::Unknown;
+}
+
+Value apply_binary(BinaryOp op, const std::string& op_text, const Value& left, const Value& right) {
+    if (left.is_text() && right.is_text() && is_number_text(left.str()) && is_number_text(right.str())) {
+        double left_num = std::stod(left.str());
+        double right_num = std::stod(right.str());
+        switch (op) {
+            case BinaryOp::Add:
+                return std::to_string(left_num + right_num);
+            case BinaryOp::Subtract:
+                return std::to_string(left_num - right_num);
+            case BinaryOp::Multiply:
+                return std::to_string(left_num * right_num);
+            case BinaryOp::Divide:
+                if (right_num == 0) {
+                    throw std::runtime_error("Division by zero");
+                }
+                return std::to_string(left_num / right_num);
+            case BinaryOp::And:
+                return (left == "true" && right == "true") ? "true" : "false";
+            case BinaryOp::Or:
+                return (left == "true" || right == "true") ? "true" : "false";
+            case BinaryOp::Less:
+                return (left_num < right_num) ? "true" : "false";
+            case BinaryOp::Greater:
+                return (left_num > right_num) ? "true" : "false";
+            case BinaryOp::LessEqual:
+                return (left_num <= right_num) ? "true" : "false";
+            case BinaryOp::GreaterEqual:
+                return (left_num >= right_num) ? "true" : "false";
+            case BinaryOp::Unknown:
+                break;
+        }
+        throw std::runtime_error("Unknown binary operator: " + op_text);
+    } else if (op == BinaryOp::Add) {
+        // Concatenate strings
+        return Value(left.text() + right.text());
+    }
+    throw std::runtime_error("Invalid operands for binary operator: " + op_text);
+}
+
+Value apply_number_binary(BinaryOp op, const std::string& op_text, const Value& left, const Value& right) {
+    double left_num = std::stod(left.str());
+    double right_num = std::stod(right.str());
+    if (!std::isfinite(left_num) || !std::isfinite(right_num)) {
+        return apply_binary(op, op_text, left, right);
+    }
+    switch (op) {
+        case BinaryOp::Add:
+            return std::to_string(left_num + right_num);
+        case BinaryOp::Subtract:
+            return std::to_string(left_num - right_num);
+        case BinaryOp::Multiply:
+            return std::to_string(left_num * right_num);
+        case BinaryOp::Divide:
+            if (right_num == 0) {
+                throw std::runtime_error("Division by zero");
+            }
+            return std::to_string(left_num / right_num);
+        case BinaryOp::Less:
+            return (left_num < right_num) ? "true" : "false";
+        case BinaryOp::Greater:
+            return (left_num > right_num) ? "true" : "false";
+        case BinaryOp::LessEqual:
+            return (left_num <= right_num) ? "true" : "false";
+        case BinaryOp::GreaterEqual:
+            return (left_num >= right_num) ? "true" : "false";
+        default:
+            return apply_binary(op, op_text, left, right);
+    }
+}
+
+Value element_at(const Value& array, const std::string& index_text) {
+    if (!is_number_text(index_text)) {
+        throw std::runtime_error("Array index is not a valid number: " + index_text);
+    }
+    int index = std::stoi(index_text);
+
+    if (array.is_array()) {
+        const auto& elements = array.elements();
+        if (index < 0 || static_cast<size_t>(index) >= elements.size()) {
+            throw std::runtime_error("Array index out of bounds: " + index_text);
+        }
+        return elements[index];
+    }
+
+    // Comma-separated text, optionally bracketed, indexes like an array
+    std::string array_value = array.text();
+    if (!array_value.empty() && array_value.front() == '[' && array_value.back() == ']') {
+        array_value = array_value.substr(1, array_value.size() - 2);  // Remove brackets
+    }
+
+    std::istringstream ss(array_value);
+    std::string element;
+    int current_index = 0;
+    while (std::getline(ss, element, ',')) {
+        if (current_index == index) {
+            return Value(element);
+        }
+        ++current_index;
+    }
+    throw std::runtime_error("Array index out of bounds: " + index_text);
+}
@@ -0,0 +1,45 @@
+#ifndef OPERATIONS_H
+#define OPERATIONS_H
+
+#include "value.h"
+#include <string>
+
+// Semantics of script values shared by the tree-walking interpreter and the
+// optimized tier (see tier.h), so both compute identical results.
+
+// Matches -?[0-9]+(\.[0-9]+)?
+bool is_number_text(const std::string& s);
+
+// Numbers print without trailing zeros: "5.000000" as "5", "2.500000" as "2.5"
+std::string display_text(const std::string& value);
+
+enum class BinaryOp {
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    And,
+    Or,
+    Less,
+    Greater,
+    LessEqual,
+    GreaterEqual,
+    Unknown  // Parsed but not implemented, such as == and !=
+};
+
+BinaryOp binary_op(const std::string& op);
+
+// `left op right`. Numbers are computed on the values their text parses to
+// and give std::to_string text; comparisons give "true" or "false"; `+`
+// concatenates anything else. `op_text` is the operator as written, for errors.
+Value apply_binary(BinaryOp op, const std::string& op_text, const Value& left, const Value& right);
+
+// apply_binary for operands infer_types (see types.h) proved to be numbers,
+// without checking their text. An operand that overflowed to "inf" is still
+// handled as apply_binary would.
+Value apply_number_binary(BinaryOp op, const std::string& op_text, const Value& left, const Value& right);
+
+// `array[index]`, where text holding comma-separated items indexes like an array
+Value element_at(const Value& array, const std::string& index_text);
+
+#endif // OPERATIONS_H
@@ -0,0 +1,799 @@
+#include "optimizer.h"
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+// Shared by every program, so a declaration from another one never matches
+std::atomic<uint64_t> next_inline_id{1};
+
+size_t count_nodes(const ASTNode& node) {
+    size_t count = 1;
+    for_each_child(node, [&](const ASTNode& child) {
+        count += count_nodes(child);
+    });
+    return count;
+}
+
+template <typename Predicate>
+bool contains(const ASTNode& node, Predicate predicate) {
+    if (predicate(node)) {
+        return true;
+    }
+    bool found = false;
+    for_each_child(node, [&](const ASTNode& child) {
+        found = found || contains(child, predicate);
+    });
+    return found;
+}
+
+bool calls(const ASTNode& node, Symbol name) {
+    return contains(node, [name](const ASTNode& child) {
+        auto call = dynamic_cast<const FunctionCallNode*>(&child);
+        return call && call->identifier == name;
+    });
+}
+
+// A `for` loop catching an error from a call keeps the callee's variables
+bool catches_call_errors(const ASTNode& node) {
+    return contains(node, [](const ASTNode& child) {
+        auto for_loop = dynamic_cast<const ForLoopNode*>(&child);
+        return for_loop && contains(*for_loop, [](const ASTNode& inner) {
+            return dynamic_cast<const FunctionCallNode*>(&inner) != nullptr;
+        });
+    });
+}
+
+// Every variable the body can read or write, including reads of missing
+// variables, which add them to the map
+void collect_locals(const ASTNode& node, std::vector<Symbol>& locals) {
+    std::optional<Symbol> name;
+    if (auto identifier = dynamic_cast<const IdentifierNode*>(&node)) {
+        name = identifier->identifier;
+    } else if (auto assignment = dynamic_cast<const AssignmentNode*>(&node)) {
+        name = assignment->identifier;
+    } else if (auto input = dynamic_cast<const InputNode*>(&node)) {
+        name = input->identifier;
+    } else if (auto for_loop = dynamic_cast<const ForLoopNode*>(&node)) {
+        name = for_loop->identifier;
+    } else if (auto foreach_loop = dynamic_cast<const ForeachLoopNode*>(&node)) {
+        name = foreach_loop->identifier;
+    } else if (auto array_index = dynamic_cast<const ArrayIndexNode*>(&node)) {
+        name = array_index->arrayName;
+    } else if (auto array_assignment = dynamic_cast<const ArrayAssignmentNode*>(&node)) {
+        name = array_assignment->arrayName;
+    } else if (auto object_declaration = dynamic_cast<const ObjectDeclarationNode*>(&node)) {
+        name = object_declaration->identifier;
+    }
+    if (name && std::find(locals.begin(), locals.end(), *name) == locals.end()) {
+        locals.push_back(*name);
+    }
+    for_each_child(node, [&](const ASTNode& child) {
+        collect_locals(child, locals);
+    });
+}
+
+
+class Inliner {
+public:
+    Inliner(BlockNode& program, const InlinePolicy& policy) : program(program), policy(policy) {}
+
+    InlineSummary run();
+
+private:
+    void declarations(ASTNode& node);
+    void count_calls(const ASTNode& node);
+    void remove_unused();
+    void mark(ASTNode& node);
+    InlineDecision& decision(Symbol name);
+
+    BlockNode& program;
+    const InlinePolicy& policy;
+    InlineSummary summary;
+    std::unordered_map<Symbol, std::vector<FunctionDeclarationNode*>> declared;
+    std::unordered_map<Symbol, std::shared_ptr<const InlinedBody>> candidates;  // Copied before any call is marked
+};
+
+InlineSummary Inliner::run() {
+    summary.max_body_nodes = policy.max_body_nodes;
+    declarations(program);
+    count_calls(program);
+
+    for (auto& decision : summary.functions) {
+        const auto& declarations = declared[decision.function];
+        FunctionDeclarationNode& function = *declarations.front();
+        decision.body_nodes = count_nodes(*function.body) - 1;
+        if (declarations.size() > 1) {
+            decision.reason = "declared " + std::to_string(declarations.size()) + " times";
+        } else if (decision.body_nodes > policy.max_body_nodes) {
+            decision.reason = "body too large";
+        } else if (calls(*function.body, function.identifier)) {
+            decision.reason = "recursive";
+        } else if (contains(*function.body, [](const ASTNode& node) {
+                       return dynamic_cast<const FunctionDeclarationNode*>(&node) || dynamic_cast<const EventListenerNode*>(&node);
+                   })) {
+            decision.reason = "declares functions or listeners";
+        } else if (catches_call_errors(*function.body)) {
+            decision.reason = "for loop around a call";
+        } else if (decision.call_sites == 0) {
+            decision.reason = "never called";
+        } else {
+            function.inline_id = next_inline_id++;
+            auto inlined = std::make_shared<InlinedBody>();
+            inlined->callee = function.inline_id;
+            inlined->parameters = function.parameters;
+            inlined->body.reset(static_cast<BlockNode*>(function.body->clone().release()));
+            inlined->locals = function.parameters;
+            collect_locals(*function.body, inlined->locals);
+            candidates.emplace(function.identifier, std::move(inlined));
+        }
+    }
+
+    // Frees the removed declarations, and any declared inside them
+    if (policy.remove_unused_functions) {
+        remove_unused();
+    }
+    declared.clear();
+    if (!candidates.empty()) {
+        mark(program);
+    }
+    return summary;
+}
+
+void Inliner::declarations(ASTNode& node) {
+    if (auto function = dynamic_cast<FunctionDeclarationNode*>(&node)) {
+        auto& list = declared[function->identifier];
+        if (list.empty()) {
+            InlineDecision decision;
+            decision.function = function->identifier;
+            summary.functions.push_back(decision);
+        }
+        list.push_back(function);
+    }
+    for_each_child(node, [this](ASTNode& child) {
+        declarations(child);
+    });
+}
+
+InlineDecision& Inliner::decision(Symbol name) {
+    return *std::find_if(summary.functions.begin(), summary.functions.end(), [name](const InlineDecision& decision) {
+        return decision.function == name;
+    });
+}
+
+void Inliner::count_calls(const ASTNode& node) {
+    if (auto call = dynamic_cast<const FunctionCallNode*>(&node)) {
+        ++summary.call_sites;
+        if (declared.count(call->identifier)) {
+            ++decision(call->identifier).call_sites;
+        }
+    }
+    for_each_child(node, [this](const ASTNode& child) {
+        count_calls(child);
+    });
+}
+
+// Top-level declarations no code outside them reaches through calls
+void Inliner::remove_unused() {
+    std::unordered_set<Symbol> reached;
+    std::vector<const ASTNode*> pending;
+    auto reach = [&](const ASTNode& node) {
+        contains(node, [&](const ASTNode& child) {
+            auto call = dynamic_cast<const FunctionCallNode*>(&child);
+            if (call && reached.insert(call->identifier).second) {
+                for (const auto* function : declared[call->identifier]) {
+                    pending.push_back(function->body.get());
+                }
+            }
+            return false;
+        });
+    };
+    for (const auto& statement : program.statements) {
+        if (!dynamic_cast<const FunctionDeclarationNode*>(statement.get())) {
+            reach(*statement);
+        }
+    }
+    while (!pending.empty()) {
+        const ASTNode* body = pending.back();
+        pending.pop_back();
+        reach(*body);
+    }
+
+    auto& statements = program.statements;
+    statements.erase(std::remove_if(statements.begin(), statements.end(), [&](const std::unique_ptr<ASTNode>& statement) {
+        auto function = dynamic_cast<const FunctionDeclarationNode*>(statement.get());
+        if (!function || reached.count(function->identifier) || declared[function->identifier].size() > 1) {
+            return false;
+        }
+        InlineDecision& removed = decision(function->identifier);
+        removed.removed = true;
+        removed.reason = "removed, nothing reaches it";
+        ++summary.functions_removed;
+        return true;
+    }), statements.end());
+}
+
+void Inliner::mark(ASTNode& node) {
+    for_each_child(node, [this](ASTNode& child) {
+        mark(child);
+    });
+    auto call = dynamic_cast<FunctionCallNode*>(&node);
+    if (!call) {
+        return;
+    }
+    auto it = candidates.find(call->identifier);
+    // A mismatched call is left to fail as written
+    if (it != candidates.end() && it->second->parameters.size() == call->arguments.size()) {
+        call->inlined = it->second;
+        ++decision(it->first).inlined_sites;
+        ++summary.calls_inlined;
+    }
+}
+
+}
+
+InlineSummary inline_functions(BlockNode& program, const InlinePolicy& policy) {
+    if (!policy.enabled) {
+        return InlineSummary();
+    }
+    return Inliner(program, policy).run();
+}
+
+void write_inline_report(std::ostream& out, const InlineSummary& summary) {
+    out << "Inlined " << summary.calls_inlined << " of " << summary.call_sites << " call sites, removed "
+        << summary.functions_removed << " unused functions (body limit " << summary.max_body_nodes << " nodes)" << std::endl;
+    for (const auto& function : summary.functions) {
+        out << "  " << std::left << std::setw(20) << function.function.str()
+            << " nodes " << std::setw(5) << function.body_nodes
+            << " calls " << std::setw(5) << function.call_sites
+            << " inlined " << function.inlined_sites;
+        if (!function.reason.empty()) {
+            out << " (" << function.reason << ")";
+        }
+        out << std::endl;
+    }
+}
+
+namespace {
+
+// Shared by every program, since functions declared by one can run inside another's loops
+std::atomic<uint32_t> next_cache_id{1};
+
+using PureFunctions = std::unordered_map<Symbol, FunctionDeclarationNode*>;
+
+bool calls_pure(const FunctionCallNode& call, const PureFunctions& pure) {
+    auto it = pure.find(call.identifier);
+    return it != pure.end() && it->second->parameters.size() == call.arguments.size();
+}
+
+// Reads only `assigned` variables and calls only pure functions
+bool pure_expression(const ASTNode& node, const std::unordered_set<Symbol>& assigned, const PureFunctions& pure) {
+    if (auto identifier = dynamic_cast<const IdentifierNode*>(&node)) {
+        if (!assigned.count(identifier->identifier)) {
+            return false;  // The caller's variable, or a missing one
+        }
+    } else if (auto array_index = dynamic_cast<const ArrayIndexNode*>(&node)) {
+        if (!assigned.count(array_index->arrayName)) {
+            return false;
+        }
+    } else if (auto call = dynamic_cast<const FunctionCallNode*>(&node)) {
+        if (!calls_pure(*call, pure)) {
+            return false;
+        }
+    } else if (!dynamic_cast<const NumberNode*>(&node) && !dynamic_cast<const StringNode*>(&node) &&
+               !dynamic_cast<const BinaryExpressionNode*>(&node) && !dynamic_cast<const ArrayLiteralNode*>(&node)) {
+        return false;  // Fields belong to objects other code can change
+    }
+    bool result = true;
+    for_each_child(node, [&](const ASTNode& child) {
+        result = result && pure_expression(child, assigned, pure);
+    });
+    return result;
+}
+
+// `assigned` gains the variables the statement is sure to assign
+bool pure_statement(const ASTNode& node, std::unordered_set<Symbol>& assigned, const PureFunctions& pure) {
+    if (auto block = dynamic_cast<const BlockNode*>(&node)) {
+        for (const auto& statement : block->statements) {
+            if (!pure_statement(*statement, assigned, pure)) {
+                return false;
+            }
+        }
+        return true;
+    } else if (auto assignment = dynamic_cast<const AssignmentNode*>(&node)) {
+        if (!pure_expression(*assignment->expression, assigned, pure)) {
+            return false;
+        }
+        assigned.insert(assignment->identifier);
+        return true;
+    } else if (auto return_node = dynamic_cast<const ReturnNode*>(&node)) {
+        return pure_expression(*return_node->expression, assigned, pure);
+    } else if (auto while_loop = dynamic_cast<const WhileLoopNode*>(&node)) {
+        // What the body assigns is not there before the first iteration, or if there is none
+        std::unordered_set<Symbol> body = assigned;
+        return pure_expression(*while_loop->condition, assigned, pure) && pure_statement(*while_loop->body, body, pure);
+    } else if (auto foreach_loop = dynamic_cast<const ForeachLoopNode*>(&node)) {
+        std::unordered_set<Symbol> body = assigned;
+        body.insert(foreach_loop->identifier);
+        return pure_expression(*foreach_loop->collection, assigned, pure) && pure_statement(*foreach_loop->body, body, pure);
+    } else if (auto array_assignment = dynamic_cast<const ArrayAssignmentNode*>(&node)) {
+        // The elements are copied first if the caller shares them
+        return assigned.count(array_assignment->arrayName) && pure_expression(*array_assignment->index, assigned, pure) &&
+               pure_expression(*array_assignment->expression, assigned, pure);
+    } else if (dynamic_cast<const FunctionCallNode*>(&node)) {
+        return pure_expression(node, assigned, pure);
+    }
+    // Output, input, objects, declarations, and `for` loops, which print errors
+    return false;
+}
+
+struct Declarations {
+    std::unordered_map<Symbol, std::vector<FunctionDeclarationNode*>> by_name;
+    std::vector<Symbol> order;  // As first declared
+};
+
+Declarations find_declarations(BlockNode& program) {
+    Declarations declared;
+    contains(program, [&](const ASTNode& node) {
+        if (auto function = dynamic_cast<const FunctionDeclarationNode*>(&node)) {
+            auto& list = declared.by_name[function->identifier];
+            if (list.empty()) {
+                declared.order.push_back(function->identifier);
+            }
+            list.push_back(const_cast<FunctionDeclarationNode*>(function));
+        }
+        return false;
+    });
+    return declared;
+}
+
+// The functions declared once that mark_pure_functions marked
+PureFunctions marked_pure(const Declarations& declared, std::vector<Symbol>& names) {
+    PureFunctions pure;
+    for (Symbol name : declared.order) {
+        const auto& functions = declared.by_name.at(name);
+        if (functions.size() == 1 && functions.front()->pure) {
+            pure.emplace(name, functions.front());
+            names.push_back(name);
+        }
+    }
+    return pure;
+}
+
+// What running part of the program can change
+struct Effects {
+    std::unordered_set<Symbol> writes;
+    bool fields = false;     // Field assignments, or calls that may make them
+    bool functions = false;  // Declarations, or calls that may make them, replacing a pure function
+    bool anything = false;   // A `for` loop may catch an error from a call, which leaves the callee's variables behind
+};
+
+void add_effects(const ASTNode& node, const PureFunctions& pure, Effects& effects) {
+    if (auto assignment = dynamic_cast<const AssignmentNode*>(&node)) {
+        effects.writes.insert(assignment->identifier);
+    } else if (auto input = dynamic_cast<const InputNode*>(&node)) {
+        effects.writes.insert(input->identifier);
+    } else if (auto array_assignment = dynamic_cast<const ArrayAssignmentNode*>(&node)) {
+        effects.writes.insert(array_assignment->arrayName);
+    } else if (auto object_declaration = dynamic_cast<const ObjectDeclarationNode*>(&node)) {
+        effects.writes.insert(object_declaration->identifier);
+    } else if (auto foreach_loop = dynamic_cast<const ForeachLoopNode*>(&node)) {
+        effects.writes.insert(foreach_loop->identifier);
+    } else if (auto for_loop = dynamic_cast<const ForLoopNode*>(&node)) {
+        effects.writes.insert(for_loop->identifier);
+        effects.anything = effects.anything || contains(*for_loop, [](const ASTNode& inner) {
+            return dynamic_cast<const FunctionCallNode*>(&inner) != nullptr;
+        });
+    } else if (dynamic_cast<const FieldAssignmentNode*>(&node)) {
+        effects.fields = true;
+    } else if (auto call = dynamic_cast<const FunctionCallNode*>(&node)) {
+        if (!calls_pure(*call, pure)) {
+            effects.fields = true;
+            effects.functions = true;
+        }
+    } else if (dynamic_cast<const FunctionDeclarationNode*>(&node)) {
+        effects.functions = true;
+        return;  // The body runs when called
+    } else if (dynamic_cast<const EventListenerNode*>(&node)) {
+        return;
+    }
+    for_each_child(node, [&](const ASTNode& child) {
+        add_effects(child, pure, effects);
+    });
+}
+
+void add_effects(const Effects& from, Effects& effects) {
+    effects.writes.insert(from.writes.begin(), from.writes.end());
+    effects.fields = effects.fields || from.fields;
+    effects.functions = effects.functions || from.functions;
+    effects.anything = effects.anything || from.anything;
+}
+
+// What an expression's value depends on
+struct Dependencies {
+    std::unordered_set<Symbol> reads;
+    bool fields = false;
+    bool functions = false;
+    bool keepable = true;  // No call to a function that is not pure
+};
+
+void add_dependencies(const ASTNode& node, const PureFunctions& pure, Dependencies& dependencies) {
+    if (auto identifier = dynamic_cast<const IdentifierNode*>(&node)) {
+        dependencies.reads.insert(identifier->identifier);
+    } else if (auto array_index = dynamic_cast<const ArrayIndexNode*>(&node)) {
+        dependencies.reads.insert(array_index->arrayName);
+    } else if (dynamic_cast<const FieldAccessNode*>(&node)) {
+        dependencies.fields = true;
+    } else if (auto call = dynamic_cast<const FunctionCallNode*>(&node)) {
+        if (calls_pure(*call, pure)) {
+            dependencies.functions = true;
+        } else {
+            dependencies.keepable = false;
+        }
+    }
+    for_each_child(node, [&](const ASTNode& child) {
+        add_dependencies(child, pure, dependencies);
+    });
+}
+
+bool unchanged(const Dependencies& dependencies, const Effects& effects) {
+    if (effects.anything || (dependencies.fields && effects.fields) || (dependencies.functions && effects.functions)) {
+        return false;
+    }
+    for (Symbol read : dependencies.reads) {
+        if (effects.writes.count(read)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Variables and constants alone cost less to evaluate than to look up
+bool worth_keeping(const ASTNode& node) {
+    return dynamic_cast<const BinaryExpressionNode*>(&node) || dynamic_cast<const FunctionCallNode*>(&node) ||
+           dynamic_cast<const ArrayIndexNode*>(&node) || dynamic_cast<const FieldAccessNode*>(&node) ||
+           dynamic_cast<const ArrayLiteralNode*>(&node);
+}
+
+// Equal for expressions that compute the same value from the same variables
+std::string expression_key(const ASTNode& node) {
+    auto list = [](const std::vector<std::unique_ptr<ASTNode>>& nodes) {
+        std::string key;
+        for (const auto& node : nodes) {
+            key += (key.empty() ? "" : ",") + expression_key(*node);
+        }
+        return key;
+    };
+    if (auto identifier = dynamic_cast<const IdentifierNode*>(&node)) {
+        return "$" + identifier->identifier;
+    } else if (auto number = dynamic_cast<const NumberNode*>(&node)) {
+        return std::to_string(number->value);
+    } else if (auto str = dynamic_cast<const StringNode*>(&node)) {
+        return "'" + std::to_string(str->value.size()) + ":" + str->value;
+    } else if (auto binary = dynamic_cast<const BinaryExpressionNode*>(&node)) {
+        return "(" + expression_key(*binary->left) + " " + binary->op + " " + expression_key(*binary->right) + ")";
+    } else if (auto call = dynamic_cast<const FunctionCallNode*>(&node)) {
+        return call->identifier + "(" + list(call->arguments) + ")";
+    } else if (auto array_literal = dynamic_cast<const ArrayLiteralNode*>(&node)) {
+        return "[" + list(array_literal->elements) + "]";
+    } else if (auto array_index = dynamic_cast<const ArrayIndexNode*>(&node)) {
+        return array_index->arrayName + "[" + expression_key(*array_index->index) + "]";
+    } else if (auto field_access = dynamic_cast<const FieldAccessNode*>(&node)) {
+        return expression_key(*field_access->object) + "." + field_access->field;
+    }
+    return "?";
+}
+
+// The expressions a statement evaluates once each time it runs, in order
+std::vector<ASTNode*> evaluated_once(ASTNode& statement) {
+    std::vector<ASTNode*> expressions;
+    if (auto assignment = dynamic_cast<AssignmentNode*>(&statement)) {
+        expressions.push_back(assignment->expression.get());
+    } else if (auto print = dynamic_cast<PrintNode*>(&statement)) {
+        expressions.push_back(print->expression.get());
+    } else if (auto return_node = dynamic_cast<ReturnNode*>(&statement)) {
+        expressions.push_back(return_node->expression.get());
+    } else if (auto array_assignment = dynamic_cast<ArrayAssignmentNode*>(&statement)) {
+        expressions.push_back(array_assignment->index.get());
+        expressions.push_back(array_assignment->expression.get());
+    } else if (auto field_assignment = dynamic_cast<FieldAssignmentNode*>(&statement)) {
+        expressions.push_back(field_assignment->object.get());
+        expressions.push_back(field_assignment->expression.get());
+    } else if (auto call = dynamic_cast<FunctionCallNode*>(&statement)) {
+        for (auto& argument : call->arguments) {
+            expressions.push_back(argument.get());
+        }
+    } else if (auto for_loop = dynamic_cast<ForLoopNode*>(&statement)) {
+        expressions.push_back(for_loop->lower_bound.get());
+        expressions.push_back(for_loop->upper_bound.get());
+    } else if (auto foreach_loop = dynamic_cast<ForeachLoopNode*>(&statement)) {
+        expressions.push_back(foreach_loop->collection.get());
+    }
+    return expressions;
+}
+
+class ExpressionCacher {
+public:
+    ExpressionCacher(const PureFunctions& pure, ExpressionSummary& summary) : pure(pure), summary(summary) {}
+
+    void block(BlockNode& block);
+
+private:
+    struct Loop {
+        uint32_t id;
+        Effects effects;  // Of the condition and body
+        std::unordered_map<std::string, uint32_t> slots;
+    };
+
+    // An expression a block may keep, in the order they are evaluated
+    struct Occurrence {
+        size_t statement;
+        ASTNode* node;
+        std::string key;
+        size_t nodes;
+        Dependencies dependencies;
+        std::optional<size_t> parent;  // The nearest enclosing occurrence
+    };
+
+    void statement(ASTNode& node);
+    void loop(ASTNode& node, ASTNode* condition, BlockNode& body, std::optional<Symbol> variable);
+    void invariant(ASTNode& expression);
+    void repeated(BlockNode& block);
+    void occurrences(ASTNode& node, size_t statement, std::optional<size_t> parent, std::vector<Occurrence>& found) const;
+
+    const PureFunctions& pure;
+    ExpressionSummary& summary;
+    std::vector<Loop> loops;  // Around the statement in the function being walked, outermost first
+};
+
+void ExpressionCacher::block(BlockNode& block) {
+    for (auto& statement : block.statements) {
+        this->statement(*statement);
+    }
+    repeated(block);
+}
+
+void ExpressionCacher::statement(ASTNode& node) {
+    for (ASTNode* expression : evaluated_once(node)) {
+        invariant(*expression);
+    }
+    if (auto block = dynamic_cast<BlockNode*>(&node)) {
+        this->block(*block);
+    } else if (auto while_loop = dynamic_cast<WhileLoopNode*>(&node)) {
+        loop(node, while_loop->condition.get(), *while_loop->body, std::nullopt);
+    } else if (auto for_loop = dynamic_cast<ForLoopNode*>(&node)) {
+        loop(node, nullptr, *for_loop->body, for_loop->identifier);
+    } else if (auto foreach_loop = dynamic_cast<ForeachLoopNode*>(&node)) {
+        loop(node, nullptr, *foreach_loop->body, foreach_loop->identifier);
+    } else if (dynamic_cast<FunctionDeclarationNode*>(&node) || dynamic_cast<EventListenerNode*>(&node)) {
+        // Bodies run later, outside the loops around the declaration
+        auto outer = std::move(loops);
+        loops.clear();
+        auto function = dynamic_cast<FunctionDeclarationNode*>(&node);
+        this->block(function ? *function->body : *static_cast<EventListenerNode&>(node).body);
+        loops = std::move(outer);
+    }
+}
+
+void ExpressionCacher::loop(ASTNode& node, ASTNode* condition, BlockNode& body, std::optional<Symbol> variable) {
+    Loop entered{next_cache_id++, Effects(), {}};
+    if (condition) {
+        add_effects(*condition, pure, entered.effects);
+    }
+    add_effects(body, pure, entered.effects);
+    if (variable) {
+        entered.effects.writes.insert(*variable);
+    }
+    loops.push_back(std::move(entered));
+    if (condition) {
+        invariant(*condition);
+    }
+    block(body);
+    const Loop& left = loops.back();
+    if (!left.slots.empty()) {
+        node.cache = left.id;
+        node.slot = static_cast<uint32_t>(left.slots.size());
+        ++summary.caches;
+    }
+    loops.pop_back();
+}
+
+// Kept by the outermost loop it does not change in, else its parts may be
+void ExpressionCacher::invariant(ASTNode& expression) {
+    if (loops.empty()) {
+        return;
+    }
+    if (worth_keeping(expression)) {
+        Dependencies dependencies;
+        add_dependencies(expression, pure, dependencies);
+        for (auto& loop : loops) {
+            if (dependencies.keepable && unchanged(dependencies, loop.effects)) {
+                auto slot = loop.slots.emplace(expression_key(expression), static_cast<uint32_t>(loop.slots.size())).first->second;
+                expression.cache = loop.id;
+                expression.slot = slot;
+                ++summary.loop_invariant;
+                return;
+            }
+        }
+    }
+    for_each_child(expression, [this](ASTNode& child) {
+        invariant(child);
+    });
+}
+
+void ExpressionCacher::occurrences(ASTNode& node, size_t statement, std::optional<size_t> parent, std::vector<Occurrence>& found) const {
+    if (node.cache) {
+        return;  // Kept by a loop
+    }
+    if (worth_keeping(node)) {
+        Dependencies dependencies;
+        add_dependencies(node, pure, dependencies);
+        if (dependencies.keepable) {
+            found.push_back({statement, &node, expression_key(node), count_nodes(node), std::move(dependencies), parent});
+            parent = found.size() - 1;
+        }
+    }
+    for_each_child(node, [&](ASTNode& child) {
+        occurrences(child, statement, parent, found);
+    });
+}
+
+// Occurrences of an expression share a value while the statements from one
+// to the next change nothing it reads. Larger expressions are grouped first,
+// and the parts of one that is kept are left alone.
+void ExpressionCacher::repeated(BlockNode& block) {
+    std::vector<Occurrence> found;
+    std::vector<Effects> whole(block.statements.size());     // Of each statement
+    std::vector<Effects> evaluating(block.statements.size()); // Of its expressions, which run before it assigns
+    for (size_t i = 0; i < block.statements.size(); ++i) {
+        for (ASTNode* expression : evaluated_once(*block.statements[i])) {
+            occurrences(*expression, i, std::nullopt, found);
+            add_effects(*expression, pure, evaluating[i]);
+        }
+        add_effects(*block.statements[i], pure, whole[i]);
+    }
+    if (found.size() < 2) {
+        return;
+    }
+
+    std::vector<size_t> largest_first(found.size());
+    for (size_t i = 0; i < found.size(); ++i) {
+        largest_first[i] = i;
+    }
+    std::stable_sort(largest_first.begin(), largest_first.end(), [&](size_t a, size_t b) {
+        return found[a].nodes > found[b].nodes;
+    });
+    std::vector<bool> kept(found.size());
+    auto covered = [&](size_t occurrence) {
+        for (auto parent = found[occurrence].parent; parent; parent = found[*parent].parent) {
+            if (kept[*parent]) {
+                return true;
+            }
+        }
+        return false;
+    };
+    auto unchanged_between = [&](const Occurrence& first, const Occurrence& next) {
+        Effects effects = evaluating[next.statement];
+        for (size_t i = first.statement; i < next.statement; ++i) {
+            add_effects(whole[i], effects);
+        }
+        return unchanged(next.dependencies, effects);
+    };
+
+    uint32_t id = 0;
+    uint32_t slots = 0;
+    std::vector<size_t> group;
+    auto keep = [&] {
+        if (group.size() > 1) {
+            if (!id) {
+                id = next_cache_id++;
+            }
+            for (size_t occurrence : group) {
+                found[occurrence].node->cache = id;
+                found[occurrence].node->slot = slots;
+                kept[occurrence] = true;
+            }
+            ++slots;
+            summary.repeated += group.size() - 1;
+        }
+        group.clear();
+    };
+    std::unordered_set<std::string> grouped;
+    for (size_t first : largest_first) {
+        const std::string& key = found[first].key;
+        if (!grouped.insert(key).second) {
+            continue;
+        }
+        for (size_t i = first; i < found.size(); ++i) {
+            if (found[i].key != key || covered(i)) {
+                continue;
+            }
+            if (!group.empty() && !unchanged_between(found[group.back()], found[i])) {
+                keep();
+            }
+            group.push_back(i);
+        }
+        keep();
+    }
+    if (id) {
+        block.cache = id;
+        block.slot = slots;
+        ++summary.caches;
+    }
+}
+
+void clear_caches(ASTNode& node) {
+    node.cache = 0;
+    node.slot = 0;
+    for_each_child(node, [](ASTNode& child) {
+        clear_caches(child);
+    });
+}
+
+}
+
+// Every function declared once starts out pure, and those that are not are
+// dropped until none is left, so functions calling each other can be pure
+std::vector<Symbol> mark_pure_functions(BlockNode& program) {
+    Declarations declared = find_declarations(program);
+    PureFunctions pure;
+    for (const auto& [name, functions] : declared.by_name) {
+        if (functions.size() == 1) {
+            pure.emplace(name, functions.front());
+        }
+    }
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto it = pure.begin(); it != pure.end();) {
+            std::unordered_set<Symbol> assigned(it->second->parameters.begin(), it->second->parameters.end());
+            if (it->second->declared_pure || pure_statement(*it->second->body, assigned, pure)) {
+                ++it;
+            } else {
+                it = pure.erase(it);
+                changed = true;
+            }
+        }
+    }
+
+    std::vector<Symbol> names;
+    for (Symbol name : declared.order) {
+        bool any = false;
+        for (auto* function : declared.by_name[name]) {
+            function->pure = function->declared_pure || pure.count(name) > 0;
+            // A body without loops or calls costs about as much to run as a lookup
+            function->memoized = function->declared_pure || (function->pure && contains(*function->body, [](const ASTNode& node) {
+                return dynamic_cast<const WhileLoopNode*>(&node) || dynamic_cast<const ForeachLoopNode*>(&node) ||
+                       dynamic_cast<const FunctionCallNode*>(&node);
+            }));
+            any = any || function->pure;
+        }
+        if (any) {
+            names.push_back(name);
+        }
+    }
+    return names;
+}
+
+ExpressionSummary cache_expressions(BlockNode& program) {
+    ExpressionSummary summary;
+    // A program run before keeps the marks of the last time
+    clear_caches(program);
+    PureFunctions pure = marked_pure(find_declarations(program), summary.pure_functions);
+    ExpressionCacher(pure, summary).block(program);
+    return summary;
+}
+
+void write_expression_report(std::ostream& out, const ExpressionSummary& summary) {
+    out << "Kept " << summary.loop_invariant << " loop-invariant and " << summary.repeated
+        << " repeated expressions, in " << summary.caches << " loops and blocks" << std::endl;
+    out << "  pure functions:";
+    for (Symbol function : summary.pure_functions) {
+        out << " " << function;
+    }
+    out << std::endl;
+}
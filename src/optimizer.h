@@ -0,0 +1,100 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "ast.h"
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Which calls inline_functions replaces with the callee's body
+struct InlinePolicy {
+    bool enabled = true;
+    size_t max_body_nodes = 24;             // Larger functions are still called
+    bool remove_unused_functions = false;   // Hosts may call functions the script never does (see Interpreter::call_function)
+};
+
+// What happened to one declared function
+struct InlineDecision {
+    Symbol function;
+    size_t body_nodes = 0;
+    size_t call_sites = 0;     // In the program, function bodies and listeners
+    size_t inlined_sites = 0;
+    std::string reason;        // Why it was not inlined, empty if it was eligible
+    bool removed = false;
+};
+
+struct InlineSummary {
+    std::vector<InlineDecision> functions;  // In declaration order
+    size_t max_body_nodes = 0;
+    size_t call_sites = 0;
+    size_t calls_inlined = 0;
+    size_t functions_removed = 0;
+};
+
+// Gives calls to small functions a copy of the callee's body (see
+// FunctionCallNode::inlined), which the interpreter runs in place of the call,
+// skipping the profile and argument checks and the copy of the whole variables
+// map a call makes: only the variables the body uses are saved and put back.
+// A function is inlined if it is declared once, its body has at most
+// `max_body_nodes` nodes, it does not call itself and it declares no functions
+// or listeners. Bodies are copied as written, so calls inside a copy are made
+// as usual. A body where a `for` loop could catch an error from a call is not
+// inlined either, since the callee's variables that error leaves behind would
+// not be put back.
+//
+// The copied declarations get an inline_id, and a call only runs its copy
+// while that same declaration is the one defined; after a redefinition or hot
+// reload it is made as written. Once the function is hot, calls run its
+// compiled code instead (see tier.h).
+//
+// With `remove_unused_functions`, top-level declarations that nothing calls,
+// directly or through other such functions, are dropped from the program.
+InlineSummary inline_functions(BlockNode& program, const InlinePolicy& policy);
+
+// One line per declared function, with the counts and decision
+void write_inline_report(std::ostream& out, const InlineSummary& summary);
+
+// Sets FunctionDeclarationNode::pure on the functions declared `pure fun`,
+// whose author promises their result depends only on the arguments, and on
+// those declared once that read only their parameters and variables they
+// have assigned, call only pure functions, and neither print, read input,
+// act, use objects, declare functions or listeners, nor contain a `for`
+// loop, which prints errors. Of these, the declared ones and those with loops
+// or calls are also `memoized`. Returns the names of the pure functions, in
+// declaration order.
+std::vector<Symbol> mark_pure_functions(BlockNode& program);
+
+struct ExpressionSummary {
+    std::vector<Symbol> pure_functions;  // In declaration order
+    size_t loop_invariant = 0;  // Expressions kept for the rest of a loop
+    size_t repeated = 0;        // Expressions a block computes more than once
+    size_t caches = 0;          // Loops and blocks that keep values
+};
+
+// Marks expressions whose value the interpreter can keep instead of
+// computing it again (see ASTNode::cache), in place of moving them:
+//
+// - An expression in a `while`, `for` or `foreach` loop that reads no
+//   variable the loop writes is kept by the outermost such loop, from the
+//   first time it is computed until the loop ends.
+// - An expression a block computes more than once, with nothing in between
+//   that writes what it reads, is kept by the block for that run of it.
+//
+// Only operators, array literals, indexing, field reads and calls to pure
+// functions are kept, never a variable or constant alone. Nothing is computed
+// earlier or more often than as written, so a loop that never runs computes
+// nothing and errors happen where they did. Field reads are not kept across
+// field assignments, nor calls to functions that are not pure, which may
+// assign fields or redefine functions. A loop in which a `for` loop can
+// catch an error from a call keeps nothing, since the callee's variables the
+// error leaves behind may be any.
+//
+// Calls are kept only to functions declared once that mark_pure_functions
+// marked, and the interpreter checks that the called functions are still the
+// pure ones before keeping a value.
+ExpressionSummary cache_expressions(BlockNode& program);
+
+void write_expression_report(std::ostream& out, const ExpressionSummary& summary);
+
+#endif // OPTIMIZER_H
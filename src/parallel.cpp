@@ -0,0 +1,668 @@
+#include "parallel.h"
+#include "interpreter.h"
+#include "operations.h"
+#include "stats.h"
+#include "thread_pool.h"
+#include "utils.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+// What calling a function can do to the caller's variables and the world
+struct FunctionEffects {
+    std::vector<Symbol> free_reads;      // Variables it may read before assigning them
+    std::unordered_set<Symbol> assigned; // Parameters and variables it or its callees assign
+    std::string rejected;                // What it does that a parallel loop may not, if anything
+    Symbol rejected_in;                  // The function that does it, when it is a callee
+    bool actions = false;
+
+    bool operator==(const FunctionEffects& other) const {
+        return std::unordered_set<Symbol>(free_reads.begin(), free_reads.end()) ==
+                   std::unordered_set<Symbol>(other.free_reads.begin(), other.free_reads.end()) &&
+               assigned == other.assigned && rejected == other.rejected && actions == other.actions;
+    }
+};
+
+using Functions = std::unordered_map<Symbol, std::shared_ptr<const FunctionDeclarationNode>>;
+
+// The right operands of `x = x op a op b ...`, leftmost first; empty if the
+// assignment does not have that form
+std::vector<const ASTNode*> reduction_operands(const AssignmentNode& assignment) {
+    std::vector<const ASTNode*> operands;
+    const ASTNode* node = assignment.expression.get();
+    while (auto binary = dynamic_cast<const BinaryExpressionNode*>(node)) {
+        operands.push_back(binary->right.get());
+        node = binary->left.get();
+    }
+    auto target = dynamic_cast<const IdentifierNode*>(node);
+    if (!target || target->identifier != assignment.identifier) {
+        operands.clear();
+    }
+    std::reverse(operands.begin(), operands.end());
+    return operands;
+}
+
+bool contains_for_loop(const ASTNode* node) {
+    if (!node) {
+        return false;
+    }
+    if (dynamic_cast<const ForLoopNode*>(node)) {
+        return true;
+    }
+    if (auto block = dynamic_cast<const BlockNode*>(node)) {
+        return std::any_of(block->statements.begin(), block->statements.end(),
+                           [](const auto& statement) { return contains_for_loop(statement.get()); });
+    }
+    if (auto loop = dynamic_cast<const WhileLoopNode*>(node)) {
+        return contains_for_loop(loop->body.get());
+    }
+    if (auto loop = dynamic_cast<const ForeachLoopNode*>(node)) {
+        return contains_for_loop(loop->body.get());
+    }
+    return false;
+}
+
+// Follows the variables a loop body or function body reads and writes, in the
+// order it runs them: a variable read before anything in the body assigned it
+// is read from outside. Assignments in a loop or after a `while` count only
+// inside it, since it may not run.
+class EffectWalker {
+public:
+    EffectWalker(const std::unordered_map<Symbol, FunctionEffects>& callees,
+                 const std::unordered_set<Symbol>& reductions, bool calls_leak)
+        : callees(callees), reductions(reductions), calls_leak(calls_leak) {}
+
+    void walk(const ASTNode* node) {
+        if (!node) {
+            return;
+        }
+        if (auto block = dynamic_cast<const BlockNode*>(node)) {
+            for (const auto& statement : block->statements) {
+                walk(statement.get());
+            }
+        } else if (auto assignment = dynamic_cast<const AssignmentNode*>(node)) {
+            auto operands = reduction_operands(*assignment);
+            if (!operands.empty()) {
+                reduction_forms.insert(assignment->identifier);
+            }
+            if (!operands.empty() && reductions.count(assignment->identifier)) {
+                for (const ASTNode* operand : operands) {
+                    walk(operand);
+                }
+                return;
+            }
+            walk(assignment->expression.get());
+            write(assignment->identifier, true);
+        } else if (auto array_assignment = dynamic_cast<const ArrayAssignmentNode*>(node)) {
+            walk(array_assignment->index.get());
+            walk(array_assignment->expression.get());
+            read(array_assignment->arrayName);
+            write(array_assignment->arrayName, true);
+        } else if (auto print = dynamic_cast<const PrintNode*>(node)) {
+            walk(print->expression.get());
+        } else if (dynamic_cast<const InputNode*>(node)) {
+            reject("read input");
+        } else if (dynamic_cast<const FunctionDeclarationNode*>(node)) {
+            reject("declare functions");
+        } else if (dynamic_cast<const EventListenerNode*>(node)) {
+            reject("declare event listeners");
+        } else if (dynamic_cast<const ObjectDeclarationNode*>(node)) {
+            reject("declare objects");
+        } else if (dynamic_cast<const FieldAssignmentNode*>(node)) {
+            reject("assign fields");
+        } else if (auto for_loop = dynamic_cast<const ForLoopNode*>(node)) {
+            walk(for_loop->lower_bound.get());
+            walk(for_loop->upper_bound.get());
+            auto outside = scope;
+            write(for_loop->identifier, true);
+            walk(for_loop->body.get());
+            scope = std::move(outside);
+        } else if (auto while_loop = dynamic_cast<const WhileLoopNode*>(node)) {
+            walk(while_loop->condition.get());
+            auto outside = scope;
+            walk(while_loop->body.get());
+            scope = std::move(outside);
+        } else if (auto foreach_loop = dynamic_cast<const ForeachLoopNode*>(node)) {
+            walk(foreach_loop->collection.get());
+            auto outside = scope;
+            write(foreach_loop->identifier, true);
+            walk(foreach_loop->body.get());
+            scope = std::move(outside);
+        } else if (dynamic_cast<const NPCActionNode*>(node)) {
+            actions = true;
+        } else if (auto return_node = dynamic_cast<const ReturnNode*>(node)) {
+            walk(return_node->expression.get());
+        } else if (auto binary = dynamic_cast<const BinaryExpressionNode*>(node)) {
+            walk(binary->left.get());
+            walk(binary->right.get());
+        } else if (auto identifier = dynamic_cast<const IdentifierNode*>(node)) {
+            read(identifier->identifier);
+        } else if (auto call = dynamic_cast<const FunctionCallNode*>(node)) {
+            for (const auto& argument : call->arguments) {
+                walk(argument.get());
+            }
+            called.insert(call->identifier);
+            auto callee = callees.find(call->identifier);
+            if (callee == callees.end()) {
+                return;
+            }
+            const FunctionEffects& effects = callee->second;
+            for (Symbol name : effects.free_reads) {
+                read(name);
+            }
+            // An error a `for` loop catches leaves the callee's variables behind
+            if (calls_leak) {
+                for (Symbol name : effects.assigned) {
+                    write(name, false);
+                }
+            }
+            if (!effects.rejected.empty() && rejected.empty()) {
+                rejected = effects.rejected;
+                rejected_in = effects.rejected_in == Symbol() ? call->identifier : effects.rejected_in;
+            }
+            actions = actions || effects.actions;
+        } else if (auto array_literal = dynamic_cast<const ArrayLiteralNode*>(node)) {
+            for (const auto& element : array_literal->elements) {
+                walk(element.get());
+            }
+        } else if (auto array_index = dynamic_cast<const ArrayIndexNode*>(node)) {
+            walk(array_index->index.get());
+            read(array_index->arrayName);
+        } else if (auto field_access = dynamic_cast<const FieldAccessNode*>(node)) {
+            walk(field_access->object.get());
+        }
+    }
+
+    void write(Symbol name, bool definite) {
+        if (writes.insert(name).second) {
+            written.push_back(name);
+        }
+        used.insert(name);
+        if (definite) {
+            scope.insert(name);
+        }
+    }
+
+    void read(Symbol name) {
+        used.insert(name);
+        if (!scope.count(name) && outer_reads.insert(name).second) {
+            read_outside.push_back(name);
+        }
+    }
+
+    std::vector<Symbol> read_outside;  // In the order first read
+    std::unordered_set<Symbol> outer_reads;
+    std::vector<Symbol> written;       // In the order first written
+    std::unordered_set<Symbol> writes;
+    std::unordered_set<Symbol> used;   // Read or written other than by the reductions
+    std::unordered_set<Symbol> reduction_forms;
+    std::unordered_set<Symbol> called;
+    std::string rejected;
+    Symbol rejected_in;
+    bool actions = false;
+
+private:
+    void reject(const std::string& what) {
+        if (rejected.empty()) {
+            rejected = what;
+        }
+    }
+
+    const std::unordered_map<Symbol, FunctionEffects>& callees;
+    const std::unordered_set<Symbol>& reductions;
+    bool calls_leak;
+    std::unordered_set<Symbol> scope;  // Assigned on every path so far
+};
+
+// The effects of every function the body can reach, to a fixpoint, since
+// functions may call each other recursively
+std::unordered_map<Symbol, FunctionEffects> function_effects(const std::unordered_set<Symbol>& roots, const Functions& functions) {
+    std::vector<Symbol> reachable;
+    std::unordered_set<Symbol> seen;
+    std::vector<Symbol> pending(roots.begin(), roots.end());
+    std::unordered_map<Symbol, FunctionEffects> effects;
+    const std::unordered_set<Symbol> no_reductions;
+    while (!pending.empty()) {
+        Symbol name = pending.back();
+        pending.pop_back();
+        auto function = functions.find(name);
+        if (function == functions.end() || !seen.insert(name).second) {
+            continue;
+        }
+        reachable.push_back(name);
+        EffectWalker walker(effects, no_reductions, true);
+        walker.walk(function->second->body.get());
+        pending.insert(pending.end(), walker.called.begin(), walker.called.end());
+    }
+    for (Symbol name : reachable) {
+        effects[name];
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (Symbol name : reachable) {
+            const FunctionDeclarationNode& function = *functions.at(name);
+            EffectWalker walker(effects, no_reductions, true);
+            for (Symbol parameter : function.parameters) {
+                walker.write(parameter, true);
+            }
+            walker.walk(function.body.get());
+            FunctionEffects result;
+            result.free_reads = std::move(walker.read_outside);
+            result.assigned = std::move(walker.writes);
+            result.rejected = std::move(walker.rejected);
+            result.rejected_in = walker.rejected_in;
+            result.actions = walker.actions;
+            if (!(result == effects[name])) {
+                effects[name] = std::move(result);
+                changed = true;
+            }
+        }
+    }
+    return effects;
+}
+
+}
+
+ParallelPlan plan_parallel_loop(const ForeachLoopNode& loop, const Functions& functions) {
+    std::unordered_set<Symbol> called;
+    {
+        const std::unordered_map<Symbol, FunctionEffects> none;
+        const std::unordered_set<Symbol> no_reductions;
+        EffectWalker walker(none, no_reductions, false);
+        walker.walk(loop.body.get());
+        called = std::move(walker.called);
+    }
+    auto effects = function_effects(called, functions);
+    bool calls_leak = contains_for_loop(loop.body.get());
+
+    // Every `x = x op ...` is taken for a reduction at first; those whose
+    // variable is also used otherwise are then walked as plain assignments
+    std::unordered_set<Symbol> reductions;
+    auto walk_body = [&] {
+        auto walker = std::make_unique<EffectWalker>(effects, reductions, calls_leak);
+        walker->write(loop.identifier, true);
+        walker->walk(loop.body.get());
+        return walker;
+    };
+    auto walker = walk_body();
+    reductions = walker->reduction_forms;
+    walker = walk_body();
+    for (auto it = reductions.begin(); it != reductions.end();) {
+        it = walker->used.count(*it) ? reductions.erase(it) : std::next(it);
+    }
+    if (reductions.size() != walker->reduction_forms.size()) {
+        walker = walk_body();
+    }
+
+    if (!walker->rejected.empty()) {
+        std::string message = "Parallel foreach cannot " + walker->rejected;
+        if (walker->rejected_in != Symbol()) {
+            message += " (in " + walker->rejected_in + ")";
+        }
+        throw std::runtime_error(message);
+    }
+    for (Symbol name : walker->read_outside) {
+        if (walker->writes.count(name)) {
+            throw std::runtime_error("Parallel foreach cannot assign a variable that iterations share: " + name);
+        }
+    }
+
+    ParallelPlan plan;
+    plan.reductions = std::move(reductions);
+    plan.written = std::move(walker->written);
+    plan.read = std::move(walker->read_outside);
+    plan.actions = walker->actions;
+    return plan;
+}
+
+// Text a run printed, and whether it went to the diagnostic stream
+struct OutputSegment {
+    bool diagnostic;
+    std::string text;
+};
+
+// Collects what a run prints to either stream in one list, so both can be
+// written in the order they were printed
+class SegmentBuffer : public std::streambuf {
+public:
+    SegmentBuffer(std::vector<OutputSegment>& segments, bool diagnostic) : segments(segments), diagnostic(diagnostic) {}
+
+protected:
+    int_type overflow(int_type c) override {
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            char ch = traits_type::to_char_type(c);
+            xsputn(&ch, 1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    std::streamsize xsputn(const char* text, std::streamsize count) override {
+        if (segments.empty() || segments.back().diagnostic != diagnostic) {
+            segments.push_back({diagnostic, std::string()});
+        }
+        segments.back().text.append(text, static_cast<size_t>(count));
+        return count;
+    }
+
+private:
+    std::vector<OutputSegment>& segments;
+    bool diagnostic;
+};
+
+// A reduction's update, with the operands an iteration computed
+struct ReductionStep {
+    Symbol variable;
+    std::vector<std::pair<std::string, Value>> terms;  // Operator and right operand, leftmost first
+};
+
+// Set on an interpreter running iterations of a `parallel foreach` for another
+struct ParallelWorker {
+    const std::unordered_set<Symbol>& reductions;
+    std::vector<ReductionStep> steps;  // Of the run of items in progress, in order
+};
+
+// One `parallel foreach` running: its items are split into runs, which the
+// threads take in turn, each iterating in its own fork of the interpreter
+class ParallelRun {
+public:
+    struct Chunk {
+        size_t begin = 0;
+        size_t end = 0;
+        bool stopped = false;  // An iteration failed or returned, so the run is made again sequentially
+        std::vector<OutputSegment> output;             // Of both streams, in the order printed
+        std::vector<ReductionStep> steps;
+        std::vector<std::pair<Symbol, Value>> finals;  // The written variables' last values, holding the loop's own objects
+        std::vector<Symbol> read;                      // Variables read from outside that exist after the run
+    };
+
+    ParallelRun(const Interpreter& source, const ForeachLoopNode& loop, const ParallelPlan& plan,
+                const std::vector<Value>& items, size_t chunk_count)
+        : chunks(chunk_count), source(source), loop(loop), plan(plan), items(items), stop(chunk_count) {
+        for (size_t i = 0; i < chunk_count; ++i) {
+            chunks[i].begin = items.size() * i / chunk_count;
+            chunks[i].end = items.size() * (i + 1) / chunk_count;
+        }
+    }
+
+    // Takes runs until none is left; returns at once if the loop is already over
+    void work() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (finished) {
+                return;
+            }
+            ++active;
+        }
+        run_chunks();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --active;
+        }
+        idle.notify_all();
+    }
+
+    // Until every thread that took a run is done with it, and its fork gone
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this] { return active == 0; });
+        finished = true;
+    }
+
+    // Runs before this one are complete; it and those after must be made again
+    size_t stopped_at() const {
+        return stop.load();
+    }
+
+    std::vector<Chunk> chunks;
+
+private:
+    void run_chunks() {
+        std::unordered_map<const ScriptObject*, ScriptObject*> copies;
+        auto worker = source.fork(copies);
+        worker->parallel_pool.reset();  // Its loops run sequentially; only the loop's interpreter may release the pool
+        ParallelWorker state{plan.reductions, {}};
+        worker->parallel_worker = &state;
+        if (loop.cache) {
+            worker->expression_caches.push_back({loop.cache, std::vector<std::optional<Value>>(loop.slot)});
+        }
+        std::ostream& diagnostics_before = diagnostic_stream();
+        for (;;) {
+            size_t index = next.fetch_add(1);
+            if (index >= chunks.size() || index >= stop.load()) {
+                break;
+            }
+            Chunk& chunk = chunks[index];
+            for (Symbol name : plan.written) {
+                worker->variables.erase(name);
+            }
+            SegmentBuffer output_buffer(chunk.output, false);
+            SegmentBuffer diagnostic_buffer(chunk.output, true);
+            std::ostream output(&output_buffer);
+            std::ostream diagnostics(&diagnostic_buffer);
+            worker->set_output(output);
+            set_diagnostic_stream(&diagnostics);
+            state.steps.clear();
+            try {
+                for (size_t i = chunk.begin; i < chunk.end && !chunk.stopped; ++i) {
+                    worker->variables[loop.identifier] = worker->heap.import(items[i], copies);
+                    stats::note_variable_count(worker->variables.size());
+                    std::optional<Value> return_value;
+                    worker->interpret_node(loop.body->clone(), return_value);
+                    chunk.stopped = return_value.has_value();
+                }
+                if (!chunk.stopped) {
+                    finish(chunk, *worker, state, copies);
+                }
+            } catch (...) {
+                chunk.stopped = true;
+            }
+            if (chunk.stopped) {
+                size_t bound = stop.load();
+                while (index < bound && !stop.compare_exchange_weak(bound, index)) {
+                }
+            }
+        }
+        set_diagnostic_stream(&diagnostics_before);
+    }
+
+    // Collects what a completed run leaves for the interpreter running the loop
+    void finish(Chunk& chunk, const Interpreter& worker, ParallelWorker& state,
+                const std::unordered_map<const ScriptObject*, ScriptObject*>& copies) {
+        std::unordered_map<const ScriptObject*, ScriptObject*> originals;
+        for (const auto& [original, copy] : copies) {
+            // The loop's interpreter only reads its objects while the runs last
+            originals[copy] = const_cast<ScriptObject*>(original);
+        }
+        for (auto& step : state.steps) {
+            for (auto& term : step.terms) {
+                term.second = original_value(term.second, originals);
+            }
+        }
+        chunk.steps = std::move(state.steps);
+        for (Symbol name : plan.written) {
+            auto variable = worker.variables.find(name);
+            if (variable != worker.variables.end()) {
+                chunk.finals.emplace_back(name, original_value(variable->second, originals));
+            }
+        }
+        for (Symbol name : plan.read) {
+            if (worker.variables.count(name)) {
+                chunk.read.push_back(name);
+            }
+        }
+    }
+
+    // The value with the fork's copies of objects replaced by the objects they were copied from
+    static Value original_value(const Value& value, const std::unordered_map<const ScriptObject*, ScriptObject*>& originals) {
+        if (value.is_object()) {
+            auto original = originals.find(value.as_object());
+            if (original == originals.end()) {
+                throw std::runtime_error("Parallel foreach created an object");
+            }
+            return Value::object(original->second);
+        }
+        if (!holds_objects(value)) {
+            return value;
+        }
+        std::vector<Value> elements;
+        elements.reserve(value.elements().size());
+        for (const Value& element : value.elements()) {
+            elements.push_back(original_value(element, originals));
+        }
+        return Value::array(std::move(elements));
+    }
+
+    const Interpreter& source;
+    const ForeachLoopNode& loop;
+    const ParallelPlan& plan;
+    const std::vector<Value>& items;
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> stop;
+    std::mutex mutex;
+    std::condition_variable idle;
+    size_t active = 0;
+    bool finished = false;
+};
+
+std::optional<Value> Interpreter::run_parallel_foreach(const ForeachLoopNode& loop, const Value& collection) {
+    ParallelPlan plan = plan_parallel_loop(loop, functions);
+    // Items may run again after one returns, so a call the body returns is
+    // made where it is returned rather than in the function's frame
+    struct NoTailCalls {
+        size_t& depth;
+        size_t previous;
+        ~NoTailCalls() { depth = previous; }
+    } no_tail_calls{tail_depth, tail_depth};
+    tail_depth = SIZE_MAX;
+    if (collection.is_object()) {
+        throw std::runtime_error("Cannot iterate over an object: " + loop.identifier);
+    }
+    std::vector<Value> items;
+    if (collection.is_array()) {
+        items = collection.elements();
+    } else {
+        std::istringstream ss(collection.str());
+        std::string item;
+        while (std::getline(ss, item, ',')) {
+            items.emplace_back(item);
+        }
+    }
+
+    size_t threads = parallel_policy.workers ? parallel_policy.workers : std::max(1u, std::thread::hardware_concurrency());
+    size_t workers = std::min(threads, items.size());
+    std::optional<Value> return_value;
+    // A worker runs loops nested in the body itself; a bus delivers actions
+    // as they are made, so they can only be made in order
+    if (workers < 2 || parallel_worker || (plan.actions && event_bus)) {
+        run_foreach_items(loop, items, 0, return_value);
+        return return_value;
+    }
+
+    if (!parallel_pool || parallel_pool->size() != threads - 1) {
+        parallel_pool = std::make_shared<ThreadPool>(threads - 1);
+    }
+    size_t chunk_count = std::min(items.size(), workers * std::max<size_t>(parallel_policy.chunks_per_worker, 1));
+    auto run = std::make_shared<ParallelRun>(*this, loop, plan, items, chunk_count);
+    for (size_t i = 1; i < workers; ++i) {
+        parallel_pool->submit([run] { run->work(); });
+    }
+    run->work();
+    run->wait();
+    stats::add(stats::ParallelLoops);
+
+    for (size_t i = 0; i < run->chunks.size(); ++i) {
+        ParallelRun::Chunk& chunk = run->chunks[i];
+        if (i >= run->stopped_at()) {
+            stats::add(stats::ParallelRunsRedone);
+            run_foreach_items(loop, items, chunk.begin, return_value);
+            return return_value;
+        }
+        // A reduction operator can fail, e.g. dividing by zero; the run is
+        // then made again from the values it started with
+        std::vector<std::pair<Symbol, std::optional<Value>>> before;
+        for (Symbol name : plan.reductions) {
+            auto variable = variables.find(name);
+            before.emplace_back(name, variable == variables.end() ? std::nullopt : std::optional<Value>(variable->second));
+        }
+        try {
+            for (const auto& step : chunk.steps) {
+                Value& value = variables[step.variable];
+                for (const auto& [op, operand] : step.terms) {
+                    value = apply_binary(binary_op(op), op, value, operand);
+                }
+            }
+        } catch (const std::exception&) {
+            for (auto& [name, value] : before) {
+                if (value) {
+                    variables[name] = std::move(*value);
+                } else {
+                    variables.erase(name);
+                }
+            }
+            stats::add(stats::ParallelRunsRedone);
+            run_foreach_items(loop, items, chunk.begin, return_value);
+            return return_value;
+        }
+        if (current_profile) {
+            current_profile->back_edges += chunk.end - chunk.begin;
+        }
+        for (const auto& segment : chunk.output) {
+            if (segment.diagnostic) {
+                diagnostic_stream() << segment.text << std::flush;
+            } else {
+                *output_stream << segment.text << std::flush;
+            }
+        }
+        for (auto& [name, value] : chunk.finals) {
+            variables[name] = std::move(value);
+        }
+        for (Symbol name : chunk.read) {
+            variables.try_emplace(name);
+        }
+    }
+    stats::note_variable_count(variables.size());
+    return return_value;
+}
+
+void Interpreter::run_foreach_items(const ForeachLoopNode& loop, const std::vector<Value>& items, size_t begin,
+                                    std::optional<Value>& return_value) {
+    for (size_t i = begin; i < items.size(); ++i) {
+        if (current_profile) {
+            ++current_profile->back_edges;
+        }
+        variables[loop.identifier] = items[i];
+        stats::note_variable_count(variables.size());
+        interpret_node(loop.body->clone(), return_value);
+        if (return_value.has_value()) {
+            break;
+        }
+    }
+}
+
+// `x = x op a op b` for a reduction x, in the body of a parallel loop: the
+// operands are computed here and the update is left to the loop's interpreter
+bool Interpreter::record_reduction(const AssignmentNode& assignment) {
+    if (call_depth != 0 || !parallel_worker->reductions.count(assignment.identifier)) {
+        return false;
+    }
+    std::vector<std::pair<std::string, Value>> terms;
+    const ASTNode* node = assignment.expression.get();
+    std::vector<const BinaryExpressionNode*> spine;
+    while (auto binary = dynamic_cast<const BinaryExpressionNode*>(node)) {
+        spine.push_back(binary);
+        node = binary->left.get();
+    }
+    for (auto binary = spine.rbegin(); binary != spine.rend(); ++binary) {
+        terms.emplace_back((*binary)->op, evaluate_expression((*binary)->right->clone()));
+    }
+    parallel_worker->steps.push_back({assignment.identifier, std::move(terms)});
+    return true;
+}
@@ -0,0 +1,48 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "ast.h"
+#include "symbol.h"
+#include <cstddef>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// How many threads run a `parallel foreach`
+struct ParallelPolicy {
+    size_t workers = 0;            // Threads, the one running the loop included; 0 means one per hardware thread
+    size_t chunks_per_worker = 4;  // The items are split into this many runs per thread, taken in turn by whichever is free
+};
+
+// What the iterations of a `parallel foreach` share with the code around it
+struct ParallelPlan {
+    // Variables the body only updates as `x = x op a op b ...`, with a, b not
+    // reading x: the iterations compute the operands, and the updates are
+    // applied to x afterwards in item order
+    std::unordered_set<Symbol> reductions;
+    // Variables the body assigns before reading them, the loop variable
+    // among them; after the loop they hold what the last iteration left
+    std::vector<Symbol> written;
+    // Variables the body may read before assigning them; the iterations see
+    // the values they had before the loop
+    std::vector<Symbol> read;
+    bool actions = false;  // The body, or a function it calls, makes NPC actions
+};
+
+// Checks that the iterations of `loop` can run at the same time and still do
+// what the sequential loop does. Each iteration runs in a fork of the
+// interpreter (see Interpreter::fork), so the body may not assign a variable
+// it also reads from before the loop, unless it is a reduction, and neither
+// it nor the functions it calls may read input, declare functions, objects or
+// listeners, or assign fields, which would change what other iterations see.
+// Throws a runtime_error naming what the body does otherwise.
+//
+// Printing and NPC actions are allowed: each run of items collects its
+// output, which is written in item order once the runs before it are done.
+// An iteration that fails or returns makes the loop run again from the start
+// of its run of items, sequentially, so it fails or returns as it would have.
+ParallelPlan plan_parallel_loop(const ForeachLoopNode& loop,
+                                const std::unordered_map<Symbol, std::shared_ptr<const FunctionDeclarationNode>>& functions);
+
+#endif // PARALLEL_H
@@ -1,119 +1,193 @@
 #include "parser.h"
+#include "stats.h"
+#include "utils.h"
 #include <stdexcept>
 #include <iostream>
 
 Parser::Parser(const std::vector<Token>& tokens) : tokens(tokens), currentPosition(0) {
     currentToken = tokens[currentPosition];
-    std::cout << "Initializing parser with first token: " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+    trace_stream() << "Initializing parser with first token: " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+}
+
+std::unique_ptr<ASTNode> Parser::atLine(std::unique_ptr<ASTNode> node, int line) {
+    node->line = line;
+    return node;
+}
+
+Parser::Parser(const std::vector<Token>& tokens, size_t begin, size_t end)
+    : tokens(tokens.begin() + begin, tokens.begin() + end), currentPosition(0) {
+    int line = end < tokens.size() ? tokens[end].line : tokens.back().line;
+    size_t offset = end < tokens.size() ? tokens[end].offset : tokens.back().offset;
+    this->tokens.push_back({TokenType::EndOfFile, "", line, offset});
+    currentToken = this->tokens[currentPosition];
+    trace_stream() << "Initializing parser with first token: " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
 }
 
 void Parser::advance() {
     currentPosition++;
     if (currentPosition < tokens.size()) {
         currentToken = tokens[currentPosition];
-        std::cout << "Advanced to token: " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+        trace_stream() << "Advanced to token: " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
     } else {
         currentToken = {TokenType::EndOfFile, "", currentToken.line};
     }
 }
 
+TokenType Parser::peekType() const {
+    return currentPosition + 1 < tokens.size() ? tokens[currentPosition + 1].type : TokenType::EndOfFile;
+}
+
 std::unique_ptr<ASTNode> Parser::parse() {
+    stats::Timer timer(stats::ParseNanoseconds);
     auto block = std::make_unique<BlockNode>();
     while (currentToken.type != TokenType::EndOfFile) {
-        block->statements.push_back(parseStatement());
-        if (currentToken.type == TokenType::Semicolon) {
-            advance();
-        }
+        block->statements.push_back(parseTopLevelStatement());
     }
     return block;
 }
 
+std::unique_ptr<ASTNode> Parser::parseTopLevelStatement() {
+    auto statement = parseStatement();
+    if (currentToken.type == TokenType::Semicolon) {
+        advance();
+    }
+    return statement;
+}
+
+size_t Parser::position() const {
+    return currentPosition;
+}
+
+bool Parser::atEnd() const {
+    return currentToken.type == TokenType::EndOfFile;
+}
+
 std::unique_ptr<ASTNode> Parser::parseStatement() {
-    std::cout << "Parsing statement starting with token: " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
-
-    if (currentToken.type == TokenType::Keyword) {
-        if (currentToken.value == "print") {
-            return parsePrintStatement();
-        } else if (currentToken.value == "fun") {
-            return parseFunctionDefinition();
-        } else if (currentToken.value == "return") {
-            return parseReturnStatement();
-        } else if (currentToken.value == "foreach") {
-            return parseForeachLoop();
-        } else if (currentToken.value == "event") {
-            return parseEventListener();
-        } else if (currentToken.value == "npc") {
-            return parseNPCAction();
-        } else if (currentToken.value == "for") {
-            return parseForLoop();
-        } else if (currentToken.value == "while") {
-            return parseWhileLoop();
-        } else if (currentToken.value == "input") {
-            return parseInputStatement();
-        } else {
-            std::cerr << "Unknown keyword: " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
-            throw std::runtime_error("Unknown keyword at line " + std::to_string(currentToken.line));
-        }
-    } else if (currentToken.type == TokenType::Identifier) {
-        return parseAssignmentOrFunctionCall();
-    } else if (currentToken.type == TokenType::Symbol && currentToken.value == "(") {
-        return parseExpression();
-    } else {
-        std::cerr << "Unknown statement type: " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
-        throw std::runtime_error("Unknown statement type at line " + std::to_string(currentToken.line));
+    int line = currentToken.line;
+    trace_stream() << "Parsing statement starting with token: " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+
+    switch (currentToken.type) {
+        case TokenType::Print:
+            return atLine(parsePrintStatement(), line);
+        case TokenType::Fun:
+            return atLine(parseFunctionDefinition(), line);
+        case TokenType::Return:
+            return atLine(parseReturnStatement(), line);
+        case TokenType::Foreach:
+            return atLine(parseForeachLoop(), line);
+        case TokenType::Event:
+            return atLine(parseEventListener(), line);
+        case TokenType::Npc:
+            return atLine(parseNPCAction(), line);
+        case TokenType::For:
+            return atLine(parseForLoop(), line);
+        case TokenType::While:
+            return atLine(parseWhileLoop(), line);
+        case TokenType::Input:
+            return atLine(parseInputStatement(), line);
+        case TokenType::Identifier:
+            // `object` declares an object only when a name follows, and `pure` and
+            // `parallel` are modifiers only directly before `fun` and `foreach`;
+            // otherwise they are ordinary identifiers
+            if (currentToken.value == "object" && peekType() == TokenType::Identifier) {
+                return atLine(parseObjectDeclaration(), line);
+            }
+            if (currentToken.value == "pure" && peekType() == TokenType::Fun) {
+                return atLine(parsePureFunctionDefinition(), line);
+            }
+            if (currentToken.value == "parallel" && peekType() == TokenType::Foreach) {
+                return atLine(parseParallelForeachLoop(), line);
+            }
+            return atLine(parseAssignmentOrFunctionCall(), line);
+        case TokenType::LeftParen:
+            return atLine(parseExpression(), line);
+        default:
+            break;
+    }
+    if (is_keyword(currentToken.type)) {
+        diagnostic_stream() << "Unknown keyword: " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+        throw std::runtime_error("Unknown keyword at line " + std::to_string(currentToken.line));
     }
+    diagnostic_stream() << "Unknown statement type: " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+    throw std::runtime_error("Unknown statement type at line " + std::to_string(currentToken.line));
 }
 
 std::unique_ptr<ASTNode> Parser::parseAssignmentOrFunctionCall() {
-    std::string identifier = currentToken.value;
+    Symbol identifier = currentToken.symbol;
     advance();
 
-    if (currentToken.type == TokenType::Operator && currentToken.value == "=") {
+    if (currentToken.type == TokenType::Assign) {
         advance();
         auto expression = parseExpression();
         if (currentToken.type == TokenType::Semicolon) {
             advance();
         }
         return std::make_unique<AssignmentNode>(identifier, std::move(expression));
-    } else if (currentToken.type == TokenType::Symbol && currentToken.value == "(") {
+    } else if (currentToken.type == TokenType::LeftParen) {
         // Function call
         return parseFunctionCall(identifier);
-    } else if (currentToken.type == TokenType::Symbol && currentToken.value == "[") {
+    } else if (currentToken.type == TokenType::LeftBracket) {
         // Array indexing
         advance();  // Skip '['
         auto index = parseExpression();
-        if (currentToken.type != TokenType::Symbol || currentToken.value != "]") {
-            std::cerr << "Expected ']' after array index, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+        if (currentToken.type != TokenType::RightBracket) {
+            diagnostic_stream() << "Expected ']' after array index, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
             throw std::runtime_error("Expected ']' after array index at line " + std::to_string(currentToken.line));
         }
         advance();  // Skip ']'
+        if (currentToken.type == TokenType::Assign) {
+            advance();
+            auto expression = parseExpression();
+            if (currentToken.type == TokenType::Semicolon) {
+                advance();
+            }
+            return std::make_unique<ArrayAssignmentNode>(identifier, std::move(index), std::move(expression));
+        }
         return std::make_unique<ArrayIndexNode>(identifier, std::move(index));
+    } else if (currentToken.type == TokenType::Dot) {
+        // Field assignment; the fields before the last one are read
+        int line = currentToken.line;
+        std::unique_ptr<ASTNode> object = atLine(std::make_unique<IdentifierNode>(identifier), line);
+        Symbol field = parseFieldName();
+        while (currentToken.type == TokenType::Dot) {
+            object = atLine(std::make_unique<FieldAccessNode>(std::move(object), field), line);
+            field = parseFieldName();
+        }
+        if (currentToken.type == TokenType::Assign) {
+            advance();
+            auto expression = parseExpression();
+            if (currentToken.type == TokenType::Semicolon) {
+                advance();
+            }
+            return std::make_unique<FieldAssignmentNode>(std::move(object), field, std::move(expression));
+        }
+        return std::make_unique<FieldAccessNode>(std::move(object), field);
     } else {
-        std::cerr << "Invalid assignment or function call statement: " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+        diagnostic_stream() << "Invalid assignment or function call statement: " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
         throw std::runtime_error("Invalid assignment or function call statement at line " + std::to_string(currentToken.line));
     }
 }
 
-std::unique_ptr<ASTNode> Parser::parseFunctionCall(const std::string& identifier) {
+std::unique_ptr<ASTNode> Parser::parseFunctionCall(Symbol identifier) {
     auto call = std::make_unique<FunctionCallNode>(identifier);
     advance();  // Skip '('
 
-    std::cout << "Parsing function call arguments " << currentToken.value << std::endl;
+    trace_stream() << "Parsing function call arguments " << currentToken.value << std::endl;
 
-    while (currentToken.value != ")") {
+    while (currentToken.type != TokenType::RightParen) {
         call->arguments.push_back(parseExpression());
-        if (currentToken.value == ",") {
+        if (currentToken.type == TokenType::Comma) {
             advance();  // Skip ','
-        } else if (currentToken.value == ")") {
+        } else if (currentToken.type == TokenType::RightParen) {
             break;  // Found closing parenthesis
         } else {
-            std::cerr << "Expected ',' or ')' in function call, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+            diagnostic_stream() << "Expected ',' or ')' in function call, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
             throw std::runtime_error("Expected ',' or ')' in function call at line " + std::to_string(currentToken.line));
         }
     }
 
-    if (currentToken.value != ")") {
-        std::cerr << "Expected ')' after function arguments, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+    if (currentToken.type != TokenType::RightParen) {
+        diagnostic_stream() << "Expected ')' after function arguments, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
         throw std::runtime_error("Expected ')' after function arguments at line " + std::to_string(currentToken.line));
     }
     advance();  // Skip ')'
@@ -137,25 +211,25 @@ std::unique_ptr<ASTNode> Parser::parsePrintStatement() {
 std::unique_ptr<ASTNode> Parser::parseFunctionDefinition() {
     advance();  // Skip 'fun'
     if (currentToken.type != TokenType::Identifier) {
-        std::cerr << "Expected function name after 'fun', got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+        diagnostic_stream() << "Expected function name after 'fun', got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
         throw std::runtime_error("Expected function name after 'fun' at line " + std::to_string(currentToken.line));
     }
-    std::string functionName = currentToken.value;
+    Symbol functionName = currentToken.symbol;
     advance();  // Skip function name
 
     // Expect a left parenthesis '('
-    if (currentToken.type != TokenType::Symbol || currentToken.value != "(") {
-        std::cerr << "Expected '(' after function name, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+    if (currentToken.type != TokenType::LeftParen) {
+        diagnostic_stream() << "Expected '(' after function name, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
         throw std::runtime_error("Expected '(' after function name at line " + std::to_string(currentToken.line));
     }
     advance();  // Skip '('
 
     // Parse function parameters (identifiers separated by commas)
-    std::vector<std::string> parameters;
+    std::vector<Symbol> parameters;
     while (currentToken.type == TokenType::Identifier) {
-        parameters.push_back(currentToken.value);
+        parameters.push_back(currentToken.symbol);
         advance();  // Skip parameter name
-        if (currentToken.type == TokenType::Symbol && currentToken.value == ",") {
+        if (currentToken.type == TokenType::Comma) {
             advance();  // Skip comma
         } else {
             break;
@@ -163,21 +237,21 @@ std::unique_ptr<ASTNode> Parser::parseFunctionDefinition() {
     }
 
     // Expect a right parenthesis ')'
-    if (currentToken.type != TokenType::Symbol || currentToken.value != ")") {
-        std::cerr << "Expected ')' after function parameters, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+    if (currentToken.type != TokenType::RightParen) {
+        diagnostic_stream() << "Expected ')' after function parameters, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
         throw std::runtime_error("Expected ')' after function parameters at line " + std::to_string(currentToken.line));
     }
     advance();  // Skip ')'
 
     // Expect a block of statements (enclosed in curly braces '{}')
-    if (currentToken.type != TokenType::Symbol || currentToken.value != "{") {
-        std::cerr << "Expected '{' to start function body, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+    if (currentToken.type != TokenType::LeftBrace) {
+        diagnostic_stream() << "Expected '{' to start function body, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
         throw std::runtime_error("Expected '{' to start function body at line " + std::to_string(currentToken.line));
     }
     advance();  // Skip '{'
 
     auto body = std::make_unique<BlockNode>();
-    while (currentToken.type != TokenType::Symbol || currentToken.value != "}") {
+    while (currentToken.type != TokenType::RightBrace) {
         body->statements.push_back(parseStatement());
         if (currentToken.type == TokenType::Semicolon) {
             advance();
@@ -185,8 +259,8 @@ std::unique_ptr<ASTNode> Parser::parseFunctionDefinition() {
     }
 
     // Expect a right curly brace '}'
-    if (currentToken.type != TokenType::Symbol || currentToken.value != "}") {
-        std::cerr << "Expected '}' to end function body, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+    if (currentToken.type != TokenType::RightBrace) {
+        diagnostic_stream() << "Expected '}' to end function body, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
         throw std::runtime_error("Expected '}' to end function body at line " + std::to_string(currentToken.line));
     }
     advance();  // Skip '}'
@@ -194,6 +268,14 @@ std::unique_ptr<ASTNode> Parser::parseFunctionDefinition() {
     return std::make_unique<FunctionDeclarationNode>(functionName, std::move(parameters), std::move(body));
 }
 
+// `pure fun name(...) { ... }`: a function whose results may be kept and reused
+std::unique_ptr<ASTNode> Parser::parsePureFunctionDefinition() {
+    advance();  // Skip 'pure'; parseStatement has seen 'fun' follow it
+    auto function = parseFunctionDefinition();
+    static_cast<FunctionDeclarationNode&>(*function).declared_pure = true;
+    return function;
+}
+
 std::unique_ptr<ASTNode> Parser::parseReturnStatement() {
     advance();  // Skip 'return'
     auto expression = parseExpression();
@@ -203,39 +285,46 @@ std::unique_ptr<ASTNode> Parser::parseReturnStatement() {
     return std::make_unique<ReturnNode>(std::move(expression));
 }
 
+std::unique_ptr<ASTNode> Parser::parseParallelForeachLoop() {
+    advance();  // Skip 'parallel'; parseStatement has seen 'foreach' follow it
+    auto loop = parseForeachLoop();
+    static_cast<ForeachLoopNode&>(*loop).parallel = true;
+    return loop;
+}
+
 std::unique_ptr<ASTNode> Parser::parseForeachLoop() {
     advance();  // Skip 'foreach'
     if (currentToken.type != TokenType::Identifier) {
-        std::cerr << "Expected identifier after 'foreach', got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+        diagnostic_stream() << "Expected identifier after 'foreach', got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
         throw std::runtime_error("Expected identifier after 'foreach' at line " + std::to_string(currentToken.line));
     }
-    std::string identifier = currentToken.value;
+    Symbol identifier = currentToken.symbol;
     advance();  // Skip identifier
 
-    if (currentToken.type != TokenType::Keyword || currentToken.value != "in") {
-        std::cerr << "Expected 'in' after identifier, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+    if (currentToken.type != TokenType::In) {
+        diagnostic_stream() << "Expected 'in' after identifier, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
         throw std::runtime_error("Expected 'in' after identifier at line " + std::to_string(currentToken.line));
     }
     advance();  // Skip 'in'
 
     auto collection = parseExpression();
 
-    if (currentToken.type != TokenType::Symbol || currentToken.value != "{") {
-        std::cerr << "Expected '{' to start loop body, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+    if (currentToken.type != TokenType::LeftBrace) {
+        diagnostic_stream() << "Expected '{' to start loop body, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
         throw std::runtime_error("Expected '{' to start loop body at line " + std::to_string(currentToken.line));
     }
     advance();  // Skip '{'
 
     auto body = std::make_unique<BlockNode>();
-    while (currentToken.type != TokenType::Symbol || currentToken.value != "}") {
+    while (currentToken.type != TokenType::RightBrace) {
         body->statements.push_back(parseStatement());
         if (currentToken.type == TokenType::Semicolon) {
             advance();
         }
     }
 
-    if (currentToken.type != TokenType::Symbol || currentToken.value != "}") {
-        std::cerr << "Expected '}' to end loop body, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+    if (currentToken.type != TokenType::RightBrace) {
+        diagnostic_stream() << "Expected '}' to end loop body, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
         throw std::runtime_error("Expected '}' to end loop body at line " + std::to_string(currentToken.line));
     }
     advance();  // Skip '}'
@@ -246,28 +335,28 @@ std::unique_ptr<ASTNode> Parser::parseForeachLoop() {
 std::unique_ptr<ASTNode> Parser::parseEventListener() {
     advance();  // Skip 'event'
     if (currentToken.type != TokenType::Identifier) {
-        std::cerr << "Expected event name after 'event', got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+        diagnostic_stream() << "Expected event name after 'event', got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
         throw std::runtime_error("Expected event name after 'event' at line " + std::to_string(currentToken.line));
     }
-    std::string event_name = currentToken.value;
+    Symbol event_name = currentToken.symbol;
     advance();  // Skip event name
 
-    if (currentToken.type != TokenType::Symbol || currentToken.value != "{") {
-        std::cerr << "Expected '{' to start event listener body, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+    if (currentToken.type != TokenType::LeftBrace) {
+        diagnostic_stream() << "Expected '{' to start event listener body, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
         throw std::runtime_error("Expected '{' to start event listener body at line " + std::to_string(currentToken.line));
     }
     advance();  // Skip '{'
 
     auto body = std::make_unique<BlockNode>();
-    while (currentToken.type != TokenType::Symbol || currentToken.value != "}") {
+    while (currentToken.type != TokenType::RightBrace) {
         body->statements.push_back(parseStatement());
         if (currentToken.type == TokenType::Semicolon) {
             advance();
         }
     }
 
-    if (currentToken.type != TokenType::Symbol || currentToken.value != "}") {
-        std::cerr << "Expected '}' to end event listener body, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+    if (currentToken.type != TokenType::RightBrace) {
+        diagnostic_stream() << "Expected '}' to end event listener body, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
         throw std::runtime_error("Expected '}' to end event listener body at line " + std::to_string(currentToken.line));
     }
     advance();  // Skip '}'
@@ -278,17 +367,17 @@ std::unique_ptr<ASTNode> Parser::parseEventListener() {
 std::unique_ptr<ASTNode> Parser::parseNPCAction() {
     advance();  // Skip 'npc'
     if (currentToken.type != TokenType::Identifier) {
-        std::cerr << "Expected NPC name after 'npc', got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+        diagnostic_stream() << "Expected NPC name after 'npc', got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
         throw std::runtime_error("Expected NPC name after 'npc' at line " + std::to_string(currentToken.line));
     }
-    std::string npc_name = currentToken.value;
+    Symbol npc_name = currentToken.symbol;
     advance();  // Skip NPC name
 
     if (currentToken.type != TokenType::Identifier) {
-        std::cerr << "Expected action after NPC name, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+        diagnostic_stream() << "Expected action after NPC name, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
         throw std::runtime_error("Expected action after NPC name at line " + std::to_string(currentToken.line));
     }
-    std::string action = currentToken.value;
+    Symbol action = currentToken.symbol;
     advance();  // Skip action
 
     if (currentToken.type == TokenType::Semicolon) {
@@ -301,44 +390,44 @@ std::unique_ptr<ASTNode> Parser::parseNPCAction() {
 std::unique_ptr<ASTNode> Parser::parseForLoop() {
     advance();  // Skip 'for'
     if (currentToken.type != TokenType::Identifier) {
-        std::cerr << "Expected identifier after 'for', got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+        diagnostic_stream() << "Expected identifier after 'for', got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
         throw std::runtime_error("Expected identifier after 'for' at line " + std::to_string(currentToken.line));
     }
-    std::string identifier = currentToken.value;
+    Symbol identifier = currentToken.symbol;
     advance();  // Skip identifier
 
-    if (currentToken.type != TokenType::Operator || currentToken.value != "=") {
-        std::cerr << "Expected '=' after identifier, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+    if (currentToken.type != TokenType::Assign) {
+        diagnostic_stream() << "Expected '=' after identifier, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
         throw std::runtime_error("Expected '=' after identifier at line " + std::to_string(currentToken.line));
     }
     advance();  // Skip '='
 
     auto lower_bound = parseExpression();
 
-    if (currentToken.type != TokenType::Keyword || currentToken.value != "to") {
-        std::cerr << "Expected 'to' after lower bound, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+    if (currentToken.type != TokenType::To) {
+        diagnostic_stream() << "Expected 'to' after lower bound, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
         throw std::runtime_error("Expected 'to' after lower bound at line " + std::to_string(currentToken.line));
     }
     advance();  // Skip 'to'
 
     auto upper_bound = parseExpression();
 
-    if (currentToken.type != TokenType::Symbol || currentToken.value != "{") {
-        std::cerr << "Expected '{' to start loop body, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+    if (currentToken.type != TokenType::LeftBrace) {
+        diagnostic_stream() << "Expected '{' to start loop body, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
         throw std::runtime_error("Expected '{' to start loop body at line " + std::to_string(currentToken.line));
     }
     advance();  // Skip '{'
 
     auto body = std::make_unique<BlockNode>();
-    while (currentToken.type != TokenType::Symbol || currentToken.value != "}") {
+    while (currentToken.type != TokenType::RightBrace) {
         body->statements.push_back(parseStatement());
         if (currentToken.type == TokenType::Semicolon) {
             advance();
         }
     }
 
-    if (currentToken.type != TokenType::Symbol || currentToken.value != "}") {
-        std::cerr << "Expected '}' to end loop body, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+    if (currentToken.type != TokenType::RightBrace) {
+        diagnostic_stream() << "Expected '}' to end loop body, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
         throw std::runtime_error("Expected '}' to end loop body at line " + std::to_string(currentToken.line));
     }
     advance();  // Skip '}'
@@ -351,22 +440,22 @@ std::unique_ptr<ASTNode> Parser::parseWhileLoop() {
 
     auto condition = parseExpression();  // Parse the condition
 
-    if (currentToken.type != TokenType::Symbol || currentToken.value != "{") {
-        std::cerr << "Expected '{' to start loop body, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+    if (currentToken.type != TokenType::LeftBrace) {
+        diagnostic_stream() << "Expected '{' to start loop body, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
         throw std::runtime_error("Expected '{' to start loop body at line " + std::to_string(currentToken.line));
     }
     advance();  // Skip '{'
 
     auto body = std::make_unique<BlockNode>();
-    while (currentToken.type != TokenType::Symbol || currentToken.value != "}") {
+    while (currentToken.type != TokenType::RightBrace) {
         body->statements.push_back(parseStatement());
         if (currentToken.type == TokenType::Semicolon) {
             advance();
         }
     }
 
-    if (currentToken.type != TokenType::Symbol || currentToken.value != "}") {
-        std::cerr << "Expected '}' to end loop body, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+    if (currentToken.type != TokenType::RightBrace) {
+        diagnostic_stream() << "Expected '}' to end loop body, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
         throw std::runtime_error("Expected '}' to end loop body at line " + std::to_string(currentToken.line));
     }
     advance();  // Skip '}'
@@ -377,10 +466,10 @@ std::unique_ptr<ASTNode> Parser::parseWhileLoop() {
 std::unique_ptr<ASTNode> Parser::parseInputStatement() {
     advance();  // Skip 'input'
     if (currentToken.type != TokenType::Identifier) {
-        std::cerr << "Expected identifier after 'input', got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+        diagnostic_stream() << "Expected identifier after 'input', got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
         throw std::runtime_error("Expected identifier after 'input' at line " + std::to_string(currentToken.line));
     }
-    std::string identifier = currentToken.value;
+    Symbol identifier = currentToken.symbol;
     advance();  // Skip identifier
 
     if (currentToken.type == TokenType::Semicolon) {
@@ -390,19 +479,70 @@ std::unique_ptr<ASTNode> Parser::parseInputStatement() {
     return std::make_unique<InputNode>(identifier);
 }
 
+std::unique_ptr<ASTNode> Parser::parseObjectDeclaration() {
+    advance();  // Skip 'object'
+    if (currentToken.type != TokenType::Identifier) {
+        diagnostic_stream() << "Expected identifier after 'object', got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+        throw std::runtime_error("Expected identifier after 'object' at line " + std::to_string(currentToken.line));
+    }
+    Symbol identifier = currentToken.symbol;
+    advance();  // Skip identifier
+
+    if (currentToken.type == TokenType::Semicolon) {
+        advance();
+    }
+
+    return std::make_unique<ObjectDeclarationNode>(identifier);
+}
+
+Symbol Parser::parseFieldName() {
+    advance();  // Skip '.'
+    if (currentToken.type != TokenType::Identifier) {
+        diagnostic_stream() << "Expected field name after '.', got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+        throw std::runtime_error("Expected field name after '.' at line " + std::to_string(currentToken.line));
+    }
+    Symbol field = currentToken.symbol;
+    advance();  // Skip field name
+    return field;
+}
+
+// `object.field.field`, after the object expression has been parsed
+std::unique_ptr<ASTNode> Parser::parseFieldAccesses(std::unique_ptr<ASTNode> object) {
+    while (currentToken.type == TokenType::Dot) {
+        int line = currentToken.line;
+        Symbol field = parseFieldName();
+        object = atLine(std::make_unique<FieldAccessNode>(std::move(object), field), line);
+    }
+    return object;
+}
+
+// Operators parseExpression combines, binding looser than * and /
+bool Parser::isAdditiveOrComparison(TokenType type) {
+    switch (type) {
+        case TokenType::Plus:
+        case TokenType::Minus:
+        case TokenType::Less:
+        case TokenType::Greater:
+        case TokenType::LessEqual:
+        case TokenType::GreaterEqual:
+        case TokenType::Equal:
+        case TokenType::NotEqual:
+            return true;
+        default:
+            return false;
+    }
+}
+
 std::unique_ptr<ASTNode> Parser::parseExpression() {
     auto lhs = parseTerm();
 
-    while ((currentToken.type == TokenType::Symbol || currentToken.type == TokenType::Operator) &&
-           (currentToken.value == "+" || currentToken.value == "-" ||
-            currentToken.value == "<" || currentToken.value == ">" ||
-            currentToken.value == "<=" || currentToken.value == ">=" ||
-            currentToken.value == "==" || currentToken.value == "!=")) {
+    while (isAdditiveOrComparison(currentToken.type)) {
         std::string op = currentToken.value;
+        int line = currentToken.line;
         advance();  // Skip operator
         auto rhs = parseTerm();
-        lhs = std::make_unique<BinaryExpressionNode>(std::move(lhs), op, std::move(rhs));
-            }
+        lhs = atLine(std::make_unique<BinaryExpressionNode>(std::move(lhs), op, std::move(rhs)), line);
+    }
 
     return lhs;
 }
@@ -410,109 +550,112 @@ std::unique_ptr<ASTNode> Parser::parseExpression() {
 std::unique_ptr<ASTNode> Parser::parseTerm() {
     auto lhs = parseFactor();
 
-    while (currentToken.type == TokenType::Symbol && (currentToken.value == "*" || currentToken.value == "/")) {
+    while (currentToken.type == TokenType::Star || currentToken.type == TokenType::Slash) {
         std::string op = currentToken.value;
+        int line = currentToken.line;
         advance();  // Skip operator
         auto rhs = parseFactor();
-        lhs = std::make_unique<BinaryExpressionNode>(std::move(lhs), op, std::move(rhs));
+        lhs = atLine(std::make_unique<BinaryExpressionNode>(std::move(lhs), op, std::move(rhs)), line);
     }
 
     return lhs;
 }
 
 std::unique_ptr<ASTNode> Parser::parseFactor() {
+    int line = currentToken.line;
     if (currentToken.type == TokenType::Number) {
         auto number = std::make_unique<NumberNode>(std::stod(currentToken.value));
         advance();  // Skip number
-        return number;
+        return atLine(std::move(number), line);
     } else if (currentToken.type == TokenType::Identifier) {
-        std::string identifier = currentToken.value;
+        Symbol identifier = currentToken.symbol;
         advance();  // Skip identifier
 
-        if (currentToken.type == TokenType::Symbol && currentToken.value == "(") {
+        if (currentToken.type == TokenType::LeftParen) {
             // Function call
-            return parseFunctionCall(identifier);
-        } else if (currentToken.type == TokenType::Symbol && currentToken.value == "[") {
+            return parseFieldAccesses(atLine(parseFunctionCall(identifier), line));
+        } else if (currentToken.type == TokenType::LeftBracket) {
             // Array indexing
             advance();  // Skip '['
             auto index = parseExpression();
-            if (currentToken.type != TokenType::Symbol || currentToken.value != "]") {
-                std::cerr << "Expected ']' after array index, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+            if (currentToken.type != TokenType::RightBracket) {
+                diagnostic_stream() << "Expected ']' after array index, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
                 throw std::runtime_error("Expected ']' after array index at line " + std::to_string(currentToken.line));
             }
             advance();  // Skip ']'
-            return std::make_unique<ArrayIndexNode>(identifier, std::move(index));
+            return parseFieldAccesses(atLine(std::make_unique<ArrayIndexNode>(identifier, std::move(index)), line));
         }
 
-        return std::make_unique<IdentifierNode>(identifier);
+        return parseFieldAccesses(atLine(std::make_unique<IdentifierNode>(identifier), line));
     } else if (currentToken.type == TokenType::String) {
         std::string value = currentToken.value;
         advance();  // Skip string
-        return std::make_unique<StringNode>(value);
-    } else if (currentToken.type == TokenType::Symbol && currentToken.value == "[") {
+        return atLine(std::make_unique<StringNode>(std::move(value)), line);
+    } else if (currentToken.type == TokenType::LeftBracket) {
         // Array literal
         advance();  // Skip '['
         auto arrayLiteral = std::make_unique<ArrayLiteralNode>();
-        while (currentToken.type != TokenType::Symbol || currentToken.value != "]") {
+        while (currentToken.type != TokenType::RightBracket) {
             arrayLiteral->elements.push_back(parseExpression());
-            if (currentToken.type == TokenType::Symbol && currentToken.value == ",") {
+            if (currentToken.type == TokenType::Comma) {
                 advance();  // Skip ','
-            } else if (currentToken.type == TokenType::Symbol && currentToken.value == "]") {
+            } else if (currentToken.type == TokenType::RightBracket) {
                 break;  // Found closing bracket
             } else {
-                std::cerr << "Expected ',' or ']' in array literal, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+                diagnostic_stream() << "Expected ',' or ']' in array literal, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
                 throw std::runtime_error("Expected ',' or ']' in array literal at line " + std::to_string(currentToken.line));
             }
         }
-        if (currentToken.type != TokenType::Symbol || currentToken.value != "]") {
-            std::cerr << "Expected ']' after array literal, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+        if (currentToken.type != TokenType::RightBracket) {
+            diagnostic_stream() << "Expected ']' after array literal, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
             throw std::runtime_error("Expected ']' after array literal at line " + std::to_string(currentToken.line));
         }
         advance();  // Skip ']'
-        return arrayLiteral;
-    } else if (currentToken.type == TokenType::Symbol && currentToken.value == "(") {
+        return atLine(std::move(arrayLiteral), line);
+    } else if (currentToken.type == TokenType::LeftParen) {
         advance();  // Skip '('
         auto expression = parseExpression();
-        if (currentToken.type != TokenType::Symbol || currentToken.value != ")") {
-            std::cerr << "Expected ')' after expression, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+        if (currentToken.type != TokenType::RightParen) {
+            diagnostic_stream() << "Expected ')' after expression, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
             throw std::runtime_error("Expected ')' after expression at line " + std::to_string(currentToken.line));
         }
         advance();  // Skip ')'
         return expression;
     } else {
-        std::cerr << "Unexpected token: " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+        diagnostic_stream() << "Unexpected token: " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
         throw std::runtime_error("Unexpected token at line " + std::to_string(currentToken.line));
     }
 }
 
 std::unique_ptr<ASTNode> Parser::parsePrimary() {
-    std::cout << "Parsing primary expression starting with token: " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+    int line = currentToken.line;
+    trace_stream() << "Parsing primary expression starting with token: " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
     if (currentToken.type == TokenType::Identifier) {
-        std::string identifier = currentToken.value;
+        Symbol identifier = currentToken.symbol;
         advance();
-        if (currentToken.type == TokenType::Symbol && currentToken.value == "(") {
-            return parseFunctionCall(identifier);
+        if (currentToken.type == TokenType::LeftParen) {
+            return atLine(parseFunctionCall(identifier), line);
         }
-        return std::make_unique<IdentifierNode>(identifier);
+        return atLine(std::make_unique<IdentifierNode>(identifier), line);
     } else if (currentToken.type == TokenType::Number) {
         double value = std::stod(currentToken.value);
         advance();
-        return std::make_unique<NumberNode>(value);
+        return atLine(std::make_unique<NumberNode>(value), line);
     } else if (currentToken.type == TokenType::String) {
         std::string value = currentToken.value;
         advance();
-        return std::make_unique<StringNode>(value);
-    } else if (currentToken.type == TokenType::Symbol && currentToken.value == "(") {
+        return atLine(std::make_unique<StringNode>(std::move(value)), line);
+    } else if (currentToken.type == TokenType::LeftParen) {
         advance();  // Skip '('
         auto expression = parseExpression();
-        if (currentToken.type != TokenType::Symbol || currentToken.value != ")") {
-            std::cerr << "Expected ')' after expression, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+        if (currentToken.type != TokenType::RightParen) {
+            diagnostic_stream() << "Expected ')' after expression, got " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
             throw std::runtime_error("Expected ')' after expression at line " + std::to_string(currentToken.line));
         }
         advance();  // Skip ')'
         return expression;
     } else {
-        std::cerr << "Unknown primary expression type: " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
+        diagnostic_stream() << "Unknown primary expression type: " << currentToken.value << " (line " << currentToken.line << ")" << std::endl;
         throw std::runtime_error("Unknown primary expression type at line " + std::to_string(currentToken.line));
     }
 }
\ No newline at end of file
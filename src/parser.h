@@ -11,26 +11,42 @@ struct Token;
 class Parser {
 public:
     Parser(const std::vector<Token>& tokens);
+    // Parses only tokens[begin, end), as if an end-of-file token followed them
+    Parser(const std::vector<Token>& tokens, size_t begin, size_t end);
     std::unique_ptr<ASTNode> parse();
 
+    // Parses one top-level statement exactly as parse() would, for incremental re-parsing
+    std::unique_ptr<ASTNode> parseTopLevelStatement();
+    size_t position() const;
+    bool atEnd() const;
+
 private:
     std::vector<Token> tokens;
     Token currentToken;
     size_t currentPosition;
 
     void advance();
+    // Kind of the token after the current one, for words that are keywords only in some positions
+    TokenType peekType() const;
+    static std::unique_ptr<ASTNode> atLine(std::unique_ptr<ASTNode> node, int line);
     std::unique_ptr<ASTNode> parseStatement();
     std::unique_ptr<ASTNode> parseAssignmentOrFunctionCall();
-    std::unique_ptr<ASTNode> parseFunctionCall(const std::string& identifier);
+    std::unique_ptr<ASTNode> parseFunctionCall(Symbol identifier);
     std::unique_ptr<ASTNode> parsePrintStatement();
     std::unique_ptr<ASTNode> parseFunctionDefinition();
+    std::unique_ptr<ASTNode> parsePureFunctionDefinition();
     std::unique_ptr<ASTNode> parseReturnStatement();
     std::unique_ptr<ASTNode> parseForeachLoop();
+    std::unique_ptr<ASTNode> parseParallelForeachLoop();
     std::unique_ptr<ASTNode> parseEventListener();
     std::unique_ptr<ASTNode> parseNPCAction();
     std::unique_ptr<ASTNode> parseForLoop();
     std::unique_ptr<ASTNode> parseWhileLoop();
     std::unique_ptr<ASTNode> parseInputStatement();
+    std::unique_ptr<ASTNode> parseObjectDeclaration();
+    Symbol parseFieldName();
+    std::unique_ptr<ASTNode> parseFieldAccesses(std::unique_ptr<ASTNode> object);
+    static bool isAdditiveOrComparison(TokenType type);
     std::unique_ptr<ASTNode> parseExpression();
 
     std::unique_ptr<ASTNode> parseTerm();
@@ -0,0 +1,135 @@
+#include "profiler.h"
+#include <algorithm>
+#include <iomanip>
+#include <stdexcept>
+
+namespace {
+
+uint64_t elapsed_ns(std::chrono::steady_clock::time_point start) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+double to_ms(uint64_t ns) {
+    return static_cast<double>(ns) / 1e6;
+}
+
+}
+
+Profiler::Profiler() {
+    // Node 0 is the root every call stack hangs off; it is never printed itself
+    stack_nodes.push_back({"", 0, 0, {}});
+}
+
+void Profiler::enter_function(const std::string& name) {
+    ProfileEntry& entry = function_entries[name];
+    ++entry.calls;
+    ++active_functions[&entry];
+
+    size_t parent = function_stack.empty() ? 0 : function_stack.back().stack_node;
+    size_t node;
+    auto child = stack_nodes[parent].children.find(name);
+    if (child != stack_nodes[parent].children.end()) {
+        node = child->second;
+    } else {
+        node = stack_nodes.size();
+        stack_nodes[parent].children[name] = node;
+        stack_nodes.push_back({name, parent, 0, {}});
+    }
+    function_stack.push_back({&entry, Clock::now(), 0, node});
+}
+
+void Profiler::exit_function() {
+    if (function_stack.empty()) {
+        throw std::logic_error("Profiler: function exit without matching entry");
+    }
+    FunctionFrame frame = function_stack.back();
+    function_stack.pop_back();
+
+    uint64_t inclusive = elapsed_ns(frame.start);
+    uint64_t exclusive = inclusive - std::min(inclusive, frame.child_ns);
+    frame.entry->exclusive_ns += exclusive;
+    stack_nodes[frame.stack_node].self_ns += exclusive;
+    // Only the outermost activation of a recursive function adds to its inclusive time
+    if (--active_functions[frame.entry] == 0) {
+        frame.entry->inclusive_ns += inclusive;
+    }
+    if (!function_stack.empty()) {
+        function_stack.back().child_ns += inclusive;
+    }
+}
+
+void Profiler::enter_statement(int line) {
+    ++line_entries[line].calls;
+    ++active_lines[line];
+    statement_stack.push_back({line, Clock::now(), 0});
+}
+
+void Profiler::exit_statement() {
+    if (statement_stack.empty()) {
+        throw std::logic_error("Profiler: statement exit without matching entry");
+    }
+    StatementFrame frame = statement_stack.back();
+    statement_stack.pop_back();
+
+    uint64_t inclusive = elapsed_ns(frame.start);
+    ProfileEntry& entry = line_entries[frame.line];
+    entry.exclusive_ns += inclusive - std::min(inclusive, frame.child_ns);
+    if (--active_lines[frame.line] == 0) {
+        entry.inclusive_ns += inclusive;
+    }
+    if (!statement_stack.empty()) {
+        statement_stack.back().child_ns += inclusive;
+    }
+}
+
+const std::unordered_map<std::string, ProfileEntry>& Profiler::functions() const {
+    return function_entries;
+}
+
+const std::map<int, ProfileEntry>& Profiler::lines() const {
+    return line_entries;
+}
+
+void Profiler::write_collapsed(std::ostream& out) const {
+    for (const auto& child : stack_nodes[0].children) {
+        write_stack(out, child.second, "");
+    }
+}
+
+void Profiler::write_stack(std::ostream& out, size_t node, const std::string& prefix) const {
+    const StackNode& stack_node = stack_nodes[node];
+    std::string path = prefix.empty() ? stack_node.name : prefix + ";" + stack_node.name;
+    if (stack_node.self_ns > 0) {
+        out << path << " " << stack_node.self_ns << "\n";
+    }
+    for (const auto& child : stack_node.children) {
+        write_stack(out, child.second, path);
+    }
+}
+
+void Profiler::write_report(std::ostream& out) const {
+    std::vector<std::pair<std::string, ProfileEntry>> functions_by_time(function_entries.begin(), function_entries.end());
+    std::sort(functions_by_time.begin(), functions_by_time.end(), [](const auto& a, const auto& b) {
+        return a.second.exclusive_ns > b.second.exclusive_ns;
+    });
+    std::vector<std::pair<int, ProfileEntry>> lines_by_time(line_entries.begin(), line_entries.end());
+    std::sort(lines_by_time.begin(), lines_by_time.end(), [](const auto& a, const auto& b) {
+        return a.second.exclusive_ns > b.second.exclusive_ns;
+    });
+
+    std::ios_base::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(3);
+    out << std::left << std::setw(24) << "function" << std::right << std::setw(10) << "calls"
+        << std::setw(14) << "incl ms" << std::setw(14) << "excl ms" << "\n";
+    for (const auto& function : functions_by_time) {
+        out << std::left << std::setw(24) << function.first << std::right << std::setw(10) << function.second.calls
+            << std::setw(14) << to_ms(function.second.inclusive_ns) << std::setw(14) << to_ms(function.second.exclusive_ns) << "\n";
+    }
+    out << "\n" << std::left << std::setw(24) << "line" << std::right << std::setw(10) << "hits"
+        << std::setw(14) << "incl ms" << std::setw(14) << "excl ms" << "\n";
+    for (const auto& line : lines_by_time) {
+        out << std::left << std::setw(24) << line.first << std::right << std::setw(10) << line.second.calls
+            << std::setw(14) << to_ms(line.second.inclusive_ns) << std::setw(14) << to_ms(line.second.exclusive_ns) << "\n";
+    }
+    out.flags(flags);
+}
@@ -0,0 +1,114 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct ProfileEntry {
+    uint64_t calls = 0;
+    uint64_t inclusive_ns = 0;  // Recursive activations are only counted once
+    uint64_t exclusive_ns = 0;
+};
+
+// Instrumenting profiler. The interpreter reports function entry/exit and
+// statement start/end; time is attributed to functions, source lines and
+// distinct call stacks. Function exclusive time excludes nested calls, line
+// exclusive time excludes nested statements (loop bodies and callees).
+class Profiler {
+public:
+    Profiler();
+
+    void enter_function(const std::string& name);
+    void exit_function();
+    void enter_statement(int line);
+    void exit_statement();
+
+    const std::unordered_map<std::string, ProfileEntry>& functions() const;
+    const std::map<int, ProfileEntry>& lines() const;
+
+    // Collapsed stacks ("main;caller;callee <ns>"), one line per distinct call
+    // stack weighted by exclusive nanoseconds, for flamegraph.pl and similar tools
+    void write_collapsed(std::ostream& out) const;
+    // Per-function and per-line tables sorted by exclusive time
+    void write_report(std::ostream& out) const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct StackNode {
+        std::string name;
+        size_t parent;
+        uint64_t self_ns;
+        std::unordered_map<std::string, size_t> children;
+    };
+
+    struct FunctionFrame {
+        ProfileEntry* entry;
+        Clock::time_point start;
+        uint64_t child_ns;
+        size_t stack_node;
+    };
+
+    struct StatementFrame {
+        int line;
+        Clock::time_point start;
+        uint64_t child_ns;
+    };
+
+    std::unordered_map<std::string, ProfileEntry> function_entries;
+    std::map<int, ProfileEntry> line_entries;
+    std::unordered_map<const ProfileEntry*, int> active_functions;
+    std::unordered_map<int, int> active_lines;
+    std::vector<FunctionFrame> function_stack;
+    std::vector<StatementFrame> statement_stack;
+    std::vector<StackNode> stack_nodes;
+
+    void write_stack(std::ostream& out, size_t node, const std::string& prefix) const;
+};
+
+// RAII helpers so the interpreter's hooks stay balanced when a script throws.
+// Both are no-ops when no profiler is attached.
+class ProfiledFunction {
+public:
+    ProfiledFunction(Profiler* profiler, const std::string& name) : profiler(profiler) {
+        if (profiler) {
+            profiler->enter_function(name);
+        }
+    }
+    ~ProfiledFunction() {
+        if (profiler) {
+            profiler->exit_function();
+        }
+    }
+    ProfiledFunction(const ProfiledFunction&) = delete;
+    ProfiledFunction& operator=(const ProfiledFunction&) = delete;
+
+private:
+    Profiler* profiler;
+};
+
+class ProfiledStatement {
+public:
+    ProfiledStatement(Profiler* profiler, int line) : profiler(profiler) {
+        if (profiler) {
+            profiler->enter_statement(line);
+        }
+    }
+    ~ProfiledStatement() {
+        if (profiler) {
+            profiler->exit_statement();
+        }
+    }
+    ProfiledStatement(const ProfiledStatement&) = delete;
+    ProfiledStatement& operator=(const ProfiledStatement&) = delete;
+
+private:
+    Profiler* profiler;
+};
+
+#endif // PROFILER_H
@@ -0,0 +1,493 @@
+#include "server.h"
+#include "input.h"
+#include "lexer.h"
+#include "parser.h"
+#include "thread_pool.h"
+#include "utils.h"
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const size_t MAX_HEADER = 64 * 1024;
+const size_t MAX_PAYLOAD = 64 * 1024 * 1024;
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+void request_stop(int) {
+    stop_requested = 1;
+}
+
+std::string format_hash(uint64_t hash) {
+    char text[17];
+    std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(hash));
+    return text;
+}
+
+// Whole-word unsigned number; std::invalid_argument with `what` otherwise, out of range included
+unsigned long long parse_number(const std::string& text, int base, const std::string& what) {
+    size_t used = 0;
+    unsigned long long number = 0;
+    try {
+        number = std::stoull(text, &used, base);
+    } catch (const std::logic_error&) {
+        used = 0;
+    }
+    if (used == 0 || used != text.size() || text[0] == '-') {
+        throw std::invalid_argument(what + ": " + text);
+    }
+    return number;
+}
+
+uint64_t parse_hash(const std::string& text) {
+    return parse_number(text, 16, "Invalid program hash");
+}
+
+size_t parse_length(const std::string& text) {
+    unsigned long long length = parse_number(text, 10, "Invalid length");
+    if (length > MAX_PAYLOAD) {
+        throw std::invalid_argument("Invalid length: " + text);
+    }
+    return static_cast<size_t>(length);
+}
+
+std::string ok(const std::string& result, const std::string& output) {
+    return "OK " + std::to_string(result.size()) + " " + std::to_string(output.size()) + "\n" + result + output;
+}
+
+std::string error(const std::string& message) {
+    return "ERR " + std::to_string(message.size()) + "\n" + message;
+}
+
+// Byte lengths of the payloads that follow a request header
+std::vector<size_t> payload_lengths(const std::vector<std::string>& header) {
+    const std::string& command = header[0];
+    if (command == "RUN" && (header.size() == 2 || header.size() == 3)) {
+        std::vector<size_t> lengths = {parse_length(header[1])};
+        if (header.size() == 3) {
+            lengths.push_back(parse_length(header[2]));
+            if (lengths[0] + lengths[1] > MAX_PAYLOAD) {
+                throw std::invalid_argument("Request too large");
+            }
+        }
+        return lengths;
+    } else if (command == "LOAD" && header.size() == 2) {
+        return {parse_length(header[1])};
+    } else if (command == "CALL" && header.size() >= 4) {
+        size_t count = parse_length(header[3]);
+        if (header.size() != 4 + count && header.size() != 5 + count) {
+            throw std::invalid_argument("CALL expects " + std::to_string(count) + " argument lengths and an optional input length");
+        }
+        std::vector<size_t> lengths;
+        size_t total = 0;
+        for (size_t i = 4; i < header.size(); ++i) {
+            lengths.push_back(parse_length(header[i]));
+            total += lengths.back();
+        }
+        if (total > MAX_PAYLOAD) {
+            throw std::invalid_argument("Arguments too large");
+        }
+        return lengths;
+    }
+    return {};
+}
+
+// One value per line for a request's `input` statements; once they run out,
+// `input` reads an empty line rather than waiting on the server's terminal
+std::vector<std::string> input_lines(const std::string& text) {
+    std::vector<std::string> lines;
+    std::istringstream in(text);
+    for (std::string line; std::getline(in, line);) {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+#ifndef _WIN32
+
+// A request taken off the front of a connection's input
+struct Request {
+    std::vector<std::string> header;
+    std::vector<std::string> payloads;
+    std::string error;  // Answered instead when the header is invalid
+};
+
+// Moves the first request in `input` to `request`; false until all of it has arrived
+bool take_request(std::string& input, Request& request) {
+    size_t newline = input.find('\n');
+    if (newline == std::string::npos) {
+        if (input.size() > MAX_HEADER) {
+            throw std::runtime_error("Request header too long");
+        }
+        return false;
+    }
+    request = Request();
+    std::istringstream words(input.substr(0, newline));
+    for (std::string word; words >> word;) {
+        request.header.push_back(word);
+    }
+    std::vector<size_t> lengths;
+    try {
+        if (!request.header.empty()) {
+            lengths = payload_lengths(request.header);
+        }
+    } catch (const std::logic_error& e) {
+        // Without the lengths the payloads cannot be skipped; reading goes on at the next line
+        request.error = e.what();
+        input.erase(0, newline + 1);
+        return true;
+    }
+    size_t size = newline + 1;
+    for (size_t length : lengths) {
+        size += length;
+    }
+    if (input.size() < size) {
+        return false;
+    }
+    size_t position = newline + 1;
+    for (size_t length : lengths) {
+        request.payloads.push_back(input.substr(position, length));
+        position += length;
+    }
+    input.erase(0, size);
+    return true;
+}
+
+bool write_all(int fd, const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t count = send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+        if (count <= 0) {
+            return false;
+        }
+        written += static_cast<size_t>(count);
+    }
+    return true;
+}
+
+// A connected client. While one of its requests is with the pool it is not
+// polled, so its requests are answered one at a time and in order.
+struct Client {
+    std::string input;
+    bool busy = false;
+    bool closing = false;  // Closed once the request with the pool is answered
+};
+
+#endif
+
+}
+
+ProgramCache::ProgramCache(size_t capacity) : capacity(std::max<size_t>(1, capacity)) {}
+
+std::shared_ptr<CachedProgram> ProgramCache::load(const std::string& source, uint64_t& hash) {
+    hash = hash_source(source);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = programs.find(hash);
+        if (it != programs.end() && it->second.first->source == source) {
+            touch(hash);
+            return it->second.first;
+        }
+    }
+
+    // Parse outside the lock so other requests keep being served
+    auto program = std::make_shared<CachedProgram>();
+    program->source = source;
+    Lexer lexer(source);
+    auto tokens = lexer.tokenize();
+    Parser parser(tokens);
+    program->ast = parser.parse();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = programs.find(hash);
+    if (it != programs.end()) {
+        if (it->second.first->source == source) {
+            touch(hash);
+            return it->second.first;  // Another request parsed it first
+        }
+        recent.erase(it->second.second);
+        programs.erase(it);
+    }
+    recent.push_front(hash);
+    programs[hash] = {program, recent.begin()};
+    while (programs.size() > capacity) {
+        programs.erase(recent.back());
+        recent.pop_back();
+    }
+    return program;
+}
+
+std::shared_ptr<CachedProgram> ProgramCache::find(uint64_t hash) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = programs.find(hash);
+    if (it == programs.end()) {
+        return nullptr;
+    }
+    touch(hash);
+    return it->second.first;
+}
+
+bool ProgramCache::evict(uint64_t hash) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = programs.find(hash);
+    if (it == programs.end()) {
+        return false;
+    }
+    recent.erase(it->second.second);
+    programs.erase(it);
+    return true;
+}
+
+size_t ProgramCache::size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return programs.size();
+}
+
+void ProgramCache::touch(uint64_t hash) {
+    auto& entry = programs[hash];
+    recent.splice(recent.begin(), recent, entry.second);
+}
+
+ScriptServer::ScriptServer(ServerOptions options) : options(std::move(options)), cache(this->options.cache_capacity) {}
+
+std::string ScriptServer::handle(const std::vector<std::string>& header, const std::vector<std::string>& payloads) {
+    try {
+        if (header.empty()) {
+            return error("Empty request");
+        }
+        const std::string& command = header[0];
+        if (command == "PING") {
+            return ok("", "");
+        } else if (command == "RUN" && (payloads.size() == 1 || payloads.size() == 2)) {
+            return run(payloads[0], payloads.size() == 2 ? payloads[1] : "");
+        } else if (command == "LOAD" && payloads.size() == 1) {
+            uint64_t hash;
+            cache.load(payloads[0], hash);
+            return ok(format_hash(hash), "");
+        } else if (command == "CALL" && header.size() >= 4) {
+            size_t count = parse_length(header[3]);
+            if (payloads.size() != count && payloads.size() != count + 1) {
+                return error("CALL expects " + std::to_string(count) + " arguments and an optional input");
+            }
+            std::vector<std::string> arguments(payloads.begin(), payloads.begin() + count);
+            return call(parse_hash(header[1]), header[2], arguments, payloads.size() > count ? payloads[count] : "");
+        } else if (command == "EVICT" && header.size() == 2) {
+            if (!cache.evict(parse_hash(header[1]))) {
+                return error("Unknown program " + header[1]);
+            }
+            return ok("", "");
+        }
+        return error("Unknown request: " + command);
+    } catch (const std::exception& e) {
+        return error(e.what());
+    }
+}
+
+std::string ScriptServer::run(const std::string& source, const std::string& input) {
+    uint64_t hash;
+    auto program = cache.load(source, hash);
+    std::ostringstream output;
+    QueueInput responses(input_lines(input));
+    Interpreter interpreter;
+    interpreter.set_output(output);
+    interpreter.set_input(&responses);
+    interpreter.interpret(program->ast->clone());
+    interpreter.execute();
+    return ok("", output.str());
+}
+
+std::string ScriptServer::call(uint64_t hash, const std::string& function, const std::vector<std::string>& arguments,
+                               const std::string& input) {
+    auto program = cache.find(hash);
+    if (!program) {
+        return error("Unknown program " + format_hash(hash) + "; LOAD it first");
+    }
+    std::call_once(program->prepared, [&program] {
+        // The top level's own output is not part of any call's response, and it has no input
+        std::ostream nowhere(nullptr);
+        QueueInput no_input(std::vector<std::string>{});
+        try {
+            auto prototype = std::make_unique<Interpreter>();
+            prototype->set_output(nowhere);
+            prototype->set_input(&no_input);
+            prototype->interpret(program->ast->clone());
+            prototype->execute();
+            prototype->set_output(std::cout);
+            prototype->set_input(nullptr);
+            program->prototype = std::move(prototype);
+        } catch (const std::exception& e) {
+            program->prepare_error = e.what();
+        }
+    });
+    if (!program->prototype) {
+        return error(program->prepare_error);
+    }
+    auto interpreter = program->prototype->fork();
+    std::ostringstream output;
+    QueueInput responses(input_lines(input));
+    interpreter->set_output(output);
+    interpreter->set_input(&responses);
+    std::string result = interpreter->call_function(function, arguments);
+    return ok(result, output.str());
+}
+
+#ifndef _WIN32
+
+void ScriptServer::serve() {
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        throw std::runtime_error("Could not create socket");
+    }
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (options.socket_path.size() >= sizeof(address.sun_path)) {
+        close(listener);
+        throw std::runtime_error("Socket path too long: " + options.socket_path);
+    }
+    std::copy(options.socket_path.begin(), options.socket_path.end(), address.sun_path);
+    unlink(options.socket_path.c_str());
+    if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(listener, 128) < 0) {
+        close(listener);
+        throw std::runtime_error("Could not listen on " + options.socket_path);
+    }
+    // Workers write to it when they finish a request, so its connection is polled again at once
+    int wake[2];
+    if (pipe(wake) < 0) {
+        close(listener);
+        throw std::runtime_error("Could not create pipe");
+    }
+    fcntl(wake[0], F_SETFL, O_NONBLOCK);
+    fcntl(wake[1], F_SETFL, O_NONBLOCK);
+
+    stop_requested = 0;
+    std::signal(SIGINT, request_stop);
+    std::signal(SIGTERM, request_stop);
+    std::unordered_map<int, Client> clients;
+    std::mutex finished_mutex;
+    std::vector<std::pair<int, bool>> finished;  // Connections whose request was answered, and whether the write succeeded
+    auto disconnect = [&clients](int fd) {
+        close(fd);
+        clients.erase(fd);
+    };
+    {
+        ThreadPool pool(options.workers);
+        // Hands the connection's next complete request, if there is one, to the pool
+        auto dispatch = [&](int fd, Client& client) {
+            Request request;
+            try {
+                if (!take_request(client.input, request)) {
+                    return;
+                }
+            } catch (const std::exception& e) {
+                request.error = e.what();
+                client.closing = true;
+            }
+            client.busy = true;
+            pool.submit([this, fd, request = std::move(request), &finished_mutex, &finished, &wake] {
+                std::ostream nowhere(nullptr);
+                set_trace_stream(&nowhere);
+                set_diagnostic_stream(&nowhere);
+                bool written = write_all(fd, request.error.empty() ? handle(request.header, request.payloads) : error(request.error));
+                set_trace_stream(nullptr);
+                set_diagnostic_stream(nullptr);
+                {
+                    std::lock_guard<std::mutex> lock(finished_mutex);
+                    finished.emplace_back(fd, written);
+                }
+                char byte = 0;
+                (void)!write(wake[1], &byte, 1);  // A full pipe already has a wake-up pending
+            });
+        };
+
+        std::vector<pollfd> waiting;
+        while (!stop_requested) {
+            std::vector<std::pair<int, bool>> answered;
+            {
+                std::lock_guard<std::mutex> lock(finished_mutex);
+                answered.swap(finished);
+            }
+            for (const auto& [fd, written] : answered) {
+                Client& client = clients[fd];
+                client.busy = false;
+                if (!written || client.closing) {
+                    disconnect(fd);
+                } else {
+                    dispatch(fd, client);  // It may have sent more while the last request ran
+                }
+            }
+
+            waiting.clear();
+            waiting.push_back({listener, POLLIN, 0});
+            waiting.push_back({wake[0], POLLIN, 0});
+            for (const auto& [fd, client] : clients) {
+                if (!client.busy) {
+                    waiting.push_back({fd, POLLIN, 0});
+                }
+            }
+            // Wake up regularly to notice a stop request
+            if (poll(waiting.data(), waiting.size(), 200) <= 0) {
+                continue;
+            }
+            if (waiting[1].revents) {
+                char drained[256];
+                while (read(wake[0], drained, sizeof(drained)) > 0) {
+                }
+            }
+            for (size_t i = 2; i < waiting.size(); ++i) {
+                if (!waiting[i].revents) {
+                    continue;
+                }
+                int fd = waiting[i].fd;
+                char chunk[64 * 1024];
+                ssize_t count = recv(fd, chunk, sizeof(chunk), 0);
+                if (count <= 0) {
+                    disconnect(fd);
+                    continue;
+                }
+                Client& client = clients[fd];
+                client.input.append(chunk, static_cast<size_t>(count));
+                dispatch(fd, client);
+            }
+            if (waiting[0].revents) {
+                int client = accept(listener, nullptr, nullptr);
+                if (client >= 0) {
+                    clients[client];
+                }
+            }
+        }
+        // The pool answers the requests it has before it is destroyed
+    }
+    for (const auto& entry : clients) {
+        close(entry.first);
+    }
+    close(wake[0]);
+    close(wake[1]);
+    close(listener);
+    unlink(options.socket_path.c_str());
+}
+
+void ScriptServer::stop() {
+    stop_requested = 1;
+}
+
+#else
+
+void ScriptServer::serve() {
+    throw std::runtime_error("The script server needs Unix domain sockets");
+}
+
+void ScriptServer::stop() {}
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "ast.h"
+#include "interpreter.h"
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A parsed script plus, once a function of it has been called, the state its
+// top level leaves behind. Calls run on a fork of that state, so the top level
+// executes once per cached program rather than once per request.
+struct CachedProgram {
+    std::string source;
+    std::unique_ptr<ASTNode> ast;
+
+    std::once_flag prepared;
+    std::unique_ptr<Interpreter> prototype;
+    std::string prepare_error;
+};
+
+// Parsed programs keyed by content hash, evicting the least recently used
+// entry beyond `capacity`. Safe to use from several threads.
+class ProgramCache {
+public:
+    explicit ProgramCache(size_t capacity);
+
+    // Parses `source` unless a program with the same text is cached
+    std::shared_ptr<CachedProgram> load(const std::string& source, uint64_t& hash);
+    std::shared_ptr<CachedProgram> find(uint64_t hash);
+    bool evict(uint64_t hash);
+    size_t size();
+
+private:
+    void touch(uint64_t hash);
+
+    size_t capacity;
+    std::mutex mutex;
+    std::unordered_map<uint64_t, std::pair<std::shared_ptr<CachedProgram>, std::list<uint64_t>::iterator>> programs;
+    std::list<uint64_t> recent;  // Most recently used first
+};
+
+struct ServerOptions {
+    std::string socket_path;
+    size_t workers = 0;  // 0 for one per core
+    size_t cache_capacity = 1024;
+};
+
+// Serves script runs and function calls over a Unix domain socket. Every
+// request is a header line, optionally followed by payloads whose byte lengths
+// the header gives; every response is "OK <result_len> <output_len>\n" followed
+// by the result and the program output, or "ERR <message_len>\n<message>".
+//
+//   PING                                   liveness check
+//   RUN <source_len> [<input_len>]         run a script in a fresh interpreter
+//   LOAD <source_len>                      cache a script; the result is its hash
+//   CALL <hash> <function> <argc> <arg_len>... [<input_len>]   call a function of a loaded script
+//   EVICT <hash>                           drop a script from the cache
+//
+// The optional input payload of RUN and CALL holds one line per `input`
+// statement. Requests never read the server's own stdin: without the payload,
+// or once its lines run out, `input` reads an empty line. A loaded script's
+// top level runs without input.
+//
+// Each connection may send any number of requests. The serving thread polls
+// the connections and hands every complete request to a pool of worker
+// threads, so an idle connection holds no worker; a connection's requests are
+// answered one at a time, in order.
+class ScriptServer {
+public:
+    explicit ScriptServer(ServerOptions options);
+
+    // Blocks until stop() is called or SIGINT/SIGTERM arrives
+    void serve();
+    void stop();
+
+    // Handles one request given its header words and payloads; public for tests
+    // and in-process use
+    std::string handle(const std::vector<std::string>& header, const std::vector<std::string>& payloads);
+
+private:
+    std::string run(const std::string& source, const std::string& input);
+    std::string call(uint64_t hash, const std::string& function, const std::vector<std::string>& arguments,
+                     const std::string& input);
+
+    ServerOptions options;
+    ProgramCache cache;
+};
+
+#endif // SERVER_H
@@ -0,0 +1,701 @@
+#include "snapshot.h"
+#include "interpreter.h"
+#include "types.h"
+#include "utils.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+enum class NodeTag : uint8_t {
+    Block = 1,
+    Assignment,
+    Print,
+    FunctionDeclaration,
+    Return,
+    BinaryExpression,
+    Identifier,
+    Number,
+    String,
+    FunctionCall,
+    ForeachLoop,
+    EventListener,
+    NPCAction,
+    ForLoop,
+    WhileLoop,
+    Input,
+    ArrayLiteral,
+    ArrayIndex,
+    ArrayAssignment,
+    ObjectDeclaration,
+    FieldAccess,
+    FieldAssignment
+};
+
+namespace {
+
+// Left on the thread's stack below the deepest level, for unwinding the error
+const size_t STACK_RESERVE = 64 * 1024;
+
+// One level of nesting, for as long as it lives. Levels take more stack in
+// some builds than others, so a thread with little stack stops before the bound.
+class Nesting {
+public:
+    Nesting(size_t& depth, const char* error) : depth(depth) {
+        if (depth >= SNAPSHOT_MAX_NESTING || native_stack_left() < STACK_RESERVE) {
+            throw std::runtime_error(error);
+        }
+        ++depth;
+    }
+    ~Nesting() {
+        --depth;
+    }
+    Nesting(const Nesting&) = delete;
+    Nesting& operator=(const Nesting&) = delete;
+
+private:
+    size_t& depth;
+};
+
+const char* const WRITE_TOO_DEEP = "Cannot snapshot: values or code nested too deeply";
+const char* const READ_TOO_DEEP = "Corrupt snapshot: nested too deeply";
+
+void write_header(SnapshotWriter& writer, NodeTag tag, const ASTNode& node) {
+    writer.write_byte(static_cast<uint8_t>(tag));
+    writer.write_varint(static_cast<uint64_t>(node.line));
+}
+
+// Numbers every object `root` holds, directly or through arrays and other
+// objects, in the order they are found
+void collect_objects(const Value& root, std::unordered_map<const ScriptObject*, uint64_t>& ids, std::vector<const ScriptObject*>& order) {
+    std::vector<const Value*> pending{&root};
+    while (!pending.empty()) {
+        const Value* value = pending.back();
+        pending.pop_back();
+        if (value->is_object()) {
+            const ScriptObject* object = value->as_object();
+            if (ids.emplace(object, order.size()).second) {
+                order.push_back(object);
+                for (const auto& field : *object) {
+                    pending.push_back(&field.value);
+                }
+            }
+        } else if (value->is_array()) {
+            for (const auto& element : value->elements()) {
+                pending.push_back(&element);
+            }
+        }
+    }
+}
+
+}
+
+SnapshotWriter::SnapshotWriter(std::ostream& out) : out(out), used(0) {}
+
+SnapshotWriter::~SnapshotWriter() {
+    flush();
+}
+
+void SnapshotWriter::write_byte(uint8_t byte) {
+    if (used == BUFFER_SIZE) {
+        flush();
+    }
+    buffer[used++] = static_cast<char>(byte);
+}
+
+void SnapshotWriter::write_u16(uint16_t value) {
+    write_byte(static_cast<uint8_t>(value & 0xff));
+    write_byte(static_cast<uint8_t>(value >> 8));
+}
+
+void SnapshotWriter::write_varint(uint64_t value) {
+    while (value >= 0x80) {
+        write_byte(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    write_byte(static_cast<uint8_t>(value));
+}
+
+void SnapshotWriter::write_double(double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    for (int i = 0; i < 8; ++i) {
+        write_byte(static_cast<uint8_t>(bits >> (i * 8)));
+    }
+}
+
+void SnapshotWriter::write_string(const std::string& value) {
+    write_varint(value.size());
+    write_bytes(value.data(), value.size());
+}
+
+void SnapshotWriter::set_object_ids(std::unordered_map<const ScriptObject*, uint64_t> ids) {
+    object_ids = std::move(ids);
+}
+
+void SnapshotWriter::write_value(const Value& value) {
+    Nesting nesting(depth, WRITE_TOO_DEEP);
+    if (value.is_text()) {
+        write_byte(0);
+        write_string(value.str());
+        return;
+    }
+    if (value.is_object()) {
+        auto it = object_ids.find(value.as_object());
+        if (it == object_ids.end()) {
+            throw std::logic_error("Object missing from the snapshot's object table");
+        }
+        write_byte(2);
+        write_varint(it->second);
+        return;
+    }
+    write_byte(1);
+    write_varint(value.elements().size());
+    for (const auto& element : value.elements()) {
+        write_value(element);
+    }
+}
+
+void SnapshotWriter::write_bytes(const char* data, size_t size) {
+    if (size > BUFFER_SIZE - used) {
+        flush();
+        if (size > BUFFER_SIZE) {
+            // Large payloads bypass the buffer entirely
+            out.write(data, static_cast<std::streamsize>(size));
+            return;
+        }
+    }
+    std::memcpy(buffer + used, data, size);
+    used += size;
+}
+
+void SnapshotWriter::flush() {
+    if (used > 0) {
+        out.write(buffer, static_cast<std::streamsize>(used));
+        used = 0;
+    }
+}
+
+void SnapshotWriter::write_node(const ASTNode& node) {
+    Nesting nesting(depth, WRITE_TOO_DEEP);
+    if (auto block = dynamic_cast<const BlockNode*>(&node)) {
+        write_header(*this, NodeTag::Block, node);
+        write_varint(block->statements.size());
+        for (const auto& statement : block->statements) {
+            write_node(*statement);
+        }
+    } else if (auto assignment = dynamic_cast<const AssignmentNode*>(&node)) {
+        write_header(*this, NodeTag::Assignment, node);
+        write_string(assignment->identifier);
+        write_node(*assignment->expression);
+    } else if (auto print = dynamic_cast<const PrintNode*>(&node)) {
+        write_header(*this, NodeTag::Print, node);
+        write_node(*print->expression);
+    } else if (auto function = dynamic_cast<const FunctionDeclarationNode*>(&node)) {
+        write_header(*this, NodeTag::FunctionDeclaration, node);
+        write_string(function->identifier);
+        write_varint(function->parameters.size());
+        for (const auto& parameter : function->parameters) {
+            write_string(parameter);
+        }
+        write_node(*function->body);
+        write_byte(function->declared_pure ? 1 : 0);
+    } else if (auto return_node = dynamic_cast<const ReturnNode*>(&node)) {
+        write_header(*this, NodeTag::Return, node);
+        write_node(*return_node->expression);
+    } else if (auto binary_expression = dynamic_cast<const BinaryExpressionNode*>(&node)) {
+        write_header(*this, NodeTag::BinaryExpression, node);
+        write_node(*binary_expression->left);
+        write_string(binary_expression->op);
+        write_node(*binary_expression->right);
+    } else if (auto identifier = dynamic_cast<const IdentifierNode*>(&node)) {
+        write_header(*this, NodeTag::Identifier, node);
+        write_string(identifier->identifier);
+    } else if (auto number = dynamic_cast<const NumberNode*>(&node)) {
+        write_header(*this, NodeTag::Number, node);
+        write_double(number->value);
+    } else if (auto str = dynamic_cast<const StringNode*>(&node)) {
+        write_header(*this, NodeTag::String, node);
+        write_string(str->value);
+    } else if (auto function_call = dynamic_cast<const FunctionCallNode*>(&node)) {
+        write_header(*this, NodeTag::FunctionCall, node);
+        write_string(function_call->identifier);
+        write_varint(function_call->arguments.size());
+        for (const auto& argument : function_call->arguments) {
+            write_node(*argument);
+        }
+    } else if (auto foreach_loop = dynamic_cast<const ForeachLoopNode*>(&node)) {
+        write_header(*this, NodeTag::ForeachLoop, node);
+        write_string(foreach_loop->identifier);
+        write_node(*foreach_loop->collection);
+        write_node(*foreach_loop->body);
+        write_byte(foreach_loop->parallel ? 1 : 0);
+    } else if (auto event_listener = dynamic_cast<const EventListenerNode*>(&node)) {
+        write_header(*this, NodeTag::EventListener, node);
+        write_string(event_listener->event_name);
+        write_node(*event_listener->body);
+    } else if (auto npc_action = dynamic_cast<const NPCActionNode*>(&node)) {
+        write_header(*this, NodeTag::NPCAction, node);
+        write_string(npc_action->npc_name);
+        write_string(npc_action->action);
+    } else if (auto for_loop = dynamic_cast<const ForLoopNode*>(&node)) {
+        write_header(*this, NodeTag::ForLoop, node);
+        write_string(for_loop->identifier);
+        write_node(*for_loop->lower_bound);
+        write_node(*for_loop->upper_bound);
+        write_node(*for_loop->body);
+    } else if (auto while_loop = dynamic_cast<const WhileLoopNode*>(&node)) {
+        write_header(*this, NodeTag::WhileLoop, node);
+        write_node(*while_loop->condition);
+        write_node(*while_loop->body);
+    } else if (auto input = dynamic_cast<const InputNode*>(&node)) {
+        write_header(*this, NodeTag::Input, node);
+        write_string(input->identifier);
+    } else if (auto array_literal = dynamic_cast<const ArrayLiteralNode*>(&node)) {
+        write_header(*this, NodeTag::ArrayLiteral, node);
+        write_varint(array_literal->elements.size());
+        for (const auto& element : array_literal->elements) {
+            write_node(*element);
+        }
+    } else if (auto array_index = dynamic_cast<const ArrayIndexNode*>(&node)) {
+        write_header(*this, NodeTag::ArrayIndex, node);
+        write_string(array_index->arrayName);
+        write_node(*array_index->index);
+    } else if (auto array_assignment = dynamic_cast<const ArrayAssignmentNode*>(&node)) {
+        write_header(*this, NodeTag::ArrayAssignment, node);
+        write_string(array_assignment->arrayName);
+        write_node(*array_assignment->index);
+        write_node(*array_assignment->expression);
+    } else if (auto object_declaration = dynamic_cast<const ObjectDeclarationNode*>(&node)) {
+        write_header(*this, NodeTag::ObjectDeclaration, node);
+        write_string(object_declaration->identifier);
+    } else if (auto field_access = dynamic_cast<const FieldAccessNode*>(&node)) {
+        write_header(*this, NodeTag::FieldAccess, node);
+        write_node(*field_access->object);
+        write_string(field_access->field);
+    } else if (auto field_assignment = dynamic_cast<const FieldAssignmentNode*>(&node)) {
+        write_header(*this, NodeTag::FieldAssignment, node);
+        write_node(*field_assignment->object);
+        write_string(field_assignment->field);
+        write_node(*field_assignment->expression);
+    } else {
+        throw std::runtime_error("Cannot snapshot unknown AST node");
+    }
+}
+
+SnapshotReader::SnapshotReader(const char* data, size_t size) : data(data), size(size), position(0) {}
+
+void SnapshotReader::require(size_t count) {
+    if (count > size - position) {
+        throw std::runtime_error("Corrupt snapshot: unexpected end of data");
+    }
+}
+
+uint8_t SnapshotReader::read_byte() {
+    require(1);
+    return static_cast<uint8_t>(data[position++]);
+}
+
+uint16_t SnapshotReader::read_u16() {
+    uint16_t low = read_byte();
+    uint16_t high = read_byte();
+    return static_cast<uint16_t>(low | (high << 8));
+}
+
+uint64_t SnapshotReader::read_varint() {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        uint8_t byte = read_byte();
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    throw std::runtime_error("Corrupt snapshot: varint too long");
+}
+
+double SnapshotReader::read_double() {
+    uint64_t bits = 0;
+    for (int i = 0; i < 8; ++i) {
+        bits |= static_cast<uint64_t>(read_byte()) << (i * 8);
+    }
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+std::string SnapshotReader::read_string() {
+    uint64_t length = read_varint();
+    require(length);
+    std::string value(data + position, length);
+    position += length;
+    return value;
+}
+
+void SnapshotReader::set_objects(std::vector<ScriptObject*> objects) {
+    this->objects = std::move(objects);
+}
+
+Value SnapshotReader::read_value() {
+    Nesting nesting(depth, READ_TOO_DEEP);
+    uint8_t kind = read_byte();
+    if (kind == 0) {
+        return Value(read_string());
+    } else if (kind == 2) {
+        uint64_t id = read_varint();
+        if (id >= objects.size()) {
+            throw std::runtime_error("Corrupt snapshot: unknown object " + std::to_string(id));
+        }
+        return Value::object(objects[id]);
+    } else if (kind != 1) {
+        throw std::runtime_error("Corrupt snapshot: unknown value kind " + std::to_string(kind));
+    }
+    std::vector<Value> elements(read_count());
+    for (auto& element : elements) {
+        element = read_value();
+    }
+    return Value::array(std::move(elements));
+}
+
+uint64_t SnapshotReader::read_count() {
+    // Every element occupies at least one byte, which bounds allocations on corrupt input
+    uint64_t count = read_varint();
+    if (count > size - position) {
+        throw std::runtime_error("Corrupt snapshot: element count exceeds data");
+    }
+    return count;
+}
+
+bool SnapshotReader::at_end() const {
+    return position == size;
+}
+
+std::unique_ptr<BlockNode> SnapshotReader::read_block() {
+    auto node = read_node();
+    if (!dynamic_cast<BlockNode*>(node.get())) {
+        throw std::runtime_error("Corrupt snapshot: expected block");
+    }
+    return std::unique_ptr<BlockNode>(static_cast<BlockNode*>(node.release()));
+}
+
+std::unique_ptr<ASTNode> SnapshotReader::read_node() {
+    Nesting nesting(depth, READ_TOO_DEEP);
+    uint8_t tag = read_byte();
+    int line = static_cast<int>(read_varint());
+    auto node = read_node_fields(tag);
+    node->line = line;
+    return node;
+}
+
+std::unique_ptr<ASTNode> SnapshotReader::read_node_fields(uint8_t tag) {
+    switch (static_cast<NodeTag>(tag)) {
+        case NodeTag::Block: {
+            auto block = std::make_unique<BlockNode>();
+            uint64_t count = read_count();
+            for (uint64_t i = 0; i < count; ++i) {
+                block->statements.push_back(read_node());
+            }
+            return block;
+        }
+        case NodeTag::Assignment: {
+            std::string identifier = read_string();
+            return std::make_unique<AssignmentNode>(identifier, read_node());
+        }
+        case NodeTag::Print:
+            return std::make_unique<PrintNode>(read_node());
+        case NodeTag::FunctionDeclaration: {
+            std::string identifier = read_string();
+            std::vector<Symbol> parameters(read_count());
+            for (auto& parameter : parameters) {
+                parameter = read_string();
+            }
+            auto function = std::make_unique<FunctionDeclarationNode>(identifier, std::move(parameters), read_block());
+            function->declared_pure = read_byte() != 0;
+            return function;
+        }
+        case NodeTag::Return:
+            return std::make_unique<ReturnNode>(read_node());
+        case NodeTag::BinaryExpression: {
+            auto left = read_node();
+            std::string op = read_string();
+            return std::make_unique<BinaryExpressionNode>(std::move(left), op, read_node());
+        }
+        case NodeTag::Identifier:
+            return std::make_unique<IdentifierNode>(read_string());
+        case NodeTag::Number:
+            return std::make_unique<NumberNode>(read_double());
+        case NodeTag::String:
+            return std::make_unique<StringNode>(read_string());
+        case NodeTag::FunctionCall: {
+            auto call = std::make_unique<FunctionCallNode>(read_string());
+            uint64_t count = read_count();
+            for (uint64_t i = 0; i < count; ++i) {
+                call->arguments.push_back(read_node());
+            }
+            return call;
+        }
+        case NodeTag::ForeachLoop: {
+            std::string identifier = read_string();
+            auto collection = read_node();
+            auto loop = std::make_unique<ForeachLoopNode>(identifier, std::move(collection), read_block());
+            loop->parallel = read_byte() != 0;
+            return loop;
+        }
+        case NodeTag::EventListener: {
+            std::string event_name = read_string();
+            return std::make_unique<EventListenerNode>(event_name, read_block());
+        }
+        case NodeTag::NPCAction: {
+            std::string npc_name = read_string();
+            return std::make_unique<NPCActionNode>(npc_name, read_string());
+        }
+        case NodeTag::ForLoop: {
+            std::string identifier = read_string();
+            auto lower_bound = read_node();
+            auto upper_bound = read_node();
+            return std::make_unique<ForLoopNode>(identifier, std::move(lower_bound), std::move(upper_bound), read_block());
+        }
+        case NodeTag::WhileLoop: {
+            auto condition = read_node();
+            return std::make_unique<WhileLoopNode>(std::move(condition), read_block());
+        }
+        case NodeTag::Input:
+            return std::make_unique<InputNode>(read_string());
+        case NodeTag::ArrayLiteral: {
+            auto array_literal = std::make_unique<ArrayLiteralNode>();
+            uint64_t count = read_count();
+            for (uint64_t i = 0; i < count; ++i) {
+                array_literal->elements.push_back(read_node());
+            }
+            return array_literal;
+        }
+        case NodeTag::ArrayIndex: {
+            std::string array_name = read_string();
+            return std::make_unique<ArrayIndexNode>(array_name, read_node());
+        }
+        case NodeTag::ArrayAssignment: {
+            std::string array_name = read_string();
+            auto index = read_node();
+            return std::make_unique<ArrayAssignmentNode>(array_name, std::move(index), read_node());
+        }
+        case NodeTag::ObjectDeclaration:
+            return std::make_unique<ObjectDeclarationNode>(read_string());
+        case NodeTag::FieldAccess: {
+            auto object = read_node();
+            return std::make_unique<FieldAccessNode>(std::move(object), read_string());
+        }
+        case NodeTag::FieldAssignment: {
+            auto object = read_node();
+            Symbol field = read_string();
+            return std::make_unique<FieldAssignmentNode>(std::move(object), field, read_node());
+        }
+    }
+    throw std::runtime_error("Corrupt snapshot: unknown node tag " + std::to_string(tag));
+}
+
+void Interpreter::snapshot(std::ostream& out) const {
+    SnapshotWriter writer(out);
+    writer.write_bytes(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    writer.write_u16(SNAPSHOT_VERSION);
+    writer.write_u16(0);
+
+    std::unordered_map<const ScriptObject*, uint64_t> object_ids;
+    std::vector<const ScriptObject*> objects;
+    for (const auto& [name, value] : variables) {
+        collect_objects(value, object_ids, objects);
+    }
+    writer.set_object_ids(std::move(object_ids));
+    writer.write_varint(objects.size());
+    for (const ScriptObject* object : objects) {
+        writer.write_varint(object->size());
+        for (const auto& field : *object) {
+            writer.write_string(field.name);
+            writer.write_value(field.value);
+        }
+    }
+
+    writer.write_varint(variables.size());
+    for (const auto& [name, value] : variables) {
+        writer.write_string(name);
+        writer.write_value(value);
+    }
+
+    writer.write_varint(functions.size());
+    for (const auto& [name, function] : functions) {
+        writer.write_node(*function);
+    }
+
+    writer.write_varint(events.size());
+    for (const auto& [name, listeners] : events) {
+        writer.write_string(name);
+        writer.write_varint(listeners.size());
+        for (const auto& listener : listeners) {
+            writer.write_node(*listener);
+        }
+    }
+
+    // The only execution state that outlives a call to execute() is the program
+    // that has been handed to interpret() but not yet run.
+    writer.write_varint(ast ? 1 : 0);
+    if (ast) {
+        writer.write_node(*ast);
+    }
+
+    writer.write_byte('E');
+    writer.flush();
+    if (!out) {
+        throw std::runtime_error("Failed to write snapshot");
+    }
+}
+
+void Interpreter::restore(const char* data, size_t size) {
+    SnapshotReader reader(data, size);
+    char magic[sizeof(SNAPSHOT_MAGIC)];
+    for (char& c : magic) {
+        c = static_cast<char>(reader.read_byte());
+    }
+    if (std::memcmp(magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+        throw std::runtime_error("Not an Abyssian snapshot");
+    }
+    uint16_t version = reader.read_u16();
+    if (version != SNAPSHOT_VERSION) {
+        throw std::runtime_error("Unsupported snapshot version: " + std::to_string(version));
+    }
+    reader.read_u16();  // Flags, reserved
+
+    // Decode into fresh containers so a corrupt snapshot leaves the interpreter
+    // untouched; objects it allocated are unreachable and will be collected
+    std::vector<ScriptObject*> objects(reader.read_count());
+    for (auto& object : objects) {
+        object = heap.allocate();
+    }
+    reader.set_objects(objects);
+    for (ScriptObject* object : objects) {
+        uint64_t field_count = reader.read_count();
+        for (uint64_t i = 0; i < field_count; ++i) {
+            Symbol name = reader.read_string();
+            heap.store(object, name, reader.read_value());
+        }
+    }
+
+    std::unordered_map<Symbol, Value> new_variables;
+    uint64_t variable_count = reader.read_count();
+    new_variables.reserve(variable_count);
+    for (uint64_t i = 0; i < variable_count; ++i) {
+        Symbol name = reader.read_string();
+        new_variables[name] = reader.read_value();
+    }
+
+    // Specializations and purity are not stored, only the source they follow from
+    BlockNode declarations;
+    uint64_t function_count = reader.read_count();
+    for (uint64_t i = 0; i < function_count; ++i) {
+        auto node = reader.read_node();
+        infer_types(*node);
+        if (!dynamic_cast<FunctionDeclarationNode*>(node.get())) {
+            throw std::runtime_error("Corrupt snapshot: expected function declaration");
+        }
+        declarations.statements.push_back(std::move(node));
+    }
+    mark_pure_functions(declarations);
+    std::unordered_map<Symbol, std::shared_ptr<const FunctionDeclarationNode>> new_functions;
+    for (auto& node : declarations.statements) {
+        auto function = static_cast<FunctionDeclarationNode*>(node.release());
+        new_functions[function->identifier] = std::unique_ptr<FunctionDeclarationNode>(function);
+    }
+
+    std::unordered_map<Symbol, std::vector<std::unique_ptr<EventListenerNode>>> new_events;
+    uint64_t event_count = reader.read_count();
+    for (uint64_t i = 0; i < event_count; ++i) {
+        auto& listeners = new_events[Symbol(reader.read_string())];
+        uint64_t listener_count = reader.read_count();
+        for (uint64_t j = 0; j < listener_count; ++j) {
+            auto node = reader.read_node();
+            infer_types(*node);
+            auto listener = dynamic_cast<EventListenerNode*>(node.get());
+            if (!listener) {
+                throw std::runtime_error("Corrupt snapshot: expected event listener");
+            }
+            node.release();
+            listener->declared = true;  // As every restored function counts as declared
+            listeners.push_back(std::unique_ptr<EventListenerNode>(listener));
+        }
+    }
+
+    std::unique_ptr<BlockNode> new_ast;
+    uint64_t frame_count = reader.read_count();
+    if (frame_count > 1) {
+        throw std::runtime_error("Corrupt snapshot: unsupported frame count");
+    }
+    if (frame_count == 1) {
+        new_ast = reader.read_block();
+        infer_types(*new_ast);
+        for (const auto& statement : new_ast->statements) {
+            if (auto listener = dynamic_cast<EventListenerNode*>(statement.get())) {
+                listener->declared = true;
+            }
+        }
+    }
+
+    if (reader.read_byte() != 'E' || !reader.at_end()) {
+        throw std::runtime_error("Corrupt snapshot: missing end marker");
+    }
+
+    variables = std::move(new_variables);
+    declared_functions.clear();
+    for (const auto& entry : new_functions) {
+        declared_functions.insert(entry.first);
+    }
+    frontend.reset();
+    functions = std::move(new_functions);
+    profiles.clear();
+    native.reset();  // Bound to the program and function declarations being replaced
+    events = std::move(new_events);
+    ast = std::move(new_ast);
+}
+
+void Interpreter::restore_file(const std::string& path) {
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open snapshot: " + path);
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Could not stat snapshot: " + path);
+    }
+    size_t size = static_cast<size_t>(info.st_size);
+    if (size == 0) {
+        ::close(fd);
+        throw std::runtime_error("Empty snapshot: " + path);
+    }
+    void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Could not map snapshot: " + path);
+    }
+    try {
+        restore(static_cast<const char*>(mapping), size);
+    } catch (...) {
+        ::munmap(mapping, size);
+        throw;
+    }
+    ::munmap(mapping, size);
+#else
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open snapshot: " + path);
+    }
+    std::vector<char> buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    restore(buffer.data(), buffer.size());
+#endif
+}
@@ -0,0 +1,93 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "ast.h"
+#include "gc.h"
+#include "value.h"
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Binary snapshot format shared by Interpreter::snapshot() and Interpreter::restore().
+//
+// Layout (all integers are unsigned LEB128 varints unless noted):
+//   magic "ABYS" (4 bytes), version (u16 little-endian), flags (u16 little-endian)
+//   objects:    count, then per object a field count and (name string, value) pairs
+//   variables:  count, then (name string, value) pairs
+//   functions:  count, then one encoded FunctionDeclarationNode each
+//   events:     count, then (event name, listener count, encoded EventListenerNodes)
+//   frames:     count, then one encoded BlockNode per suspended frame
+//   end marker 'E'
+// Strings are a varint length followed by raw bytes. Values are a one byte
+// kind: 0 and a string for text, 1 and a count of values for an array, 2 and
+// an index into the objects section for an object, so shared objects and
+// cycles are written once. Objects not reachable from a variable are garbage
+// and are left out. AST nodes are a one byte tag
+// and the node's source line, followed by the node's fields in declaration order.
+
+constexpr char SNAPSHOT_MAGIC[4] = {'A', 'B', 'Y', 'S'};
+constexpr uint16_t SNAPSHOT_VERSION = 6;
+// Deepest nesting of arrays or AST nodes written or read. Both directions
+// recurse, so the bound keeps a crafted snapshot from exhausting the stack.
+constexpr size_t SNAPSHOT_MAX_NESTING = 4096;
+
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(std::ostream& out);
+    ~SnapshotWriter();
+
+    void write_byte(uint8_t byte);
+    void write_u16(uint16_t value);
+    void write_varint(uint64_t value);
+    void write_double(double value);
+    void write_string(const std::string& value);
+    // Indices written for object values; every object written must have one
+    void set_object_ids(std::unordered_map<const ScriptObject*, uint64_t> ids);
+    void write_value(const Value& value);
+    void write_bytes(const char* data, size_t size);
+    void write_node(const ASTNode& node);
+    void flush();
+
+private:
+    static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+    std::ostream& out;
+    char buffer[BUFFER_SIZE];
+    size_t used;
+    size_t depth = 0;
+    std::unordered_map<const ScriptObject*, uint64_t> object_ids;
+};
+
+class SnapshotReader {
+public:
+    SnapshotReader(const char* data, size_t size);
+
+    uint8_t read_byte();
+    uint16_t read_u16();
+    uint64_t read_varint();
+    uint64_t read_count();
+    double read_double();
+    std::string read_string();
+    // The objects that object values refer to, by index
+    void set_objects(std::vector<ScriptObject*> objects);
+    Value read_value();
+    std::unique_ptr<ASTNode> read_node();
+    std::unique_ptr<BlockNode> read_block();
+    bool at_end() const;
+
+private:
+    const char* data;
+    size_t size;
+    size_t position;
+    size_t depth = 0;
+    std::vector<ScriptObject*> objects;
+
+    void require(size_t count);
+    std::unique_ptr<ASTNode> read_node_fields(uint8_t tag);
+};
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,134 @@
+#include "stats.h"
+#include <algorithm>
+
+namespace {
+
+// Slots are never reused, so the counts of finished threads stay in the totals.
+// Threads beyond the last slot share it and switch it to atomic increments.
+const size_t MAX_SLOTS = 256;
+
+stats::Slot slots[MAX_SLOTS];
+std::atomic<size_t> next_slot{0};
+
+const char* const NODE_KIND_NAMES[NODE_KIND_COUNT] = {
+    "Block", "Assignment", "Print", "Input", "FunctionDeclaration", "Return",
+    "BinaryExpression", "Identifier", "Number", "String", "FunctionCall",
+    "ForeachLoop", "EventListener", "NPCAction", "ForLoop", "WhileLoop",
+    "ArrayLiteral", "ArrayIndex", "ArrayAssignment", "ObjectDeclaration",
+    "FieldAccess", "FieldAssignment"
+};
+
+}
+
+const char* node_kind_name(NodeKind kind) {
+    return NODE_KIND_NAMES[static_cast<size_t>(kind)];
+}
+
+stats::Slot* stats::claim_slot() {
+    size_t index = next_slot.fetch_add(1, std::memory_order_relaxed);
+    if (index >= MAX_SLOTS) {
+        index = MAX_SLOTS - 1;
+        slots[index].shared.store(true, std::memory_order_relaxed);
+    }
+    return &slots[index];
+}
+
+uint64_t RuntimeStats::nodes_evaluated() const {
+    uint64_t total = 0;
+    for (uint64_t count : nodes_by_kind) {
+        total += count;
+    }
+    return total;
+}
+
+namespace {
+
+void add_slot(RuntimeStats& totals, const stats::Slot& slot) {
+    auto value = [&slot](size_t counter) { return slot.values[counter].load(std::memory_order_relaxed); };
+    for (size_t kind = 0; kind < NODE_KIND_COUNT; ++kind) {
+        totals.nodes_by_kind[kind] += value(stats::NodeKinds + kind);
+    }
+    totals.function_calls += value(stats::FunctionCalls);
+    totals.variable_lookups += value(stats::VariableLookups);
+    totals.heap_allocations += value(stats::HeapAllocations);
+    totals.heap_bytes += value(stats::HeapBytes);
+    totals.peak_variables = std::max(totals.peak_variables, value(stats::PeakVariables));
+    totals.lex_ns += value(stats::LexNanoseconds);
+    totals.parse_ns += value(stats::ParseNanoseconds);
+    totals.execute_ns += value(stats::ExecuteNanoseconds);
+    totals.gc_collections += value(stats::GcCollections);
+    totals.gc_objects_freed += value(stats::GcObjectsFreed);
+    totals.gc_pause_ns += value(stats::GcPauseNanoseconds);
+    totals.gc_max_pause_ns = std::max(totals.gc_max_pause_ns, value(stats::GcMaxPauseNanoseconds));
+    totals.functions_optimized += value(stats::FunctionsOptimized);
+    totals.deoptimizations += value(stats::Deoptimizations);
+    totals.calls_inlined += value(stats::CallsInlined);
+    totals.functions_removed += value(stats::FunctionsRemoved);
+    totals.expressions_cached += value(stats::ExpressionsCached);
+    totals.cached_values_reused += value(stats::CachedValuesReused);
+    totals.memo_hits += value(stats::MemoHits);
+    totals.memo_misses += value(stats::MemoMisses);
+    totals.parallel_loops += value(stats::ParallelLoops);
+    totals.parallel_runs_redone += value(stats::ParallelRunsRedone);
+    totals.tail_calls += value(stats::TailCalls);
+}
+
+}
+
+RuntimeStats collect_stats() {
+    RuntimeStats totals;
+    size_t used = std::min(next_slot.load(std::memory_order_relaxed), MAX_SLOTS);
+    for (size_t i = 0; i < used; ++i) {
+        add_slot(totals, slots[i]);
+    }
+    return totals;
+}
+
+RuntimeStats collect_thread_stats() {
+    RuntimeStats totals;
+    add_slot(totals, stats::local_slot());
+    return totals;
+}
+
+void reset_stats() {
+    size_t used = std::min(next_slot.load(std::memory_order_relaxed), MAX_SLOTS);
+    for (size_t i = 0; i < used; ++i) {
+        for (auto& value : slots[i].values) {
+            value.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+void write_stats_json(std::ostream& out, const RuntimeStats& stats) {
+    out << "{\n";
+    out << "  \"nodes_evaluated\": " << stats.nodes_evaluated() << ",\n";
+    out << "  \"nodes_by_kind\": {";
+    for (size_t kind = 0; kind < NODE_KIND_COUNT; ++kind) {
+        out << (kind == 0 ? "" : ", ") << "\"" << node_kind_name(static_cast<NodeKind>(kind)) << "\": " << stats.nodes_by_kind[kind];
+    }
+    out << "},\n";
+    out << "  \"function_calls\": " << stats.function_calls << ",\n";
+    out << "  \"variable_lookups\": " << stats.variable_lookups << ",\n";
+    out << "  \"heap_allocations\": " << stats.heap_allocations << ",\n";
+    out << "  \"heap_bytes\": " << stats.heap_bytes << ",\n";
+    out << "  \"peak_variables\": " << stats.peak_variables << ",\n";
+    out << "  \"lex_ns\": " << stats.lex_ns << ",\n";
+    out << "  \"parse_ns\": " << stats.parse_ns << ",\n";
+    out << "  \"execute_ns\": " << stats.execute_ns << ",\n";
+    out << "  \"gc_collections\": " << stats.gc_collections << ",\n";
+    out << "  \"gc_objects_freed\": " << stats.gc_objects_freed << ",\n";
+    out << "  \"gc_pause_ns\": " << stats.gc_pause_ns << ",\n";
+    out << "  \"gc_max_pause_ns\": " << stats.gc_max_pause_ns << ",\n";
+    out << "  \"functions_optimized\": " << stats.functions_optimized << ",\n";
+    out << "  \"deoptimizations\": " << stats.deoptimizations << ",\n";
+    out << "  \"calls_inlined\": " << stats.calls_inlined << ",\n";
+    out << "  \"functions_removed\": " << stats.functions_removed << ",\n";
+    out << "  \"expressions_cached\": " << stats.expressions_cached << ",\n";
+    out << "  \"cached_values_reused\": " << stats.cached_values_reused << ",\n";
+    out << "  \"memo_hits\": " << stats.memo_hits << ",\n";
+    out << "  \"memo_misses\": " << stats.memo_misses << ",\n";
+    out << "  \"parallel_loops\": " << stats.parallel_loops << ",\n";
+    out << "  \"parallel_runs_redone\": " << stats.parallel_runs_redone << ",\n";
+    out << "  \"tail_calls\": " << stats.tail_calls << "\n";
+    out << "}\n";
+}
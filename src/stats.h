@@ -0,0 +1,173 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+enum class NodeKind {
+    Block,
+    Assignment,
+    Print,
+    Input,
+    FunctionDeclaration,
+    Return,
+    BinaryExpression,
+    Identifier,
+    Number,
+    String,
+    FunctionCall,
+    ForeachLoop,
+    EventListener,
+    NPCAction,
+    ForLoop,
+    WhileLoop,
+    ArrayLiteral,
+    ArrayIndex,
+    ArrayAssignment,
+    ObjectDeclaration,
+    FieldAccess,
+    FieldAssignment,
+    Count
+};
+
+const size_t NODE_KIND_COUNT = static_cast<size_t>(NodeKind::Count);
+
+const char* node_kind_name(NodeKind kind);
+
+// Always-on runtime counters. Every thread counts into its own slot with
+// relaxed atomic loads and stores, so counting costs a few instructions and no
+// synchronization; collect_stats() sums the slots of all threads.
+namespace stats {
+
+enum Counter {
+    FunctionCalls,
+    VariableLookups,
+    HeapAllocations,
+    HeapBytes,
+    LexNanoseconds,
+    ParseNanoseconds,
+    ExecuteNanoseconds,
+    PeakVariables,  // A maximum rather than a sum
+    GcCollections,
+    GcObjectsFreed,
+    GcPauseNanoseconds,
+    GcMaxPauseNanoseconds,  // A maximum rather than a sum
+    FunctionsOptimized,
+    Deoptimizations,
+    CallsInlined,
+    FunctionsRemoved,
+    ExpressionsCached,
+    CachedValuesReused,
+    MemoHits,
+    MemoMisses,
+    ParallelLoops,
+    ParallelRunsRedone,
+    TailCalls,
+    NodeKinds,  // First of NODE_KIND_COUNT per-kind counters
+    CounterCount = NodeKinds + NODE_KIND_COUNT
+};
+
+struct alignas(64) Slot {
+    std::array<std::atomic<uint64_t>, CounterCount> values;
+    std::atomic<bool> shared;  // Claimed by more than one thread
+};
+
+Slot* claim_slot();
+
+inline thread_local Slot* current_slot = nullptr;
+
+inline Slot& local_slot() {
+    if (!current_slot) {
+        current_slot = claim_slot();
+    }
+    return *current_slot;
+}
+
+inline void add(Counter counter, uint64_t amount = 1) {
+    Slot& slot = local_slot();
+    if (slot.shared.load(std::memory_order_relaxed)) {
+        slot.values[counter].fetch_add(amount, std::memory_order_relaxed);
+    } else {
+        slot.values[counter].store(slot.values[counter].load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+}
+
+inline void count_node(NodeKind kind) {
+    add(static_cast<Counter>(NodeKinds + static_cast<size_t>(kind)));
+}
+
+inline void note_variable_count(size_t count) {
+    std::atomic<uint64_t>& peak = local_slot().values[PeakVariables];
+    if (count > peak.load(std::memory_order_relaxed)) {
+        peak.store(count, std::memory_order_relaxed);
+    }
+}
+
+inline void note_gc_pause(uint64_t nanoseconds) {
+    add(GcPauseNanoseconds, nanoseconds);
+    std::atomic<uint64_t>& longest = local_slot().values[GcMaxPauseNanoseconds];
+    if (nanoseconds > longest.load(std::memory_order_relaxed)) {
+        longest.store(nanoseconds, std::memory_order_relaxed);
+    }
+}
+
+// Adds the lifetime of the scope to a time counter
+class Timer {
+public:
+    explicit Timer(Counter counter) : counter(counter), start(std::chrono::steady_clock::now()) {}
+    ~Timer() {
+        add(counter, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()));
+    }
+    Timer(const Timer&) = delete;
+    Timer& operator=(const Timer&) = delete;
+
+private:
+    Counter counter;
+    std::chrono::steady_clock::time_point start;
+};
+
+}
+
+struct RuntimeStats {
+    std::array<uint64_t, NODE_KIND_COUNT> nodes_by_kind{};
+    uint64_t function_calls = 0;
+    uint64_t variable_lookups = 0;
+    uint64_t heap_allocations = 0;  // Strings and arrays held by reference, objects and their field blocks
+    uint64_t heap_bytes = 0;
+    uint64_t peak_variables = 0;    // Most variables visible at once in any interpreter
+    uint64_t lex_ns = 0;
+    uint64_t parse_ns = 0;
+    uint64_t execute_ns = 0;
+    uint64_t gc_collections = 0;    // Completed collector cycles, over all interpreters
+    uint64_t gc_objects_freed = 0;
+    uint64_t gc_pause_ns = 0;       // Time spent in collector steps
+    uint64_t gc_max_pause_ns = 0;   // Longest single step
+    uint64_t functions_optimized = 0;  // Compilations into the optimized tier (see tier.h)
+    uint64_t deoptimizations = 0;      // Compiled code dropped after a failed speculation
+    uint64_t calls_inlined = 0;        // Call sites inline_functions replaced (see optimizer.h)
+    uint64_t functions_removed = 0;    // Declarations it dropped because nothing calls them
+    uint64_t expressions_cached = 0;   // Expressions cache_expressions marked to be kept
+    uint64_t cached_values_reused = 0; // Evaluations of them that used the kept value
+    uint64_t memo_hits = 0;            // Calls to memoized functions answered from their results (see memo.h)
+    uint64_t memo_misses = 0;          // Calls to them that ran the body
+    uint64_t parallel_loops = 0;       // `parallel foreach` loops whose items were split among threads (see parallel.h)
+    uint64_t parallel_runs_redone = 0; // Runs of their items made again sequentially, because one failed or returned
+    uint64_t tail_calls = 0;           // Calls made in the frame of the function returning their result (see CallPolicy)
+
+    uint64_t nodes_evaluated() const;
+};
+
+// Totals over all threads since start-up or the last reset
+RuntimeStats collect_stats();
+// The calling thread's counters alone, e.g. to measure one script by taking the
+// difference of two readings around it
+RuntimeStats collect_thread_stats();
+// Zeroes every thread's counters; updates racing with the reset may survive it
+void reset_stats();
+void write_stats_json(std::ostream& out, const RuntimeStats& stats);
+
+#endif // STATS_H
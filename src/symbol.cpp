@@ -0,0 +1,75 @@
+#include "symbol.h"
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_map>
+
+namespace {
+
+// Entries live in a deque, so their addresses never change as it grows
+struct SymbolTable {
+    std::shared_mutex mutex;
+    std::deque<Symbol::Entry> entries;
+    std::unordered_map<std::string_view, const Symbol::Entry*> index;
+
+    SymbolTable() {
+        entries.push_back({"", 0});
+        index.emplace(entries.back().text, &entries.back());
+    }
+
+    const Symbol::Entry* intern(std::string_view text) {
+        if (const Symbol::Entry* entry = find(text)) {
+            return entry;
+        }
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        auto it = index.find(text);
+        if (it != index.end()) {
+            return it->second;  // Interned by another thread in the meantime
+        }
+        entries.push_back({std::string(text), static_cast<uint32_t>(entries.size())});
+        const Symbol::Entry* entry = &entries.back();
+        index.emplace(entry->text, entry);
+        return entry;
+    }
+
+    const Symbol::Entry* find(std::string_view text) {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        auto it = index.find(text);
+        return it == index.end() ? nullptr : it->second;
+    }
+
+    size_t size() {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return entries.size();
+    }
+};
+
+SymbolTable& table() {
+    static SymbolTable* symbols = new SymbolTable();  // Never destroyed: symbols may outlive static destructors
+    return *symbols;
+}
+
+const Symbol::Entry* empty_entry() {
+    static const Symbol::Entry* entry = table().intern("");
+    return entry;
+}
+
+}
+
+Symbol::Symbol() : entry(empty_entry()) {}
+
+Symbol::Symbol(const std::string& text) : entry(table().intern(text)) {}
+
+Symbol::Symbol(const char* text) : entry(table().intern(text)) {}
+
+std::optional<Symbol> Symbol::find(const std::string& text) {
+    if (const Entry* entry = table().find(text)) {
+        return Symbol(entry);
+    }
+    return std::nullopt;
+}
+
+size_t Symbol::count() {
+    return table().size();
+}
@@ -0,0 +1,80 @@
+#ifndef SYMBOL_H
+#define SYMBOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <ostream>
+#include <string>
+
+// An interned string. All symbols with the same text share one immutable
+// entry in a process-wide table that is never freed, so a Symbol is a single
+// pointer: copying it allocates nothing, equality compares pointers, and
+// hashing uses the entry's small integer id instead of the characters.
+//
+// Only names are interned: identifiers as the lexer produces them, and names
+// restored from snapshots. String literals and run-time text are not, since
+// the table keeps every entry for good; a long-running server or batch run
+// then only grows it by the names its scripts use. Constructing a Symbol from
+// text looks the text up (and adds it if new) under a lock, so do it once, not
+// in a loop. The table is safe to use from several threads.
+class Symbol {
+public:
+    struct Entry {
+        std::string text;
+        uint32_t id;
+    };
+
+    Symbol();  // The empty string
+    Symbol(const std::string& text);
+    Symbol(const char* text);
+
+    const std::string& str() const { return entry->text; }
+    operator const std::string&() const { return entry->text; }
+    const char* c_str() const { return entry->text.c_str(); }
+    uint32_t id() const { return entry->id; }
+    bool empty() const { return entry->text.empty(); }
+    size_t size() const { return entry->text.size(); }
+
+    bool operator==(Symbol other) const { return entry == other.entry; }
+    bool operator!=(Symbol other) const { return entry != other.entry; }
+
+    // The symbol for `text` if it has been interned, without adding it. Use
+    // this for names that come from outside, which should not grow the table.
+    static std::optional<Symbol> find(const std::string& text);
+    // Number of distinct strings interned so far
+    static size_t count();
+
+private:
+    explicit Symbol(const Entry* entry) : entry(entry) {}
+
+    const Entry* entry;
+};
+
+inline bool operator==(Symbol symbol, const std::string& text) { return symbol.str() == text; }
+inline bool operator==(const std::string& text, Symbol symbol) { return symbol.str() == text; }
+inline bool operator!=(Symbol symbol, const std::string& text) { return symbol.str() != text; }
+inline bool operator!=(const std::string& text, Symbol symbol) { return symbol.str() != text; }
+inline bool operator==(Symbol symbol, const char* text) { return symbol.str() == text; }
+inline bool operator!=(Symbol symbol, const char* text) { return symbol.str() != text; }
+
+inline std::string operator+(const std::string& text, Symbol symbol) { return text + symbol.str(); }
+inline std::string operator+(const char* text, Symbol symbol) { return text + symbol.str(); }
+inline std::string operator+(Symbol symbol, const std::string& text) { return symbol.str() + text; }
+inline std::string operator+(Symbol symbol, const char* text) { return symbol.str() + text; }
+
+inline std::ostream& operator<<(std::ostream& out, Symbol symbol) {
+    return out << symbol.str();
+}
+
+namespace std {
+template <>
+struct hash<Symbol> {
+    size_t operator()(Symbol symbol) const noexcept {
+        return symbol.id();
+    }
+};
+}
+
+#endif // SYMBOL_H
@@ -0,0 +1,1053 @@
+#include "tier.h"
+#include "interpreter.h"
+#include "operations.h"
+#include "stats.h"
+#include "utils.h"
+#include <cmath>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+namespace {
+
+// Doubles below this are integers exactly, whatever their text looks like
+const double EXACT_INTEGER_LIMIT = 9007199254740992.0;  // 2^53
+
+// A value as compiled code holds it. Whether the value is a number, or the
+// text "true", is worked out once when the Operand is made, and numbers the
+// tier computes stay doubles until their text is needed.
+struct Operand {
+    Value value;           // The text, unless `formatted` is false
+    double number = 0;     // What the text parses to; valid when `numeric`
+    bool numeric = false;
+    bool formatted = true;
+    bool truth = false;    // The value is the text "true"
+};
+
+Operand classify(Value value) {
+    Operand operand;
+    if (value.is_text()) {
+        const std::string& text = value.str();
+        if (is_number_text(text)) {
+            operand.numeric = true;
+            operand.number = std::stod(text);
+        } else {
+            operand.truth = text == "true";
+        }
+    }
+    operand.value = std::move(value);
+    return operand;
+}
+
+// The result of arithmetic, as the interpreter would see it after formatting
+// the result with std::to_string and parsing it again. Whole numbers survive
+// that unchanged, so their text is left for later.
+Operand number_operand(double number) {
+    if (std::trunc(number) == number && std::fabs(number) < EXACT_INTEGER_LIMIT) {
+        Operand operand;
+        operand.number = number;
+        operand.numeric = true;
+        operand.formatted = false;
+        return operand;
+    }
+    return classify(Value(std::to_string(number)));
+}
+
+const Operand TRUE_OPERAND = classify(Value("true"));
+const Operand FALSE_OPERAND = classify(Value("false"));
+
+const Operand& truth(bool value) {
+    return value ? TRUE_OPERAND : FALSE_OPERAND;
+}
+
+void format(Operand& operand) {
+    if (!operand.formatted) {
+        operand.value = Value(std::to_string(operand.number));
+        operand.formatted = true;
+    }
+}
+
+Value to_value(Operand operand) {
+    format(operand);
+    return std::move(operand.value);
+}
+
+enum class SlotState : uint8_t {
+    Unset,    // Not read or assigned yet: callers' frames or the variables map have the value
+    Missing,  // Read, but no variable of that name existed
+    Clean,    // Holds the value the callers' frames or the map had
+    Dirty     // Assigned by this frame
+};
+
+struct StackSlot {
+    Operand operand;
+    SlotState state = SlotState::Unset;
+};
+
+struct Frame;
+
+}
+
+struct TierStack {
+    std::vector<StackSlot> slots;
+    Frame* top = nullptr;  // Innermost compiled frame whose callers can be searched
+};
+
+namespace {
+
+// One activation of compiled code: its slots are stack.slots[base, base + names.size())
+struct Frame {
+    Interpreter& interpreter;
+    FunctionProfile& profile;
+    TierStack& stack;
+    const CompiledFunction::Code& code;
+    const std::vector<Symbol>& names;
+    size_t base;
+    bool program;   // Top level: the slots stand for the interpreter's variables
+    Frame* caller;  // Next compiled frame to search for names this one has not bound
+    Operand result;
+    bool again = false;  // The body returned a call to its own function, to run in this frame
+
+    StackSlot& at(size_t slot) { return stack.slots[base + slot]; }
+
+    void set(size_t slot, Operand operand) {
+        StackSlot& entry = at(slot);
+        entry.operand = std::move(operand);
+        entry.state = SlotState::Dirty;
+    }
+
+    // The frame's value for `name`, if it has one
+    const Operand* find(Symbol name) {
+        for (size_t slot = 0; slot < names.size(); ++slot) {
+            if (names[slot] == name) {
+                const StackSlot& entry = at(slot);
+                bool bound = entry.state == SlotState::Clean || entry.state == SlotState::Dirty;
+                return bound ? &entry.operand : nullptr;
+            }
+        }
+        return nullptr;
+    }
+};
+
+using Expression = std::function<Operand(Frame&)>;
+using Condition = std::function<bool(Frame&)>;
+// Returns true once the code has its result, which ends the body
+using Statement = std::function<bool(Frame&)>;
+
+}
+
+struct CompiledFunction::Code {
+    std::vector<Symbol> names;      // One per slot, parameters first
+    size_t parameters = 0;
+    std::vector<size_t> shadowed;   // Parameters hidden by a later one of the same name
+    Statement body;
+};
+
+// Builds the closures of a CompiledFunction. A friend of Interpreter: the
+// closures read and write its variables, heap and output directly.
+class TierCompiler {
+public:
+    explicit TierCompiler(FunctionProfile& profile) : profile(profile) {}
+
+    std::shared_ptr<const CompiledFunction> compile(const std::vector<Symbol>& parameters, const BlockNode& body);
+
+    static TierStack& stack(Interpreter& interpreter);
+    // Runs `code` on a new frame whose arguments are the top stack slots from `base`
+    static bool execute(const CompiledFunction::Code& code, Interpreter& interpreter, FunctionProfile& profile, size_t base, bool program, Operand& result);
+
+private:
+    struct Unsupported {};
+
+    size_t slot(Symbol name);
+
+    Statement compile_block(const BlockNode& block, bool counted);
+    Statement compile_statement(const ASTNode& node);
+    Statement compile_assignment(const AssignmentNode& assignment);
+    Statement compile_append(const AssignmentNode& assignment);
+    Statement compile_for_loop(const ForLoopNode& for_loop);
+    Statement compile_foreach_loop(const ForeachLoopNode& foreach_loop);
+    Expression compile_expression(const ASTNode& node);
+    Expression compile_call(const FunctionCallNode& call, bool tail);
+    Expression compile_binary(const BinaryExpressionNode& binary);
+    Condition compile_condition(const ASTNode& node);
+    bool speculates(size_t site, BinaryOp op) const;
+
+    static Operand& load(Frame& frame, size_t slot);
+    static void flush(Frame& frame);
+    static void write_frames(Frame* frame);
+    static void safe_point(Frame& frame);
+    static Operand invoke(Frame& frame, Symbol name, size_t first, size_t count);
+    static std::optional<Operand> call_in_place(Frame& frame, Symbol name, size_t first);
+
+    FunctionProfile& profile;
+    std::unordered_map<Symbol, size_t> slots;
+    std::vector<Symbol> names;
+    size_t sites = 0;
+    size_t for_loops = 0;  // Being compiled around the statement: a call it returns is not in tail position
+};
+
+size_t TierCompiler::slot(Symbol name) {
+    auto it = slots.find(name);
+    if (it != slots.end()) {
+        return it->second;
+    }
+    slots.emplace(name, names.size());
+    names.push_back(name);
+    return names.size() - 1;
+}
+
+std::shared_ptr<const CompiledFunction> TierCompiler::compile(const std::vector<Symbol>& parameters, const BlockNode& body) {
+    auto code = std::make_shared<CompiledFunction::Code>();
+    // Parameter i is slot i, where the caller put argument i; of parameters
+    // sharing a name, the last one is bound, as in the interpreter
+    for (Symbol parameter : parameters) {
+        auto it = slots.find(parameter);
+        if (it != slots.end()) {
+            code->shadowed.push_back(it->second);
+            names[it->second] = Symbol();
+        }
+        slots[parameter] = names.size();
+        names.push_back(parameter);
+    }
+    code->parameters = parameters.size();
+    try {
+        code->body = compile_block(body, false);
+    } catch (const Unsupported&) {
+        return nullptr;
+    }
+    code->names = names;
+    profile.generic_sites.resize(sites, 0);
+    auto compiled = std::make_shared<CompiledFunction>();
+    compiled->code = std::move(code);
+    return compiled;
+}
+
+TierStack& TierCompiler::stack(Interpreter& interpreter) {
+    if (!interpreter.tier_stack) {
+        interpreter.tier_stack = std::make_shared<TierStack>();
+    }
+    return *interpreter.tier_stack;
+}
+
+bool TierCompiler::execute(const CompiledFunction::Code& code, Interpreter& interpreter, FunctionProfile& profile, size_t base, bool program, Operand& result) {
+    TierStack& stack = *interpreter.tier_stack;
+    stack.slots.resize(base + code.names.size());
+    for (size_t slot : code.shadowed) {
+        stack.slots[base + slot].state = SlotState::Missing;
+    }
+    Frame frame{interpreter, profile, stack, code, code.names, base, program, stack.top, Operand()};
+    stack.top = &frame;
+
+    // Slots are released, and a program's variables stored, however the body exits
+    struct Exit {
+        Frame& frame;
+        ~Exit() {
+            if (frame.program) {
+                flush(frame);
+            }
+            frame.stack.top = frame.caller;
+            frame.stack.slots.resize(frame.base);
+        }
+    } exit{frame};
+
+    // The keys of memoized calls the body made in its frame get its result
+    std::optional<Interpreter::TailResults> results;
+    if (!program) {
+        results.emplace(interpreter);
+    }
+    while (code.body(frame)) {
+        if (!frame.again) {
+            result = std::move(frame.result);
+            if (results) {
+                results->keep(to_value(result));
+            }
+            return true;
+        }
+        frame.again = false;
+    }
+    if (results) {
+        results->keep(Value());
+    }
+    return false;
+}
+
+// Binds a slot the first time it is used: to the value the caller's scope
+// has, which cannot change while this frame runs
+Operand& TierCompiler::load(Frame& frame, size_t slot) {
+    StackSlot& entry = frame.at(slot);
+    if (entry.state != SlotState::Unset) {
+        return entry.operand;
+    }
+    Symbol name = frame.names[slot];
+    for (Frame* caller = frame.caller; caller; caller = caller->caller) {
+        if (const Operand* value = caller->find(name)) {
+            entry.operand = *value;
+            entry.state = SlotState::Clean;
+            return entry.operand;
+        }
+    }
+    auto& variables = frame.interpreter.variables;
+    auto it = variables.find(name);
+    if (it == variables.end()) {
+        entry.state = SlotState::Missing;
+    } else {
+        entry.operand = classify(it->second);
+        entry.state = SlotState::Clean;
+    }
+    return entry.operand;
+}
+
+// Stores a program frame's assignments in the interpreter's variables
+void TierCompiler::flush(Frame& frame) {
+    auto& variables = frame.interpreter.variables;
+    for (size_t slot = 0; slot < frame.names.size(); ++slot) {
+        StackSlot& entry = frame.at(slot);
+        if (entry.state == SlotState::Dirty) {
+            format(entry.operand);
+            variables[frame.names[slot]] = entry.operand.value;
+            entry.state = SlotState::Clean;
+        }
+    }
+    stats::note_variable_count(variables.size());
+}
+
+// Writes the assignments of `frame` and its callers to the variables map,
+// innermost last so it shadows the others, for an interpreted callee to see
+void TierCompiler::write_frames(Frame* frame) {
+    if (!frame) {
+        return;
+    }
+    write_frames(frame->caller);
+    auto& variables = frame->interpreter.variables;
+    for (size_t slot = 0; slot < frame->names.size(); ++slot) {
+        StackSlot& entry = frame->at(slot);
+        if (entry.state == SlotState::Dirty) {
+            format(entry.operand);
+            variables[frame->names[slot]] = entry.operand.value;
+        }
+    }
+}
+
+// As Interpreter::gc_safe_point; the collector finds a program's values in the variables map
+void TierCompiler::safe_point(Frame& frame) {
+    Interpreter& interpreter = frame.interpreter;
+    if (interpreter.call_depth == 0 && interpreter.heap.wants_collection()) {
+        flush(frame);
+        interpreter.collect_garbage(interpreter.gc_budget);
+    }
+}
+
+// Calls a function whose `count` arguments are the top stack slots from `first`
+Operand TierCompiler::invoke(Frame& frame, Symbol name, size_t first, size_t count) {
+    Interpreter& interpreter = frame.interpreter;
+    auto it = interpreter.functions.find(name);
+    if (it == interpreter.functions.end()) {
+        throw std::runtime_error("Function not found: " + name);
+    }
+    auto function = it->second;  // Keeps the body alive if the call redefines the function
+    if (function->parameters.size() != count) {
+        throw std::runtime_error("Argument count mismatch in function call: " + name);
+    }
+    if (!function->pure) {
+        ++interpreter.impure_calls;  // The interpreter may be keeping the value of an expression making this call
+    }
+    stats::add(stats::FunctionCalls);
+    Interpreter::CallScope call(interpreter, name);
+
+    std::shared_ptr<FunctionProfile> callee = interpreter.profile_for(function);
+    // As Interpreter::call_memoized
+    std::optional<std::string> key;
+    if (function->memoized && interpreter.memo_policy.enabled) {
+        std::vector<Value> arguments;
+        arguments.reserve(count);
+        for (size_t i = first; i < first + count; ++i) {
+            arguments.push_back(to_value(frame.stack.slots[i].operand));
+        }
+        key = MemoTable::key(arguments);
+        if (key) {
+            if (const Value* kept = callee->memo.find(*key)) {
+                frame.stack.slots.resize(first);
+                return classify(*kept);
+            }
+        }
+    }
+    if (auto compiled = interpreter.optimized_code(*callee)) {
+        ProfiledFunction scope(interpreter.profiler, name);
+        Operand result;
+        execute(*compiled->code, interpreter, *callee, first, false, result);
+        if (callee->invalidated) {
+            interpreter.deoptimize(*callee);
+        }
+        if (key) {
+            callee->memo.insert(std::move(*key), to_value(result), interpreter.memo_policy.capacity);
+        }
+        return result;
+    }
+
+    // The interpreted callee looks names up in the variables map, which gets
+    // the frames' assignments for the duration of the call
+    TierStack& stack = frame.stack;
+    std::vector<Value> arguments;
+    arguments.reserve(count);
+    for (size_t i = first; i < first + count; ++i) {
+        arguments.push_back(to_value(std::move(stack.slots[i].operand)));
+    }
+    stack.slots.resize(first);
+    struct Outside {
+        Interpreter& interpreter;
+        TierStack& stack;
+        Frame* top;
+        std::unordered_map<Symbol, Value> variables;
+        ~Outside() {
+            interpreter.variables = std::move(variables);
+            stack.top = top;
+        }
+    } outside{interpreter, stack, stack.top, interpreter.variables};
+    write_frames(stack.top);
+    stack.top = nullptr;
+    Value result = interpreter.call_body(*function, *callee, name, arguments);
+    if (key) {
+        callee->memo.insert(std::move(*key), result, interpreter.memo_policy.capacity);
+    }
+    return classify(std::move(result));
+}
+
+// A function's call to itself that its body returns runs in the frame
+// making it: the arguments become the parameters, and the other slots keep
+// their values, which are the ones a new frame would find in this one.
+// Recursion in tail position then takes no stack. The result is empty, as
+// the body starts again; nothing if the call has to be made by invoke.
+std::optional<Operand> TierCompiler::call_in_place(Frame& frame, Symbol name, size_t first) {
+    Interpreter& interpreter = frame.interpreter;
+    FunctionProfile& profile = frame.profile;
+    // A new frame would run other code once the profile drops or replaces this
+    if (frame.program || !interpreter.call_policy.tail_calls || profile.invalidated || !profile.compiled ||
+        profile.compiled->code.get() != &frame.code) {
+        return std::nullopt;
+    }
+    auto function = interpreter.functions.at(name);  // The call checked that it exists
+    if (function != profile.function) {
+        return std::nullopt;
+    }
+    if (!function->pure) {
+        ++interpreter.impure_calls;
+    }
+    TierStack& stack = frame.stack;
+    const CompiledFunction::Code& code = frame.code;
+    if (function->memoized && interpreter.memo_policy.enabled) {
+        std::vector<Value> arguments;
+        arguments.reserve(code.parameters);
+        for (size_t i = first; i < first + code.parameters; ++i) {
+            arguments.push_back(to_value(stack.slots[i].operand));
+        }
+        if (const Value* kept = interpreter.memo_tail_call(function, arguments)) {
+            stack.slots.resize(first);
+            return classify(*kept);
+        }
+    }
+    stats::add(stats::FunctionCalls);
+    stats::add(stats::TailCalls);
+    ++profile.calls;  // As Interpreter::optimized_code counts it
+    for (size_t i = 0; i < code.parameters; ++i) {
+        frame.set(i, std::move(stack.slots[first + i].operand));
+    }
+    for (size_t slot : code.shadowed) {
+        frame.at(slot).state = SlotState::Missing;
+    }
+    stack.slots.resize(first);
+    frame.again = true;
+    return Operand();
+}
+
+Statement TierCompiler::compile_block(const BlockNode& block, bool counted) {
+    std::vector<std::pair<int, Statement>> statements;
+    for (const auto& statement : block.statements) {
+        statements.emplace_back(statement->line, compile_statement(*statement));
+    }
+    return [statements = std::move(statements), counted](Frame& frame) {
+        if (counted) {
+            stats::count_node(NodeKind::Block);
+        }
+        for (const auto& [line, statement] : statements) {
+            ProfiledStatement scope(frame.interpreter.profiler, line);
+            if (statement(frame)) {
+                return true;
+            }
+            safe_point(frame);
+        }
+        return false;
+    };
+}
+
+Statement TierCompiler::compile_statement(const ASTNode& node) {
+    if (auto block = dynamic_cast<const BlockNode*>(&node)) {
+        return compile_block(*block, true);
+    } else if (auto assignment = dynamic_cast<const AssignmentNode*>(&node)) {
+        return compile_assignment(*assignment);
+    } else if (auto print = dynamic_cast<const PrintNode*>(&node)) {
+        Expression expression = compile_expression(*print->expression);
+        return [expression](Frame& frame) {
+            stats::count_node(NodeKind::Print);
+            Value value = to_value(expression(frame));
+            *frame.interpreter.output_stream << display_text(value.text()) << std::endl;
+            return false;
+        };
+    } else if (auto input = dynamic_cast<const InputNode*>(&node)) {
+        Symbol identifier = input->identifier;
+        size_t target = slot(identifier);
+        return [identifier, target](Frame& frame) {
+            stats::count_node(NodeKind::Input);
+            // Exhausted input reads as an empty line, as it does at the end of std::cin
+            std::string value;
+            if (InputProvider* provider = frame.interpreter.input_provider) {
+                value = provider->next(identifier).value_or("");
+            } else {
+                std::getline(std::cin, value);
+            }
+            frame.set(target, classify(Value(std::move(value))));
+            return false;
+        };
+    } else if (auto function = dynamic_cast<const FunctionDeclarationNode*>(&node)) {
+        // One declaration for every time the statement runs, so the function
+        // keeps its profile and compiled code
+        std::shared_ptr<const FunctionDeclarationNode> declaration(static_cast<FunctionDeclarationNode*>(function->clone().release()));
+        return [declaration](Frame& frame) {
+            stats::count_node(NodeKind::FunctionDeclaration);
+            Interpreter& interpreter = frame.interpreter;
+            auto& entry = interpreter.functions[declaration->identifier];
+            if (entry != declaration) {
+                if (entry) {
+                    interpreter.profiles.erase(entry.get());
+                }
+                entry = declaration;
+            }
+            return false;
+        };
+    } else if (auto return_node = dynamic_cast<const ReturnNode*>(&node)) {
+        auto call = dynamic_cast<const FunctionCallNode*>(return_node->expression.get());
+        Expression expression = call && for_loops == 0 ? compile_call(*call, true) : compile_expression(*return_node->expression);
+        return [expression](Frame& frame) {
+            stats::count_node(NodeKind::Return);
+            frame.result = expression(frame);
+            return true;
+        };
+    } else if (auto for_loop = dynamic_cast<const ForLoopNode*>(&node)) {
+        return compile_for_loop(*for_loop);
+    } else if (auto while_loop = dynamic_cast<const WhileLoopNode*>(&node)) {
+        Condition condition = compile_condition(*while_loop->condition);
+        Statement body = compile_statement(*while_loop->body);
+        return [condition, body](Frame& frame) {
+            stats::count_node(NodeKind::WhileLoop);
+            while (condition(frame)) {
+                if (body(frame)) {
+                    return true;
+                }
+            }
+            return false;
+        };
+    } else if (auto foreach_loop = dynamic_cast<const ForeachLoopNode*>(&node)) {
+        return compile_foreach_loop(*foreach_loop);
+    } else if (auto listener = dynamic_cast<const EventListenerNode*>(&node)) {
+        std::shared_ptr<const ASTNode> declaration = listener->clone();
+        Symbol event_name = listener->event_name;
+        return [declaration, event_name](Frame& frame) {
+            stats::count_node(NodeKind::EventListener);
+            frame.interpreter.events[event_name].push_back(std::unique_ptr<EventListenerNode>(static_cast<EventListenerNode*>(declaration->clone().release())));
+            return false;
+        };
+    } else if (auto array_assignment = dynamic_cast<const ArrayAssignmentNode*>(&node)) {
+        Symbol name = array_assignment->arrayName;
+        size_t target = slot(name);
+        Expression index = compile_expression(*array_assignment->index);
+        Expression expression = compile_expression(*array_assignment->expression);
+        return [name, target, index, expression](Frame& frame) {
+            stats::count_node(NodeKind::ArrayAssignment);
+            std::string index_str = to_value(index(frame)).text();
+            if (!is_number_text(index_str)) {
+                throw std::runtime_error("Array index is not a valid number: " + index_str);
+            }
+            int position = std::stoi(index_str);
+            Value value = to_value(expression(frame));
+
+            stats::add(stats::VariableLookups);
+            Operand& array = load(frame, target);
+            if (!array.value.is_array()) {
+                throw std::runtime_error("Not an array: " + name);
+            }
+            // Copies the elements first if a caller's variable still shares them
+            auto& elements = array.value.mutable_elements();
+            if (position < 0 || static_cast<size_t>(position) >= elements.size()) {
+                throw std::runtime_error("Array index out of bounds: " + index_str);
+            }
+            elements[position] = value.is_text() ? Value(display_text(value.str())) : std::move(value);
+            frame.at(target).state = SlotState::Dirty;
+            return false;
+        };
+    } else if (auto object_declaration = dynamic_cast<const ObjectDeclarationNode*>(&node)) {
+        size_t target = slot(object_declaration->identifier);
+        return [target](Frame& frame) {
+            stats::count_node(NodeKind::ObjectDeclaration);
+            frame.set(target, Operand{Value::object(frame.interpreter.heap.allocate())});
+            return false;
+        };
+    } else if (auto field_assignment = dynamic_cast<const FieldAssignmentNode*>(&node)) {
+        Symbol field = field_assignment->field;
+        Expression object = compile_expression(*field_assignment->object);
+        Expression expression = compile_expression(*field_assignment->expression);
+        return [field, object, expression](Frame& frame) {
+            stats::count_node(NodeKind::FieldAssignment);
+            Value holder = to_value(object(frame));
+            if (!holder.is_object()) {
+                throw std::runtime_error("Not an object, assigning field: " + field);
+            }
+            frame.interpreter.heap.store(holder.as_object(), field, to_value(expression(frame)));
+            return false;
+        };
+    } else if (auto npc_action = dynamic_cast<const NPCActionNode*>(&node)) {
+        Symbol npc_name = npc_action->npc_name;
+        Symbol action = npc_action->action;
+        return [npc_name, action](Frame& frame) {
+            stats::count_node(NodeKind::NPCAction);
+            Interpreter& interpreter = frame.interpreter;
+            if (interpreter.event_bus) {
+                while (!interpreter.event_bus->send(RecordKind::NPCAction, npc_name, action)) {
+                    std::this_thread::yield();
+                }
+                return false;
+            }
+            *interpreter.output_stream << "Executing NPC action for: " << npc_name << std::endl;
+            return false;
+        };
+    }
+
+    // An expression used as a statement becomes the result
+    Expression expression = compile_expression(node);
+    return [expression](Frame& frame) {
+        frame.result = expression(frame);
+        return true;
+    };
+}
+
+Statement TierCompiler::compile_assignment(const AssignmentNode& assignment) {
+    size_t target = slot(assignment.identifier);
+    Expression expression = compile_expression(*assignment.expression);
+    Statement append = compile_append(assignment);
+    return [target, expression, append](Frame& frame) {
+        if (append) {
+            load(frame, target);
+            if (frame.at(target).state != SlotState::Missing) {
+                return append(frame);
+            }
+        }
+        stats::count_node(NodeKind::Assignment);
+        frame.set(target, expression(frame));
+        return false;
+    };
+}
+
+// `s = s + a + b` appends to the slot in place, as the interpreter appends to
+// the variable (see Interpreter::append_in_place); nullptr for other assignments
+Statement TierCompiler::compile_append(const AssignmentNode& assignment) {
+    std::vector<const ASTNode*> operands;
+    const ASTNode* node = assignment.expression.get();
+    while (auto binary = dynamic_cast<const BinaryExpressionNode*>(node)) {
+        if (binary->op != "+") {
+            return nullptr;
+        }
+        operands.push_back(binary->right.get());
+        node = binary->left.get();
+    }
+    auto target_node = dynamic_cast<const IdentifierNode*>(node);
+    if (!target_node || target_node->identifier != assignment.identifier || operands.empty()) {
+        return nullptr;
+    }
+
+    size_t target = slot(assignment.identifier);
+    std::vector<Expression> pieces;
+    for (auto operand = operands.rbegin(); operand != operands.rend(); ++operand) {
+        pieces.push_back(compile_expression(**operand));
+    }
+    // The pieces are evaluated before anything is appended, so up to two are
+    // held on the C++ stack; longer chains use the slot stack
+    return [target, pieces](Frame& frame) {
+        stats::count_node(NodeKind::Assignment);
+        stats::count_node(NodeKind::Identifier);
+        stats::add(stats::VariableLookups);
+        TierStack& stack = frame.stack;
+        size_t first = stack.slots.size();
+        for (const auto& piece : pieces) {
+            Operand value = piece(frame);
+            stack.slots.emplace_back();
+            stack.slots.back().operand = std::move(value);
+        }
+        for (size_t i = first; i < first + pieces.size(); ++i) {
+            stats::count_node(NodeKind::BinaryExpression);
+            Operand& value = frame.at(target).operand;
+            Operand& piece = stack.slots[i].operand;
+            if (value.numeric && piece.numeric) {
+                value = number_operand(value.number + piece.number);
+            } else {
+                format(value);
+                format(piece);
+                value.value.append(piece.value.text());  // Copies first only if the text is shared
+                value = classify(std::move(value.value));
+            }
+        }
+        stack.slots.resize(first);
+        frame.at(target).state = SlotState::Dirty;
+        return false;
+    };
+}
+
+Statement TierCompiler::compile_for_loop(const ForLoopNode& for_loop) {
+    size_t variable = slot(for_loop.identifier);
+    Expression lower = compile_expression(*for_loop.lower_bound);
+    Expression upper = compile_expression(*for_loop.upper_bound);
+    ++for_loops;
+    Statement body = compile_statement(*for_loop.body);
+    --for_loops;
+    return [variable, lower, upper, body](Frame& frame) {
+        stats::count_node(NodeKind::ForLoop);
+        try {
+            std::string lower_bound_str = to_value(lower(frame)).text();
+            std::string upper_bound_str = to_value(upper(frame)).text();
+            if (!is_number_text(lower_bound_str) || !is_number_text(upper_bound_str)) {
+                throw std::invalid_argument("Bounds are not valid numbers");
+            }
+            int lower_bound = std::stoi(lower_bound_str);
+            int upper_bound = std::stoi(upper_bound_str);
+            for (int i = lower_bound; i <= upper_bound; ++i) {
+                Operand counter{Value(std::to_string(i))};
+                counter.number = i;
+                counter.numeric = true;
+                frame.set(variable, std::move(counter));
+                if (body(frame)) {
+                    return true;
+                }
+            }
+        } catch (const std::invalid_argument& e) {
+            diagnostic_stream() << "Invalid argument in for loop bounds: " << e.what() << std::endl;
+        } catch (const std::out_of_range& e) {
+            diagnostic_stream() << "Out of range error in for loop bounds: " << e.what() << std::endl;
+        }
+        return false;
+    };
+}
+
+Statement TierCompiler::compile_foreach_loop(const ForeachLoopNode& foreach_loop) {
+    // Its iterations run in forks of the interpreter, which work on the
+    // variables map rather than a frame (see parallel.h)
+    if (foreach_loop.parallel) {
+        throw Unsupported();
+    }
+    Symbol identifier = foreach_loop.identifier;
+    size_t variable = slot(identifier);
+    Expression collection_expression = compile_expression(*foreach_loop.collection);
+    Statement body = compile_statement(*foreach_loop.body);
+    return [identifier, variable, collection_expression, body](Frame& frame) {
+        stats::count_node(NodeKind::ForeachLoop);
+        // Holding the collection keeps the elements fixed even if the body
+        // assigns into the array; the collector may run between statements
+        Value collection = to_value(collection_expression(frame));
+        auto& pins = frame.interpreter.pinned_values;
+        pins.push_back(&collection);
+        struct Unpin {
+            std::vector<const Value*>& pins;
+            ~Unpin() { pins.pop_back(); }
+        } unpin{pins};
+
+        if (collection.is_array()) {
+            for (const auto& item : collection.elements()) {
+                frame.set(variable, classify(item));
+                if (body(frame)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        if (collection.is_object()) {
+            throw std::runtime_error("Cannot iterate over an object: " + identifier);
+        }
+        // Text is split on commas, as std::getline splits it in the interpreter
+        const std::string& text = collection.str();
+        size_t position = 0;
+        while (position < text.size()) {
+            size_t comma = text.find(',', position);
+            size_t end = comma == std::string::npos ? text.size() : comma;
+            frame.set(variable, classify(Value(text.substr(position, end - position))));
+            if (body(frame)) {
+                return true;
+            }
+            position = end + 1;
+        }
+        return false;
+    };
+}
+
+Expression TierCompiler::compile_expression(const ASTNode& node) {
+    if (auto identifier = dynamic_cast<const IdentifierNode*>(&node)) {
+        size_t source = slot(identifier->identifier);
+        return [source](Frame& frame) {
+            stats::count_node(NodeKind::Identifier);
+            stats::add(stats::VariableLookups);
+            return load(frame, source);
+        };
+    } else if (auto number = dynamic_cast<const NumberNode*>(&node)) {
+        Operand constant = number_operand(number->value);
+        return [constant](Frame&) {
+            stats::count_node(NodeKind::Number);
+            return constant;
+        };
+    } else if (auto str = dynamic_cast<const StringNode*>(&node)) {
+        Operand constant = classify(Value(str->value));
+        return [constant](Frame&) {
+            stats::count_node(NodeKind::String);
+            return constant;
+        };
+    } else if (auto binary = dynamic_cast<const BinaryExpressionNode*>(&node)) {
+        return compile_binary(*binary);
+    } else if (auto call = dynamic_cast<const FunctionCallNode*>(&node)) {
+        return compile_call(*call, false);
+    } else if (auto array_literal = dynamic_cast<const ArrayLiteralNode*>(&node)) {
+        std::vector<Expression> elements;
+        for (const auto& element : array_literal->elements) {
+            elements.push_back(compile_expression(*element));
+        }
+        return [elements](Frame& frame) {
+            stats::count_node(NodeKind::ArrayLiteral);
+            std::vector<Value> values;
+            values.reserve(elements.size());
+            for (const auto& element : elements) {
+                Value value = to_value(element(frame));
+                values.push_back(value.is_text() ? Value(display_text(value.str())) : std::move(value));
+            }
+            return Operand{Value::array(std::move(values))};
+        };
+    } else if (auto array_index = dynamic_cast<const ArrayIndexNode*>(&node)) {
+        size_t source = slot(array_index->arrayName);
+        Expression index = compile_expression(*array_index->index);
+        return [source, index](Frame& frame) {
+            stats::count_node(NodeKind::ArrayIndex);
+            Operand position = index(frame);
+            format(position);
+            std::string index_str = position.value.text();
+            if (!is_number_text(index_str)) {
+                throw std::runtime_error("Array index is not a valid number: " + index_str);
+            }
+            stats::add(stats::VariableLookups);
+            Operand& array = load(frame, source);
+            if (array.value.is_array() && position.numeric) {
+                // Checked exactly as element_at checks it
+                const auto& elements = array.value.elements();
+                int element = std::stoi(index_str);
+                if (element >= 0 && static_cast<size_t>(element) < elements.size()) {
+                    return classify(elements[element]);
+                }
+            }
+            format(array);
+            return classify(element_at(array.value, index_str));
+        };
+    } else if (auto field_access = dynamic_cast<const FieldAccessNode*>(&node)) {
+        Symbol field = field_access->field;
+        Expression object = compile_expression(*field_access->object);
+        return [field, object](Frame& frame) {
+            stats::count_node(NodeKind::FieldAccess);
+            Value holder = to_value(object(frame));
+            if (!holder.is_object()) {
+                throw std::runtime_error("Not an object, reading field: " + field);
+            }
+            const Value* value = holder.as_object()->find(field);
+            return value ? classify(*value) : Operand();
+        };
+    }
+    throw Unsupported();
+}
+
+// A call in tail position may run in the frame returning it (see call_in_place)
+Expression TierCompiler::compile_call(const FunctionCallNode& call, bool tail) {
+    Symbol name = call.identifier;
+    std::vector<Expression> arguments;
+    for (const auto& argument : call.arguments) {
+        arguments.push_back(compile_expression(*argument));
+    }
+    return [name, arguments, tail](Frame& frame) {
+        stats::count_node(NodeKind::FunctionCall);
+        Interpreter& interpreter = frame.interpreter;
+        // Check the call before evaluating arguments, which may have side effects
+        auto it = interpreter.functions.find(name);
+        if (it == interpreter.functions.end()) {
+            throw std::runtime_error("Function not found: " + name);
+        }
+        if (it->second->parameters.size() != arguments.size()) {
+            throw std::runtime_error("Argument count mismatch in function call: " + name);
+        }
+        // All arguments are evaluated in the caller's scope, onto the stack
+        // where the callee's frame starts
+        TierStack& stack = frame.stack;
+        size_t first = stack.slots.size();
+        for (const auto& argument : arguments) {
+            Operand value = argument(frame);
+            stack.slots.emplace_back();
+            stack.slots.back().operand = std::move(value);
+            stack.slots.back().state = SlotState::Dirty;
+        }
+        if (tail) {
+            if (std::optional<Operand> result = call_in_place(frame, name, first)) {
+                return std::move(*result);
+            }
+        }
+        return invoke(frame, name, first, arguments.size());
+    };
+}
+
+// Sites start out compiled for numbers only, unless type feedback from an
+// earlier compilation of the function says otherwise
+bool TierCompiler::speculates(size_t site, BinaryOp op) const {
+    if (op == BinaryOp::And || op == BinaryOp::Or || op == BinaryOp::Unknown) {
+        return false;
+    }
+    return site >= profile.generic_sites.size() || !profile.generic_sites[site];
+}
+
+Expression TierCompiler::compile_binary(const BinaryExpressionNode& binary) {
+    size_t site = sites++;
+    BinaryOp op = binary_op(binary.op);
+    std::string op_text = binary.op;
+    Expression left = compile_expression(*binary.left);
+    Expression right = compile_expression(*binary.right);
+
+    // infer_types proved one side is never a number
+    if (binary.specialization == BinarySpecialization::Concat) {
+        return [left, right](Frame& frame) {
+            stats::count_node(NodeKind::BinaryExpression);
+            Operand left_value = left(frame);
+            Operand right_value = right(frame);
+            return classify(Value(to_value(std::move(left_value)).text() + to_value(std::move(right_value)).text()));
+        };
+    }
+    if (!speculates(site, op)) {
+        return [op, op_text, left, right](Frame& frame) {
+            stats::count_node(NodeKind::BinaryExpression);
+            Operand left_value = left(frame);
+            Operand right_value = right(frame);
+            return classify(apply_binary(op, op_text, to_value(std::move(left_value)), to_value(std::move(right_value))));
+        };
+    }
+    return [site, op, op_text, left, right](Frame& frame) -> Operand {
+        stats::count_node(NodeKind::BinaryExpression);
+        Operand left_value = left(frame);
+        Operand right_value = right(frame);
+        if (left_value.numeric && right_value.numeric) {
+            double l = left_value.number;
+            double r = right_value.number;
+            switch (op) {
+                case BinaryOp::Add:
+                    return number_operand(l + r);
+                case BinaryOp::Subtract:
+                    return number_operand(l - r);
+                case BinaryOp::Multiply:
+                    return number_operand(l * r);
+                case BinaryOp::Divide:
+                    if (r == 0) {
+                        throw std::runtime_error("Division by zero");
+                    }
+                    return number_operand(l / r);
+                case BinaryOp::Less:
+                    return truth(l < r);
+                case BinaryOp::Greater:
+                    return truth(l > r);
+                case BinaryOp::LessEqual:
+                    return truth(l <= r);
+                case BinaryOp::GreaterEqual:
+                    return truth(l >= r);
+                default:
+                    break;
+            }
+        }
+        // The speculation failed: compute the generic result and have the
+        // function recompiled without it
+        if (site < frame.profile.generic_sites.size()) {
+            frame.profile.generic_sites[site] = 1;
+            frame.profile.invalidated = true;
+        }
+        return classify(apply_binary(op, op_text, to_value(std::move(left_value)), to_value(std::move(right_value))));
+    };
+}
+
+// Comparisons on numbers answer the condition directly instead of making an
+// operand for "true" or "false"
+Condition TierCompiler::compile_condition(const ASTNode& node) {
+    auto binary = dynamic_cast<const BinaryExpressionNode*>(&node);
+    BinaryOp op = binary ? binary_op(binary->op) : BinaryOp::Unknown;
+    bool comparison = op == BinaryOp::Less || op == BinaryOp::Greater || op == BinaryOp::LessEqual || op == BinaryOp::GreaterEqual;
+    if (!comparison || !speculates(sites, op)) {
+        Expression expression = compile_expression(node);
+        return [expression](Frame& frame) {
+            return expression(frame).truth;
+        };
+    }
+
+    size_t site = sites++;
+    std::string op_text = binary->op;
+    Expression left = compile_expression(*binary->left);
+    Expression right = compile_expression(*binary->right);
+    return [site, op, op_text, left, right](Frame& frame) {
+        stats::count_node(NodeKind::BinaryExpression);
+        Operand left_value = left(frame);
+        Operand right_value = right(frame);
+        if (left_value.numeric && right_value.numeric) {
+            double l = left_value.number;
+            double r = right_value.number;
+            switch (op) {
+                case BinaryOp::Less:
+                    return l < r;
+                case BinaryOp::Greater:
+                    return l > r;
+                case BinaryOp::LessEqual:
+                    return l <= r;
+                default:
+                    return l >= r;
+            }
+        }
+        if (site < frame.profile.generic_sites.size()) {
+            frame.profile.generic_sites[site] = 1;
+            frame.profile.invalidated = true;
+        }
+        return apply_binary(op, op_text, to_value(std::move(left_value)), to_value(std::move(right_value))) == "true";
+    };
+}
+
+std::shared_ptr<const CompiledFunction> CompiledFunction::compile(const FunctionDeclarationNode& function, FunctionProfile& profile) {
+    return TierCompiler(profile).compile(function.parameters, *function.body);
+}
+
+std::shared_ptr<const CompiledFunction> CompiledFunction::compile_program(const BlockNode& program, FunctionProfile& profile) {
+    return TierCompiler(profile).compile({}, program);
+}
+
+Value CompiledFunction::run(Interpreter& interpreter, const std::vector<Value>& arguments, FunctionProfile& profile) const {
+    TierStack& stack = TierCompiler::stack(interpreter);
+    size_t first = stack.slots.size();
+    for (const Value& argument : arguments) {
+        stack.slots.emplace_back();
+        stack.slots.back().operand = classify(argument);
+        stack.slots.back().state = SlotState::Dirty;
+    }
+    Operand result;
+    if (TierCompiler::execute(*code, interpreter, profile, first, false, result)) {
+        return to_value(std::move(result));
+    }
+    return Value();
+}
+
+std::optional<Value> CompiledFunction::run_program(Interpreter& interpreter, FunctionProfile& profile) const {
+    TierStack& stack = TierCompiler::stack(interpreter);
+    Operand result;
+    if (TierCompiler::execute(*code, interpreter, profile, stack.slots.size(), true, result)) {
+        return to_value(std::move(result));
+    }
+    return std::nullopt;
+}
@@ -0,0 +1,86 @@
+#ifndef TIER_H
+#define TIER_H
+
+#include "ast.h"
+#include "memo.h"
+#include "value.h"
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+class Interpreter;
+class CompiledFunction;
+struct TierStack;  // Slots of one interpreter's compiled frames, defined in tier.cpp
+
+enum class ExecutionMode {
+    Tiered,   // Interpreted, with functions compiled once they are hot (see TierPolicy)
+    Compiled  // The program and every function compiled before they first run
+};
+
+// When functions move from the tree-walking interpreter to the optimized tier
+struct TierPolicy {
+    bool enabled = true;
+    uint64_t call_threshold = 1000;        // Calls run by the interpreter before optimizing
+    uint64_t back_edge_threshold = 10000;  // Or loop iterations run by the interpreter
+    uint32_t max_deoptimizations = 4;      // After this many, the function stays interpreted
+};
+
+// What the interpreter has seen of one function declaration
+struct FunctionProfile {
+    std::shared_ptr<const FunctionDeclarationNode> function;  // Keeps the declaration, and so this profile's key, alive
+    uint64_t calls = 0;
+    uint64_t back_edges = 0;
+    std::shared_ptr<const CompiledFunction> compiled;
+    // Type feedback, one entry per operator site: set once a site saw operands
+    // that are not numbers, so it is no longer compiled for numbers only
+    std::vector<uint8_t> generic_sites;
+    bool invalidated = false;  // A speculation failed; drop `compiled` once the call returns
+    uint32_t deoptimizations = 0;
+    bool interpreted_only = false;  // Cannot be compiled, or deoptimized too often
+    MemoTable memo;  // Results of the calls, if the function is memoized
+};
+
+// A function body, or a whole program, compiled to a tree of closures.
+// Compared to interpreting it:
+//
+//   - Each node is inspected once, when compiling: children are bound into
+//     their parent's closure and operators are resolved to a BinaryOp, so
+//     running the code does no dynamic_cast, clone or operator string compare.
+//   - Parameters and variables live in frame slots on a stack the interpreter
+//     reuses, so calls between compiled functions allocate nothing. Dynamic
+//     scoping is kept: a name a function has not bound yet is looked up in the
+//     frames of its compiled callers, then in the variables map. Before calling
+//     an interpreted function the frames are written to the map, and the map
+//     is put back afterwards, as the interpreter does for its own calls. A
+//     program's frame is written to the map when it ends and before the
+//     collector runs.
+//   - Operator sites speculate that their operands are numbers, kept as
+//     doubles rather than as text between operations; comparisons give a truth
+//     value without making "true" or "false" text. A site that sees anything
+//     else computes the generic result, records it in the profile's type
+//     feedback and invalidates the compiled code, which is recompiled without
+//     the speculation.
+//
+// Results, output and errors are those of the interpreter. Event listener
+// bodies run in the interpreter when dispatched.
+class CompiledFunction {
+public:
+    struct Code;  // Defined in tier.cpp
+
+    // nullptr when the body cannot be compiled
+    static std::shared_ptr<const CompiledFunction> compile(const FunctionDeclarationNode& function, FunctionProfile& profile);
+    // A top-level program, whose variables are those of the interpreter
+    static std::shared_ptr<const CompiledFunction> compile_program(const BlockNode& program, FunctionProfile& profile);
+
+    Value run(Interpreter& interpreter, const std::vector<Value>& arguments, FunctionProfile& profile) const;
+    // The value the program returned, if it did
+    std::optional<Value> run_program(Interpreter& interpreter, FunctionProfile& profile) const;
+
+private:
+    friend class TierCompiler;
+
+    std::shared_ptr<const Code> code;
+};
+
+#endif // TIER_H
@@ -0,0 +1,235 @@
+#include "types.h"
+#include "operations.h"
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+enum class StaticType : uint8_t {
+    Unknown,
+    Number,  // Number text, as literals, loop counters and arithmetic give
+    Text     // Has a character no number has, so `+` with it always concatenates
+};
+
+// What is known at one point; a variable that is not listed could hold anything
+using TypeState = std::unordered_map<Symbol, StaticType>;
+
+// Keeps only what both states agree on
+void join_into(TypeState& state, const TypeState& other) {
+    for (auto it = state.begin(); it != state.end();) {
+        auto found = other.find(it->first);
+        if (found == other.end() || found->second != it->second) {
+            it = state.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+StaticType literal_type(const std::string& text) {
+    if (is_number_text(text)) {
+        return StaticType::Number;
+    }
+    for (char c : text) {
+        if ((c < '0' || c > '9') && c != '-' && c != '.') {
+            return StaticType::Text;
+        }
+    }
+    return StaticType::Unknown;  // Such as "-" or "1.", which concatenate into numbers
+}
+
+BinarySpecialization specialize(BinaryOp op, StaticType left, StaticType right) {
+    bool numbers = left == StaticType::Number && right == StaticType::Number;
+    switch (op) {
+        case BinaryOp::Add:
+            if (left == StaticType::Text || right == StaticType::Text) {
+                return BinarySpecialization::Concat;
+            }
+            return numbers ? BinarySpecialization::NumberArithmetic : BinarySpecialization::Generic;
+        case BinaryOp::Subtract:
+        case BinaryOp::Multiply:
+        case BinaryOp::Divide:
+            return numbers ? BinarySpecialization::NumberArithmetic : BinarySpecialization::Generic;
+        case BinaryOp::Less:
+        case BinaryOp::Greater:
+        case BinaryOp::LessEqual:
+        case BinaryOp::GreaterEqual:
+            return numbers ? BinarySpecialization::NumberCompare : BinarySpecialization::Generic;
+        default:
+            return BinarySpecialization::Generic;
+    }
+}
+
+// The type of the result, whenever evaluating the expression does not fail
+StaticType result_type(BinaryOp op, StaticType left, StaticType right) {
+    switch (op) {
+        case BinaryOp::Add:
+            if (left == StaticType::Text || right == StaticType::Text) {
+                return StaticType::Text;
+            }
+            return left == StaticType::Number && right == StaticType::Number ? StaticType::Number : StaticType::Unknown;
+        case BinaryOp::Subtract:
+        case BinaryOp::Multiply:
+        case BinaryOp::Divide:
+            return StaticType::Number;  // Anything but two numbers is an error
+        case BinaryOp::Unknown:
+            return StaticType::Unknown;
+        default:
+            return StaticType::Text;  // "true" or "false"
+    }
+}
+
+class TypeInference {
+public:
+    void body(BlockNode& body) {
+        TypeState state;
+        block(body, state);
+    }
+
+private:
+    bool block(BlockNode& block, TypeState& state);
+    bool statement(ASTNode& node, TypeState& state);
+    StaticType expression(ASTNode& node, const TypeState& state);
+    void assign(TypeState& state, Symbol name, StaticType type);
+
+    // Until a loop's state stops changing
+    template <typename Iteration>
+    void loop(TypeState& state, Iteration iteration);
+
+    std::vector<TypeState*> caught;  // Join of every state reached inside each enclosing `for`
+    size_t calls = 0;
+};
+
+// Returns false if the block always ends its function, as `return` and
+// expression statements do
+bool TypeInference::block(BlockNode& block, TypeState& state) {
+    for (const auto& node : block.statements) {
+        if (!statement(*node, state)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TypeInference::statement(ASTNode& node, TypeState& state) {
+    if (auto nested = dynamic_cast<BlockNode*>(&node)) {
+        return block(*nested, state);
+    } else if (auto assignment = dynamic_cast<AssignmentNode*>(&node)) {
+        assign(state, assignment->identifier, expression(*assignment->expression, state));
+    } else if (auto print = dynamic_cast<PrintNode*>(&node)) {
+        expression(*print->expression, state);
+    } else if (auto input = dynamic_cast<InputNode*>(&node)) {
+        assign(state, input->identifier, StaticType::Unknown);
+    } else if (auto function = dynamic_cast<FunctionDeclarationNode*>(&node)) {
+        TypeInference().body(*function->body);
+    } else if (auto listener = dynamic_cast<EventListenerNode*>(&node)) {
+        TypeInference().body(*listener->body);
+    } else if (auto return_node = dynamic_cast<ReturnNode*>(&node)) {
+        expression(*return_node->expression, state);
+        return false;
+    } else if (auto for_loop = dynamic_cast<ForLoopNode*>(&node)) {
+        // The loop catches errors from its bounds and body, so afterwards the
+        // variables can be as they were at any point inside
+        size_t calls_before = calls;
+        TypeState errors = state;
+        caught.push_back(&errors);
+        expression(*for_loop->lower_bound, state);
+        expression(*for_loop->upper_bound, state);
+        loop(state, [&](TypeState& body) {
+            assign(body, for_loop->identifier, StaticType::Number);
+            return block(*for_loop->body, body);
+        });
+        caught.pop_back();
+        join_into(state, errors);
+        if (calls != calls_before) {
+            state.clear();
+        }
+    } else if (auto while_loop = dynamic_cast<WhileLoopNode*>(&node)) {
+        loop(state, [&](TypeState& body) {
+            expression(*while_loop->condition, body);
+            return block(*while_loop->body, body);
+        });
+    } else if (auto foreach_loop = dynamic_cast<ForeachLoopNode*>(&node)) {
+        expression(*foreach_loop->collection, state);
+        loop(state, [&](TypeState& body) {
+            assign(body, foreach_loop->identifier, StaticType::Unknown);
+            return block(*foreach_loop->body, body);
+        });
+    } else if (auto array_assignment = dynamic_cast<ArrayAssignmentNode*>(&node)) {
+        expression(*array_assignment->index, state);
+        expression(*array_assignment->expression, state);
+        assign(state, array_assignment->arrayName, StaticType::Unknown);
+    } else if (auto object_declaration = dynamic_cast<ObjectDeclarationNode*>(&node)) {
+        assign(state, object_declaration->identifier, StaticType::Unknown);
+    } else if (auto field_assignment = dynamic_cast<FieldAssignmentNode*>(&node)) {
+        expression(*field_assignment->object, state);
+        expression(*field_assignment->expression, state);
+    } else if (!dynamic_cast<NPCActionNode*>(&node)) {
+        // An expression used as a statement becomes the result
+        expression(node, state);
+        return false;
+    }
+    return true;
+}
+
+// `state` is the state before the loop, and after it once the loop ends
+template <typename Iteration>
+void TypeInference::loop(TypeState& state, Iteration iteration) {
+    while (true) {
+        TypeState body = state;
+        TypeState next = state;
+        if (iteration(body)) {
+            join_into(next, body);
+        }
+        if (next == state) {
+            return;
+        }
+        state = std::move(next);
+    }
+}
+
+void TypeInference::assign(TypeState& state, Symbol name, StaticType type) {
+    if (type == StaticType::Unknown) {
+        state.erase(name);
+    } else {
+        state[name] = type;
+    }
+    for (TypeState* errors : caught) {
+        join_into(*errors, state);
+    }
+}
+
+StaticType TypeInference::expression(ASTNode& node, const TypeState& state) {
+    if (auto identifier = dynamic_cast<IdentifierNode*>(&node)) {
+        auto it = state.find(identifier->identifier);
+        return it == state.end() ? StaticType::Unknown : it->second;
+    } else if (dynamic_cast<NumberNode*>(&node)) {
+        return StaticType::Number;
+    } else if (auto str = dynamic_cast<StringNode*>(&node)) {
+        return literal_type(str->value);
+    } else if (auto binary = dynamic_cast<BinaryExpressionNode*>(&node)) {
+        StaticType left = expression(*binary->left, state);
+        StaticType right = expression(*binary->right, state);
+        BinaryOp op = binary_op(binary->op);
+        binary->specialization = specialize(op, left, right);
+        return result_type(op, left, right);
+    } else if (dynamic_cast<FunctionCallNode*>(&node)) {
+        ++calls;
+    }
+    for_each_child(node, [&](ASTNode& child) {
+        expression(child, state);
+    });
+    return StaticType::Unknown;
+}
+
+}
+
+void infer_types(ASTNode& node) {
+    if (auto block = dynamic_cast<BlockNode*>(&node)) {
+        TypeInference().body(*block);
+    } else if (auto function = dynamic_cast<FunctionDeclarationNode*>(&node)) {
+        TypeInference().body(*function->body);
+    } else if (auto listener = dynamic_cast<EventListenerNode*>(&node)) {
+        TypeInference().body(*listener->body);
+    }
+}
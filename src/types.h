@@ -0,0 +1,24 @@
+#ifndef TYPES_H
+#define TYPES_H
+
+#include "ast.h"
+
+// Static type inference. Walks a program, function declaration or event
+// listener in execution order, tracking which variables certainly hold a
+// number and which certainly hold text that can never read as one, and sets
+// each BinaryExpressionNode's specialization where its operand types are
+// proven, so that evaluating it skips the runtime checks.
+//
+// The analysis is flow-sensitive: an assignment changes what is known about
+// its variable from there on, and loops are iterated to a fixed point. Each
+// function and listener body is analysed on its own, starting from nothing
+// known, since its parameters take any argument and dynamic scoping gives it
+// the caller's other variables. Calls cannot assign the caller's variables,
+// except that a call ending in an error a `for` loop catches leaves the
+// callee's behind, so nothing is known after such a loop.
+//
+// Specializing never changes a result, and running the pass again on a
+// specialized tree is harmless.
+void infer_types(ASTNode& node);
+
+#endif // TYPES_H
@@ -1,4 +1,34 @@
 #include "utils.h"
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#ifdef __GLIBC__
+#include <pthread.h>
+#endif
+
+namespace {
+
+thread_local std::ostream* current_trace = nullptr;
+thread_local std::ostream* current_diagnostics = nullptr;
+
+// Lowest address of the thread's stack, which grows down; nullptr if unknown
+const char* stack_end() {
+#ifdef __GLIBC__
+    pthread_attr_t attributes;
+    if (pthread_getattr_np(pthread_self(), &attributes) != 0) {
+        return nullptr;
+    }
+    void* address = nullptr;
+    size_t size = 0;
+    pthread_attr_getstack(&attributes, &address, &size);
+    pthread_attr_destroy(&attributes);
+    return static_cast<const char*>(address);
+#else
+    return nullptr;
+#endif
+}
+
+}
 
 std::vector<std::string> split(const std::string& str, char delimiter) {
     std::vector<std::string> tokens;
@@ -8,4 +38,48 @@ std::vector<std::string> split(const std::string& str, char delimiter) {
         tokens.push_back(token);
     }
     return tokens;
-}
\ No newline at end of file
+}
+
+std::string read_file(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open file: " + filename);
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return buffer.str();
+}
+
+uint64_t hash_source(const std::string& source) {
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : source) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+size_t native_stack_left() {
+    thread_local const char* end = stack_end();
+    auto frame = static_cast<const char*>(__builtin_frame_address(0));
+    if (!end || frame < end) {
+        return SIZE_MAX;
+    }
+    return frame - end;
+}
+
+std::ostream& trace_stream() {
+    return current_trace ? *current_trace : std::cout;
+}
+
+void set_trace_stream(std::ostream* stream) {
+    current_trace = stream;
+}
+
+std::ostream& diagnostic_stream() {
+    return current_diagnostics ? *current_diagnostics : std::cerr;
+}
+
+void set_diagnostic_stream(std::ostream* stream) {
+    current_diagnostics = stream;
+}
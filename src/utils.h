@@ -1,10 +1,31 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <sstream>
+#include <ostream>
 
 std::vector<std::string> split(const std::string& str, char delimiter);
+std::string read_file(const std::string& filename);
+
+// 64-bit FNV-1a hash of a script's text, used to key caches of parsed programs
+uint64_t hash_source(const std::string& source);
+
+// Bytes left on the calling thread's stack below the caller's frame, or
+// SIZE_MAX where the platform does not tell how large the stack is
+size_t native_stack_left();
+
+// Where the lexer and parser write their token-by-token trace. The setting is
+// per thread so front ends running concurrently can be silenced or captured
+// independently; nullptr restores the default, std::cout. A std::ostream
+// constructed with a null buffer discards everything.
+std::ostream& trace_stream();
+void set_trace_stream(std::ostream* stream);
+// Same for the lexer, parser and interpreter error diagnostics; defaults to std::cerr
+std::ostream& diagnostic_stream();
+void set_diagnostic_stream(std::ostream* stream);
 
 #endif // UTILS_H
\ No newline at end of file
@@ -0,0 +1,138 @@
+#include "value.h"
+#include "stats.h"
+#include <stdexcept>
+
+namespace {
+
+// The data a Value holds by reference, counted as the interpreter's heap allocations
+std::shared_ptr<std::string> shared_string(std::string text) {
+    stats::add(stats::HeapAllocations);
+    stats::add(stats::HeapBytes, sizeof(std::string) + text.capacity());
+    return std::make_shared<std::string>(std::move(text));
+}
+
+std::shared_ptr<std::vector<Value>> shared_array(std::vector<Value> elements) {
+    stats::add(stats::HeapAllocations);
+    stats::add(stats::HeapBytes, sizeof(std::vector<Value>) + elements.capacity() * sizeof(Value));
+    return std::make_shared<std::vector<Value>>(std::move(elements));
+}
+
+}
+
+Value::Value(std::string text) {
+    if (text.size() >= LARGE_STRING) {
+        data = shared_string(std::move(text));
+    } else {
+        data = std::move(text);
+    }
+}
+
+Value::Value(const char* text) : Value(std::string(text)) {}
+
+Value Value::array(std::vector<Value> elements) {
+    Value value;
+    value.data = shared_array(std::move(elements));
+    return value;
+}
+
+Value Value::object(ScriptObject* object) {
+    Value value;
+    value.data = object;
+    return value;
+}
+
+bool Value::is_text() const {
+    return std::holds_alternative<std::string>(data) || std::holds_alternative<SharedString>(data);
+}
+
+bool Value::is_array() const {
+    return std::holds_alternative<SharedArray>(data);
+}
+
+bool Value::is_object() const {
+    return std::holds_alternative<ScriptObject*>(data);
+}
+
+std::string Value::text() const {
+    if (is_text()) {
+        return str();
+    }
+    if (is_object()) {
+        return "<object>";
+    }
+    std::string joined;
+    for (const auto& element : elements()) {
+        if (!joined.empty()) {
+            joined += ",";
+        }
+        joined += element.text();
+    }
+    return joined;
+}
+
+const std::string& Value::str() const {
+    if (auto inline_text = std::get_if<std::string>(&data)) {
+        return *inline_text;
+    }
+    if (auto shared_text = std::get_if<SharedString>(&data)) {
+        return **shared_text;
+    }
+    throw std::logic_error("Array or object used where text was expected");
+}
+
+const std::vector<Value>& Value::elements() const {
+    if (auto array = std::get_if<SharedArray>(&data)) {
+        return **array;
+    }
+    throw std::runtime_error("Value is not an array");
+}
+
+ScriptObject* Value::as_object() const {
+    if (auto object = std::get_if<ScriptObject*>(&data)) {
+        return *object;
+    }
+    throw std::runtime_error("Value is not an object");
+}
+
+void Value::append(const std::string& text) {
+    if (!is_text()) {
+        data = this->text();
+    }
+    if (auto inline_text = std::get_if<std::string>(&data)) {
+        if (inline_text->size() + text.size() < LARGE_STRING) {
+            *inline_text += text;
+            return;
+        }
+        data = shared_string(std::move(*inline_text));
+    }
+    auto& shared_text = std::get<SharedString>(data);
+    if (shared_text.use_count() > 1) {
+        shared_text = shared_string(*shared_text);
+    }
+    *shared_text += text;
+}
+
+std::vector<Value>& Value::mutable_elements() {
+    auto array = std::get_if<SharedArray>(&data);
+    if (!array) {
+        throw std::runtime_error("Value is not an array");
+    }
+    if (array->use_count() > 1) {
+        *array = shared_array(**array);
+    }
+    return **array;
+}
+
+bool Value::shared() const {
+    if (auto shared_text = std::get_if<SharedString>(&data)) {
+        return shared_text->use_count() > 1;
+    }
+    if (auto array = std::get_if<SharedArray>(&data)) {
+        return array->use_count() > 1;
+    }
+    return false;
+}
+
+bool Value::operator==(const std::string& text) const {
+    return is_text() && str() == text;
+}
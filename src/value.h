@@ -0,0 +1,61 @@
+#ifndef VALUE_H
+#define VALUE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <variant>
+#include <vector>
+
+class ScriptObject;
+
+// A script value: text (numbers are text as well), an array of values, or a
+// reference to an object in the interpreter's heap (see gc.h).
+//
+// Arrays and strings of LARGE_STRING bytes or more are reference counted, so
+// copying a Value (assignment, passing an argument, returning, forking an
+// interpreter) shares the data instead of duplicating it. Shared data is never
+// modified: the mutating accessors copy it first unless this Value is its only
+// owner. Short strings are stored inline, where copying is as cheap as sharing.
+class Value {
+public:
+    static const size_t LARGE_STRING = 64;
+
+    Value() = default;
+    Value(std::string text);
+    Value(const char* text);
+    static Value array(std::vector<Value> elements);
+    static Value object(ScriptObject* object);
+
+    bool is_text() const;
+    bool is_array() const;
+    bool is_object() const;
+
+    // A string's text; an array's elements joined with commas, as they print;
+    // "<object>" for an object
+    std::string text() const;
+    // A string's text without copying; must not be called on an array
+    const std::string& str() const;
+    const std::vector<Value>& elements() const;
+    ScriptObject* as_object() const;
+
+    // Appends to a string in place, copying it first if it is shared
+    void append(const std::string& text);
+    // An array's elements, copied first if they are shared
+    std::vector<Value>& mutable_elements();
+
+    // Whether the data is shared with other values (always false when inline)
+    bool shared() const;
+
+    bool operator==(const std::string& text) const;
+    bool operator!=(const std::string& text) const { return !(*this == text); }
+
+private:
+    using SharedString = std::shared_ptr<std::string>;
+    using SharedArray = std::shared_ptr<std::vector<Value>>;
+
+    // Objects are not owned: the heap's collector decides when they are freed
+    std::variant<std::string, SharedString, SharedArray, ScriptObject*> data;
+};
+
+#endif // VALUE_H
@@ -0,0 +1,856 @@
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "event_bus.h"
+#include "incremental.h"
+#include "interpreter.h"
+#include "lexer.h"
+#include "parser.h"
+#include "profiler.h"
+#include "server.h"
+#include "symbol.h"
+#include "utils.h"
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// Tests of the C++ interfaces a host program uses directly. Script behaviour
+// is covered by the .aby cases that runTests (test_main.cpp) runs.
+
+namespace {
+
+struct ApiTest {
+    std::string name;
+    std::function<void()> run;
+};
+
+void check(bool condition, const std::string& message) {
+    if (!condition) {
+        throw std::runtime_error(message);
+    }
+}
+
+template <typename T>
+void checkEqual(const T& actual, const T& expected, const std::string& what) {
+    if (!(actual == expected)) {
+        std::ostringstream message;
+        message << what << ": expected " << expected << ", got " << actual;
+        throw std::runtime_error(message.str());
+    }
+}
+
+// Fails unless `action` throws; returns the error message
+std::string checkThrows(const std::function<void()>& action, const std::string& what) {
+    try {
+        action();
+    } catch (const std::exception& e) {
+        return e.what();
+    }
+    throw std::runtime_error(what + ": no error was thrown");
+}
+
+std::unique_ptr<ASTNode> parseSource(const std::string& source) {
+    Lexer lexer(source);
+    auto tokens = lexer.tokenize();
+    Parser parser(tokens);
+    return parser.parse();
+}
+
+// An interpreter that has run `source`, printing to `output`
+std::unique_ptr<Interpreter> runSource(const std::string& source, std::ostream& output) {
+    auto interpreter = std::make_unique<Interpreter>();
+    interpreter->set_output(output);
+    interpreter->interpret(parseSource(source));
+    interpreter->execute();
+    return interpreter;
+}
+
+// Snapshots
+
+const char* SNAPSHOT_SCRIPT = R"(
+count = 3;
+name = "guard";
+items = [1, "two", [3, 4]];
+object captain;
+captain.rank = 5;
+object mate;
+mate.captain = captain;
+captain.mate = mate;
+fun rank_of(person) {
+    return person.rank;
+}
+fun promote() {
+    boss = mate.captain;
+    boss.rank = 9;
+    return captain.rank;
+}
+fun describe() {
+    return name + " " + count + " " + items[1] + " " + rank_of(mate.captain);
+}
+event alarm {
+    print "alarm: " + event_data;
+}
+)";
+
+std::string snapshotOf(const Interpreter& interpreter) {
+    std::ostringstream out;
+    interpreter.snapshot(out);
+    return out.str();
+}
+
+void testSnapshotRoundTrip() {
+    std::ostringstream output;
+    auto original = runSource(SNAPSHOT_SCRIPT, output);
+    std::string data = snapshotOf(*original);
+
+    std::ostringstream restoredOutput;
+    Interpreter restored;
+    restored.set_output(restoredOutput);
+    restored.restore(data.data(), data.size());
+    checkEqual(restored.call_function("describe", {}), original->call_function("describe", {}), "restored state");
+    checkEqual(restored.dispatch_event("alarm", "fire"), size_t(1), "restored listeners");
+    checkEqual(restoredOutput.str(), std::string("alarm: fire\n"), "restored listener output");
+
+    // The cycle between the two objects comes back as a cycle, not as copies
+    checkEqual(restored.call_function("promote", {}), std::string("9.000000"), "object identity after restore");
+}
+
+void testSnapshotOfPendingProgram() {
+    std::ostringstream output;
+    Interpreter original;
+    original.set_output(output);
+    original.interpret(parseSource("total = 40 + 2;\nprint total;"));
+    std::string data = snapshotOf(original);
+
+    Interpreter restored;
+    restored.set_output(output);
+    restored.restore(data.data(), data.size());
+    restored.execute();
+    checkEqual(output.str(), std::string("42\n"), "pending program output");
+}
+
+void testSnapshotRejectsTruncatedInput() {
+    std::ostringstream output;
+    auto original = runSource(SNAPSHOT_SCRIPT, output);
+    std::string data = snapshotOf(*original);
+
+    Interpreter target;
+    target.set_output(output);
+    target.interpret(parseSource("marker = \"untouched\";\nfun read_marker() {\n    return marker;\n}"));
+    target.execute();
+    for (size_t size = 0; size < data.size(); ++size) {
+        checkThrows([&] { target.restore(data.data(), size); }, "restoring " + std::to_string(size) + " of " + std::to_string(data.size()) + " bytes");
+    }
+    // A failed restore leaves the interpreter as it was
+    checkEqual(target.call_function("read_marker", {}), std::string("untouched"), "state after failed restores");
+}
+
+void testSnapshotRejectsCorruptInput() {
+    std::ostringstream output;
+    auto original = runSource(SNAPSHOT_SCRIPT, output);
+    std::string data = snapshotOf(*original);
+
+    std::string badMagic = data;
+    badMagic[0] = 'X';
+    Interpreter target;
+    checkEqual(checkThrows([&] { target.restore(badMagic.data(), badMagic.size()); }, "bad magic"),
+               std::string("Not an Abyssian snapshot"), "bad magic error");
+
+    std::string badVersion = data;
+    badVersion[4] = static_cast<char>(badVersion[4] + 1);
+    checkThrows([&] { target.restore(badVersion.data(), badVersion.size()); }, "bad version");
+
+    std::string trailing = data + "E";
+    checkThrows([&] { target.restore(trailing.data(), trailing.size()); }, "trailing bytes");
+
+    // Any single damaged byte is either rejected or still decodes; it never crashes
+    for (size_t i = 0; i < data.size(); ++i) {
+        std::string damaged = data;
+        damaged[i] = static_cast<char>(damaged[i] ^ 0xff);
+        Interpreter scratch;
+        try {
+            scratch.restore(damaged.data(), damaged.size());
+        } catch (const std::exception&) {
+        }
+    }
+}
+
+void testSnapshotRejectsDeepNesting() {
+    std::ostringstream output;
+    auto original = runSource("marker = \"untouched\";\nfun read_marker() {\n    return marker;\n}\n", output);
+    std::string data = snapshotOf(*original);
+    std::string header = data.substr(0, 8);  // Magic, version and flags
+    const int depth = 100000;
+
+    // No objects, then one variable holding arrays nested far past the bound
+    std::string arrays = header + '\x00' + '\x01' + '\x01' + 'x';
+    for (int i = 0; i < depth; ++i) {
+        arrays += "\x01\x01";
+    }
+    Interpreter target;
+    target.restore(data.data(), data.size());
+    checkEqual(checkThrows([&] { target.restore(arrays.data(), arrays.size()); }, "nested arrays"),
+               std::string("Corrupt snapshot: nested too deeply"), "nested arrays error");
+
+    // No objects or variables, then one function of nested return statements
+    std::string nodes = header + '\x00' + '\x00' + '\x01';
+    for (int i = 0; i < depth; ++i) {
+        nodes += "\x05\x01";
+    }
+    checkEqual(checkThrows([&] { target.restore(nodes.data(), nodes.size()); }, "nested nodes"),
+               std::string("Corrupt snapshot: nested too deeply"), "nested nodes error");
+    checkEqual(target.call_function("read_marker", {}), std::string("untouched"), "state after rejected restores");
+
+    // Writing refuses values it could not read back
+    auto deep = runSource("nest = [];\nfor i = 1 to 5000 {\n    nest = [nest];\n}\n", output);
+    checkEqual(checkThrows([&] { snapshotOf(*deep); }, "snapshot of deep value"),
+               std::string("Cannot snapshot: values or code nested too deeply"), "deep value error");
+}
+
+
+// Hot reload
+
+const char* RELOAD_SCRIPT = R"(
+level = 1;
+fun greet() {
+    return "hello";
+}
+fun farewell() {
+    return "bye";
+}
+fun arm() {
+    event alarm {
+        print "armed";
+    }
+}
+event alarm {
+    print "first";
+}
+)";
+
+void testReloadReusesUnchangedDeclarations() {
+    std::ostringstream output;
+    Interpreter interpreter;
+    interpreter.set_output(output);
+    interpreter.interpret_source(RELOAD_SCRIPT);
+    interpreter.execute();
+
+    // Seeded by interpret_source, so nothing has to be parsed again
+    ReloadSummary unchanged = interpreter.reload(RELOAD_SCRIPT);
+    checkEqual(unchanged.reparsed, size_t(0), "reparsed after no change");
+    checkEqual(unchanged.reused, size_t(4), "reused after no change");
+    checkEqual(unchanged.removed, size_t(0), "removed after no change");
+
+    std::string edited = RELOAD_SCRIPT;
+    edited.replace(edited.find("\"hello\""), 7, "\"hi\"");
+    ReloadSummary changed = interpreter.reload(edited);
+    checkEqual(changed.reparsed, size_t(1), "reparsed after one edit");
+    checkEqual(changed.reused, size_t(3), "reused after one edit");
+    checkEqual(interpreter.call_function("greet", {}), std::string("hi"), "reloaded function");
+    checkEqual(interpreter.call_function("farewell", {}), std::string("bye"), "unchanged function");
+}
+
+void testReloadRemovesDeletedFunctions() {
+    std::ostringstream output;
+    Interpreter interpreter;
+    interpreter.set_output(output);
+    interpreter.interpret_source(RELOAD_SCRIPT);
+    interpreter.execute();
+
+    std::string edited = RELOAD_SCRIPT;
+    size_t start = edited.find("fun farewell");
+    edited.erase(start, edited.find("fun arm") - start);
+    ReloadSummary summary = interpreter.reload(edited);
+    checkEqual(summary.removed, size_t(1), "removed functions");
+    // The declarations on either side of the edit are parsed again; the listener after them is not
+    checkEqual(summary.reused + summary.reparsed, size_t(3), "declarations after removal");
+    checkEqual(summary.reused, size_t(1), "reused after removal");
+    checkThrows([&] { interpreter.call_function("farewell", {}); }, "calling a removed function");
+    checkEqual(interpreter.call_function("greet", {}), std::string("hello"), "remaining function");
+}
+
+void testReloadKeepsListenersAddedAtRunTime() {
+    std::ostringstream output;
+    Interpreter interpreter;
+    interpreter.set_output(output);
+    interpreter.interpret_source(RELOAD_SCRIPT);
+    interpreter.execute();
+    interpreter.call_function("arm", {});
+
+    std::string edited = RELOAD_SCRIPT;
+    edited.replace(edited.find("\"first\""), 7, "\"second\"");
+    interpreter.reload(edited);
+    checkEqual(interpreter.dispatch_event("alarm", ""), size_t(2), "listeners after reload");
+    checkEqual(output.str(), std::string("armed\nsecond\n"), "listener output after reload");
+}
+
+// Incremental parsing
+
+// The program an interpreter would run, written out as a snapshot so two trees can be compared
+std::string programOf(std::unique_ptr<ASTNode> ast) {
+    Interpreter interpreter;
+    interpreter.interpret(std::move(ast));
+    return snapshotOf(interpreter);
+}
+
+void checkMatchesFullParse(const IncrementalFrontend& frontend, const std::string& what) {
+    Lexer lexer(frontend.source());
+    auto tokens = lexer.tokenize();
+    checkEqual(frontend.tokens().size(), tokens.size(), what + ": token count");
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        const Token& kept = frontend.tokens()[i];
+        std::string where = what + ": token " + std::to_string(i);
+        checkEqual(static_cast<int>(kept.type), static_cast<int>(tokens[i].type), where + " kind");
+        checkEqual(kept.value, tokens[i].value, where + " text");
+        checkEqual(kept.line, tokens[i].line, where + " line");
+        checkEqual(kept.offset, tokens[i].offset, where + " offset");
+    }
+    Parser parser(tokens);
+    check(programOf(frontend.parse()) == programOf(parser.parse()), what + ": tree differs from a full parse");
+}
+
+void testIncrementalEditsMatchFullParse() {
+    std::string source =
+        "count = 0;\n"
+        "fun add(a, b) {\n"
+        "    return a + b;\n"
+        "}\n"
+        "while (count < 3) {\n"
+        "    count = add(count, 1);\n"
+        "}\n"
+        "print \"done\";\n";
+    IncrementalFrontend frontend(source);
+    checkMatchesFullParse(frontend, "initial parse");
+
+    frontend.edit(3, 3, "    return a * b + 1;\n");
+    checkMatchesFullParse(frontend, "edit inside a function");
+    checkEqual(frontend.last_stats().statements_reparsed, size_t(1), "statements parsed again after a local edit");
+
+    frontend.edit(1, 0, "limit = 10;\nlabel = \"x\";\n");
+    checkMatchesFullParse(frontend, "lines inserted at the top");
+
+    frontend.edit(7, 9, "");
+    checkMatchesFullParse(frontend, "loop deleted");
+
+    // Splits one identifier into two tokens
+    size_t at = frontend.source().find("limit");
+    frontend.replace(at + 3, 0, " = 1;\nmore");
+    checkMatchesFullParse(frontend, "token split");
+
+    frontend.update(frontend.source() + "fun twice(x) {\n    return add(x, x);\n}\n");
+    checkMatchesFullParse(frontend, "function appended");
+
+    // A syntax error leaves the front end usable; fixing it reaches the same tree as a full parse
+    std::string fixed = frontend.source();
+    size_t brace = fixed.rfind('}');
+    checkThrows([&] { frontend.replace(brace, 1, ""); }, "unclosed function");
+    frontend.update(fixed);
+    checkMatchesFullParse(frontend, "syntax error fixed");
+}
+
+// Script server
+
+// "OK <result_len> <output_len>\n<result><output>" split into its parts, or the message of an ERR
+struct ServerResponse {
+    bool ok = false;
+    std::string result;
+    std::string output;
+};
+
+ServerResponse parseResponse(const std::string& text) {
+    ServerResponse response;
+    std::istringstream in(text);
+    std::string status;
+    size_t resultLength = 0;
+    size_t outputLength = 0;
+    in >> status >> resultLength;
+    response.ok = status == "OK";
+    if (response.ok) {
+        in >> outputLength;
+    }
+    size_t body = text.find('\n') + 1;
+    checkEqual(text.size() - body, resultLength + outputLength, "response length of " + text);
+    response.result = text.substr(body, resultLength);
+    response.output = text.substr(body + resultLength);
+    return response;
+}
+
+// handle() takes the payloads as given; the lengths in the header only matter on a socket
+ServerResponse request(ScriptServer& server, const std::string& header, const std::vector<std::string>& payloads = {}) {
+    std::vector<std::string> words;
+    std::istringstream in(header);
+    for (std::string word; in >> word;) {
+        words.push_back(word);
+    }
+    return parseResponse(server.handle(words, payloads));
+}
+
+void checkError(const ServerResponse& response, const std::string& message, const std::string& what) {
+    check(!response.ok, what + ": expected an error, got OK");
+    check(response.result.find(message) != std::string::npos, what + ": expected \"" + message + "\" in \"" + response.result + "\"");
+}
+
+const char* SERVER_SCRIPT = R"(
+greeting = "Hello";
+print "top level";
+fun greet(name) {
+    print "greeting " + name;
+    return greeting + ", " + name;
+}
+)";
+
+void testServerRunAndCall() {
+    ServerOptions options;
+    ScriptServer server(options);
+    check(request(server, "PING").ok, "PING");
+
+    ServerResponse run = request(server, "RUN 20", {"print \"ran\";\nx = 1;"});
+    check(run.ok, "RUN: " + run.result);
+    checkEqual(run.output, std::string("ran\n"), "RUN output");
+
+    ServerResponse load = request(server, "LOAD 1", {SERVER_SCRIPT});
+    check(load.ok, "LOAD: " + load.result);
+    checkEqual(load.result.size(), size_t(16), "hash length");
+    checkEqual(request(server, "LOAD 1", {SERVER_SCRIPT}).result, load.result, "hash of the same script");
+
+    // The top level runs once, and its output is not part of any call's response
+    for (int i = 0; i < 2; ++i) {
+        ServerResponse call = request(server, "CALL " + load.result + " greet 1 4", {"Mira"});
+        check(call.ok, "CALL: " + call.result);
+        checkEqual(call.result, std::string("Hello, Mira"), "CALL result");
+        checkEqual(call.output, std::string("greeting Mira\n"), "CALL output");
+    }
+
+    check(request(server, "EVICT " + load.result).ok, "EVICT");
+    checkError(request(server, "CALL " + load.result + " greet 1 4", {"Mira"}), "LOAD it first", "CALL after EVICT");
+    checkError(request(server, "EVICT " + load.result), "Unknown program", "EVICT twice");
+}
+
+void testServerInput() {
+    ServerOptions options;
+    ScriptServer server(options);
+    std::string asking = "input name;\ninput mood;\nprint name + \" is \" + mood;";
+
+    std::string lines = "Mira\ncalm\n";
+    ServerResponse answered = request(server, "RUN 1 1", {asking, lines});
+    check(answered.ok, "RUN with input: " + answered.result);
+    checkEqual(answered.output, std::string("Mira is calm\n"), "RUN output with input");
+
+    // Without input, or past its end, `input` reads an empty line instead of the server's stdin
+    checkEqual(request(server, "RUN 1", {asking}).output, std::string(" is \n"), "RUN output without input");
+    checkEqual(request(server, "RUN 1 1", {asking, "Mira"}).output, std::string("Mira is \n"), "RUN output past the input");
+
+    std::string hash = request(server, "LOAD 1", {"input opening;\nfun ask(prompt) {\n    input reply;\n    return prompt + reply + opening;\n}"}).result;
+    ServerResponse call = request(server, "CALL " + hash + " ask 1 1 1", {"Who? ", "Jun"});
+    check(call.ok, "CALL with input: " + call.result);
+    checkEqual(call.result, std::string("Who? Jun"), "CALL result with input");
+    checkEqual(request(server, "CALL " + hash + " ask 1 1", {"Who? "}).result, std::string("Who? "), "CALL result without input");
+    checkError(request(server, "CALL " + hash + " ask 1 1 1 1", {"a", "b", "c"}), "CALL expects 1 arguments", "CALL with an extra payload");
+}
+
+void testServerErrors() {
+    ServerOptions options;
+    ScriptServer server(options);
+    checkError(request(server, ""), "Empty request", "empty request");
+    checkError(request(server, "JUMP"), "Unknown request: JUMP", "unknown command");
+    checkError(request(server, "RUN 1", {"print ;"}), "", "syntax error");
+    checkError(request(server, "EVICT xyz"), "Invalid program hash: xyz", "malformed hash");
+    checkError(request(server, "EVICT 99999999999999999999"), "Invalid program hash", "hash out of range");
+    checkError(request(server, "CALL 0000000000000001 greet 0"), "Unknown program", "CALL without LOAD");
+
+    std::string hash = request(server, "LOAD 1", {SERVER_SCRIPT}).result;
+    checkError(request(server, "CALL " + hash + " missing 0"), "missing", "unknown function");
+    ServerResponse bad = request(server, "LOAD 1", {"fun broken( {"});
+    check(!bad.ok, "LOAD of a script that does not parse");
+}
+
+#ifndef _WIN32
+
+int connectTo(const std::string& path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::copy(path.begin(), path.end(), address.sun_path);
+    for (int attempt = 0; attempt < 200; ++attempt) {
+        if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) {
+            return fd;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    close(fd);
+    throw std::runtime_error("Could not connect to " + path);
+}
+
+void sendAll(int fd, const std::string& data) {
+    check(send(fd, data.data(), data.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(data.size()), "send");
+}
+
+// Reads until `count` responses have arrived, or fails after a few seconds
+std::string receiveResponses(int fd, size_t count) {
+    std::string data;
+    size_t complete = 0;
+    while (complete < count) {
+        pollfd waiting{fd, POLLIN, 0};
+        check(poll(&waiting, 1, 5000) == 1, "no response within 5 s after " + std::to_string(complete) + " of " + std::to_string(count));
+        char chunk[4096];
+        ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+        check(received > 0, "connection closed");
+        data.append(chunk, static_cast<size_t>(received));
+        complete = 0;
+        for (size_t position = 0; position < data.size();) {
+            size_t newline = data.find('\n', position);
+            if (newline == std::string::npos) {
+                break;
+            }
+            std::istringstream header(data.substr(position, newline - position));
+            std::string status;
+            size_t first = 0;
+            size_t second = 0;
+            header >> status >> first;
+            if (status == "OK") {
+                header >> second;
+            }
+            if (data.size() < newline + 1 + first + second) {
+                break;
+            }
+            position = newline + 1 + first + second;
+            ++complete;
+        }
+    }
+    return data;
+}
+
+void testServerSocket() {
+    ServerOptions options;
+    options.socket_path = (std::filesystem::temp_directory_path() / ("abyssian-api-" + std::to_string(getpid()) + ".sock")).string();
+    options.workers = 1;
+    ScriptServer server(options);
+    std::thread serving([&server] { server.serve(); });
+    std::vector<int> fds;
+    try {
+        // Idle connections hold no worker, so with one worker the last connection is still answered
+        for (int i = 0; i < 3; ++i) {
+            fds.push_back(connectTo(options.socket_path));
+        }
+        int fd = fds.back();
+        sendAll(fd, "PING\n");
+        checkEqual(receiveResponses(fd, 1), std::string("OK 0 0\n"), "PING on the last connection");
+
+        // Requests sent back to back, one of them with a length out of range, are answered in order
+        std::string source = "print \"hi\";";
+        sendAll(fd, "RUN " + std::to_string(source.size()) + "\n" + source + "RUN 99999999999999999999\nPING\n");
+        checkEqual(receiveResponses(fd, 3), std::string("OK 0 3\nhi\nERR 36\nInvalid length: 99999999999999999999OK 0 0\n"), "pipelined responses");
+
+        // A request split over several writes is answered once it is complete
+        sendAll(fd, "RU");
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        sendAll(fd, "N " + std::to_string(source.size()) + "\nprint");
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        sendAll(fd, source.substr(5));
+        checkEqual(receiveResponses(fd, 1), std::string("OK 0 3\nhi\n"), "split request");
+
+        // Input arrives as a second payload; the server's own stdin is never read
+        std::string asking = "input name;\nprint name;";
+        sendAll(fd, "RUN " + std::to_string(asking.size()) + " 5\n" + asking + "Mira\n");
+        checkEqual(receiveResponses(fd, 1), std::string("OK 0 5\nMira\n"), "RUN with input");
+    } catch (...) {
+        server.stop();
+        serving.join();
+        for (int fd : fds) {
+            close(fd);
+        }
+        throw;
+    }
+    server.stop();
+    serving.join();
+    for (int fd : fds) {
+        close(fd);
+    }
+}
+
+#endif
+
+// Event bus
+
+void testRingWrapsAround() {
+    // Indices start just below 2^64, so they overflow as well as wrap around the slots
+    RingIndices indices;
+    indices.head = UINT64_MAX - 5;
+    indices.tail = UINT64_MAX - 5;
+    BusRecord records[4];
+    SpscRing producer(&indices, records, 4);
+    SpscRing consumer(&indices, records, 4);
+
+    uint32_t sent = 0;
+    uint32_t received = 0;
+    for (int round = 0; round < 6; ++round) {
+        while (producer.try_push(BusRecord::make(RecordKind::WorldEvent, "tick", std::to_string(sent)))) {
+            ++sent;
+        }
+        checkEqual(producer.size(), size_t(4), "records in a full ring");
+        // Leave one behind, so the next round starts at a different slot
+        for (int i = 0; i < 3; ++i) {
+            BusRecord record;
+            check(consumer.try_pop(record), "pop from a non-empty ring");
+            checkEqual(record.payload_text(), std::to_string(received), "record order");
+            ++received;
+        }
+    }
+    BusRecord record;
+    check(consumer.try_pop(record), "last record");
+    check(!consumer.try_pop(record), "pop from an empty ring");
+    checkEqual(sent, uint32_t(19), "records sent");
+}
+
+void testRingAcrossThreads() {
+    RingIndices indices;
+    BusRecord records[8];
+    SpscRing producer(&indices, records, 8);
+    SpscRing consumer(&indices, records, 8);
+    const uint32_t count = 100000;
+
+    std::thread producing([&] {
+        for (uint32_t i = 0; i < count; ++i) {
+            BusRecord record = BusRecord::make(RecordKind::NPCAction, "npc", "");
+            record.sequence = i;
+            while (!producer.try_push(record)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+    uint32_t expected = 0;
+    bool ordered = true;
+    while (expected < count) {
+        BusRecord record;
+        if (!consumer.try_pop(record)) {
+            std::this_thread::yield();
+            continue;
+        }
+        ordered = ordered && record.sequence == expected;
+        ++expected;
+    }
+    producing.join();
+    check(ordered, "records arrived out of order");
+}
+
+#ifndef _WIN32
+
+void testEventBusBetweenSides() {
+    std::string name = "abyssian-api-" + std::to_string(getpid());
+    auto host = EventBus::create(name, 5);
+    auto script = EventBus::open(name);
+    checkEqual(host->capacity(), uint64_t(8), "rounded capacity");
+    checkEqual(script->capacity(), uint64_t(8), "capacity seen by the script");
+
+    // Sequences count on across many trips around the ring
+    uint32_t sequence = 0;
+    for (int round = 0; round < 5; ++round) {
+        size_t sent = 0;
+        while (host->send(RecordKind::WorldEvent, "door", "open " + std::to_string(sent))) {
+            ++sent;
+        }
+        checkEqual(sent, size_t(8), "records sent before the ring is full");
+        BusRecord record;
+        for (size_t i = 0; i < sent; ++i) {
+            check(script->receive(record), "receive");
+            checkEqual(record.sequence, sequence++, "sequence");
+            checkEqual(record.name_text(), std::string("door"), "event name");
+            checkEqual(record.payload_text(), "open " + std::to_string(i), "event data");
+        }
+        check(!script->receive(record), "receive from an empty ring");
+    }
+
+    // The script's interpreter publishes NPC actions to the host; long text is truncated
+    std::ostringstream output;
+    Interpreter interpreter;
+    interpreter.set_output(output);
+    interpreter.set_event_bus(script.get());
+    interpreter.interpret(parseSource("npc guard wave;\nnpc " + std::string(80, 'g') + " nod;"));
+    interpreter.execute();
+    BusRecord record;
+    check(host->receive(record), "first NPC action");
+    checkEqual(static_cast<int>(record.kind), static_cast<int>(RecordKind::NPCAction), "record kind");
+    checkEqual(record.name_text() + " " + record.payload_text(), std::string("guard wave"), "NPC action");
+    check(host->receive(record), "second NPC action");
+    checkEqual(record.name_text(), std::string(sizeof(record.name), 'g'), "truncated NPC name");
+    check(!host->receive(record), "no more NPC actions");
+    checkEqual(output.str(), std::string(), "output with an event bus");
+    check(!host->receive(record) && !script->receive(record), "nothing left on either ring");
+
+    checkThrows([&] { EventBus::open(name + "-missing"); }, "opening a bus that does not exist");
+
+    // A second host cannot take over a bus in use, and the name is free again once the host is gone
+    std::string taken = checkThrows([&] { EventBus::create(name); }, "creating a bus that exists");
+    check(taken.find("already exists") != std::string::npos, "error for a bus that exists: " + taken);
+    check(script->receive(record) == false && host->send(RecordKind::Close, "", ""), "bus after a failed create");
+    check(script->receive(record) && record.kind == RecordKind::Close, "record sent after a failed create");
+    script.reset();
+    host.reset();
+    checkEqual(EventBus::create(name)->capacity(), uint64_t(4096), "bus created again after the host is gone");
+}
+
+#endif
+
+// Symbols
+
+void testSymbolInterning() {
+    size_t before = Symbol::count();
+    Symbol first("api_test_symbol");
+    Symbol second(std::string("api_test_") + "symbol");
+    check(first == second, "same text, same symbol");
+    checkEqual(first.id(), second.id(), "ids of the same text");
+    check(first != Symbol("api_test_other"), "different text, different symbol");
+    checkEqual(Symbol::count(), before + 2, "entries added");
+    check(Symbol().empty() && Symbol("") == Symbol(), "the empty symbol");
+
+    // find() never adds an entry
+    check(!Symbol::find("api_test_never_interned"), "find of new text");
+    check(Symbol::find("api_test_symbol") == first, "find of interned text");
+    checkEqual(Symbol::count(), before + 2, "entries after find");
+
+    // Threads interning the same names at once agree on their entries
+    std::vector<std::vector<Symbol>> seen(4);
+    std::vector<std::thread> threads;
+    for (auto& symbols : seen) {
+        threads.emplace_back([&symbols] {
+            for (int i = 0; i < 200; ++i) {
+                symbols.push_back(Symbol("api_test_thread_" + std::to_string(i)));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (const auto& symbols : seen) {
+        check(symbols == seen[0], "threads saw different entries");
+    }
+    checkEqual(Symbol::count(), before + 202, "entries after interning from threads");
+}
+
+void testOnlyNamesAreInterned() {
+    // String literals and values made while running are not interned, so the table
+    // does not grow with the data of every script a server or batch run sees
+    std::ostringstream output;
+    auto program = parseSource(
+        "object record;\n"
+        "record.label = \"api test literal\";\n"
+        "text = \"\";\n"
+        "i = 0;\n"
+        "while (i < 50) {\n"
+        "    text = text + \"api test piece \" + i;\n"
+        "    i = i + 1;\n"
+        "}\n"
+        "event api_test_event {\n"
+        "    print event_data;\n"
+        "}\n");
+    size_t before = Symbol::count();
+    Interpreter interpreter;
+    interpreter.set_output(output);
+    interpreter.interpret(std::move(program));
+    interpreter.execute();
+    interpreter.dispatch_event("api_test_event", "api test data");
+    checkThrows([&] { interpreter.call_function("api_test_missing_function", {}); }, "calling a function that does not exist");
+    checkEqual(Symbol::count(), before, "entries after running");
+    check(!Symbol::find("api test literal") && !Symbol::find("api test piece 7") && !Symbol::find("api test data"),
+          "text interned while running");
+
+    ServerOptions options;
+    ScriptServer server(options);
+    for (int i = 0; i < 20; ++i) {
+        request(server, "RUN 1", {"print \"api test run " + std::to_string(i) + "\";"});
+    }
+    checkEqual(Symbol::count(), before, "entries after serving scripts with different literals");
+}
+
+// Profiling
+
+void testProfilerCountsCalls() {
+    std::ostringstream output;
+    Interpreter interpreter;
+    interpreter.set_output(output);
+    Profiler profiler;
+    interpreter.set_profiler(&profiler);
+    interpreter.interpret(parseSource(
+        "fun square(n) {\n"
+        "    return n * n;\n"
+        "}\n"
+        "fun total(limit) {\n"
+        "    sum = 0;\n"
+        "    for i = 1 to limit {\n"
+        "        sum = sum + square(i);\n"
+        "    }\n"
+        "    return sum;\n"
+        "}\n"
+        "print total(4);\n"
+        "print total(2);\n"));
+    interpreter.execute();
+    checkEqual(output.str(), std::string("30\n5\n"), "profiled output");
+
+    const auto& functions = profiler.functions();
+    checkEqual(functions.size(), size_t(3), "profiled functions");
+    checkEqual(functions.at("main").calls, uint64_t(1), "main calls");
+    checkEqual(functions.at("total").calls, uint64_t(2), "total calls");
+    checkEqual(functions.at("square").calls, uint64_t(6), "square calls");
+    check(functions.at("main").inclusive_ns >= functions.at("total").inclusive_ns, "main includes its callees");
+    checkEqual(profiler.lines().at(7).calls, uint64_t(6), "hits of the loop body");
+
+    std::ostringstream stacks;
+    profiler.write_collapsed(stacks);
+    check(stacks.str().find("main;total;square ") != std::string::npos, "collapsed stacks: " + stacks.str());
+}
+}
+
+int main() {
+    std::ostream nowhere(nullptr);
+    set_trace_stream(&nowhere);
+    set_diagnostic_stream(&nowhere);
+
+    const std::vector<ApiTest> tests = {
+        {"snapshot round trip", testSnapshotRoundTrip},
+        {"snapshot of a pending program", testSnapshotOfPendingProgram},
+        {"snapshot rejects truncated input", testSnapshotRejectsTruncatedInput},
+        {"snapshot rejects corrupt input", testSnapshotRejectsCorruptInput},
+        {"snapshot rejects deep nesting", testSnapshotRejectsDeepNesting},
+        {"reload reuses unchanged declarations", testReloadReusesUnchangedDeclarations},
+        {"reload removes deleted functions", testReloadRemovesDeletedFunctions},
+        {"reload keeps listeners added at run time", testReloadKeepsListenersAddedAtRunTime},
+        {"incremental edits match a full parse", testIncrementalEditsMatchFullParse},
+        {"server runs scripts and calls functions", testServerRunAndCall},
+        {"server feeds input to requests", testServerInput},
+        {"server reports errors", testServerErrors},
+#ifndef _WIN32
+        {"server answers requests over a socket", testServerSocket},
+#endif
+        {"ring wraps around", testRingWrapsAround},
+        {"ring passes records between threads", testRingAcrossThreads},
+#ifndef _WIN32
+        {"event bus between host and script", testEventBusBetweenSides},
+#endif
+        {"symbol interning", testSymbolInterning},
+        {"only names are interned", testOnlyNamesAreInterned},
+        {"profiler counts calls", testProfilerCountsCalls},
+    };
+    int passed = 0;
+    for (const auto& test : tests) {
+        try {
+            test.run();
+            std::cout << "Passed " << test.name << std::endl;
+            ++passed;
+        } catch (const std::exception& e) {
+            std::cout << "Failed " << test.name << ": " << e.what() << std::endl;
+        }
+    }
+    std::cout << passed << " out of " << tests.size() << " tests passed." << std::endl;
+    return passed == static_cast<int>(tests.size()) ? 0 : 1;
+}
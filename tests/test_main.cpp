@@ -1,19 +1,51 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 #include <filesystem>
+#include "aot.h"
 #include "interpreter.h"
 #include "lexer.h"
 #include "parser.h"
+#include "stats.h"
+#include "utils.h"
 
 namespace fs = std::filesystem;
 
+// Optional `<name>.perf` sidecar: `key = value` lines, `#` starts a comment.
+//   max_nodes = 2400   fail when executing the script evaluates more AST nodes
+//   max_ms = 250       fail when the fastest run takes longer; only checked with
+//                      --time-budgets (or ABYSSIAN_TIME_BUDGETS=1), since wall-clock
+//                      time depends on the machine and its load
+//   runs = 3           how many times to execute the script when timing it
+struct PerfBudget {
+    uint64_t maxNodes = 0;
+    double maxMs = 0;
+    int runs = 1;
+};
+
 struct TestCase {
     std::string name;
     std::string inputFile;
     std::string expectedFile;
+    std::string perfFile;
+    std::string stdinFile;  // Lines fed to `input` statements, if the file exists
+};
+
+struct TestResult {
+    bool passed = false;
+    bool outputMatched = false;  // Ran to completion with the expected output
+    std::string message;
+    uint64_t nodes = 0;
+    double ms = 0;
 };
 
 std::vector<TestCase> getTestCases(const std::string& testDir) {
@@ -21,69 +53,228 @@ std::vector<TestCase> getTestCases(const std::string& testDir) {
     for (const auto& entry : fs::directory_iterator(testDir)) {
         if (entry.path().extension() == ".aby") {
             std::string testName = entry.path().stem().string();
-            testCases.push_back({testName, entry.path().string(), testDir + "/" + testName + ".expected"});
+            testCases.push_back({testName, entry.path().string(), testDir + "/" + testName + ".expected", testDir + "/" + testName + ".perf",
+                                 testDir + "/" + testName + ".stdin"});
         }
     }
+    std::sort(testCases.begin(), testCases.end(), [](const TestCase& a, const TestCase& b) { return a.name < b.name; });
     return testCases;
 }
 
 std::string readFile(const std::string& filePath) {
     std::ifstream file(filePath);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open file: " + filePath);
+    }
     std::stringstream buffer;
     buffer << file.rdbuf();
     return buffer.str();
 }
 
-bool runTest(const TestCase& testCase) {
-    std::stringstream nullout;
-    std::streambuf* originalCout = std::cout.rdbuf(nullout.rdbuf());
-
-    // Run the interpreter on the test input file
-    std::string input = readFile(testCase.inputFile);
+PerfBudget readPerfBudget(const std::string& filePath) {
+    PerfBudget budget;
+    std::ifstream file(filePath);
+    if (!file.is_open()) {
+        return budget;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+        size_t equals = line.find('=');
+        if (equals == std::string::npos) {
+            continue;
+        }
+        std::string key = line.substr(0, equals);
+        key.erase(std::remove_if(key.begin(), key.end(), [](unsigned char c) { return std::isspace(c); }), key.end());
+        double value = std::stod(line.substr(equals + 1));
+        if (key == "max_nodes") {
+            budget.maxNodes = static_cast<uint64_t>(value);
+        } else if (key == "max_ms") {
+            budget.maxMs = value;
+        } else if (key == "runs") {
+            budget.runs = std::max(1, static_cast<int>(value));
+        } else {
+            throw std::runtime_error("Unknown key in " + filePath + ": " + key);
+        }
+    }
+    return budget;
+}
 
-    // Create a lexer and parser for the input
-    Lexer lexer(input);
-    auto tokens = lexer.tokenize();
-    Parser parser(tokens);
-    auto ast = parser.parse();
+// Runs one case on the calling thread. The lexer and parser trace is discarded
+// and the program writes to its own stream, so cases can run concurrently.
+// Unless `timed`, the script runs once in each mode and max_ms is not checked.
+TestResult runTest(const TestCase& testCase, bool timed) {
+    TestResult result;
+    std::ostream nowhere(nullptr);
+    set_trace_stream(&nowhere);
+    try {
+        PerfBudget budget = readPerfBudget(testCase.perfFile);
+        std::string input = readFile(testCase.inputFile);
+        std::string expectedOutput = readFile(testCase.expectedFile);
 
-    // Run the interpreter
-    Interpreter interpreter;
-    interpreter.interpret(std::move(ast));
+        Lexer lexer(input);
+        auto tokens = lexer.tokenize();
+        Parser parser(tokens);
+        auto ast = parser.parse();
 
-    std::cout.rdbuf(originalCout);
+        // Never wait on the terminal: without a .stdin file input runs dry at once
+        auto runOnce = [&](const TierPolicy& policy, ExecutionMode mode, std::string& output, uint64_t& nodes,
+                           std::shared_ptr<const NativeModule> module = nullptr) {
+            std::unique_ptr<InputProvider> feed;
+            if (fs::exists(testCase.stdinFile)) {
+                feed = std::make_unique<FileInput>(testCase.stdinFile);
+            } else {
+                feed = std::make_unique<QueueInput>(std::vector<std::string>());
+            }
+            Interpreter interpreter;
+            std::stringstream outputStream;
+            interpreter.set_output(outputStream);
+            interpreter.set_input(feed.get());
+            interpreter.set_tier_policy(policy);
+            interpreter.set_execution_mode(mode);
+            // Parallel loops are split among threads even on a single core;
+            // only this thread's share of their nodes is counted
+            ParallelPolicy parallel;
+            parallel.workers = 4;
+            interpreter.set_parallel_policy(parallel);
+            interpreter.interpret(ast->clone());
+            if (module && !interpreter.bind_native(module)) {
+                throw std::runtime_error("the native module does not match the program");
+            }
 
-    // Redirect std::cout to a string stream for capturing the output
-    std::stringstream outputStream;
-    std::streambuf* originalOut = std::cout.rdbuf(outputStream.rdbuf());
+            // Counters are per thread, so the difference belongs to this case alone
+            uint64_t nodesBefore = collect_thread_stats().nodes_evaluated();
+            auto start = std::chrono::steady_clock::now();
+            interpreter.execute();
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            nodes = collect_thread_stats().nodes_evaluated() - nodesBefore;
+            output = outputStream.str();
+            return ms;
+        };
 
-    interpreter.execute();
+        result.ms = INFINITY;
+        std::string output;
+        for (int run = 0; run < (timed ? budget.runs : 1); ++run) {
+            result.ms = std::min(result.ms, runOnce(TierPolicy(), ExecutionMode::Tiered, output, result.nodes));
+            if (run == 0 && output != expectedOutput) {
+                result.message = "output differs from " + testCase.expectedFile + "\n--- expected\n" + expectedOutput + "--- actual\n" + output;
+                set_trace_stream(nullptr);
+                return result;
+            }
+        }
 
-    // Restore std::cout
-    std::cout.rdbuf(originalOut);
+        // Again with every function in the optimized tier from its first call,
+        // which must not change what the script does
+        TierPolicy eager;
+        eager.call_threshold = 0;
+        eager.back_edge_threshold = 0;
+        uint64_t eagerNodes = 0;
+        runOnce(eager, ExecutionMode::Tiered, output, eagerNodes);
+        if (output != expectedOutput) {
+            result.message = "output differs from " + testCase.expectedFile + " with functions optimized\n--- expected\n" + expectedOutput + "--- actual\n" + output;
+            set_trace_stream(nullptr);
+            return result;
+        }
+        // And with the whole program compiled, top level included
+        runOnce(TierPolicy(), ExecutionMode::Compiled, output, eagerNodes);
+        if (output != expectedOutput) {
+            result.message = "output differs from " + testCase.expectedFile + " with the program compiled\n--- expected\n" + expectedOutput + "--- actual\n" + output;
+            set_trace_stream(nullptr);
+            return result;
+        }
+        // And compiled ahead of time to a shared object
+        std::string library = (fs::temp_directory_path() / (fs::path(testCase.inputFile).stem().string() + "-" +
+                                                           std::to_string(hash_source(input)) + ".so")).string();
+        std::string error;
+        auto block = dynamic_cast<const BlockNode*>(ast.get());
+        if (!block || !compile_native(transpile(*block, hash_source(input)), library, error)) {
+            throw std::runtime_error("could not compile ahead of time: " + error);
+        }
+        auto module = NativeModule::load(library, error);
+        fs::remove(library);
+        if (!module) {
+            throw std::runtime_error("could not load the native module: " + error);
+        }
+        runOnce(TierPolicy(), ExecutionMode::Tiered, output, eagerNodes, module);
+        if (output != expectedOutput) {
+            result.message = "output differs from " + testCase.expectedFile + " compiled ahead of time\n--- expected\n" + expectedOutput + "--- actual\n" + output;
+            set_trace_stream(nullptr);
+            return result;
+        }
 
-    // Read the expected output
-    std::string expectedOutput = readFile(testCase.expectedFile);
+        result.outputMatched = true;
+        if (budget.maxNodes > 0 && result.nodes > budget.maxNodes) {
+            result.message = "evaluated " + std::to_string(result.nodes) + " nodes, budget is " + std::to_string(budget.maxNodes);
+        } else if (timed && budget.maxMs > 0 && result.ms > budget.maxMs) {
+            result.message = "took " + std::to_string(result.ms) + " ms, budget is " + std::to_string(budget.maxMs) + " ms";
+        } else {
+            result.passed = true;
+        }
+    } catch (const std::exception& e) {
+        result.message = std::string("error: ") + e.what();
+    }
+    set_trace_stream(nullptr);
+    return result;
+}
 
-    // Compare the actual output with the expected output
-    return outputStream.str() == expectedOutput;
+// Records the measured cost with headroom as the new budget
+void writePerfBudget(const TestCase& testCase, const TestResult& result) {
+    std::ofstream file(testCase.perfFile);
+    file << "# Performance budget for " << testCase.name << ".aby (runTests --write-perf)\n";
+    file << "max_nodes = " << static_cast<uint64_t>(std::ceil(result.nodes * 1.1)) << "\n";
+    file << "max_ms = " << std::max(1.0, std::ceil(result.ms * 3)) << "\n";
+    file << "runs = 3\n";
 }
 
-int main() {
-    std::string testDir = "../../tests/test_cases";
+int main(int argc, char* argv[]) {
+    std::string testDir = ABYSSIAN_TEST_DIR;
+    unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+    bool writePerf = false;
+    const char* timeBudgets = std::getenv("ABYSSIAN_TIME_BUDGETS");
+    bool timed = timeBudgets && std::string(timeBudgets) != "0";
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        if (argument.rfind("--jobs=", 0) == 0) {
+            jobs = std::max(1, std::stoi(argument.substr(7)));
+        } else if (argument == "--write-perf") {
+            writePerf = true;
+            timed = true;  // The recorded max_ms is the fastest of the runs
+        } else if (argument == "--time-budgets") {
+            timed = true;
+        } else {
+            testDir = argument;
+        }
+    }
+
     auto testCases = getTestCases(testDir);
+    std::vector<TestResult> results(testCases.size());
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < std::min<size_t>(jobs, testCases.size()); ++i) {
+        workers.emplace_back([&] {
+            for (size_t index = next++; index < testCases.size(); index = next++) {
+                results[index] = runTest(testCases[index], timed);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
 
     int passed = 0;
-    for (const auto& testCase : testCases) {
-        std::cout << "Running " << testCase.name << "..." << std::endl;
-        if (runTest(testCase)) {
-            std::cout << "Passed " << testCase.name << std::endl;
+    for (size_t i = 0; i < testCases.size(); ++i) {
+        const auto& result = results[i];
+        if (writePerf && result.outputMatched) {
+            writePerfBudget(testCases[i], result);
+        }
+        if (result.passed) {
+            std::cout << "Passed " << testCases[i].name << " (" << result.nodes << " nodes, " << result.ms << " ms)" << std::endl;
             ++passed;
         } else {
-            std::cout << "Failed " << testCase.name << std::endl;
+            std::cout << "Failed " << testCases[i].name << ": " << result.message << std::endl;
         }
     }
 
     std::cout << passed << " out of " << testCases.size() << " tests passed." << std::endl;
-    return 0;
-}
\ No newline at end of file
+    return passed == static_cast<int>(testCases.size()) ? 0 : 1;
+}